@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include "apu.hpp"
+#include "blip.hpp"
 #include "gameboy/types.hpp"
 #include "gba.hpp"
 #include "bit.hpp"
@@ -24,6 +25,11 @@
 #define APU gba.apu
 
 namespace gba::apu {
+
+// defined with the sampling code at the bottom
+static auto sync_to(Gba& gba, s32 time) -> void;
+static auto update_blip(Gba& gba, s32 time) -> void;
+
 namespace {
 
 constexpr log::Type LOG_TYPE[4] =
@@ -68,8 +74,10 @@ auto get_frame_sequencer_cycles(const Gba& gba) -> u16
     return 8192 * 4; // 32768
 }
 
-template<typename T>
-void channel_sync(Gba& gba, T& channel)
+// if BandLimited, every change in the output of the channel is
+// added to the blip buffer at the time of the tick.
+template<bool BandLimited, typename T>
+void channel_sync(Gba& gba, T& channel, s32 new_timestamp)
 {
     if (!channel.is_enabled(gba))
     {
@@ -82,7 +90,6 @@ void channel_sync(Gba& gba, T& channel)
         return;
     }
 
-    const auto new_timestamp = gba.scheduler.get_ticks();
     const auto cycles = new_timestamp - channel.timestamp;
     channel.timestamp = new_timestamp;
     channel.counter += cycles;
@@ -91,8 +98,23 @@ void channel_sync(Gba& gba, T& channel)
     // this loop away :)
     while (channel.counter >= freq)
     {
-        channel.tick(gba);
-        channel.counter -= freq;
+        if constexpr (BandLimited)
+        {
+            const auto old_sample = channel.sample(gba);
+            channel.tick(gba);
+            channel.counter -= freq;
+
+            if (channel.sample(gba) != old_sample)
+            {
+                // counter is now the cycles since the tick
+                update_blip(gba, new_timestamp - channel.counter);
+            }
+        }
+        else
+        {
+            channel.tick(gba);
+            channel.counter -= freq;
+        }
     }
 }
 
@@ -816,10 +838,13 @@ auto on_fifo_write32(Gba& gba, u32 value, u8 num) -> void
     on_fifo_write8(gba, static_cast<u8>(value >> 0x18), num);
 }
 
-auto on_timer_overflow(Gba& gba, u8 timer_num) -> void
+auto on_timer_overflow(Gba& gba, u8 timer_num, s32 late) -> void
 {
     assert(timer_num == 0 || timer_num == 1);
 
+    // the samples before the overflow use the old fifo sample
+    sync_to(gba, gba.scheduler.get_ticks() + late);
+
     for (auto i = 0; i < 2; i++)
     {
         if (APU.fifo[i].timer_select == static_cast<bool>(timer_num))
@@ -1132,6 +1157,9 @@ auto write_WAVE(Gba& gba, u8 addr, u8 value) -> void
 
 auto read_WAVE(Gba& gba, u8 addr) -> u8
 {
+    // the position of the wave channel is only updated on sync
+    sync(gba);
+
     log::print_info(gba, log::Type::WAVE, "ram read: 0x%02X\n", addr);
 
     if (gba.is_gb())
@@ -1223,14 +1251,7 @@ auto reset(Gba& gba, bool skip_bios) -> void
         }
     }
 
-    if (gba.audio_callback && !gba.sample_data.empty() && gba.sample_rate_calculated)
-    {
-        gba.scheduler.add(scheduler::ID::APU_SAMPLE, gba.sample_rate_calculated, on_sample_event, &gba);
-    }
-    else
-    {
-        gba.scheduler.remove(scheduler::ID::APU_SAMPLE);
-    }
+    start_sampling(gba);
 
     if (gba.is_gb())
     {
@@ -1330,7 +1351,8 @@ static auto push_sample(Gba& gba, s16 left, s16 right)
     }
 }
 
-static auto sample_gb(Gba& gba)
+// mixes the psg channels, the result is unsigned 16bit
+static auto psg_level_gb(Gba& gba, s32& left, s32& right)
 {
     static constexpr auto vol_table = []()
     {
@@ -1360,13 +1382,21 @@ static auto sample_gb(Gba& gba)
     sample_right += vol_table[APU.wave.sample(gba) * APU.wave.right_enabled(gba) * right_volume] * wave_volume_divider;
     sample_right += vol_table[APU.noise.sample(gba) * APU.noise.right_enabled(gba) * right_volume];
 
-    sample_left ^= 0x8000;
-    sample_right ^= 0x8000;
+    left = static_cast<u16>(sample_left);
+    right = static_cast<u16>(sample_right);
+}
 
-    push_sample(gba, sample_left, sample_right);
+static auto output_gb(Gba& gba, s32 left, s32 right)
+{
+    // the blip output can overshoot slightly
+    const auto sample_left = static_cast<u16>(std::clamp(left, 0, 0xFFFF)) ^ 0x8000;
+    const auto sample_right = static_cast<u16>(std::clamp(right, 0, 0xFFFF)) ^ 0x8000;
+
+    push_sample(gba, static_cast<s16>(sample_left), static_cast<s16>(sample_right));
 }
 
-static auto sample_gba(Gba& gba)
+// mixes the psg channels, the result is in the same (10bit) range as the fifo
+static auto psg_level_gba(Gba& gba, s32& left, s32& right)
 {
     s16 sample_left = 0;
     s16 sample_right = 0;
@@ -1399,6 +1429,16 @@ static auto sample_gba(Gba& gba)
     sample_left /= psg_master_volume(gba);
     sample_right /= psg_master_volume(gba);
 
+    left = sample_left;
+    right = sample_right;
+}
+
+// mixes the psg output with the fifo and outputs the sample
+static auto output_gba(Gba& gba, s32 left, s32 right)
+{
+    s16 sample_left = left;
+    s16 sample_right = right;
+
     // scale to 10bits
     const s16 fifo0_sample = bit::scale<8, 10, s16>(APU.fifo[0].sample());
     const s16 fifo1_sample = bit::scale<8, 10, s16>(APU.fifo[1].sample());
@@ -1466,45 +1506,211 @@ static auto sample_gba(Gba& gba)
     push_sample(gba, sample_left, sample_right);
 }
 
-auto sample(Gba& gba)
+static auto psg_level(Gba& gba, s32& left, s32& right)
 {
-    if (gba.audio_callback == nullptr || gba.sample_data.empty()) [[unlikely]]
+    if (gba.is_gb())
     {
-        return;
+        psg_level_gb(gba, left, right);
+    }
+    else
+    {
+        psg_level_gba(gba, left, right);
     }
+}
 
+static auto output(Gba& gba, s32 left, s32 right)
+{
+    if (!is_apu_enabled(gba)) [[unlikely]]
+    {
+        push_sample(gba, 0, 0);
+    }
+    else if (gba.is_gb())
+    {
+        output_gb(gba, left, right);
+    }
+    else
+    {
+        output_gba(gba, left, right);
+    }
+}
+
+// point-samples the channels at timestamp
+static auto sample(Gba& gba, s32 timestamp)
+{
     if (!is_apu_enabled(gba)) [[unlikely]]
     {
         push_sample(gba, 0, 0);
         return;
     }
 
-    channel_sync(gba, APU.square0);
-    channel_sync(gba, APU.square1);
-    channel_sync(gba, APU.wave);
-    channel_sync(gba, APU.noise);
+    channel_sync<false>(gba, APU.square0, timestamp);
+    channel_sync<false>(gba, APU.square1, timestamp);
+    channel_sync<false>(gba, APU.wave, timestamp);
+    channel_sync<false>(gba, APU.noise, timestamp);
 
-    if (gba.is_gb())
+    s32 left;
+    s32 right;
+    psg_level(gba, left, right);
+    output(gba, left, right);
+}
+
+static auto update_blip(Gba& gba, s32 time) -> void
+{
+    s32 left;
+    s32 right;
+    psg_level(gba, left, right);
+    gba.blip.update(time, left, right);
+}
+
+// every change to the output is synced beforehand, so anything that
+// changed since the last sync happened at the time of that sync.
+static auto sync_band_limited(Gba& gba, s32 time) -> void
+{
+    auto& blip = gba.blip;
+    assert(blip.time == APU.sample_timestamp && "blip is out of sync");
+
+    time = std::max(time, blip.sync_time);
+    update_blip(gba, blip.sync_time);
+
+    for (;;)
     {
-        sample_gb(gba);
+        // steps can only be added so far ahead of the read
+        const auto end = std::min<s32>(time, blip.time + Blip::MAX_AHEAD * gba.sample_rate_calculated);
+
+        if (is_apu_enabled(gba))
+        {
+            channel_sync<true>(gba, APU.square0, end);
+            channel_sync<true>(gba, APU.square1, end);
+            channel_sync<true>(gba, APU.wave, end);
+            channel_sync<true>(gba, APU.noise, end);
+        }
+
+        while (APU.sample_timestamp <= end)
+        {
+            s32 left;
+            s32 right;
+            blip.read(left, right);
+            output(gba, left, right);
+            APU.sample_timestamp += gba.sample_rate_calculated;
+        }
+
+        if (end == time)
+        {
+            break;
+        }
+    }
+
+    blip.sync_time = time;
+}
+
+static auto is_sampling(const Gba& gba) -> bool
+{
+    return gba.audio_callback && !gba.sample_data.empty() && gba.sample_rate_calculated;
+}
+
+// the event fires on the sample that fills the buffer, so that the
+// callback happens at the same time as it would if sampled per event.
+// if nothing else syncs, this is the only time samples are made.
+static auto add_sample_event(Gba& gba)
+{
+    const auto remaining = std::max<s32>(1, (gba.sample_data.size() - gba.sample_count) / 2);
+    const auto time = APU.sample_timestamp + (remaining - 1) * gba.sample_rate_calculated;
+    gba.scheduler.add_absolute(scheduler::ID::APU_SAMPLE, time, on_sample_event, &gba);
+}
+
+static auto sync_to(Gba& gba, s32 time) -> void
+{
+    if (!is_sampling(gba))
+    {
+        return;
+    }
+
+    // the clock keeps running so that un-skipping carries on from the
+    // same point, but nothing is made.
+    if (gba.skip_audio)
+    {
+        if (APU.sample_timestamp <= time)
+        {
+            const auto samples = (time - APU.sample_timestamp) / gba.sample_rate_calculated + 1;
+            APU.sample_timestamp += samples * gba.sample_rate_calculated;
+        }
+        return;
+    }
+
+    if (gba.band_limited_audio)
+    {
+        sync_band_limited(gba, time);
+        return;
+    }
+
+    // the state is constant between syncs, other than the channels
+    // which are ticked to the time of each sample.
+    while (APU.sample_timestamp <= time)
+    {
+        sample(gba, APU.sample_timestamp);
+        APU.sample_timestamp += gba.sample_rate_calculated;
+    }
+}
+
+auto sync(Gba& gba) -> void
+{
+    sync_to(gba, gba.scheduler.get_ticks());
+}
+
+auto start_sampling(Gba& gba) -> void
+{
+    if (is_sampling(gba))
+    {
+        APU.sample_timestamp = gba.scheduler.get_ticks() + gba.sample_rate_calculated;
+        gba.blip.reset(gba.scheduler.get_ticks(), gba.sample_rate_calculated);
+        add_sample_event(gba);
     }
     else
     {
-        sample_gba(gba);
+        gba.scheduler.remove(scheduler::ID::APU_SAMPLE);
+    }
+}
+
+// the clock runs on whilst skipping, so unless the blip was restored
+// along with it (see Gba::load_snapshot()), its steps are stale.
+static auto resync_blip(Gba& gba) -> void
+{
+    if (!gba.skip_audio && gba.blip.time != APU.sample_timestamp)
+    {
+        gba.blip.reset(APU.sample_timestamp - gba.sample_rate_calculated, gba.sample_rate_calculated);
+    }
+}
+
+auto resume_sampling(Gba& gba, s32 sample_timestamp, const Blip& blip) -> void
+{
+    if (is_sampling(gba))
+    {
+        APU.sample_timestamp = sample_timestamp;
+        gba.blip = blip;
+        resync_blip(gba);
+        add_sample_event(gba);
+    }
+}
+
+auto on_skip_audio_end(Gba& gba) -> void
+{
+    if (is_sampling(gba))
+    {
+        resync_blip(gba);
     }
 }
 
-auto on_sample_event(void* user, s32 id, s32 late) -> void
+auto on_sample_event(void* user, [[maybe_unused]] s32 id, s32 late) -> void
 {
     auto& gba = *static_cast<Gba*>(user);
-    gba.delta.add(id, late);
-    sample(gba);
-    gba.scheduler.add(id, gba.delta.get(id, gba.sample_rate_calculated), on_sample_event, &gba);
+    sync_to(gba, gba.scheduler.get_ticks() + late);
+    add_sample_event(gba);
 }
 
 auto on_frame_sequencer_event(void* user, s32 id, s32 late) -> void
 {
     auto& gba = *static_cast<Gba*>(user);
+    sync_to(gba, gba.scheduler.get_ticks() + late);
     APU.frame_sequencer.clock(gba);
 
     if (gba.is_gba())
@@ -12,6 +12,7 @@ struct Square0;
 struct Square1;
 struct Wave;
 struct Noise;
+struct Blip;
 
 struct FrameSequencer
 {
@@ -184,13 +185,17 @@ struct Apu
     Wave wave;
     Noise noise;
 
+    // time of the next output sample, see sync()
+    s32 sample_timestamp;
+
     bool enabled;
 };
 
 auto on_fifo_write8(Gba& gba, u8 value, u8 num) -> void;
 auto on_fifo_write16(Gba& gba, u16 value, u8 num) -> void;
 auto on_fifo_write32(Gba& gba, u32 value, u8 num) -> void;
-auto on_timer_overflow(Gba& gba, u8 timer_num) -> void;
+// late is the same as the timer event, <= 0
+auto on_timer_overflow(Gba& gba, u8 timer_num, s32 late) -> void;
 auto on_soundcnt_write(Gba& gba) -> void;
 
 auto write_NR10(Gba& gba, u8 value) -> void;
@@ -220,6 +225,19 @@ auto read_WAVE(Gba& gba, u8 addr) -> u8;
 auto on_frame_sequencer_event(void* user, s32 id = 0, s32 late = 0) -> void;
 auto on_sample_event(void* user, s32 id, s32 late) -> void;
 
+// samples are synthesised in batches rather than one per event.
+// this outputs every sample up to now, it must be called before
+// anything that changes the output, ie, a reg write.
+auto sync(Gba& gba) -> void;
+// (re)starts the sample clock from now, call this when the
+// sample rate / buffer changes.
+auto start_sampling(Gba& gba) -> void;
+// carries on sampling from a sample clock and blip that were saved
+// together, ie, see Gba::load_snapshot().
+auto resume_sampling(Gba& gba, s32 sample_timestamp, const Blip& blip) -> void;
+// see Gba::set_skip_audio()
+auto on_skip_audio_end(Gba& gba) -> void;
+
 auto is_apu_enabled(Gba& gba) -> bool;
 
 auto reset(Gba& gba, bool skip_bios) -> void;
@@ -0,0 +1,145 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "blip.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+namespace gba::apu {
+namespace {
+
+using BlipKernel = std::array<std::array<s32, Blip::WIDTH>, Blip::PHASES>;
+
+// each row is the difference between consecutive samples of a
+// band-limited unit step, placed PHASE / PHASES of a sample later.
+// the rows sum to exactly a unit, so the sum never drifts.
+const BlipKernel BLIP_KERNEL = []()
+{
+    // a little below nyquist, as the window isn't a perfect filter
+    constexpr auto cutoff = 0.9;
+    constexpr auto pi = std::numbers::pi;
+    constexpr auto unit = static_cast<double>(1 << Blip::UNIT_BITS);
+    constexpr auto half_width = static_cast<double>(Blip::HALF_WIDTH);
+    constexpr auto phases = static_cast<double>(Blip::PHASES);
+    // number of points each tap is integrated over
+    constexpr auto steps = 64;
+
+    // windowed sinc (blackman)
+    const auto impulse = [](double x)
+    {
+        if (std::abs(x) >= half_width)
+        {
+            return 0.0;
+        }
+
+        const auto sinc = x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+        const auto w = pi * (x / half_width + 1.0);
+        const auto window = 0.42 - 0.5 * std::cos(w) + 0.08 * std::cos(2.0 * w);
+        return cutoff * sinc * window;
+    };
+
+    BlipKernel kernel{};
+
+    for (u32 phase = 0; phase < Blip::PHASES; phase++)
+    {
+        const auto step = half_width - 1.0 + phase / phases;
+        std::array<double, Blip::WIDTH> taps{};
+        auto total = 0.0;
+
+        for (u32 k = 0; k < Blip::WIDTH; k++)
+        {
+            // area of the impulse over [k-1, k) relative to the step
+            const auto start = k - 1.0 - step;
+            for (auto i = 0; i < steps; i++)
+            {
+                taps[k] += impulse(start + (i + 0.5) / steps) / steps;
+            }
+            total += taps[k];
+        }
+
+        s32 sum = 0;
+        for (u32 k = 0; k < Blip::WIDTH; k++)
+        {
+            kernel[phase][k] = static_cast<s32>(std::lround(taps[k] / total * unit));
+            sum += kernel[phase][k];
+        }
+
+        // put the rounding error on the largest tap
+        const auto largest = std::max_element(kernel[phase].begin(), kernel[phase].end());
+        *largest += (1 << Blip::UNIT_BITS) - sum;
+    }
+
+    return kernel;
+}();
+
+} // namespace
+
+auto Blip::reset(s32 now, u32 _clocks_per_sample) -> void
+{
+    std::memset(buf, 0, sizeof(buf));
+    std::memset(sum, 0, sizeof(sum));
+    std::memset(level, 0, sizeof(level));
+    index = 0;
+    time = now + _clocks_per_sample;
+    sync_time = now;
+    clocks_per_sample = _clocks_per_sample;
+}
+
+auto Blip::update(s32 _time, s32 left, s32 right) -> void
+{
+    if (left == level[0] && right == level[1])
+    {
+        return;
+    }
+
+    const auto clocks = static_cast<u32>(std::max(0, _time - time));
+    const auto offset = clocks / clocks_per_sample;
+    const auto phase = (clocks % clocks_per_sample) * PHASES / clocks_per_sample;
+    assert(offset <= MAX_AHEAD && "blip step is too far ahead of the read");
+
+    add_step(offset, phase, 0, left - level[0]);
+    add_step(offset, phase, 1, right - level[1]);
+
+    level[0] = left;
+    level[1] = right;
+}
+
+auto Blip::read(s32& left, s32& right) -> void
+{
+    const auto i = index % BUFFER_SIZE;
+
+    sum[0] += buf[0][i];
+    sum[1] += buf[1][i];
+    buf[0][i] = 0;
+    buf[1][i] = 0;
+
+    // round to nearest
+    constexpr auto half = 1 << (UNIT_BITS - 1);
+    left = (sum[0] + half) >> UNIT_BITS;
+    right = (sum[1] + half) >> UNIT_BITS;
+
+    index++;
+    time += clocks_per_sample;
+}
+
+auto Blip::add_step(u32 offset, u32 phase, u8 side, s32 delta) -> void
+{
+    if (!delta)
+    {
+        return;
+    }
+
+    const auto& taps = BLIP_KERNEL[phase];
+    const auto start = index + std::min<u32>(offset, MAX_AHEAD);
+
+    for (u32 k = 0; k < WIDTH; k++)
+    {
+        buf[side][(start + k) % BUFFER_SIZE] += taps[k] * delta;
+    }
+}
+
+} // namespace gba::apu
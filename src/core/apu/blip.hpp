@@ -0,0 +1,58 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// band-limited step synthesis (blip), used for the psg channels.
+// rather than point-sampling the channels at the output rate, each
+// change in amplitude is added as a band-limited step at the time that
+// it happened. the cost depends on the number of changes rather than the
+// sample rate, and low sample rates don't alias.
+// samples are read in order, each read returns the amplitude at the
+// time of the sample, delayed by HALF_WIDTH samples.
+#pragma once
+
+#include "fwd.hpp"
+
+namespace gba::apu {
+
+struct Blip
+{
+    enum : u32
+    {
+        // the step is spread over WIDTH samples, centred on the step
+        HALF_WIDTH = 8,
+        WIDTH = HALF_WIDTH * 2,
+        // number of sub-sample positions a step can be placed at
+        PHASE_BITS = 5,
+        PHASES = 1 << PHASE_BITS,
+        // a unit step in the buffer is 1 << UNIT_BITS
+        UNIT_BITS = 14,
+        // must be a power of 2.
+        // steps can be added at most MAX_AHEAD samples ahead of the read.
+        BUFFER_SIZE = 1 << 10,
+        MAX_AHEAD = BUFFER_SIZE - WIDTH,
+    };
+
+    // clears the buffer, the next read is a sample after now
+    auto reset(s32 now, u32 clocks_per_sample) -> void;
+    // sets the amplitude from time onwards, time can't be before
+    // the time of the next read (it's clamped if so).
+    auto update(s32 time, s32 left, s32 right) -> void;
+    // reads the next sample, advances time by a sample
+    auto read(s32& left, s32& right) -> void;
+
+    // the time of the next sample to be read
+    s32 time;
+    // see apu::sync()
+    s32 sync_time;
+
+private:
+    s32 buf[2][BUFFER_SIZE];
+    s32 sum[2];
+    s32 level[2];
+    u32 index;
+    u32 clocks_per_sample;
+
+    auto add_step(u32 offset, u32 phase, u8 side, s32 delta) -> void;
+};
+
+} // namespace gba::apu
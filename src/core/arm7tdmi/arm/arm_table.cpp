@@ -14,6 +14,7 @@
 #include "arm7tdmi/arm/msr.cpp"
 #include "arm7tdmi/arm/mrs.cpp"
 #include "arm7tdmi/arm7tdmi.hpp"
+#include "arm7tdmi/block_cache.hpp"
 #include "gba.hpp"
 #include "mem.hpp"
 #include "log.hpp"
@@ -327,23 +328,132 @@ inline auto fetch(Gba& gba)
     return opcode;
 }
 
-} // namespace
-
-auto execute(Gba& gba) -> void
+constexpr auto func_table = []<std::size_t ...I>(std::index_sequence<I...>)
 {
-    static constexpr auto func_table = []<std::size_t ...I>(std::index_sequence<I...>)
-    {
-        return std::array{fill_table<I>()...};
-    }(std::make_index_sequence<4096>());
+    return std::array{fill_table<I>()...};
+}(std::make_index_sequence<4096>());
 
-    const auto opcode = fetch(gba);
+inline auto execute_opcode(Gba& gba, const u32 opcode, const ArmFunction func) -> void
+{
     const auto cond = bit::get_range<28, 31>(opcode);
 
     // it's highly likely that cond == 0xE, so we optimise for that
     // before hitting the switch (slower).
     if (cond == COND_AL || check_cond(gba, cond)) [[likely]]
     {
-        func_table[decode_template(opcode)](gba, opcode);
+        func(gba, opcode);
+    }
+}
+
+auto execute_interpreter(Gba& gba) -> void
+{
+    // run until the budget runs out, see Scheduler::should_fire().
+    // switching to thumb state ends the budget early.
+    do
+    {
+        const auto opcode = fetch(gba);
+        execute_opcode(gba, opcode, func_table[decode_template(opcode)]);
+    } while (!gba.scheduler.should_fire());
+}
+
+[[nodiscard]]
+auto decode_block(Gba& gba, u32 addr) -> BlockCache::Block*
+{
+    auto block = gba.block_cache->create(gba, addr, State::ARM);
+
+    if (block)
+    {
+        for (u32 i = 0; i < block->count; i++)
+        {
+            block->arm[i] = func_table[decode_template(block->opcodes[i])];
+        }
+    }
+
+    return block;
+}
+
+// see thumb::execute_block()
+auto execute_block(Gba& gba, const BlockCache::Block& block) -> void
+{
+    const auto region = block.region;
+    u32 pc = CPU.registers[PC_INDEX];
+
+    for (u32 i = 0; i < block.count; i++)
+    {
+        pc += 4;
+        CPU.pipeline[0] = CPU.pipeline[1];
+        CPU.pipeline[1] = block.opcodes[i + 2];
+        CPU.registers[PC_INDEX] = pc;
+
+        const auto new_region = mem::is_new_region(gba.last_region, region);
+        gba.last_region = region;
+        gba.scheduler.tick(gba.timing_table_32[new_region][region]);
+
+        execute_opcode(gba, block.opcodes[i], block.arm[i]);
+
+        if (CPU.registers[PC_INDEX] != pc || gba.scheduler.should_fire() || !gba.block_cache->is_valid(block))
+        {
+            break;
+        }
+    }
+}
+
+auto execute_cached(Gba& gba) -> void
+{
+    do
+    {
+        const auto addr = get_pc(gba) - 4;
+
+        // bios and vram can't be cached, so the rest of the budget is
+        // interpreted rather than looking up a block per instruction.
+        if (!BlockCache::is_cacheable(addr)) [[unlikely]]
+        {
+            execute_interpreter(gba);
+            return;
+        }
+
+        auto block = gba.block_cache->find(gba.rmap, addr, State::ARM);
+
+        if (!block)
+        {
+            block = decode_block(gba, addr);
+        }
+
+        if (block && CPU.pipeline[0] == block->opcodes[0] && CPU.pipeline[1] == block->opcodes[1]) [[likely]]
+        {
+            if (block->compiled)
+            {
+                block->compiled(gba);
+            }
+            else
+            {
+                execute_block(gba, *block);
+
+                if (gba.jit.is_enabled() && ++block->hits == Jit::HOT_THRESHOLD)
+                {
+                    block->compiled = gba.jit.compile(gba, *block);
+                }
+            }
+        }
+        else
+        {
+            const auto opcode = fetch(gba);
+            execute_opcode(gba, opcode, func_table[decode_template(opcode)]);
+        }
+    } while (!gba.scheduler.should_fire());
+}
+
+} // namespace
+
+auto execute(Gba& gba) -> void
+{
+    if (gba.block_cache)
+    {
+        execute_cached(gba);
+    }
+    else
+    {
+        execute_interpreter(gba);
     }
 }
 
@@ -23,6 +23,11 @@ auto branch(Gba& gba, const u32 opcode) -> void
     }
 
     set_pc(gba, pc + offset);
+
+    if constexpr(!L)
+    {
+        gba.waitloop.on_arm_loop(gba, pc, pc + offset);
+    }
 }
 
 } // namespace
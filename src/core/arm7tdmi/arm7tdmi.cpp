@@ -74,6 +74,17 @@ constexpr auto is_valid_mode(const u8 mode) -> bool
     return false;
 }
 
+// arm::execute() and thumb::execute() only check the scheduler after each
+// instruction, so the budget is ended to return to run(), which then
+// picks the execute() for the new state.
+auto on_state_change(Gba& gba, const State old_state) -> void
+{
+    if (get_state(gba) != old_state)
+    {
+        gba.scheduler.end_budget();
+    }
+}
+
 [[nodiscard]]
 constexpr auto get_u32_from_psr(const Psr psr) -> u32
 {
@@ -392,8 +403,10 @@ auto load_spsr_into_cpsr(Gba& gba) -> void
     assert(old_mode != MODE_USER && "user mode doesn't have spsr");
     if (old_mode != MODE_USER && old_mode != MODE_SYSTEM) [[likely]]
     {
+        const auto old_state = get_state(gba);
         CPU.cpsr = CPU.spsr;
         change_mode(gba, old_mode, new_mode);
+        on_state_change(gba, old_state);
         schedule_interrupt(gba); // I may now be unset, enabling interrupts
     }
 }
@@ -401,9 +414,11 @@ auto load_spsr_into_cpsr(Gba& gba) -> void
 auto set_cpsr_from_u32(Gba& gba, const u32 value, const bool flag_write, const bool control_write) -> void
 {
     const auto old_mode = get_mode(gba);
+    const auto old_state = get_state(gba);
     set_psr_from_u32(gba, CPU.cpsr, value, flag_write, control_write);
     const auto new_mode = get_mode(gba);
     change_mode(gba, old_mode, new_mode);
+    on_state_change(gba, old_state);
 }
 
 auto set_spsr_from_u32(Gba& gba, const u32 value, const bool flag_write, const bool control_write) -> void
@@ -498,6 +513,8 @@ auto set_reg_thumb(Gba& gba, const u8 reg, const u32 value) -> void
 
 auto change_state(Gba &gba, const State new_state, const u32 new_pc) -> void
 {
+    const auto old_state = get_state(gba);
+
     // if bit0 == 0, switch to arm, else thumb
     switch (new_state)
     {
@@ -511,6 +528,8 @@ auto change_state(Gba &gba, const State new_state, const u32 new_pc) -> void
             set_pc(gba, mem::align<u16>(new_pc));
             break;
     }
+
+    on_state_change(gba, old_state);
 }
 
 auto software_interrupt(Gba& gba, const u8 comment_field) -> void
@@ -525,6 +544,7 @@ auto software_interrupt(Gba& gba, const u8 comment_field) -> void
 auto fire_interrupt(Gba& gba, const Interrupt i) -> void
 {
     REG_IF |= std::to_underlying(i);
+    gba.waitloop.on_event_change(gba, waitloop::WAITLOOP_EVENT_IO, mem::IO_IF);
     schedule_interrupt(gba);
 }
 
@@ -706,7 +726,9 @@ auto on_halt_trigger(Gba& gba, const HaltType type) -> void
 
 auto run(Gba& gba) -> void
 {
-    // get which state (ARM, THUMB) we are in
+    // each execute() runs a tight loop of instructions until an event
+    // is due. if the state (ARM, THUMB) changes, the budget is ended early,
+    // see on_state_change().
     switch (get_state(gba))
     {
         case State::ARM:
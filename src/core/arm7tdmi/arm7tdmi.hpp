@@ -69,19 +69,21 @@ enum class Interrupt : u16
     Cassette = 1 << 0xD, // (T) = Cassette Interrupt
 };
 
+// plain members rather than bitfields, so that the jit can address each
+// flag by its offset.
 struct Psr
 {
     // condition flags
-    bool N:1;     // negative, less than
-    bool Z:1;     // zero
-    bool C:1;     // carry, borrow, extend
-    bool V:1;     // overflow
+    bool N;     // negative, less than
+    bool Z;     // zero
+    bool C;     // carry, borrow, extend
+    bool V;     // overflow
 
     // control
-    bool I:1;     // IRQ disable (1=off,0=on)
-    bool F:1;     // FIQ disable (1=off,0=on)
-    bool T:1;     // state bit (1=thumb,0=arm)
-    u8 M:5;  // mode
+    bool I;     // IRQ disable (1=off,0=on)
+    bool F;     // FIQ disable (1=off,0=on)
+    bool T;     // state bit (1=thumb,0=arm)
+    u8 M;  // mode
 };
 
 struct Arm7tdmi
@@ -109,6 +111,8 @@ struct Arm7tdmi
 
     bool halted;
     bool stopped;
+    // state of a hle IntrWait, see bios_hle.cpp
+    u8 intr_wait;
 };
 
 #define CPU gba.cpu
@@ -162,6 +166,20 @@ auto set_reg_thumb(Gba& gba, u8 reg, u32 value) -> void;
 // eg, for thumb, pc = new_pc & ~0x1.
 auto change_state(Gba& gba, State new_state, u32 new_pc) -> void;
 
+// how instructions are executed, all of them produce the same output.
+enum class Backend : u8
+{
+    // fetch and decode every instruction
+    interpreter,
+    // decode blocks of instructions once, see block_cache.hpp
+    cached_interpreter,
+    // same as above, but hot blocks are compiled to host code (x86-64 only).
+    // falls back to cached_interpreter on other hosts.
+    jit,
+};
+
+// runs at least 1 instruction, then keeps running until an event is due
+// or the state (ARM, THUMB) changes.
 auto run(Gba& gba) -> void;
 
 // on halt event
@@ -173,9 +191,9 @@ enum class HaltType
     // bios hle of hlt to skip mode switching
     hle_halt,
     // bios hle of waiting for vblank int until halt is exited
-    // hle_vblank_halt,
+    hle_vblank_halt,
     // bio hle of waiting for specific int until halt is exited
-    // hle_int_halt,
+    hle_int_halt,
 };
 
 auto on_interrupt_event(void* user, s32 id, s32 late) -> void;
@@ -0,0 +1,120 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "arm7tdmi/block_cache.hpp"
+#include "gba.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace gba::arm7tdmi {
+namespace {
+
+template<typename T> [[nodiscard]]
+auto read_opcode(const mem::ReadArray& entry, const u32 addr) -> u32
+{
+    T data;
+    std::memcpy(&data, entry.array + (mem::align<T>(addr) & entry.mask), sizeof(T));
+
+    if constexpr(std::endian::native == std::endian::big)
+    {
+        return std::byteswap(data);
+    }
+
+    return data;
+}
+
+} // namespace
+
+void BlockCache::reset()
+{
+    std::ranges::fill(versions, 0);
+
+    for (auto& block : blocks)
+    {
+        block.count = 0;
+    }
+}
+
+auto BlockCache::create(Gba& gba, u32 addr, State state) -> Block*
+{
+    const u8 region = (addr >> 24) & 0xF;
+    const u32 size = state == State::THUMB ? 2 : 4;
+    const auto& entry = gba.rmap[region];
+
+    if (!is_cacheable(addr) || !(entry.access & size))
+    {
+        return nullptr;
+    }
+
+    // rom is never written to, so only wram blocks are limited to a page.
+    // the 2 prefetched opcodes have to be within the page as well.
+    u32 remaining = MAX_INSTRUCTIONS + 2;
+    if (region == 0x2 || region == 0x3)
+    {
+        remaining = std::min<u32>(remaining, (PAGE_SIZE - (addr & (PAGE_SIZE - 1))) / size);
+    }
+
+    if (remaining <= 2)
+    {
+        return nullptr;
+    }
+
+    auto& block = blocks[get_index(addr)];
+    block.addr = addr;
+    block.page = get_page(addr);
+    block.version = versions[block.page];
+    block.region = region;
+    block.count = remaining - 2;
+    block.state = state;
+    block.hits = 0;
+    block.compiled = nullptr;
+
+    for (u32 i = 0; i < block.count + 2U; i++)
+    {
+        if (state == State::THUMB)
+        {
+            block.opcodes[i] = read_opcode<u16>(entry, addr + i * size);
+        }
+        else
+        {
+            block.opcodes[i] = read_opcode<u32>(entry, addr + i * size);
+        }
+    }
+
+    return &block;
+}
+
+void BlockCache::clear_compiled()
+{
+    for (auto& block : blocks)
+    {
+        block.hits = 0;
+        block.compiled = nullptr;
+    }
+}
+
+void BlockCache::on_write_range(u32 addr, u32 size)
+{
+    if (!size)
+    {
+        return;
+    }
+
+    const auto start = get_page(addr);
+    const auto end = get_page(addr + size - 1);
+
+    // the range wrapped around the region mirror
+    if (end < start)
+    {
+        std::ranges::for_each(versions, [](auto& v){ v++; });
+        return;
+    }
+
+    for (auto page = start; page <= end; page++)
+    {
+        versions[page]++;
+    }
+}
+
+} // namespace gba::arm7tdmi
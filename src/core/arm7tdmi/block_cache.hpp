@@ -0,0 +1,156 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// cache of decoded straight-line runs of instructions.
+// each block holds the opcodes and handlers of up to MAX_INSTRUCTIONS
+// from rom, iwram or ewram, so the cpu doesn't have to go through the
+// memory map and function table for every fetch.
+#pragma once
+
+#include "fwd.hpp"
+#include "arm7tdmi/arm7tdmi.hpp"
+#include "mem.hpp"
+
+namespace gba::arm7tdmi {
+
+using ThumbFunction = void(*)(Gba& gba, u16 opcode);
+using ArmFunction = void(*)(Gba& gba, u32 opcode);
+// host code generated for a block, see jit.hpp
+using CompiledFunction = void(*)(Gba& gba);
+
+struct BlockCache
+{
+public:
+    enum : u32
+    {
+        // blocks never cross a page, so that a write only has to
+        // invalidate the page it landed in.
+        PAGE_SHIFT = 8,
+        PAGE_SIZE = 1 << PAGE_SHIFT,
+
+        EWRAM_PAGES = mem::EWRAM_SIZE >> PAGE_SHIFT,
+        IWRAM_PAGES = mem::IWRAM_SIZE >> PAGE_SHIFT,
+        // page 0 is used by rom, which is never written to.
+        PAGE_COUNT = 1 + EWRAM_PAGES + IWRAM_PAGES,
+
+        MAX_INSTRUCTIONS = 32,
+        BLOCK_COUNT = 4096,
+    };
+
+    struct Block
+    {
+        // address of the first instruction (pipeline[0])
+        u32 addr;
+        // version of the page when the block was decoded
+        u32 version;
+        u16 page;
+        u8 region;
+        u8 count;
+        State state;
+        // number of times the block was run by the interpreter
+        u16 hits;
+        // set once the block is hot enough to be compiled
+        CompiledFunction compiled;
+
+        union
+        {
+            ThumbFunction thumb[MAX_INSTRUCTIONS];
+            ArmFunction arm[MAX_INSTRUCTIONS];
+        };
+
+        // +2 for the opcodes that are prefetched by the last instruction
+        u32 opcodes[MAX_INSTRUCTIONS + 2];
+    };
+
+    // call this on startup, see Gba::set_cpu_backend()
+    void reset();
+    // returns true if addr is in rom, ewram or iwram
+    [[nodiscard]] static constexpr auto is_cacheable(u32 addr) -> bool
+    {
+        switch ((addr >> 24) & 0xF)
+        {
+            case 0x2: // ewram
+            case 0x3: // iwram
+            case 0x8: case 0x9: // rom
+            case 0xA: case 0xB:
+            case 0xC: case 0xD:
+                return true;
+
+            default:
+                return false;
+        }
+    }
+    // returns a block ready to be executed or nullptr if it needs decoding
+    [[nodiscard]] auto find(const mem::ReadArray (&rmap)[16], u32 addr, State state) -> Block*
+    {
+        auto& block = blocks[get_index(addr)];
+
+        if (!block.count || block.addr != addr || block.state != state || !is_valid(block))
+        {
+            return nullptr;
+        }
+
+        // rom can be unmapped at runtime, ie, gpio being readable
+        const auto size = state == State::THUMB ? mem::Access_16bit : mem::Access_32bit;
+        if (!(rmap[block.region].access & size))
+        {
+            return nullptr;
+        }
+
+        return &block;
+    }
+    // returns a block with the opcodes filled in, the caller then fills
+    // in the handlers. returns nullptr if addr cannot be cached.
+    [[nodiscard]] auto create(Gba& gba, u32 addr, State state) -> Block*;
+    // removes the compiled code from every block, ie, the jit ran out of space
+    void clear_compiled();
+    // returns false if the memory the block was decoded from was written to
+    [[nodiscard]] auto is_valid(const Block& block) const -> bool
+    {
+        return versions[block.page] == block.version;
+    }
+
+    // address of the version that is_valid() checks the block against
+    [[nodiscard]] auto get_version_address(const Block& block) const -> const u32*
+    {
+        return &versions[block.page];
+    }
+
+    // the jit bumps the versions itself on stores to ewram / iwram,
+    // indexed the same as get_page().
+    [[nodiscard]] auto get_versions_address() -> u32*
+    {
+        return versions;
+    }
+
+    // call this on every write to ewram / iwram
+    void on_write(u32 addr)
+    {
+        versions[get_page(addr)]++;
+    }
+
+    // same as above but for a range, ie, dma.
+    void on_write_range(u32 addr, u32 size);
+
+private:
+    Block blocks[BLOCK_COUNT];
+    u32 versions[PAGE_COUNT];
+
+    [[nodiscard]] static auto get_page(u32 addr) -> u16
+    {
+        switch ((addr >> 24) & 0xF)
+        {
+            case 0x2: return 1 + ((addr & mem::EWRAM_MASK) >> PAGE_SHIFT);
+            case 0x3: return 1 + EWRAM_PAGES + ((addr & mem::IWRAM_MASK) >> PAGE_SHIFT);
+            default: return 0;
+        }
+    }
+
+    [[nodiscard]] static auto get_index(u32 addr) -> u32
+    {
+        // mix in the upper bits so that rom and wram don't alias
+        return ((addr >> 1) ^ (addr >> 17)) & (BLOCK_COUNT - 1);
+    }
+};
+
+} // namespace gba::arm7tdmi
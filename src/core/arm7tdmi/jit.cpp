@@ -0,0 +1,1429 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "arm7tdmi/jit.hpp"
+#include "arm7tdmi/arm7tdmi.hpp"
+#include "bit.hpp"
+#include "gba.hpp"
+#include "mem.hpp"
+#include "waitloop.hpp"
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// only the system v calling convention is emitted
+#if defined(__x86_64__) && !defined(_WIN32)
+    #define JIT_X64 1
+    #include <sys/mman.h>
+#else
+    #define JIT_X64 0
+#endif
+
+namespace gba::arm7tdmi {
+
+#if JIT_X64
+namespace {
+
+enum : std::size_t
+{
+    BUFFER_SIZE = 1024 * 1024 * 16,
+    // worst case size of a compiled block, checked before compiling
+    MAX_BLOCK_SIZE = 1024 * 16,
+    // worst case size of a single translated instruction. the block is
+    // cut short if the next one might not fit.
+    MAX_INSTRUCTION_SIZE = 1024,
+    // worst case size of the exit stubs and epilogue
+    MAX_EXITS_SIZE = 64 * (BlockCache::MAX_INSTRUCTIONS + 1),
+    // the buffer is never writable and executable at the same time,
+    // so the pages of a block are flipped to rw whilst it's emitted.
+    HOST_PAGE_SIZE = 4096,
+};
+
+// the low 8 / 16 / 32 bits are used depending on the instruction
+enum Reg : u8
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    NO_REG = 0xFF,
+};
+
+// x86 condition codes, used for jcc and setcc
+enum Cond : u8
+{
+    CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+    CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G,
+    // carry flag
+    CC_C = CC_B,
+    CC_NC = CC_AE,
+};
+
+// the /digit of the 0x81 group
+enum Alu : u8
+{
+    ALU_ADD, ALU_OR, ALU_ADC, ALU_SBB, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP,
+};
+
+// the /digit of the 0xC1 group
+enum Shift : u8
+{
+    SHIFT_ROL, SHIFT_ROR, SHIFT_RCL, SHIFT_RCR, SHIFT_SHL, SHIFT_SHR, SHIFT_SAL, SHIFT_SAR,
+};
+
+// [base + index * (1 << scale) + disp32]
+struct Mem
+{
+    Reg base;
+    s32 disp;
+    Reg index{NO_REG};
+    u8 scale{};
+};
+
+struct Emitter
+{
+    u8* ptr;
+
+    void emit8(u8 v) { *ptr++ = v; }
+    void emit32(u32 v) { std::memcpy(ptr, &v, sizeof(v)); ptr += sizeof(v); }
+    void emit64(u64 v) { std::memcpy(ptr, &v, sizeof(v)); ptr += sizeof(v); }
+
+    // opcodes > 0xFF are 0x0F escaped
+    void opcode(u32 op)
+    {
+        if (op > 0xFF)
+        {
+            emit8(op >> 8);
+        }
+        emit8(op & 0xFF);
+    }
+
+    // byte forces a rex prefix, so that spl-dil are used rather than ah-bh
+    void rex(bool w, u8 reg, u8 index, u8 base, bool byte)
+    {
+        const u8 v = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | (((index >> 3) & 1) << 1) | ((base >> 3) & 1);
+        if (v != 0x40 || byte)
+        {
+            emit8(v);
+        }
+    }
+
+    // op reg, [mem]
+    void rm(u32 op, u8 reg, const Mem& m, bool w = false, bool byte = false)
+    {
+        const u8 index = m.index == NO_REG ? RSP : m.index;
+        rex(w, reg, m.index == NO_REG ? 0 : m.index, m.base, byte);
+        opcode(op);
+
+        // rsp and r12 as a base always need a sib byte
+        if (m.index == NO_REG && (m.base & 7) != RSP)
+        {
+            emit8(0x80 | ((reg & 7) << 3) | (m.base & 7));
+        }
+        else
+        {
+            emit8(0x80 | ((reg & 7) << 3) | RSP);
+            emit8((m.scale << 6) | ((index & 7) << 3) | (m.base & 7));
+        }
+        emit32(m.disp);
+    }
+
+    // op reg, rm
+    void rr(u32 op, u8 reg, u8 rm, bool w = false, bool byte = false)
+    {
+        rex(w, reg, 0, rm, byte);
+        opcode(op);
+        emit8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void mov(Reg d, const Mem& m) { rm(0x8B, d, m); }
+    void mov(const Mem& m, Reg s) { rm(0x89, s, m); }
+    void mov(Reg d, Reg s) { rr(0x89, s, d); }
+    void mov(Reg d, u32 imm) { rex(false, 0, 0, d, false); emit8(0xB8 + (d & 7)); emit32(imm); }
+    void mov(const Mem& m, u32 imm) { rm(0xC7, 0, m); emit32(imm); }
+    void mov8(const Mem& m, Reg s) { rm(0x88, s, m, false, true); }
+    void mov8(const Mem& m, u8 imm) { rm(0xC6, 0, m); emit8(imm); }
+    void mov16(const Mem& m, Reg s) { emit8(0x66); rm(0x89, s, m); }
+    void mov64(Reg d, const Mem& m) { rm(0x8B, d, m, true); }
+    void mov64(Reg d, Reg s) { rr(0x89, s, d, true); }
+    void mov64(Reg d, u64 imm) { rex(true, 0, 0, d, false); emit8(0xB8 + (d & 7)); emit64(imm); }
+    void movzx8(Reg d, const Mem& m) { rm(0x0FB6, d, m); }
+    void movzx8(Reg d, Reg s) { rr(0x0FB6, d, s, false, true); }
+    void movzx16(Reg d, const Mem& m) { rm(0x0FB7, d, m); }
+    void movsx8(Reg d, const Mem& m) { rm(0x0FBE, d, m); }
+    void movsx16(Reg d, const Mem& m) { rm(0x0FBF, d, m); }
+    void lea64(Reg d, const Mem& m) { rm(0x8D, d, m, true); }
+
+    void alu(Alu op, Reg d, Reg s) { rr(0x01 + op * 8, s, d); }
+    void alu(Alu op, Reg d, const Mem& m) { rm(0x03 + op * 8, d, m); }
+    void alu(Alu op, Reg d, u32 imm) { rr(0x81, op, d); emit32(imm); }
+    void alu(Alu op, const Mem& m, u32 imm) { rm(0x81, op, m); emit32(imm); }
+    void alu8(Alu op, const Mem& m, u8 imm) { rm(0x80, op, m); emit8(imm); }
+    void test(Reg a, Reg b) { rr(0x85, b, a); }
+    void test(Reg a, u32 imm) { rr(0xF7, 0, a); emit32(imm); }
+    void test8(const Mem& m, u8 imm) { rm(0xF6, 0, m); emit8(imm); }
+    void shift(Shift op, Reg d, u8 amount) { rr(0xC1, op, d); emit8(amount); }
+    void shift_cl(Shift op, Reg d) { rr(0xD3, op, d); }
+    void bt(Reg d, u8 bit) { rr(0x0FBA, 4, d); emit8(bit); }
+    void bts(const Mem& m, Reg bit) { rm(0x0FAB, bit, m); }
+    void not_(Reg d) { rr(0xF7, 2, d); }
+    void inc(const Mem& m) { rm(0xFF, 0, m); }
+    void setcc(Cond cc, const Mem& m) { rm(0x0F90 + cc, 0, m); }
+    void setcc(Cond cc, Reg d) { rr(0x0F90 + cc, 0, d, false, true); }
+    void cmc() { emit8(0xF5); }
+    void push(Reg r) { rex(false, 0, 0, r, false); emit8(0x50 + (r & 7)); }
+    void pop(Reg r) { rex(false, 0, 0, r, false); emit8(0x58 + (r & 7)); }
+    void call(Reg r) { rr(0xFF, 2, r); }
+    void ret() { emit8(0xC3); }
+
+    // returns the address of rel32 to be patched with bind()
+    [[nodiscard]] auto jcc(Cond cc) -> u8*
+    {
+        emit8(0x0F); emit8(0x80 + cc); emit32(0);
+        return ptr - 4;
+    }
+
+    [[nodiscard]] auto jmp() -> u8*
+    {
+        emit8(0xE9); emit32(0);
+        return ptr - 4;
+    }
+
+    static void bind(u8* rel, const u8* target)
+    {
+        const auto offset = static_cast<s32>(target - (rel + 4));
+        std::memcpy(rel, &offset, sizeof(offset));
+    }
+};
+
+// how the shifter carry of an arm data processing op / thumb shift is set
+enum class Carry : u8
+{
+    OLD, // unchanged
+    ZERO,
+    ONE,
+    DL, // in dl
+};
+
+// the waitloop takes the pc + 8 / 4 of the branch, same as the handlers
+void on_arm_loop(Gba& gba, u32 current_pc, u32 new_jump_pc)
+{
+    gba.waitloop.on_arm_loop(gba, current_pc, new_jump_pc);
+}
+
+void on_thumb_loop(Gba& gba, u32 current_pc, u32 new_jump_pc)
+{
+    gba.waitloop.on_thumb_loop(gba, current_pc, new_jump_pc);
+}
+
+template<typename T>
+auto to_ptr(T func) -> u64
+{
+    return reinterpret_cast<std::uintptr_t>(func);
+}
+
+static_assert(sizeof(mem::Page) == 16, "the page lookup is a shift by 4");
+
+// translates a block into x86-64.
+// the alu, branch and load / store forms that are common in hot loops are
+// emitted as host code, everything else calls the handler directly.
+// the output (including cycles) is identical to execute_block().
+//
+// whilst in the block: rbx = &gba, r12d = cycles, r13d = seq fetch timing
+// for the region of the block, r14d = deadline, r15 = block cache versions.
+// the cycles are written back before a handler is called and on exit,
+// all other state lives in gba.
+struct Translator
+{
+    Gba& gba;
+    const BlockCache::Block& block;
+    Emitter e;
+
+    bool thumb;
+    u32 size;
+    u8 region;
+
+    // set if last_region is known to be the region of the block,
+    // ie, no memory was accessed since the last fetch.
+    bool known_region{};
+    // the instruction being translated, pc is its address + 8 / 4
+    u32 index{};
+    u32 pc{};
+
+    // jump to the exit stub of an instruction, which stores the pc and
+    // pipeline. STORED exits jump straight to the epilogue.
+    static constexpr u32 STORED = ~0U;
+    struct Exit { u8* rel; u32 index; };
+    Exit exits[BlockCache::MAX_INSTRUCTIONS * 10];
+    u32 exit_count{};
+    // jumps to the handler of the current instruction
+    u8* slow[4]{};
+    u32 slow_count{};
+
+    // before the fetch of the first instruction
+    const u8* entry{};
+    // after the fetch of the first instruction
+    const u8* body{};
+
+    Translator(Gba& gba_, const BlockCache::Block& block_, u8* start) :
+        gba{gba_},
+        block{block_},
+        e{start},
+        thumb{block_.state == State::THUMB},
+        size{thumb ? 2U : 4U},
+        region{block_.region}
+    {}
+
+    [[nodiscard]] auto at(const void* p) const -> Mem
+    {
+        const auto offset = static_cast<const u8*>(p) - reinterpret_cast<const u8*>(&gba);
+        return {RBX, static_cast<s32>(offset)};
+    }
+
+    [[nodiscard]] auto reg(u32 n) const -> Mem { return at(&gba.cpu.registers[n]); }
+    [[nodiscard]] auto ticks() const -> Mem { return at(gba.scheduler.get_ticks_address()); }
+    [[nodiscard]] auto version() const -> Mem { return {R15, static_cast<s32>(block.page * sizeof(u32))}; }
+    [[nodiscard]] auto seq_timing() const -> Mem
+    {
+        return thumb ? at(&gba.timing_table_16[mem::SEQ][region]) : at(&gba.timing_table_32[mem::SEQ][region]);
+    }
+
+    void exit_if(Cond cc, u32 i) { assert(exit_count < std::size(exits)); exits[exit_count++] = {e.jcc(cc), i}; }
+    void exit_if(Cond cc) { exit_if(cc, index); }
+    void exit_stored_if(Cond cc) { exit_if(cc, STORED); }
+    void slow_if(Cond cc) { assert(slow_count < std::size(slow)); slow[slow_count++] = e.jcc(cc); }
+
+    void check_deadline(bool stored)
+    {
+        e.alu(ALU_CMP, R12, R14);
+        exit_if(CC_GE, stored ? STORED : index);
+    }
+
+    // a store may have written to the page of the block
+    void check_version(bool stored)
+    {
+        e.alu(ALU_CMP, version(), block.version);
+        exit_if(CC_NE, stored ? STORED : index);
+    }
+
+    void reload()
+    {
+        e.mov(R12, ticks());
+        e.mov(R14, at(gba.scheduler.get_deadline_address()));
+        e.movzx8(R13, seq_timing());
+        known_region = false;
+    }
+
+    // pc and pipeline as they are after the fetch of the instruction
+    void store_state(u32 i)
+    {
+        e.mov(reg(PC_INDEX), block.addr + size * (i + 2));
+        e.mov(at(&gba.cpu.pipeline[0]), block.opcodes[i + 1]);
+        e.mov(at(&gba.cpu.pipeline[1]), block.opcodes[i + 2]);
+    }
+
+    void call_handler(u32 opcode)
+    {
+        store_state(index);
+        e.mov(ticks(), R12);
+        e.mov64(RDI, RBX);
+        e.mov(RSI, opcode);
+        e.mov64(RAX, thumb ? to_ptr(block.thumb[index]) : to_ptr(block.arm[index]));
+        e.call(RAX);
+        reload();
+    }
+
+    // same checks as execute_block() after each instruction
+    void handler(u32 opcode)
+    {
+        call_handler(opcode);
+        e.alu(ALU_CMP, reg(PC_INDEX), pc);
+        exit_stored_if(CC_NE);
+        check_deadline(true);
+        check_version(true);
+    }
+
+    // the fast path jumps over the call to the handler
+    void bind_slow(u32 opcode)
+    {
+        if (!slow_count)
+        {
+            return;
+        }
+
+        const auto done = e.jmp();
+        for (u32 i = 0; i < slow_count; i++)
+        {
+            Emitter::bind(slow[i], e.ptr);
+        }
+        slow_count = 0;
+        call_handler(opcode);
+        Emitter::bind(done, e.ptr);
+        known_region = false;
+    }
+
+    void fetch()
+    {
+        if (known_region)
+        {
+            e.alu(ALU_ADD, R12, R13);
+            return;
+        }
+
+        // see mem::is_new_region()
+        const u8 mask = region >= 0x8 ? 0xE : 0xF;
+        e.movzx8(RAX, at(&gba.last_region));
+        e.mov8(at(&gba.last_region), static_cast<u8>(region));
+        e.alu(ALU_AND, RAX, mask);
+        e.alu(ALU_CMP, RAX, region & mask);
+        const auto nseq = e.jcc(CC_NE);
+        e.alu(ALU_ADD, R12, R13);
+        const auto done = e.jmp();
+        Emitter::bind(nseq, e.ptr);
+        e.movzx8(RAX, thumb ? at(&gba.timing_table_16[mem::NSEQ][region]) : at(&gba.timing_table_32[mem::NSEQ][region]));
+        e.alu(ALU_ADD, R12, RAX);
+        Emitter::bind(done, e.ptr);
+        known_region = true;
+    }
+
+    void value(Reg d, u32 n)
+    {
+        if (n == PC_INDEX)
+        {
+            e.mov(d, pc);
+        }
+        else
+        {
+            e.mov(d, reg(n));
+        }
+    }
+
+    void set_nz(Reg r)
+    {
+        e.test(r, r);
+        e.setcc(CC_S, at(&gba.cpu.cpsr.N));
+        e.setcc(CC_E, at(&gba.cpu.cpsr.Z));
+    }
+
+    void set_nzcv(bool sub)
+    {
+        e.setcc(CC_S, at(&gba.cpu.cpsr.N));
+        e.setcc(CC_E, at(&gba.cpu.cpsr.Z));
+        e.setcc(sub ? CC_NC : CC_C, at(&gba.cpu.cpsr.C));
+        e.setcc(CC_O, at(&gba.cpu.cpsr.V));
+    }
+
+    void set_carry(Carry carry)
+    {
+        switch (carry)
+        {
+            case Carry::OLD: break;
+            case Carry::ZERO: e.mov8(at(&gba.cpu.cpsr.C), u8{0}); break;
+            case Carry::ONE: e.mov8(at(&gba.cpu.cpsr.C), u8{1}); break;
+            case Carry::DL: e.mov8(at(&gba.cpu.cpsr.C), RDX); break;
+        }
+    }
+
+    // cf = C, for adc. sbb wants cf = !C, which is the cmp alone.
+    void load_carry(bool invert)
+    {
+        e.alu8(ALU_CMP, at(&gba.cpu.cpsr.C), 1);
+        if (!invert)
+        {
+            e.cmc();
+        }
+    }
+
+    // barrel::shift_imm() of ecx, the carry is only computed if needed
+    auto shift_imm(u32 type, u8 amount, bool need_carry) -> Carry
+    {
+        switch (type)
+        {
+            case 0: // lsl
+                if (!amount)
+                {
+                    return Carry::OLD;
+                }
+                e.shift(SHIFT_SHL, RCX, amount);
+                break;
+
+            case 1: // lsr, #0 is #32
+                if (!amount)
+                {
+                    e.bt(RCX, 31);
+                    e.setcc(CC_C, RDX);
+                    e.mov(RCX, 0U);
+                    return Carry::DL;
+                }
+                e.shift(SHIFT_SHR, RCX, amount);
+                break;
+
+            case 2: // asr, #0 is #32
+                e.shift(SHIFT_SAR, RCX, amount ? amount : 31);
+                if (!amount)
+                {
+                    e.bt(RCX, 31);
+                }
+                break;
+
+            case 3: // ror, #0 is rrx
+                if (!amount)
+                {
+                    load_carry(false);
+                    e.shift(SHIFT_RCR, RCX, 1);
+                }
+                else
+                {
+                    e.shift(SHIFT_ROR, RCX, amount);
+                }
+                break;
+        }
+
+        if (need_carry)
+        {
+            e.setcc(CC_C, RDX);
+        }
+        return Carry::DL;
+    }
+
+    // jumps if the condition fails, see check_cond()
+    auto skip_unless(u32 cond) -> u8*
+    {
+        auto& cpsr = gba.cpu.cpsr;
+
+        const auto flag = [this](bool& f, Cond skip)
+        {
+            e.alu8(ALU_CMP, at(&f), 0);
+            return e.jcc(skip);
+        };
+
+        switch (cond)
+        {
+            case COND_EQ: return flag(cpsr.Z, CC_E);
+            case COND_NE: return flag(cpsr.Z, CC_NE);
+            case COND_CS: return flag(cpsr.C, CC_E);
+            case COND_CC: return flag(cpsr.C, CC_NE);
+            case COND_MI: return flag(cpsr.N, CC_E);
+            case COND_PL: return flag(cpsr.N, CC_NE);
+            case COND_VS: return flag(cpsr.V, CC_E);
+            case COND_VC: return flag(cpsr.V, CC_NE);
+
+            case COND_HI:
+            case COND_LS:
+                // hi is C > Z
+                e.movzx8(RAX, at(&cpsr.C));
+                e.movzx8(RCX, at(&cpsr.Z));
+                e.alu(ALU_CMP, RAX, RCX);
+                return e.jcc(cond == COND_HI ? CC_BE : CC_A);
+
+            case COND_GE:
+            case COND_LT:
+                e.movzx8(RAX, at(&cpsr.N));
+                e.movzx8(RCX, at(&cpsr.V));
+                e.alu(ALU_CMP, RAX, RCX);
+                return e.jcc(cond == COND_GE ? CC_NE : CC_E);
+
+            case COND_GT:
+            case COND_LE:
+                // gt is (N ^ V) | Z == 0
+                e.movzx8(RAX, at(&cpsr.N));
+                e.movzx8(RCX, at(&cpsr.V));
+                e.alu(ALU_XOR, RAX, RCX);
+                e.movzx8(RCX, at(&cpsr.Z));
+                e.alu(ALU_OR, RAX, RCX);
+                return e.jcc(cond == COND_GT ? CC_NE : CC_E);
+        }
+
+        assert(!"unhandled cond");
+        return nullptr;
+    }
+
+    // see read_internal() / write_internal() in mem.cpp.
+    // eax = address, which is preserved. rsi = array and ecx = offset on return.
+    // if the page can't be accessed directly, the handler is called instead.
+    void access_page(u8 access_size, bool write)
+    {
+        e.mov(RDX, RAX);
+        e.alu(ALU_AND, RDX, 0x0FFFFFFFU);
+        e.mov(RCX, RDX);
+        e.shift(SHIFT_SHR, RCX, mem::PAGE_SHIFT);
+        e.shift(SHIFT_SHL, RCX, 4);
+        e.lea64(RSI, {RBX, at(&gba.pages).disp, RCX, 0});
+
+        const auto access = write ? offsetof(mem::Page, write_access) : offsetof(mem::Page, read_access);
+        e.test8({RSI, static_cast<s32>(access)}, access_size);
+        slow_if(CC_E);
+
+        e.mov(RCX, RDX);
+        e.shift(SHIFT_SHR, RCX, 24);
+
+        if (write)
+        {
+            // only ewram / iwram, which need the blocks and pages
+            // invalidated, everything else may have side effects.
+            e.lea64(R10, {RCX, -2});
+            e.alu(ALU_CMP, R10, 1U);
+            slow_if(CC_A);
+        }
+
+        // tick(page.timing[is_new_region(last_region, region)])
+        e.movzx8(RDI, at(&gba.last_region));
+        e.mov8(at(&gba.last_region), RCX);
+        e.alu(ALU_XOR, RDI, RCX);
+        e.shift(SHIFT_SHR, RCX, 3);
+        e.alu(ALU_XOR, RCX, 0xFU);
+        e.test(RDI, RCX);
+        e.setcc(CC_NE, RDI);
+        e.movzx8(RDI, RDI);
+        const auto timing = access_size == sizeof(u32) ? offsetof(mem::Page, timing_32) : offsetof(mem::Page, timing_16);
+        e.movzx8(RDI, {RSI, static_cast<s32>(timing), RDI, 0});
+        e.alu(ALU_ADD, R12, RDI);
+
+        e.movzx16(RCX, {RSI, static_cast<s32>(offsetof(mem::Page, mask))});
+        if (access_size > 1)
+        {
+            e.alu(ALU_AND, RDX, ~(access_size - 1U));
+        }
+        e.alu(ALU_AND, RCX, RDX);
+        e.mov64(RSI, {RSI, static_cast<s32>(offsetof(mem::Page, array))});
+        known_region = false;
+    }
+
+    // eax = address, the result is in edx (not rotated)
+    void load(u8 access_size, bool sign)
+    {
+        access_page(access_size, false);
+        const Mem m{RSI, 0, RCX, 0};
+
+        switch (access_size)
+        {
+            case 1: sign ? e.movsx8(RDX, m) : e.movzx8(RDX, m); break;
+            case 2: sign ? e.movsx16(RDX, m) : e.movzx16(RDX, m); break;
+            case 4: e.mov(RDX, m); break;
+        }
+    }
+
+    // eax = address, r9d = value
+    void store(u8 access_size)
+    {
+        access_page(access_size, true);
+        const Mem m{RSI, 0, RCX, 0};
+
+        switch (access_size)
+        {
+            case 1: e.mov8(m, R9); break;
+            case 2: e.mov16(m, R9); break;
+            case 4: e.mov(m, R9); break;
+        }
+
+        // BlockCache::on_write() and DirtyPages::set() for both users
+        const auto invalidate = [this](u32 mask, u32 first_page, u32 mem_offset)
+        {
+            e.mov(RCX, RDX);
+            e.alu(ALU_AND, RCX, mask);
+            e.mov(RDI, RCX);
+            e.shift(SHIFT_SHR, RDI, BlockCache::PAGE_SHIFT);
+            e.inc({R15, static_cast<s32>(first_page * sizeof(u32)), RDI, 2});
+            e.alu(ALU_ADD, RCX, mem_offset);
+            e.shift(SHIFT_SHR, RCX, mem::DirtyPages::SHIFT);
+            e.bts(at(&gba.dirty_pages.bits[mem::DirtyPages::USER_DELTA]), RCX);
+            e.bts(at(&gba.dirty_pages.bits[mem::DirtyPages::USER_SNAPSHOT]), RCX);
+        };
+
+        e.test(R10, R10);
+        const auto iwram = e.jcc(CC_NE);
+        invalidate(mem::EWRAM_MASK, 1, offsetof(mem::Mem, ewram));
+        const auto done = e.jmp();
+        Emitter::bind(iwram, e.ptr);
+        invalidate(mem::IWRAM_MASK, 1 + BlockCache::EWRAM_PAGES, offsetof(mem::Mem, iwram));
+        Emitter::bind(done, e.ptr);
+    }
+
+    // rotates edx by (eax & mask) * 8, for misaligned ldr / ldrh
+    void rotate_misaligned(u32 mask)
+    {
+        e.mov(RCX, RAX);
+        e.alu(ALU_AND, RCX, mask);
+        e.shift(SHIFT_SHL, RCX, 3);
+        e.shift_cl(SHIFT_ROR, RDX);
+    }
+
+    // a branch to the start of the block (ie, a loop) stays in the
+    // generated code. these are the same checks that execute_cached()
+    // does before running a block again.
+    void loop_back(u32 opcode, u32 target)
+    {
+        e.alu(ALU_CMP, version(), block.version);
+        slow_if(CC_NE);
+        // rom can be unmapped at runtime, see BlockCache::find()
+        const auto access = at(&gba.rmap[region]).disp + static_cast<s32>(offsetof(mem::ReadArray, access));
+        e.test8({RBX, access}, static_cast<u8>(size));
+        slow_if(CC_E);
+
+        // refill_pipeline(), the last access was the fetch of the branch
+        e.mov(reg(PC_INDEX), block.addr + size);
+        e.mov(at(&gba.cpu.pipeline[0]), block.opcodes[0]);
+        e.mov(at(&gba.cpu.pipeline[1]), block.opcodes[1]);
+        e.alu(ALU_ADD, R12, R13);
+        e.alu(ALU_ADD, R12, R13);
+
+        if (index < waitloop::Waitloop::MAX_INSTRUCTIONS)
+        {
+            // this can fire events, ie, an irq or dma
+            e.mov(ticks(), R12);
+            e.mov64(RDI, RBX);
+            e.mov(RSI, pc);
+            e.mov(RDX, target);
+            e.mov64(RAX, thumb ? to_ptr(&on_thumb_loop) : to_ptr(&on_arm_loop));
+            e.call(RAX);
+            reload();
+            e.alu(ALU_CMP, reg(PC_INDEX), block.addr + size);
+            exit_stored_if(CC_NE);
+            check_deadline(true);
+            check_version(true);
+            Emitter::bind(e.jmp(), entry);
+        }
+        else
+        {
+            check_deadline(true);
+            e.alu(ALU_ADD, R12, R13);
+            Emitter::bind(e.jmp(), body);
+        }
+
+        const auto done = e.jmp();
+        for (u32 i = 0; i < slow_count; i++)
+        {
+            Emitter::bind(slow[i], e.ptr);
+        }
+        slow_count = 0;
+        call_handler(opcode);
+        Emitter::bind(done, e.ptr);
+        // the handler always branches
+        exits[exit_count++] = {e.jmp(), STORED};
+    }
+
+    void branch(u32 opcode, u32 target)
+    {
+        if (target == block.addr)
+        {
+            loop_back(opcode, target);
+        }
+        else
+        {
+            handler(opcode);
+        }
+    }
+
+    // returns false if the instruction isn't translated
+    auto arm_data_processing(u32 opcode) -> bool
+    {
+        const auto I = bit::is_set<25>(opcode);
+        const auto op = bit::get_range<21, 24>(opcode);
+        const auto S = bit::is_set<20>(opcode);
+        const auto Rn = bit::get_range<16, 19>(opcode);
+        const auto Rd = bit::get_range<12, 15>(opcode);
+
+        // writes to pc, shift by register (or multiply / halfword transfer),
+        // msr / mrs / bx
+        if (Rd == PC_INDEX || (!I && bit::is_set<4>(opcode)) || (op >= 8 && op <= 11 && !S))
+        {
+            return false;
+        }
+
+        const auto logical = op <= 1 || (op >= 8 && op <= 9) || op >= 12;
+        auto carry = Carry::OLD;
+
+        if (I)
+        {
+            const auto rotate = bit::get_range<8, 11>(opcode) * 2;
+            const auto imm = std::rotr(bit::get_range<0, 7>(opcode), rotate);
+            e.mov(RCX, imm);
+            if (rotate)
+            {
+                carry = bit::is_set<31>(imm) ? Carry::ONE : Carry::ZERO;
+            }
+        }
+        else
+        {
+            value(RCX, bit::get_range<0, 3>(opcode));
+            carry = shift_imm(bit::get_range<5, 6>(opcode), bit::get_range<7, 11>(opcode), S && logical);
+        }
+
+        if (op != 13 && op != 15)
+        {
+            value(RAX, Rn);
+        }
+
+        switch (op)
+        {
+            case 0: case 8: e.alu(ALU_AND, RAX, RCX); break; // and / tst
+            case 1: case 9: e.alu(ALU_XOR, RAX, RCX); break; // eor / teq
+            case 12: e.alu(ALU_OR, RAX, RCX); break; // orr
+            case 13: e.mov(RAX, RCX); break; // mov
+            case 14: e.not_(RCX); e.alu(ALU_AND, RAX, RCX); break; // bic
+            case 15: e.mov(RAX, RCX); e.not_(RAX); break; // mvn
+            case 2: case 10: e.alu(ALU_SUB, RAX, RCX); break; // sub / cmp
+            case 3: e.alu(ALU_SUB, RCX, RAX); break; // rsb
+            case 4: case 11: e.alu(ALU_ADD, RAX, RCX); break; // add / cmn
+            case 5: load_carry(false); e.alu(ALU_ADC, RAX, RCX); break; // adc
+            case 6: load_carry(true); e.alu(ALU_SBB, RAX, RCX); break; // sbc
+            case 7: load_carry(true); e.alu(ALU_SBB, RCX, RAX); break; // rsc
+        }
+
+        if (S)
+        {
+            if (logical)
+            {
+                set_nz(RAX);
+                set_carry(carry);
+            }
+            else
+            {
+                set_nzcv(op != 4 && op != 5 && op != 11);
+            }
+        }
+
+        // rsb / rsc
+        if (op == 3 || op == 7)
+        {
+            e.mov(RAX, RCX);
+        }
+
+        if (op < 8 || op > 11)
+        {
+            e.mov(reg(Rd), RAX);
+        }
+
+        return true;
+    }
+
+    auto arm_single_data_transfer(u32 opcode) -> bool
+    {
+        const auto I = bit::is_set<25>(opcode);
+        const auto P = bit::is_set<24>(opcode);
+        const auto U = bit::is_set<23>(opcode);
+        const auto B = bit::is_set<22>(opcode);
+        const auto W = bit::is_set<21>(opcode);
+        const auto L = bit::is_set<20>(opcode);
+        const auto Rn = bit::get_range<16, 19>(opcode);
+        const auto Rd = bit::get_range<12, 15>(opcode);
+        const auto Rm = bit::get_range<0, 3>(opcode);
+        const auto writeback = W || !P;
+
+        if ((I && (bit::is_set<4>(opcode) || Rm == PC_INDEX)) || (L && Rd == PC_INDEX) || (Rn == PC_INDEX && writeback))
+        {
+            return false;
+        }
+
+        // r11d = final address
+        value(RAX, Rn);
+        e.mov(R11, RAX);
+        if (I)
+        {
+            value(RCX, Rm);
+            shift_imm(bit::get_range<5, 6>(opcode), bit::get_range<7, 11>(opcode), false);
+            e.alu(U ? ALU_ADD : ALU_SUB, R11, RCX);
+        }
+        else
+        {
+            e.alu(U ? ALU_ADD : ALU_SUB, R11, bit::get_range<0, 11>(opcode));
+        }
+
+        if (P)
+        {
+            e.mov(RAX, R11);
+        }
+
+        if (L)
+        {
+            load(B ? 1 : 4, false);
+            if (!B)
+            {
+                rotate_misaligned(3);
+            }
+            e.mov(reg(Rd), RDX);
+            e.alu(ALU_ADD, R12, 1U);
+            if (writeback && Rd != Rn)
+            {
+                e.mov(reg(Rn), R11);
+            }
+        }
+        else
+        {
+            if (Rd == PC_INDEX)
+            {
+                e.mov(R9, pc + 4);
+            }
+            else
+            {
+                e.mov(R9, reg(Rd));
+            }
+            store(B ? 1 : 4);
+            if (writeback)
+            {
+                e.mov(reg(Rn), R11);
+            }
+        }
+
+        bind_slow(opcode);
+
+        if (!L)
+        {
+            check_version(false);
+        }
+
+        return true;
+    }
+
+    void translate_arm(u32 opcode)
+    {
+        const auto cond = opcode >> 28;
+
+        // never executed
+        if (cond == 0xF)
+        {
+            return;
+        }
+
+        const auto skip = cond == COND_AL ? nullptr : skip_unless(cond);
+        bool translated = false;
+
+        switch (bit::get_range<25, 27>(opcode))
+        {
+            case 0b000:
+            case 0b001:
+                translated = arm_data_processing(opcode);
+                break;
+
+            case 0b010:
+            case 0b011:
+                translated = arm_single_data_transfer(opcode);
+                break;
+
+            case 0b101:
+                // bl always leaves the block
+                if (!bit::is_set<24>(opcode))
+                {
+                    const auto offset = bit::sign_extend<25>(bit::get_range<0, 23>(opcode) << 2);
+                    branch(opcode, pc + offset);
+                    translated = true;
+                }
+                break;
+        }
+
+        if (!translated)
+        {
+            handler(opcode);
+        }
+
+        if (skip)
+        {
+            Emitter::bind(skip, e.ptr);
+            // the handler may not have been called
+            known_region = false;
+        }
+    }
+
+    // the result is stored to Rd
+    void thumb_load(u32 Rd, u8 access_size, bool sign)
+    {
+        load(access_size, sign);
+        if (access_size == 4)
+        {
+            rotate_misaligned(3);
+        }
+        else if (access_size == 2 && !sign)
+        {
+            rotate_misaligned(1);
+        }
+        e.mov(reg(Rd), RDX);
+        e.alu(ALU_ADD, R12, 1U);
+    }
+
+    void thumb_store(u32 Rd, u8 access_size)
+    {
+        e.mov(R9, reg(Rd));
+        store(access_size);
+    }
+
+    auto thumb_alu(u32 opcode) -> bool
+    {
+        const auto op = bit::get_range<6, 9>(opcode);
+        const auto Rs = bit::get_range<3, 5>(opcode);
+        const auto Rd = bit::get_range<0, 2>(opcode);
+
+        // shift by register, ror and mul
+        if ((op >= 0x2 && op <= 0x4) || op == 0x7 || op == 0xD)
+        {
+            return false;
+        }
+
+        e.mov(RAX, reg(Rd));
+        e.mov(RCX, reg(Rs));
+
+        switch (op)
+        {
+            case 0x0: e.alu(ALU_AND, RAX, RCX); set_nz(RAX); break; // and
+            case 0x1: e.alu(ALU_XOR, RAX, RCX); set_nz(RAX); break; // eor
+            case 0x5: load_carry(false); e.alu(ALU_ADC, RAX, RCX); set_nzcv(false); break; // adc
+            case 0x6: load_carry(true); e.alu(ALU_SBB, RAX, RCX); set_nzcv(true); break; // sbc
+            case 0x8: e.alu(ALU_AND, RAX, RCX); set_nz(RAX); return true; // tst
+            case 0x9: e.mov(RAX, 0U); e.alu(ALU_SUB, RAX, RCX); set_nzcv(true); break; // neg
+            case 0xA: e.alu(ALU_SUB, RAX, RCX); set_nzcv(true); return true; // cmp
+            case 0xB: e.alu(ALU_ADD, RAX, RCX); set_nzcv(false); return true; // cmn
+            case 0xC: e.alu(ALU_OR, RAX, RCX); set_nz(RAX); break; // orr
+            case 0xE: e.not_(RCX); e.alu(ALU_AND, RAX, RCX); set_nz(RAX); break; // bic
+            case 0xF: e.mov(RAX, RCX); e.not_(RAX); set_nz(RAX); break; // mvn
+        }
+
+        e.mov(reg(Rd), RAX);
+        return true;
+    }
+
+    auto thumb_hi_register_operations(u32 opcode) -> bool
+    {
+        const auto op = bit::get_range<8, 9>(opcode);
+        const auto Rs = bit::get_range<3, 6>(opcode);
+        const auto Rd = bit::get_range<0, 2>(opcode) | (bit::is_set<7>(opcode) << 3);
+
+        // bx and writes to pc
+        if (op == 3 || (op != 1 && Rd == PC_INDEX))
+        {
+            return false;
+        }
+
+        value(RCX, Rs);
+
+        switch (op)
+        {
+            case 0: // add
+                value(RAX, Rd);
+                e.alu(ALU_ADD, RAX, RCX);
+                e.mov(reg(Rd), RAX);
+                break;
+
+            case 1: // cmp
+                value(RAX, Rd);
+                e.alu(ALU_SUB, RAX, RCX);
+                set_nzcv(true);
+                break;
+
+            case 2: // mov
+                e.mov(reg(Rd), RCX);
+                break;
+        }
+
+        return true;
+    }
+
+    auto thumb_native(u32 opcode) -> bool
+    {
+        switch (opcode >> 11)
+        {
+            // move shifted register
+            case 0b00000:
+            case 0b00001:
+            case 0b00010: {
+                e.mov(RCX, reg(bit::get_range<3, 5>(opcode)));
+                const auto carry = shift_imm(opcode >> 11, bit::get_range<6, 10>(opcode), true);
+                set_nz(RCX);
+                set_carry(carry);
+                e.mov(reg(bit::get_range<0, 2>(opcode)), RCX);
+                return true;
+            }
+
+            // add / subtract
+            case 0b00011: {
+                const auto Rn = bit::get_range<6, 8>(opcode);
+                const auto op = bit::is_set<9>(opcode) ? ALU_SUB : ALU_ADD;
+                e.mov(RAX, reg(bit::get_range<3, 5>(opcode)));
+                if (bit::is_set<10>(opcode))
+                {
+                    e.alu(op, RAX, Rn);
+                }
+                else
+                {
+                    e.alu(op, RAX, reg(Rn));
+                }
+                set_nzcv(op == ALU_SUB);
+                e.mov(reg(bit::get_range<0, 2>(opcode)), RAX);
+                return true;
+            }
+
+            // move / compare / add / subtract immediate
+            case 0b00100:
+            case 0b00101:
+            case 0b00110:
+            case 0b00111: {
+                const auto op = bit::get_range<11, 12>(opcode);
+                const auto Rd = bit::get_range<8, 10>(opcode);
+                const auto imm = bit::get_range<0, 7>(opcode);
+                if (op == 0)
+                {
+                    e.mov(reg(Rd), imm);
+                    e.mov8(at(&gba.cpu.cpsr.N), u8{0});
+                    e.mov8(at(&gba.cpu.cpsr.Z), static_cast<u8>(imm == 0));
+                    return true;
+                }
+                e.mov(RAX, reg(Rd));
+                e.alu(op == 2 ? ALU_ADD : ALU_SUB, RAX, imm);
+                set_nzcv(op != 2);
+                if (op != 1)
+                {
+                    e.mov(reg(Rd), RAX);
+                }
+                return true;
+            }
+
+            case 0b01000:
+                if (bit::is_set<10>(opcode))
+                {
+                    return thumb_hi_register_operations(opcode);
+                }
+                return thumb_alu(opcode);
+
+            // pc relative load
+            case 0b01001:
+                e.mov(RAX, mem::align<u32>(pc) + (bit::get_range<0, 7>(opcode) << 2));
+                thumb_load(bit::get_range<8, 10>(opcode), 4, false);
+                break;
+
+            // load / store with register offset, sign extended byte / halfword
+            case 0b01010:
+            case 0b01011: {
+                const auto op = bit::get_range<9, 11>(opcode);
+                const auto Rd = bit::get_range<0, 2>(opcode);
+                e.mov(RAX, reg(bit::get_range<3, 5>(opcode)));
+                e.alu(ALU_ADD, RAX, reg(bit::get_range<6, 8>(opcode)));
+                switch (op)
+                {
+                    case 0b000: thumb_store(Rd, 4); break; // str
+                    case 0b001: thumb_store(Rd, 2); break; // strh
+                    case 0b010: thumb_store(Rd, 1); break; // strb
+                    case 0b011: thumb_load(Rd, 1, true); break; // ldsb
+                    case 0b100: thumb_load(Rd, 4, false); break; // ldr
+                    case 0b101: thumb_load(Rd, 2, false); break; // ldrh
+                    case 0b110: thumb_load(Rd, 1, false); break; // ldrb
+                    case 0b111: // ldsh, misaligned is ldsb
+                        e.test(RAX, 1U);
+                        slow_if(CC_NE);
+                        thumb_load(Rd, 2, true);
+                        break;
+                }
+                break;
+            }
+
+            // load / store with immediate offset
+            case 0b01100:
+            case 0b01101:
+            case 0b01110:
+            case 0b01111: {
+                const auto B = bit::is_set<12>(opcode);
+                const auto offset = bit::get_range<6, 10>(opcode) << (B ? 0 : 2);
+                const auto Rd = bit::get_range<0, 2>(opcode);
+                e.mov(RAX, reg(bit::get_range<3, 5>(opcode)));
+                e.alu(ALU_ADD, RAX, offset);
+                if (bit::is_set<11>(opcode))
+                {
+                    thumb_load(Rd, B ? 1 : 4, false);
+                }
+                else
+                {
+                    thumb_store(Rd, B ? 1 : 4);
+                }
+                break;
+            }
+
+            // load / store halfword
+            case 0b10000:
+            case 0b10001: {
+                const auto Rd = bit::get_range<0, 2>(opcode);
+                e.mov(RAX, reg(bit::get_range<3, 5>(opcode)));
+                e.alu(ALU_ADD, RAX, bit::get_range<6, 10>(opcode) << 1);
+                if (bit::is_set<11>(opcode))
+                {
+                    thumb_load(Rd, 2, false);
+                }
+                else
+                {
+                    thumb_store(Rd, 2);
+                }
+                break;
+            }
+
+            // sp relative load / store
+            case 0b10010:
+            case 0b10011: {
+                const auto Rd = bit::get_range<8, 10>(opcode);
+                e.mov(RAX, reg(SP_INDEX));
+                e.alu(ALU_ADD, RAX, bit::get_range<0, 7>(opcode) << 2);
+                if (bit::is_set<11>(opcode))
+                {
+                    thumb_load(Rd, 4, false);
+                }
+                else
+                {
+                    thumb_store(Rd, 4);
+                }
+                break;
+            }
+
+            // load address
+            case 0b10100:
+                e.mov(reg(bit::get_range<8, 10>(opcode)), mem::align<u32>(pc) + (bit::get_range<0, 7>(opcode) << 2));
+                return true;
+
+            case 0b10101:
+                e.mov(RAX, reg(SP_INDEX));
+                e.alu(ALU_ADD, RAX, bit::get_range<0, 7>(opcode) << 2);
+                e.mov(reg(bit::get_range<8, 10>(opcode)), RAX);
+                return true;
+
+            // add offset to stack pointer, the rest is push / pop
+            case 0b10110:
+                if (bit::get_range<8, 10>(opcode))
+                {
+                    return false;
+                }
+                e.alu(bit::is_set<7>(opcode) ? ALU_SUB : ALU_ADD, reg(SP_INDEX), bit::get_range<0, 6>(opcode) << 2);
+                return true;
+
+            // conditional branch, 0xE is undefined and 0xF is swi
+            case 0b11010:
+            case 0b11011: {
+                const auto cond = bit::get_range<8, 11>(opcode);
+                if (cond >= COND_AL)
+                {
+                    return false;
+                }
+                const auto skip = skip_unless(cond);
+                branch(opcode, pc + (bit::sign_extend<8>(bit::get_range<0, 7>(opcode) << 1)));
+                Emitter::bind(skip, e.ptr);
+                known_region = false;
+                return true;
+            }
+
+            // unconditional branch
+            case 0b11100:
+                branch(opcode, pc + (bit::sign_extend<11>(bit::get_range<0, 10>(opcode) << 1)));
+                return true;
+
+            // long branch with link, the first half only sets lr
+            case 0b11110:
+                e.mov(reg(LR_INDEX), pc + bit::sign_extend<22>(bit::get_range<0, 10>(opcode) << 12));
+                return true;
+
+            default:
+                return false;
+        }
+
+        // loads / stores
+        bind_slow(opcode);
+        if (!bit::is_set<11>(opcode) || (opcode >> 12) == 0b0101)
+        {
+            check_version(false);
+        }
+        return true;
+    }
+
+    void translate_thumb(u32 opcode)
+    {
+        if (!thumb_native(opcode))
+        {
+            handler(opcode);
+        }
+    }
+
+    // returns the end of the code
+    auto run() -> u8*
+    {
+        const auto start = e.ptr;
+
+        e.push(RBX);
+        e.push(R12);
+        e.push(R13);
+        e.push(R14);
+        e.push(R15);
+        e.mov64(RBX, RDI);
+        e.mov64(R15, to_ptr(gba.block_cache->get_versions_address()));
+        reload();
+
+        entry = e.ptr;
+
+        // see execute_block() in thumb_table.cpp and arm_table.cpp
+        for (u32 i = 0; i < block.count; i++)
+        {
+            // out of space, exit after the last instruction
+            if (static_cast<std::size_t>(e.ptr - start) + MAX_INSTRUCTION_SIZE + MAX_EXITS_SIZE > MAX_BLOCK_SIZE)
+            {
+                exit_if_always(i - 1);
+                break;
+            }
+
+            index = i;
+            pc = block.addr + size * (i + 2);
+            fetch();
+
+            if (i == 0)
+            {
+                body = e.ptr;
+            }
+
+            if (thumb)
+            {
+                translate_thumb(block.opcodes[i]);
+            }
+            else
+            {
+                translate_arm(block.opcodes[i]);
+            }
+
+            if (i + 1 == block.count)
+            {
+                exit_if_always(i);
+            }
+            else
+            {
+                check_deadline(false);
+            }
+        }
+
+        // same as the fetch of the next instruction
+        u8* epilogue[BlockCache::MAX_INSTRUCTIONS + 1];
+        u32 epilogue_count = 0;
+
+        for (u32 i = 0; i < block.count; i++)
+        {
+            bool used = false;
+            for (u32 j = 0; j < exit_count; j++)
+            {
+                if (exits[j].index == i)
+                {
+                    Emitter::bind(exits[j].rel, e.ptr);
+                    used = true;
+                }
+            }
+
+            if (used)
+            {
+                store_state(i);
+                epilogue[epilogue_count++] = e.jmp();
+            }
+        }
+
+        for (u32 i = 0; i < epilogue_count; i++)
+        {
+            Emitter::bind(epilogue[i], e.ptr);
+        }
+        for (u32 j = 0; j < exit_count; j++)
+        {
+            if (exits[j].index == STORED)
+            {
+                Emitter::bind(exits[j].rel, e.ptr);
+            }
+        }
+
+        e.mov(ticks(), R12);
+        e.pop(R15);
+        e.pop(R14);
+        e.pop(R13);
+        e.pop(R12);
+        e.pop(RBX);
+        e.ret();
+
+        assert(static_cast<std::size_t>(e.ptr - start) <= MAX_BLOCK_SIZE);
+        return e.ptr;
+    }
+
+    void exit_if_always(u32 i)
+    {
+        assert(exit_count < std::size(exits));
+        exits[exit_count++] = {e.jmp(), i};
+    }
+};
+
+} // namespace
+
+Jit::~Jit()
+{
+    if (buffer)
+    {
+        munmap(buffer, BUFFER_SIZE);
+    }
+}
+
+void Jit::reset(bool enable)
+{
+    used = 0;
+
+    if (!enable && buffer)
+    {
+        munmap(buffer, BUFFER_SIZE);
+        buffer = nullptr;
+    }
+    else if (enable && !buffer)
+    {
+        auto ptr = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        buffer = ptr == MAP_FAILED ? nullptr : static_cast<u8*>(ptr);
+    }
+
+    enabled = enable && buffer;
+}
+
+auto Jit::compile(Gba& gba, const BlockCache::Block& block) -> CompiledFunction
+{
+    if (!enabled)
+    {
+        return nullptr;
+    }
+
+    // out of space, throw everything away and start again
+    if (used + MAX_BLOCK_SIZE > BUFFER_SIZE)
+    {
+        gba.block_cache->clear_compiled();
+        used = 0;
+    }
+
+    const auto start = buffer + used;
+    // the first page may hold the end of the last block
+    const auto pages_offset = used & ~std::size_t{HOST_PAGE_SIZE - 1};
+    const auto pages_size = ((used + MAX_BLOCK_SIZE + HOST_PAGE_SIZE - 1) & ~std::size_t{HOST_PAGE_SIZE - 1}) - pages_offset;
+
+    if (mprotect(buffer + pages_offset, pages_size, PROT_READ | PROT_WRITE))
+    {
+        return nullptr;
+    }
+
+    Translator translator{gba, block, start};
+    const auto end = translator.run();
+
+    // the earlier blocks in these pages can't be run either
+    if (mprotect(buffer + pages_offset, pages_size, PROT_READ | PROT_EXEC))
+    {
+        gba.block_cache->clear_compiled();
+        enabled = false;
+        return nullptr;
+    }
+
+    used += static_cast<std::size_t>(end - start);
+    return reinterpret_cast<CompiledFunction>(start);
+}
+
+#else
+
+Jit::~Jit() = default;
+
+void Jit::reset([[maybe_unused]] bool enable)
+{
+    used = 0;
+    enabled = false;
+}
+
+auto Jit::compile([[maybe_unused]] Gba& gba, [[maybe_unused]] const BlockCache::Block& block) -> CompiledFunction
+{
+    return nullptr;
+}
+
+#endif // JIT_X64
+
+} // namespace gba::arm7tdmi
@@ -0,0 +1,47 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// compiles hot blocks from the block cache into x86-64 code.
+// the alu, branch and load / store forms are translated to host code,
+// with loads / stores to ewram and iwram done inline. everything else
+// calls the handler directly, so the output is identical to the
+// cached interpreter.
+#pragma once
+
+#include "fwd.hpp"
+#include "arm7tdmi/block_cache.hpp"
+#include <cstddef>
+
+namespace gba::arm7tdmi {
+
+struct Jit
+{
+public:
+    enum : u16
+    {
+        // number of times a block is interpreted before it's compiled
+        HOT_THRESHOLD = 8,
+    };
+
+    Jit() = default;
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    auto operator=(const Jit&) -> Jit& = delete;
+
+    // call this on startup or to disable the jit.
+    // all previously compiled code is discarded.
+    void reset(bool enable);
+    // returns nullptr if the block cannot be compiled
+    [[nodiscard]] auto compile(Gba& gba, const BlockCache::Block& block) -> CompiledFunction;
+    // returns master enable flag
+    [[nodiscard]] auto is_enabled() const -> bool { return enabled; }
+
+private:
+    u8* buffer{};
+    std::size_t used{};
+    // master enable flag, false if the host is not supported
+    bool enabled{};
+};
+
+} // namespace gba::arm7tdmi
@@ -22,6 +22,7 @@
 #include "multiple_load_store.cpp"
 #include "software_interrupt.cpp"
 #include "arm7tdmi/arm7tdmi.hpp"
+#include "arm7tdmi/block_cache.hpp"
 #include "gba.hpp"
 #include "log.hpp"
 #include <cassert>
@@ -351,17 +352,125 @@ auto fetch(Gba& gba)
     return opcode;
 }
 
+constexpr auto func_table = []<std::size_t ...I>(std::index_sequence<I...>)
+{
+    return std::array{fill_table<I>()...};
+}(std::make_index_sequence<1024>());
+
+auto execute_interpreter(Gba& gba) -> void
+{
+    // run until the budget runs out, see Scheduler::should_fire().
+    // switching to arm state ends the budget early.
+    do
+    {
+        const auto opcode = fetch(gba);
+        func_table[opcode >> 6](gba, opcode);
+    } while (!gba.scheduler.should_fire());
+}
+
+[[nodiscard]]
+auto decode_block(Gba& gba, u32 addr) -> BlockCache::Block*
+{
+    auto block = gba.block_cache->create(gba, addr, State::THUMB);
+
+    if (block)
+    {
+        for (u32 i = 0; i < block->count; i++)
+        {
+            block->thumb[i] = func_table[block->opcodes[i] >> 6];
+        }
+    }
+
+    return block;
+}
+
+// same as fetch(), but the prefetched opcode comes from the block and the
+// wait states are charged for the region the block was decoded from.
+// exits early on branches, events and writes to the block's page.
+auto execute_block(Gba& gba, const BlockCache::Block& block) -> void
+{
+    const auto region = block.region;
+    u32 pc = CPU.registers[PC_INDEX];
+
+    for (u32 i = 0; i < block.count; i++)
+    {
+        pc += 2;
+        CPU.pipeline[0] = CPU.pipeline[1];
+        CPU.pipeline[1] = block.opcodes[i + 2];
+        CPU.registers[PC_INDEX] = pc;
+
+        const auto new_region = mem::is_new_region(gba.last_region, region);
+        gba.last_region = region;
+        gba.scheduler.tick(gba.timing_table_16[new_region][region]);
+
+        block.thumb[i](gba, block.opcodes[i]);
+
+        if (CPU.registers[PC_INDEX] != pc || gba.scheduler.should_fire() || !gba.block_cache->is_valid(block))
+        {
+            break;
+        }
+    }
+}
+
+auto execute_cached(Gba& gba) -> void
+{
+    do
+    {
+        const auto addr = get_pc(gba) - 2;
+
+        // bios and vram can't be cached, so the rest of the budget is
+        // interpreted rather than looking up a block per instruction.
+        if (!BlockCache::is_cacheable(addr)) [[unlikely]]
+        {
+            execute_interpreter(gba);
+            return;
+        }
+
+        auto block = gba.block_cache->find(gba.rmap, addr, State::THUMB);
+
+        if (!block)
+        {
+            block = decode_block(gba, addr);
+        }
+
+        // the pipeline may hold opcodes that were fetched before
+        // the block was written to.
+        if (block && CPU.pipeline[0] == block->opcodes[0] && CPU.pipeline[1] == block->opcodes[1]) [[likely]]
+        {
+            if (block->compiled)
+            {
+                block->compiled(gba);
+            }
+            else
+            {
+                execute_block(gba, *block);
+
+                if (gba.jit.is_enabled() && ++block->hits == Jit::HOT_THRESHOLD)
+                {
+                    block->compiled = gba.jit.compile(gba, *block);
+                }
+            }
+        }
+        else
+        {
+            const auto opcode = fetch(gba);
+            func_table[opcode >> 6](gba, opcode);
+        }
+    } while (!gba.scheduler.should_fire());
+}
+
 } // namespace
 
 auto execute(Gba& gba) -> void
 {
-    static constexpr auto func_table = []<std::size_t ...I>(std::index_sequence<I...>)
+    if (gba.block_cache)
     {
-        return std::array{fill_table<I>()...};
-    }(std::make_index_sequence<1024>());
-
-    const auto opcode = fetch(gba);
-    func_table[opcode >> 6](gba, opcode);
+        execute_cached(gba);
+    }
+    else
+    {
+        execute_interpreter(gba);
+    }
 }
 
 } // namespace gba::arm7tdmi::thumb
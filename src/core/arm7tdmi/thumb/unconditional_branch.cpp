@@ -14,7 +14,10 @@ auto unconditional_branch(Gba& gba, const u16 opcode) -> void
     auto offset11 = bit::get_range<0, 10>(opcode) << 1;
     offset11 = bit::sign_extend<11>(offset11);
 
-    set_pc(gba, get_pc(gba) + offset11);
+    const auto pc = get_pc(gba);
+    const u32 new_pc = pc + offset11;
+    set_pc(gba, new_pc);
+    gba.waitloop.on_thumb_loop(gba, pc, new_pc);
 }
 
 } // namespace
@@ -6,9 +6,14 @@
 #include "bios_hle.hpp"
 #include "arm7tdmi/arm7tdmi.hpp"
 #include "mem.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
+#include <numbers>
+#include <type_traits>
 
 namespace gba::bios {
 namespace {
@@ -91,6 +96,73 @@ constexpr const char* SWI_STR[0xFF] =
 
 // https://problemkaputt.de/gbatek.htm#biosarithmeticfunctions
 
+// swi's handled here don't enter the bios, so the cycles that the bios
+// would've spent running its own code are ticked with idle() instead.
+// memory accesses are already ticked by mem::read / write.
+// the numbers are measured against the bundled bios.
+enum : s32
+{
+    // exception entry, swi table lookup and return
+    CYCLES_SWI = 60,
+};
+
+// 1.14 fixed point, sin(i * 2pi / 256), same as the table in the bios
+const std::array<s16, 256> SINE_TABLE = []()
+{
+    std::array<s16, 256> table{};
+
+    for (u32 i = 0; i < table.size(); i++)
+    {
+        table[i] = static_cast<s16>(std::sin(i * 2.0 * std::numbers::pi / 256.0) * 0x4000);
+    }
+
+    return table;
+}();
+
+auto idle(Gba& gba, s32 cycles) -> void
+{
+    gba.scheduler.tick(cycles);
+}
+
+// the bios won't read from itself, or from past the end of the bus
+// (it returns junk). these are left to the bios.
+auto is_valid_source(u32 src, u32 size) -> bool
+{
+    return src >= 0x02000000 && src < 0x0F000000 && size < 0x0F000000 - src;
+}
+
+// the Write16bit functions write a halfword for every 2 bytes,
+// as vram can't be written 8bit at a time.
+template<bool Write16>
+struct ByteWriter
+{
+    Gba& gba;
+    u32 dst;
+    u16 halfword{};
+
+    auto write(u8 data) -> void
+    {
+        if constexpr(Write16)
+        {
+            if (dst & 1)
+            {
+                halfword |= data << 8;
+                mem::write16(gba, dst ^ 1, halfword);
+            }
+            else
+            {
+                halfword = data;
+            }
+        }
+        else
+        {
+            mem::write8(gba, dst, data);
+        }
+
+        dst++;
+    }
+};
+
 // 0x2
 auto Halt(Gba& gba) -> bool
 {
@@ -98,24 +170,172 @@ auto Halt(Gba& gba) -> bool
     return true;
 }
 
+// see Arm7tdmi::intr_wait
+enum IntrWaitState : u8
+{
+    INTR_WAIT_NONE,
+    // the next run of the swi halts
+    INTR_WAIT_HALT,
+    // the next run of the swi checks the flags, halting again if none are set
+    INTR_WAIT_CHECK,
+};
+
+// shared by IntrWait and VBlankIntrWait.
+// rather than running the bios loop, the swi is left as the next
+// instruction and the cpu is halted. the irq that exits the halt then
+// returns to the swi, which is run again to check the flags.
+auto intr_wait(Gba& gba, bool discard, u16 flags, arm7tdmi::HaltType type) -> bool
+{
+    // set by the game's irq handler
+    constexpr u32 INTR_CHECK_ADDR = 0x03007FF8;
+
+    // the irq can't be taken, the bios would hang here
+    if (!REG_IE || gba.cpu.cpsr.I)
+    {
+        gba.cpu.intr_wait = INTR_WAIT_NONE;
+        return false;
+    }
+
+    const auto is_irq_pending = [&gba]()
+    {
+        return REG_IE & REG_IF & 0x3FFF;
+    };
+
+    // the bios sets ime whenever it touches the flags, so it's left
+    // as is for the first halt if they're not discarded.
+    auto set_ime = true;
+
+    switch (gba.cpu.intr_wait)
+    {
+        case INTR_WAIT_NONE:
+            // swi entry and the setup before the first halt
+            idle(gba, discard ? 67 : 50);
+            if (discard)
+            {
+                const auto check = mem::read16(gba, INTR_CHECK_ADDR);
+                mem::write16(gba, INTR_CHECK_ADDR, check & ~flags);
+            }
+            else
+            {
+                set_ime = false;
+            }
+            gba.cpu.intr_wait = INTR_WAIT_HALT;
+            break;
+
+        case INTR_WAIT_HALT:
+            break;
+
+        case INTR_WAIT_CHECK:
+            // the irq that exited the halt is taken before the flags are checked
+            if ((REG_IME & 1) && is_irq_pending())
+            {
+                break;
+            }
+
+            if (const auto check = mem::read16(gba, INTR_CHECK_ADDR); check & flags)
+            {
+                mem::write16(gba, INTR_CHECK_ADDR, check & ~flags);
+                REG_IME = 1;
+                arm7tdmi::schedule_interrupt(gba);
+                arm7tdmi::set_reg(gba, 0, flags);
+                arm7tdmi::set_reg(gba, 1, check & flags);
+                gba.cpu.intr_wait = INTR_WAIT_NONE;
+                // the check and the swi return
+                idle(gba, 36);
+                return true;
+            }
+
+            gba.cpu.intr_wait = INTR_WAIT_HALT;
+            break;
+    }
+
+    // run the swi again once the irq returns
+    const auto thumb = arm7tdmi::get_state(gba) == arm7tdmi::State::THUMB;
+    arm7tdmi::set_pc(gba, arm7tdmi::get_pc(gba) - (thumb ? 4 : 8));
+
+    if (set_ime)
+    {
+        REG_IME = 1;
+        arm7tdmi::schedule_interrupt(gba);
+    }
+
+    if (gba.cpu.intr_wait == INTR_WAIT_HALT)
+    {
+        if (!is_irq_pending())
+        {
+            gba.cpu.intr_wait = INTR_WAIT_CHECK;
+            arm7tdmi::on_halt_trigger(gba, type);
+        }
+        // with ime clear, the halt exits straight away.
+        // otherwise the irq is taken first and the bios halts after.
+        else if (!(REG_IME & 1))
+        {
+            gba.cpu.intr_wait = INTR_WAIT_CHECK;
+        }
+    }
+
+    return true;
+}
+
+// 0x4
+auto IntrWait(Gba& gba) -> bool
+{
+    const auto discard = arm7tdmi::get_reg(gba, 0) != 0;
+    const auto flags = arm7tdmi::get_reg(gba, 1);
+
+    return intr_wait(gba, discard, flags, arm7tdmi::HaltType::hle_int_halt);
+}
+
+// 0x5
+auto VBlankIntrWait(Gba& gba) -> bool
+{
+    return intr_wait(gba, true, 1, arm7tdmi::HaltType::hle_vblank_halt);
+}
+
+// shared by Div and DivArm
+auto div(Gba& gba, s32 number, s32 denom) -> bool
+{
+    if (denom == 0)
+    {
+        return false; // the bios loops forever
+    }
+
+    // done unsigned so that INT_MIN / -1 doesn't overflow
+    const auto n = number < 0 ? 0U - number : static_cast<u32>(number);
+    const auto d = denom < 0 ? 0U - denom : static_cast<u32>(denom);
+    const auto quot = n / d;
+    const auto rem = n % d;
+
+    arm7tdmi::set_reg(gba, 0, (number < 0) != (denom < 0) ? 0U - quot : quot);
+    arm7tdmi::set_reg(gba, 1, number < 0 ? 0U - rem : rem);
+    arm7tdmi::set_reg(gba, 3, quot);
+
+    // the bios divides a bit at a time
+    idle(gba, 14 + 14 * std::bit_width(quot));
+    return true;
+}
+
 // 0x6
 auto Div(Gba& gba) -> bool
 {
     const s32 number = arm7tdmi::get_reg(gba, 0);
     const s32 denom = arm7tdmi::get_reg(gba, 1);
+    return div(gba, number, denom);
+}
+
+// 0x7
+auto DivArm(Gba& gba) -> bool
+{
+    const s32 denom = arm7tdmi::get_reg(gba, 0);
+    const s32 number = arm7tdmi::get_reg(gba, 1);
 
-    if (number == 0 || denom == 0)
+    if (!div(gba, number, denom))
     {
-        return false; // don't handle edge cases
+        return false;
     }
 
-    const auto result = std::div(number, denom);
-    const auto is_signed = result.quot < 0 ? -1 : 1;
-
-    arm7tdmi::set_reg(gba, 0, result.quot);
-    arm7tdmi::set_reg(gba, 1, result.rem);
-    arm7tdmi::set_reg(gba, 3, result.quot * is_signed);
-
+    // swapping the args
+    idle(gba, 6);
     return true;
 }
 
@@ -124,6 +344,78 @@ auto Sqrt(Gba& gba) -> bool
 {
     const u32 number = arm7tdmi::get_reg(gba, 0);
     const u16 result = std::sqrt(number);
+    arm7tdmi::set_reg(gba, 0, result);
+    idle(gba, 73);
+    return true;
+}
+
+// polynomial approximation, tan is 1.14 fixed point
+auto arctan(s32 tan) -> s32
+{
+    const auto a = -((tan * tan) >> 14);
+    auto b = ((0xA9 * a) >> 14) + 0x390;
+    b = ((b * a) >> 14) + 0x91C;
+    b = ((b * a) >> 14) + 0xFB6;
+    b = ((b * a) >> 14) + 0x16AA;
+    b = ((b * a) >> 14) + 0x2081;
+    b = ((b * a) >> 14) + 0x3651;
+    b = ((b * a) >> 14) + 0xA2F9;
+    return (tan * b) >> 16;
+}
+
+// 0x9
+auto ArcTan(Gba& gba) -> bool
+{
+    const s32 tan = arm7tdmi::get_reg(gba, 0);
+    arm7tdmi::set_reg(gba, 0, arctan(tan));
+    idle(gba, 50);
+    return true;
+}
+
+// 0xA
+auto ArcTan2(Gba& gba) -> bool
+{
+    const s32 x = arm7tdmi::get_reg(gba, 0);
+    const s32 y = arm7tdmi::get_reg(gba, 1);
+    // 0x0000 - 0xFFFF is 0 - 2pi
+    s32 result;
+
+    // the rest calls Div and ArcTan
+    const auto divide = [&gba](s32 number, s32 denom)
+    {
+        const auto quot = number / denom;
+        idle(gba, 102 + 14 * std::bit_width(static_cast<u32>(std::abs(quot))));
+        return quot;
+    };
+
+    idle(gba, 14);
+
+    if (y == 0)
+    {
+        result = x < 0 ? 0x8000 : 0;
+    }
+    else if (x == 0)
+    {
+        result = y < 0 ? 0xC000 : 0x4000;
+    }
+    else if (std::abs(x) > std::abs(y) || (std::abs(x) == std::abs(y) && !(x < 0 && y < 0)))
+    {
+        result = arctan(divide(y << 14, x));
+
+        if (x < 0)
+        {
+            result += 0x8000;
+        }
+        else if (y < 0)
+        {
+            result += 0x10000;
+        }
+    }
+    else
+    {
+        result = (y < 0 ? 0xC000 : 0x4000) - arctan(divide(x << 14, y));
+    }
+
     arm7tdmi::set_reg(gba, 0, result);
     return true;
 }
@@ -141,6 +433,13 @@ auto CpuSet(Gba& gba) -> bool
     const auto mode = bit::is_set<24>(r2);
     const auto width = bit::is_set<26>(r2);
 
+    if (!is_valid_source(src, len << (width + 1)))
+    {
+        return false;
+    }
+
+    idle(gba, 20 + (mode ? 5 : 10) * len);
+
     const auto func = [&gba, &src, &dst, &len, mode](auto read, auto write, auto inc)
     {
         if (mode == 0) // copy
@@ -186,25 +485,481 @@ auto CpuSet(Gba& gba) -> bool
     return true;
 }
 
+// 0xC
+auto CpuFastSet(Gba& gba) -> bool
+{
+    const auto r2 = arm7tdmi::get_reg(gba, 2);
+
+    auto src = mem::align<u32>(arm7tdmi::get_reg(gba, 0));
+    auto dst = mem::align<u32>(arm7tdmi::get_reg(gba, 1));
+    // always done in blocks of 8 words
+    auto len = (bit::get_range<0, 20>(r2) + 7) & ~7;
+    const auto mode = bit::is_set<24>(r2);
+
+    if (!is_valid_source(src, len * 4))
+    {
+        return false;
+    }
+
+    // the bios copies 8 words at a time
+    idle(gba, 16 + (mode ? 44 : 84) * (len / 8));
+
+    if (mode == 0) // copy
+    {
+        for (; len; len--, src += 4, dst += 4)
+        {
+            mem::write32(gba, dst, mem::read32(gba, src));
+        }
+    }
+    else // fill
+    {
+        const auto data = mem::read32(gba, src);
+        src += 4;
+
+        for (; len; len--, dst += 4)
+        {
+            mem::write32(gba, dst, data);
+        }
+    }
+
+    arm7tdmi::set_reg(gba, 0, src);
+    arm7tdmi::set_reg(gba, 1, dst);
+    return true;
+}
+
+// 0xE
+auto BgAffineSet(Gba& gba) -> bool
+{
+    auto src = arm7tdmi::get_reg(gba, 0);
+    auto dst = arm7tdmi::get_reg(gba, 1);
+    const auto count = arm7tdmi::get_reg(gba, 2);
+
+    for (u32 i = 0; i < count; i++, src += 20, dst += 16)
+    {
+        // centre of the bg (8.8), centre of the screen, scale (8.8), angle (8.8)
+        const s32 ox = mem::read32(gba, src + 0);
+        const s32 oy = mem::read32(gba, src + 4);
+        const s16 dx = mem::read16(gba, src + 8);
+        const s16 dy = mem::read16(gba, src + 10);
+        const s16 sx = mem::read16(gba, src + 12);
+        const s16 sy = mem::read16(gba, src + 14);
+        const u8 theta = mem::read16(gba, src + 16) >> 8;
+
+        const s32 sin = SINE_TABLE[theta];
+        const s32 cos = SINE_TABLE[(theta + 0x40) & 0xFF];
+
+        const s16 pa = (sx * cos) >> 14;
+        const s16 pb = -((sx * sin) >> 14);
+        const s16 pc = (sy * sin) >> 14;
+        const s16 pd = (sy * cos) >> 14;
+
+        mem::write16(gba, dst + 0, pa);
+        mem::write16(gba, dst + 2, pb);
+        mem::write16(gba, dst + 4, pc);
+        mem::write16(gba, dst + 6, pd);
+        mem::write32(gba, dst + 8, ox - (pa * dx + pb * dy));
+        mem::write32(gba, dst + 12, oy - (pc * dx + pd * dy));
+    }
+
+    idle(gba, 14 + 96 * count);
+    return true;
+}
+
+// 0xF
+auto ObjAffineSet(Gba& gba) -> bool
+{
+    auto src = arm7tdmi::get_reg(gba, 0);
+    auto dst = arm7tdmi::get_reg(gba, 1);
+    const auto count = arm7tdmi::get_reg(gba, 2);
+    // 2 for bg, 8 for oam
+    const auto offset = arm7tdmi::get_reg(gba, 3);
+
+    for (u32 i = 0; i < count; i++, src += 8, dst += offset * 4)
+    {
+        const s16 sx = mem::read16(gba, src + 0);
+        const s16 sy = mem::read16(gba, src + 2);
+        const u8 theta = mem::read16(gba, src + 4) >> 8;
+
+        const s32 sin = SINE_TABLE[theta];
+        const s32 cos = SINE_TABLE[(theta + 0x40) & 0xFF];
+
+        mem::write16(gba, dst + offset * 0, (sx * cos) >> 14);
+        mem::write16(gba, dst + offset * 1, -((sx * sin) >> 14));
+        mem::write16(gba, dst + offset * 2, (sy * sin) >> 14);
+        mem::write16(gba, dst + offset * 3, (sy * cos) >> 14);
+    }
+
+    idle(gba, 17 + 50 * count);
+    return true;
+}
+
+// https://problemkaputt.de/gbatek.htm#biosdecompressionfunctions
+
+// 0x10
+auto BitUnPack(Gba& gba) -> bool
+{
+    auto src = arm7tdmi::get_reg(gba, 0);
+    auto dst = arm7tdmi::get_reg(gba, 1);
+    const auto info = arm7tdmi::get_reg(gba, 2);
+
+    const auto len = mem::read16(gba, info + 0);
+    const auto src_width = mem::read8(gba, info + 2);
+    const auto dst_width = mem::read8(gba, info + 3);
+    const auto data_offset = mem::read32(gba, info + 4);
+    const auto offset = bit::get_range<0, 30>(data_offset);
+    const auto zero_flag = bit::is_set<31>(data_offset);
+
+    if (!std::has_single_bit(src_width) || src_width > 8 ||
+        !std::has_single_bit(dst_width) || dst_width > 32 ||
+        !is_valid_source(src, len))
+    {
+        return false;
+    }
+
+    const auto mask = (1U << src_width) - 1;
+    u32 data = 0;
+    u32 bits = 0;
+
+    for (u32 i = 0; i < len; i++)
+    {
+        const auto byte = mem::read8(gba, src++);
+
+        for (u32 shift = 0; shift < 8; shift += src_width)
+        {
+            auto unit = (byte >> shift) & mask;
+
+            if (unit || zero_flag)
+            {
+                unit += offset;
+            }
+
+            data |= unit << bits;
+            bits += dst_width;
+
+            if (bits == 32)
+            {
+                mem::write32(gba, dst, data);
+                dst += 4;
+                data = 0;
+                bits = 0;
+            }
+        }
+    }
+
+    idle(gba, 52 + 7 * len + 26 * len * (8 / src_width));
+    return true;
+}
+
+// 0x11, 0x12
+template<bool Write16>
+auto LZ77UnComp(Gba& gba) -> bool
+{
+    auto src = arm7tdmi::get_reg(gba, 0);
+    ByteWriter<Write16> writer{gba, arm7tdmi::get_reg(gba, 1)};
+
+    if (!is_valid_source(src, 4))
+    {
+        return false;
+    }
+
+    auto len = mem::read32(gba, src) >> 8;
+    src += 4;
+
+    // the cycles of each path through the bios' loop. the bios has a
+    // faster loop for a group of 8 literals (flags == 0), the last item
+    // of a group doesn't take the branch back, and the item that finishes
+    // the data exits from the middle of its path.
+    // the bios is slower writing 16bit as it has to buffer the byte.
+    constexpr s32 ENTRY_CYCLES = Write16 ? 20 : 7;
+    constexpr s32 EXIT_CYCLES = Write16 ? 13 : 10;
+    constexpr s32 FLAG_CYCLES = 6;
+    constexpr s32 FAST_FLAG_CYCLES = 9;
+    // after the 8th item, less the branch back that it doesn't take
+    constexpr s32 GROUP_END_CYCLES = 3;
+    constexpr s32 FAST_GROUP_END_CYCLES = 2;
+    constexpr s32 LITERAL_CYCLES = Write16 ? 22 : 16;
+    constexpr s32 LITERAL_END_CYCLES = Write16 ? 18 : 11;
+    constexpr s32 FAST_LITERAL_CYCLES = Write16 ? 17 : 9;
+    constexpr s32 FAST_LITERAL_END_CYCLES = Write16 ? 15 : 7;
+    constexpr s32 BLOCK_CYCLES = Write16 ? 29 : 28;
+    constexpr s32 BLOCK_END_CYCLES = Write16 ? 19 : 18;
+    constexpr s32 BYTE_CYCLES = Write16 ? 20 : 12;
+    idle(gba, ENTRY_CYCLES + EXIT_CYCLES);
+
+    while (len)
+    {
+        const auto flags = mem::read8(gba, src++);
+        const auto fast = flags == 0;
+        idle(gba, fast ? FAST_FLAG_CYCLES : FLAG_CYCLES);
+
+        for (u32 i = 0; i < 8 && len; i++)
+        {
+            s32 cycles = 0;
+            s32 end_cycles = 0;
+
+            if (flags & (0x80 >> i)) // compressed
+            {
+                const auto hi = mem::read8(gba, src++);
+                const auto lo = mem::read8(gba, src++);
+                const auto disp = (((hi & 0xF) << 8) | lo) + 1;
+                const auto count = std::min<u32>((hi >> 4) + 3, len);
+
+                for (u32 j = 0; j < count; j++)
+                {
+                    writer.write(mem::read8(gba, writer.dst - disp));
+                }
+
+                cycles = BLOCK_CYCLES + BYTE_CYCLES * count;
+                end_cycles = BLOCK_END_CYCLES + BYTE_CYCLES * count;
+                len -= count;
+            }
+            else // uncompressed
+            {
+                writer.write(mem::read8(gba, src++));
+                cycles = fast ? FAST_LITERAL_CYCLES : LITERAL_CYCLES;
+                end_cycles = fast ? FAST_LITERAL_END_CYCLES : LITERAL_END_CYCLES;
+                len--;
+            }
+
+            if (!len)
+            {
+                idle(gba, end_cycles);
+            }
+            else if (i == 7)
+            {
+                idle(gba, cycles + (fast ? FAST_GROUP_END_CYCLES : GROUP_END_CYCLES));
+            }
+            else
+            {
+                idle(gba, cycles);
+            }
+        }
+    }
+
+    return true;
+}
+
+// 0x13
+auto HuffUnCompReadNormal(Gba& gba) -> bool
+{
+    auto src = arm7tdmi::get_reg(gba, 0);
+    auto dst = arm7tdmi::get_reg(gba, 1);
+
+    if (!is_valid_source(src, 4))
+    {
+        return false;
+    }
+
+    const auto header = mem::read32(gba, src);
+    const auto bits = bit::get_range<0, 3>(header);
+    auto len = header >> 8;
+
+    if (bits != 4 && bits != 8)
+    {
+        return false;
+    }
+
+    // the tree follows the header, the size is in halfwords - 1
+    const auto tree = src + 5;
+    src += 4 + (mem::read8(gba, src + 4) + 1) * 2;
+
+    auto node_addr = tree;
+    auto node = mem::read8(gba, node_addr);
+    u32 data = 0;
+    u32 data_bits = 0;
+
+    // per bit of the stream, and per unit of data
+    constexpr s32 BIT_CYCLES = 25;
+    const s32 data_cycles = bits == 4 ? 16 : 4;
+    idle(gba, 47);
+
+    while (len)
+    {
+        const auto stream = mem::read32(gba, src);
+        src += 4;
+
+        for (u32 i = 0; i < 32 && len; i++)
+        {
+            // each node has 2 children, either another node or data
+            const auto right = bit::is_set(stream, 31 - i);
+            idle(gba, BIT_CYCLES);
+            const auto next = (node_addr & ~1) + bit::get_range<0, 5>(node) * 2 + 2 + right;
+
+            if (!bit::is_set(node, 7 - right))
+            {
+                node_addr = next;
+                node = mem::read8(gba, node_addr);
+                continue;
+            }
+
+            data |= (mem::read8(gba, next) & ((1U << bits) - 1)) << data_bits;
+            data_bits += bits;
+            idle(gba, data_cycles);
+            node_addr = tree;
+            node = mem::read8(gba, node_addr);
+
+            if (data_bits == 32)
+            {
+                mem::write32(gba, dst, data);
+                dst += 4;
+                len = len > 4 ? len - 4 : 0;
+                data = 0;
+                data_bits = 0;
+            }
+        }
+    }
+
+    return true;
+}
+
+// 0x14, 0x15
+template<bool Write16>
+auto RLUnComp(Gba& gba) -> bool
+{
+    auto src = arm7tdmi::get_reg(gba, 0);
+    ByteWriter<Write16> writer{gba, arm7tdmi::get_reg(gba, 1)};
+
+    if (!is_valid_source(src, 4))
+    {
+        return false;
+    }
+
+    auto len = mem::read32(gba, src) >> 8;
+    src += 4;
+
+    constexpr s32 FLAG_CYCLES = Write16 ? 17 : 15;
+    constexpr s32 RUN_CYCLES = Write16 ? 18 : 8;
+    constexpr s32 LITERAL_CYCLES = Write16 ? 18 : 10;
+    idle(gba, Write16 ? 17 : 5);
+
+    while (len)
+    {
+        const auto flag = mem::read8(gba, src++);
+        idle(gba, FLAG_CYCLES);
+
+        if (flag & 0x80) // compressed
+        {
+            const auto count = std::min<u32>((flag & 0x7F) + 3, len);
+            const auto data = mem::read8(gba, src++);
+
+            for (u32 i = 0; i < count; i++)
+            {
+                writer.write(data);
+            }
+
+            idle(gba, RUN_CYCLES * count);
+            len -= count;
+        }
+        else // uncompressed
+        {
+            const auto count = std::min<u32>((flag & 0x7F) + 1, len);
+
+            for (u32 i = 0; i < count; i++)
+            {
+                writer.write(mem::read8(gba, src++));
+            }
+
+            idle(gba, LITERAL_CYCLES * count);
+            len -= count;
+        }
+    }
+
+    return true;
+}
+
+// 0x16, 0x17, 0x18
+template<typename In, bool Write16>
+auto DiffUnFilter(Gba& gba) -> bool
+{
+    auto src = arm7tdmi::get_reg(gba, 0);
+    auto dst = arm7tdmi::get_reg(gba, 1);
+
+    if (!is_valid_source(src, 4))
+    {
+        return false;
+    }
+
+    const auto len = mem::read32(gba, src) >> 8;
+    src += 4;
+
+    In data = 0;
+    ByteWriter<Write16> writer{gba, dst};
+
+    for (u32 i = 0; i < len; i += sizeof(In), src += sizeof(In))
+    {
+        if constexpr(std::is_same<In, u8>())
+        {
+            data += mem::read8(gba, src);
+            writer.write(data);
+        }
+        else
+        {
+            data += mem::read16(gba, src);
+            mem::write16(gba, dst + i, data);
+        }
+    }
+
+    constexpr s32 UNIT_CYCLES = sizeof(In) == 2 ? 10 : Write16 ? 20 : 9;
+    idle(gba, UNIT_CYCLES * (len / sizeof(In)));
+    return true;
+}
+
 } // namespace
 
 auto hle(Gba& gba, u8 comment_field) -> bool
 {
-    // return false;
+    if (!gba.bios_hle)
+    {
+        return false;
+    }
+
     //gba_log("[SWI] comment_field: %u %s\n", comment_field, SWI_STR[comment_field]);
 
+    // these are run again after every irq whilst waiting,
+    // so they tick their own cycles.
     switch (comment_field)
     {
-        // case 0x02: return Halt(gba);
-        // case 0x06: return Div(gba);
-        case 0x08: return Sqrt(gba);
-        case 0x0B: return CpuSet(gba);
+        case 0x04: return IntrWait(gba);
+        case 0x05: return VBlankIntrWait(gba);
+    }
+
+    const auto handled = [&gba, comment_field]()
+    {
+        switch (comment_field)
+        {
+            // case 0x02: return Halt(gba);
+            case 0x06: return Div(gba);
+            case 0x07: return DivArm(gba);
+            case 0x08: return Sqrt(gba);
+            case 0x09: return ArcTan(gba);
+            case 0x0A: return ArcTan2(gba);
+            case 0x0B: return CpuSet(gba);
+            case 0x0C: return CpuFastSet(gba);
+            case 0x0E: return BgAffineSet(gba);
+            case 0x0F: return ObjAffineSet(gba);
+            case 0x10: return BitUnPack(gba);
+            case 0x11: return LZ77UnComp<false>(gba);
+            case 0x12: return LZ77UnComp<true>(gba);
+            case 0x13: return HuffUnCompReadNormal(gba);
+            case 0x14: return RLUnComp<false>(gba);
+            case 0x15: return RLUnComp<true>(gba);
+            case 0x16: return DiffUnFilter<u8, false>(gba);
+            case 0x17: return DiffUnFilter<u8, true>(gba);
+            case 0x18: return DiffUnFilter<u16, true>(gba);
 
-        default:
-            // std::printf("[BIOS-HLE] unhandled: 0x%02X %s\n", comment_field, SWI_STR[comment_field]);
-            //assert(0 && "unhandled swi");
-            return false;
+            default:
+                // std::printf("[BIOS-HLE] unhandled: 0x%02X %s\n", comment_field, SWI_STR[comment_field]);
+                //assert(0 && "unhandled swi");
+                return false;
+        }
+    }();
+
+    if (handled)
+    {
+        idle(gba, CYCLES_SWI);
     }
+
+    return handled;
 }
 
 } // namespace gba::bios
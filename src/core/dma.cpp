@@ -236,7 +236,7 @@ auto get_read_data(Gba& gba, u32 addr) -> RW
             }
             else
             {
-                src.ptr = gba.rom;
+                src.ptr = const_cast<u8*>(gba.rom); // only read from
                 src.size = mem::ROM_SIZE;
                 src.addr = addr & mem::ROM_MASK;
                 src.type = DMA_TYPE_NORMAL;
@@ -387,6 +387,38 @@ enum DmaTransfer
     DMA_TRANSFER_UNKNOWN,
 };
 
+// vram, pram and oam are written to directly, so anything caching them has to be told here.
+// this is done after each run rather than up front, as the events fired
+// between runs may render a line, which would cache a partial transfer.
+void on_fast_dma_write(Gba& gba, const RW& dst, u32 addr, u32 size)
+{
+    // dst is always an array within mem
+    gba.dirty_pages.set_range(dst.ptr + addr - reinterpret_cast<const u8*>(&gba.mem), size);
+
+    if (dst.ptr == gba.mem.vram)
+    {
+        gba.tile_cache.on_write_range(addr, size);
+        gba.render_thread.on_write(0x6, addr, size);
+    }
+    else if (dst.ptr == gba.mem.pram)
+    {
+        gba.render_thread.on_write(0x5, addr, size);
+    }
+    else if (dst.ptr == gba.mem.oam)
+    {
+        gba.obj_cache.dirty = true;
+        gba.render_thread.on_write(0x7, addr, size);
+    }
+}
+
+// copies a single unit, memory is stored as little-endian bytes
+// so this is the same on every host.
+template<typename T>
+void copy_unit(u8* dst, const u8* src)
+{
+    std::memcpy(dst, src, sizeof(T));
+}
+
 template<typename T, s8 src_inc, s8 dst_inc>
 void fast_dma_copy(Gba& gba, Channel& dma, RW src, RW dst)
 {
@@ -397,22 +429,32 @@ void fast_dma_copy(Gba& gba, Channel& dma, RW src, RW dst)
     do {
         const u32 event_cycles = std::max<u32>(1, gba.scheduler.get_next_event_cycles() / total_cycles);
         const u32 run_length = std::min<u32>(event_cycles, len_end - len);
+        const u32 run_addr = dst.addr;
 
-        for (u32 i = 0; i < run_length; i++)
-        {
-            dst.ptr[dst.addr + 0] = src.ptr[src.addr + 0];
-            dst.ptr[dst.addr + 1] = src.ptr[src.addr + 1];
+        const u32 run_size = run_length * sizeof(T);
 
-            if constexpr(std::is_same<T, u32>())
+        // the dma copies a unit at a time, so if the dst overlaps
+        // after the src, the copied data is copied again. memmove
+        // is the same in every other case.
+        if (src_inc > 0 && dst_inc > 0 && (src.ptr != dst.ptr || dst.addr <= src.addr || dst.addr >= src.addr + run_size))
+        {
+            std::memmove(dst.ptr + dst.addr, src.ptr + src.addr, run_size);
+            src.addr += run_size;
+            dst.addr += run_size;
+        }
+        else
+        {
+            for (u32 i = 0; i < run_length; i++)
             {
-                dst.ptr[dst.addr + 2] = src.ptr[src.addr + 2];
-                dst.ptr[dst.addr + 3] = src.ptr[src.addr + 3];
+                copy_unit<T>(dst.ptr + dst.addr, src.ptr + src.addr);
+                src.addr += sizeof(T) * src_inc;
+                dst.addr += sizeof(T) * dst_inc;
             }
-
-            src.addr += sizeof(T) * src_inc;
-            dst.addr += sizeof(T) * dst_inc;
         }
 
+        // lowest addr written to in this run
+        on_fast_dma_write(gba, dst, dst_inc > 0 ? run_addr : dst.addr + sizeof(T), run_length * sizeof(T));
+
         len += run_length;
         gba.scheduler.tick(run_length * total_cycles);
 
@@ -437,25 +479,35 @@ void fast_dma_fixed_src(Gba& gba, Channel& dma, RW src, RW dst)
     do {
         const u32 event_cycles = std::max<u32>(1, gba.scheduler.get_next_event_cycles() / total_cycles);
         const u32 run_length = std::min<u32>(event_cycles, len_end - len);
+        const u32 run_addr = dst.addr;
 
-        // as the src never changes, we don't really have to read
-        // from src each time, however, this didn't provide any
-        // speed improvement, likely the compiler also figured
-        // it out and cache doing it's thing.
-        for (u32 i = 0; i < run_length; i++)
-        {
-            dst.ptr[dst.addr + 0] = src.ptr[src.addr + 0];
-            dst.ptr[dst.addr + 1] = src.ptr[src.addr + 1];
+        // the src never changes, even if the dst range covers it, as
+        // the same value is written back. so it's read once and then
+        // filled with whole units, which the compiler can vectorise.
+        T value;
+        copy_unit<T>(reinterpret_cast<u8*>(&value), src.ptr + src.addr);
 
-            if constexpr(std::is_same<T, u32>())
+        if constexpr(dst_inc > 0)
+        {
+            u8* out = dst.ptr + dst.addr;
+            for (u32 i = 0; i < run_length; i++)
             {
-                dst.ptr[dst.addr + 2] = src.ptr[src.addr + 2];
-                dst.ptr[dst.addr + 3] = src.ptr[src.addr + 3];
+                std::memcpy(out + i * sizeof(T), &value, sizeof(T));
+            }
+            dst.addr += run_length * sizeof(T);
+        }
+        else
+        {
+            for (u32 i = 0; i < run_length; i++)
+            {
+                std::memcpy(dst.ptr + dst.addr, &value, sizeof(T));
+                dst.addr -= sizeof(T);
             }
-
-            dst.addr += sizeof(T) * dst_inc;
         }
 
+        // lowest addr written to in this run
+        on_fast_dma_write(gba, dst, dst_inc > 0 ? run_addr : dst.addr + sizeof(T), run_length * sizeof(T));
+
         len += run_length;
         gba.scheduler.tick(run_length * total_cycles);
 
@@ -484,15 +536,9 @@ void fast_dma_fixed_dst(Gba& gba, Channel& dma, RW src, RW dst)
         // because the dst never changes, we can simply skip the addr
         // of the last value that will be written and write that.
         src.addr += (run_length - 1) * sizeof(T) * src_inc;
+        copy_unit<T>(dst.ptr + dst.addr, src.ptr + src.addr);
 
-        dst.ptr[dst.addr + 0] = src.ptr[src.addr + 0];
-        dst.ptr[dst.addr + 1] = src.ptr[src.addr + 1];
-
-        if constexpr(std::is_same<T, u32>())
-        {
-            dst.ptr[dst.addr + 2] = src.ptr[src.addr + 2];
-            dst.ptr[dst.addr + 3] = src.ptr[src.addr + 3];
-        }
+        on_fast_dma_write(gba, dst, dst.addr, sizeof(T));
 
         src.addr += sizeof(T) * src_inc;
         len += run_length;
@@ -520,14 +566,9 @@ void fast_dma_fixed_both(Gba& gba, Channel& dma, RW src, RW dst)
 
         // because both the src and dst do not change, there is no
         // need for a loop, a single write is the same thing.
-        dst.ptr[dst.addr + 0] = src.ptr[src.addr + 0];
-        dst.ptr[dst.addr + 1] = src.ptr[src.addr + 1];
+        copy_unit<T>(dst.ptr + dst.addr, src.ptr + src.addr);
 
-        if constexpr(std::is_same<T, u32>())
-        {
-            dst.ptr[dst.addr + 2] = src.ptr[src.addr + 2];
-            dst.ptr[dst.addr + 3] = src.ptr[src.addr + 3];
-        }
+        on_fast_dma_write(gba, dst, dst.addr, sizeof(T));
 
         len -= run_length;
         dma.len = len;
@@ -626,6 +667,30 @@ void fast_dma_setup(Gba& gba, Channel& dma)
         return;
     }
 
+    // memory is written to directly, so any cached code has to be invalidated here.
+    // vram, pram and oam are handled by on_fast_dma_write().
+    if (const auto region = get_region(dma.dst_addr); region == 0x2 || region == 0x3)
+    {
+        // offset of the lowest addr written to and the size of the range
+        u32 offset = 0;
+        u32 size = sizeof(T);
+
+        if (dma.dst_increment > 0)
+        {
+            size = max_len_inc;
+        }
+        else if (dma.dst_increment < 0)
+        {
+            offset = max_len_inc - sizeof(T);
+            size = max_len_inc;
+        }
+
+        if (gba.block_cache)
+        {
+            gba.block_cache->on_write_range(dma.dst_addr - offset, size);
+        }
+    }
+
     switch (tranfer_type)
     {
         case DMA_TRANSFER_COPY_SRC_INC_DST_INC: fast_dma_copy<T, +1, +1>(gba, dma, src, dst); break;
@@ -0,0 +1,212 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "fork_pool.hpp"
+#include "gba.hpp"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    #define FORK_THREAD 0
+#else
+    #define FORK_THREAD 1
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+#endif
+
+namespace gba {
+
+struct ForkPool::State
+{
+    std::vector<std::unique_ptr<Gba>> forks;
+    std::unique_ptr<Snapshot> snapshot{std::make_unique<Snapshot>()};
+    ForkCallback init_callback{};
+    void* init_user{};
+
+    // the current run()
+    Gba* gba{};
+    ForkCallback callback{};
+    void* user{};
+    std::size_t count{};
+    // the index of the next fork to run
+    std::atomic<std::size_t> next{};
+    std::atomic<bool> failed{};
+
+    // called by each thread until every fork has been run
+    void run_forks()
+    {
+        for (;;)
+        {
+            const auto index = next.fetch_add(1);
+            if (index >= count)
+            {
+                return;
+            }
+
+            auto& fork = *forks[index];
+            bool result;
+
+            // the snapshot only has the pages that changed, so the fork has
+            // to have been forked from the same game before.
+            if (fork.rom_image == gba->rom_image && fork.bios_hle == gba->bios_hle && !std::memcmp(fork.bios, gba->bios, sizeof(fork.bios)))
+            {
+                result = fork.load_snapshot(*snapshot);
+            }
+            else
+            {
+                result = gba->clone_into(fork);
+            }
+
+            if (result)
+            {
+                callback(user, fork, index);
+            }
+            else
+            {
+                failed = true;
+            }
+        }
+    }
+
+    #if FORK_THREAD
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    // incremented on each run()
+    u64 generation{};
+    // number of threads that haven't finished the current run()
+    std::size_t running{};
+    bool quit{};
+
+    void run()
+    {
+        std::unique_lock lock{mutex};
+        u64 last_generation = 0;
+
+        for (;;)
+        {
+            work_cv.wait(lock, [this, last_generation]{ return quit || generation != last_generation; });
+
+            if (quit)
+            {
+                return;
+            }
+
+            last_generation = generation;
+            lock.unlock();
+            run_forks();
+            lock.lock();
+
+            if (--running == 0)
+            {
+                done_cv.notify_all();
+            }
+        }
+    }
+    #endif
+};
+
+ForkPool::ForkPool(std::size_t thread_count) : state{std::make_unique<State>()}
+{
+    #if FORK_THREAD
+    if (!thread_count)
+    {
+        thread_count = std::thread::hardware_concurrency();
+    }
+
+    // the thread calling run() is the first
+    for (std::size_t i = 1; i < thread_count; i++)
+    {
+        state->threads.emplace_back([s = state.get()]{ s->run(); });
+    }
+    #endif
+}
+
+ForkPool::~ForkPool()
+{
+    #if FORK_THREAD
+    {
+        std::scoped_lock lock{state->mutex};
+        state->quit = true;
+    }
+
+    state->work_cv.notify_all();
+
+    for (auto& thread : state->threads)
+    {
+        thread.join();
+    }
+    #endif
+}
+
+void ForkPool::set_init_callback(ForkCallback cb, void* user)
+{
+    state->init_callback = cb;
+    state->init_user = user;
+}
+
+auto ForkPool::run(Gba& gba, std::size_t count, ForkCallback cb, void* user) -> bool
+{
+    auto& s = *state;
+
+    gba.save_snapshot(*s.snapshot);
+
+    while (s.forks.size() < count)
+    {
+        auto& fork = s.forks.emplace_back(std::make_unique<Gba>());
+
+        if (s.init_callback)
+        {
+            s.init_callback(s.init_user, *fork, s.forks.size() - 1);
+        }
+    }
+
+    s.gba = &gba;
+    s.callback = cb;
+    s.user = user;
+    s.count = count;
+    s.next = 0;
+    s.failed = false;
+
+    #if FORK_THREAD
+    {
+        std::scoped_lock lock{s.mutex};
+        s.running = s.threads.size();
+        s.generation++;
+    }
+
+    s.work_cv.notify_all();
+    s.run_forks();
+
+    std::unique_lock lock{s.mutex};
+    s.done_cv.wait(lock, [&s]{ return s.running == 0; });
+    #else
+    s.run_forks();
+    #endif
+
+    return !s.failed;
+}
+
+auto ForkPool::get_fork(std::size_t index) -> Gba&
+{
+    return *state->forks[index];
+}
+
+auto ForkPool::get_fork_count() const -> std::size_t
+{
+    return state->forks.size();
+}
+
+auto ForkPool::get_thread_count() const -> std::size_t
+{
+    #if FORK_THREAD
+    return state->threads.size() + 1;
+    #else
+    return 1;
+    #endif
+}
+
+} // namespace gba
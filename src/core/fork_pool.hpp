@@ -0,0 +1,55 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// runs forks of a game on a pool of threads, ie, for input search or
+// automated testing, where many branches are run from the same point.
+// each fork is a Gba that's kept between runs, so forking again only
+// copies what the fork changed: the game is saved to a snapshot once,
+// which each fork then loads (see Gba::load_snapshot()). a new fork, or
+// one from a different rom, is cloned in full (see Gba::clone_into()).
+// the rom image is shared by every fork.
+#pragma once
+
+#include "fwd.hpp"
+#include <cstddef>
+#include <memory>
+
+namespace gba {
+
+// index is the fork's index in the pool
+using ForkCallback = void(*)(void* user, Gba& fork, std::size_t index);
+
+struct ForkPool
+{
+public:
+    // thread_count of 0 uses a thread per core.
+    // the thread that calls run() also runs forks, so 1 is serial.
+    explicit ForkPool(std::size_t thread_count = 0);
+    ~ForkPool();
+
+    ForkPool(const ForkPool&) = delete;
+    auto operator=(const ForkPool&) -> ForkPool& = delete;
+
+    // called once for each new fork, before it's forked, to set its
+    // userdata, pixels, sample_data, callbacks and settings.
+    // clone_into() leaves these as is, so they're kept between runs.
+    void set_init_callback(ForkCallback cb, void* user);
+
+    // forks gba count times and calls cb with each fork, from the pool.
+    // cb can be called at the same time from different threads.
+    // gba is saved to a snapshot first, then only read until this returns.
+    // returns false if gba couldn't be forked, see clone_into().
+    auto run(Gba& gba, std::size_t count, ForkCallback cb, void* user) -> bool;
+
+    // the forks are kept until the pool is destroyed, along with their
+    // state from the last run().
+    [[nodiscard]] auto get_fork(std::size_t index) -> Gba&;
+    [[nodiscard]] auto get_fork_count() const -> std::size_t;
+    [[nodiscard]] auto get_thread_count() const -> std::size_t;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+} // namespace gba
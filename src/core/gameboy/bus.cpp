@@ -349,6 +349,12 @@ inline void write_io(Gba& gba, u16 addr, u8 value)
 {
     addr &= 0x7F;
 
+    // samples are made lazily, so output the ones before the write
+    if (addr >= 0x10 && addr <= 0x3F) [[unlikely]]
+    {
+        apu::sync(gba);
+    }
+
     switch (addr)
     {
         case 0x00: // joypad
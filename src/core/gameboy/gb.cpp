@@ -87,7 +87,9 @@ void set_system_type(Gba& gba, const enum SystemType type)
 
 void on_set_builtin_palette(Gba& gba, struct PaletteEntry* p)
 {
-    if (!gba.colour_callback)
+    const auto lut = gba.get_colour_lut();
+
+    if (!lut)
     {
         gba.gameboy.palette = *p;
         return;
@@ -95,17 +97,17 @@ void on_set_builtin_palette(Gba& gba, struct PaletteEntry* p)
 
     for (auto i = 0; i < 4; i++)
     {
-        gba.gameboy.palette.BG[i] = gba.colour_callback(gba.userdata, Colour(p->BG[i]));
+        gba.gameboy.palette.BG[i] = lut[p->BG[i] & 0x7FFF];
     }
 
     for (auto i = 0; i < 4; i++)
     {
-        gba.gameboy.palette.OBJ0[i] = gba.colour_callback(gba.userdata, Colour(p->OBJ0[i]));
+        gba.gameboy.palette.OBJ0[i] = lut[p->OBJ0[i] & 0x7FFF];
     }
 
     for (auto i = 0; i < 4; i++)
     {
-        gba.gameboy.palette.OBJ1[i] = gba.colour_callback(gba.userdata, Colour(p->OBJ1[i]));
+        gba.gameboy.palette.OBJ1[i] = lut[p->OBJ1[i] & 0x7FFF];
     }
 }
 
@@ -177,6 +179,11 @@ auto init(Gba& gba) -> bool
     return true;
 }
 
+void skip_frame(Gba& gba, bool enable)
+{
+    gba.set_skip_render(enable);
+}
+
 void reset(Gba& gba)
 {
     gba.system = System::GB;
@@ -521,8 +528,8 @@ auto loadrom(Gba& gba, std::span<const u8> rom) -> bool
         return false;
     }
 
-    // todo: should add more checks before we get to this point!
-    std::memcpy(gba.rom, rom.data(), rom.size());
+    // the rom is already set by Gba::loadrom()
+    assert(gba.rom_image->get_rom().data() == rom.data());
 
     reset(gba);
 
@@ -718,17 +725,18 @@ void run(Gba& gba, u32 tcycles)
 
     for (;;)
     {
-        cpu_run(gba);
-        ppu_run(gba, gba.gameboy.cycles >> gba.gameboy.cpu.double_speed);
+        // run until the next event is due
+        do
+        {
+            cpu_run(gba);
+            ppu_run(gba, gba.gameboy.cycles >> gba.gameboy.cpu.double_speed);
+            gba.scheduler.tick(gba.gameboy.cycles >> gba.gameboy.cpu.double_speed);
+        } while (!gba.scheduler.should_fire());
 
-        gba.scheduler.tick(gba.gameboy.cycles >> gba.gameboy.cpu.double_speed);
-        if (gba.scheduler.should_fire())
+        gba.scheduler.fire();
+        if (gba.frame_end) [[unlikely]]
         {
-            gba.scheduler.fire();
-            if (gba.frame_end) [[unlikely]]
-            {
-                break;
-            }
+            break;
         }
     }
 }
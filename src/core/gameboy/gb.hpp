@@ -9,6 +9,7 @@ namespace gba::gb {
 auto init(Gba& gba) -> bool;
 void reset(Gba& gba);
 
+// same as Gba::set_skip_render()
 void skip_frame(Gba& gba, bool enable);
 
 // todo: explain this function
@@ -18,8 +19,7 @@ void set_sram(Gba& gba, u8* ram, std::size_t size);
 auto get_rom_info(const u8* data, std::size_t size, struct RomInfo* info_out) -> bool;
 
 // pass the fully loaded rom data.
-// this memory is NOT owned.
-// freeing the memory should still be handled by the caller!
+// this must be the rom of gba.rom_image, see Gba::loadrom().
 auto loadrom(Gba& gba, std::span<const u8> rom) -> bool;
 
 auto has_save(const Gba& gba) -> bool;
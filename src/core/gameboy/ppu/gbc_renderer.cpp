@@ -37,6 +37,8 @@ inline void gbc_update_colours(Gba& gba, bool dirty[8], u32 map[8][4], const u8
     }
     #endif
 
+    const auto lut = gba.get_colour_lut();
+
     for (auto palette = 0; palette < 8; palette++)
     {
         if (dirty[palette])
@@ -49,9 +51,9 @@ inline void gbc_update_colours(Gba& gba, bool dirty[8], u32 map[8][4], const u8
                 const auto col_b = palette_mem[(palette * 8) + pos + 1];
                 const auto pair = (col_b << 8) | col_a;
 
-                if (gba.colour_callback)
+                if (lut)
                 {
-                    map[palette][colours] = gba.colour_callback(gba.userdata, Colour(pair));
+                    map[palette][colours] = lut[pair & 0x7FFF];
                 }
                 else
                 {
@@ -142,6 +142,16 @@ void on_lcd_enable(Gba& gba)
     compare_LYC(gba);
 }
 
+// T is the output pixel type
+template<typename T>
+void write_scanline(T* pixels, const u32 scanline[160])
+{
+    for (auto i = 0; i < SCREEN_WIDTH; i++)
+    {
+        pixels[i] = static_cast<T>(scanline[i]);
+    }
+}
+
 } // namespace
 
 // these are extern, used for dmg / gbc / sgb render functions
@@ -163,32 +173,23 @@ void write_scanline_to_frame(void* _pixels, u32 stride, u8 bpp, int x, int y, co
         return;
     }
 
-    const auto func = [&scanline, x, y](auto pixels) {
-        pixels = &pixels[y + x];
-
-        for (auto i = 0; i < SCREEN_WIDTH; i++)
-        {
-            pixels[i] = scanline[i];
-        }
-    };
-
     switch (bpp)
     {
         case 1:
         case 8:
-            func(static_cast<u8*>(_pixels));
+            write_scanline(static_cast<u8*>(_pixels) + y + x, scanline);
             break;
 
         case 2:
         case 15:
         case 16:
-            func(static_cast<u16*>(_pixels));
+            write_scanline(static_cast<u16*>(_pixels) + y + x, scanline);
             break;
 
         case 4:
         case 24:
         case 32:
-            func(static_cast<u32*>(_pixels));
+            write_scanline(static_cast<u32*>(_pixels) + y + x, scanline);
             break;
 
         default:
@@ -454,11 +455,44 @@ void DMA(Gba& gba)
     }
 }
 
+namespace {
+
+// the window line is the only state that rendering updates, so it's
+// advanced here exactly as render_win_dmg() / render_win_gbc() would.
+void skip_scanline(Gba& gba)
+{
+    const auto type = get_system_type(gba);
+
+    if (type != SYSTEM_TYPE_DMG && type != SYSTEM_TYPE_GBC)
+    {
+        return;
+    }
+
+    // dmg only draws the window if the bg is enabled
+    if (type == SYSTEM_TYPE_DMG && !is_bg_enabled(gba))
+    {
+        return;
+    }
+
+    // the window always has a visible pixel if WX <= 166
+    if ((is_win_enabled(gba)) && (IO_WX <= 166) && (IO_WY <= 143) && (IO_WY <= IO_LY))
+    {
+        gba.gameboy.ppu.window_line++;
+    }
+}
+
+} // namespace
+
 void draw_scanline(Gba& gba)
 {
     // first frame after the lcd is enabled is not displayed!
     if (gba.gameboy.ppu.first_frame_enabled) [[unlikely]]
     {
+        if (gba.skip_render)
+        {
+            return;
+        }
+
         u32 scanline[160]{};
         std::memset(scanline, 0xFF, sizeof(scanline));
         const auto x = 40;
@@ -473,6 +507,12 @@ void draw_scanline(Gba& gba)
         return;
     }
 
+    if (gba.skip_render)
+    {
+        skip_scanline(gba);
+        return;
+    }
+
     switch (get_system_type(gba))
     {
         case SYSTEM_TYPE_DMG:
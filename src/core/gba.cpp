@@ -16,6 +16,8 @@
 #include "gameboy/internal.hpp"
 #include "gameboy/ppu/ppu.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdio>
@@ -36,6 +38,9 @@ void on_scheduler_reset_cb(void* user, s32 id, s32 cycles_late)
     gba->apu.square1.timestamp -= scheduler::TIMEOUT_VALUE;
     gba->apu.wave.timestamp -= scheduler::TIMEOUT_VALUE;
     gba->apu.noise.timestamp -= scheduler::TIMEOUT_VALUE;
+    gba->apu.sample_timestamp -= scheduler::TIMEOUT_VALUE;
+    gba->blip.time -= scheduler::TIMEOUT_VALUE;
+    gba->blip.sync_time -= scheduler::TIMEOUT_VALUE;
     // dont forget gb timers :)
     if (gba->is_gb() && gba->gameboy.timer.tima_reload_timestamp >= scheduler::TIMEOUT_VALUE)
     {
@@ -45,19 +50,6 @@ void on_scheduler_reset_cb(void* user, s32 id, s32 cycles_late)
     gba->scheduler.add_absolute(id, scheduler::TIMEOUT_VALUE, on_scheduler_reset_cb, user);
 }
 
-// fills the rom with OOB values
-// NOTE: this does NOT work for OOB dma, as they return open bus!!!
-// > offset is the starting point in rom to fill rom
-// > for optimising, offset=rom_size, otherwise fill the entire rom
-constexpr auto fill_rom_oob_values(std::span<u8> rom, const u32 offset)
-{
-    for (auto i = offset; i < rom.size(); i += 2)
-    {
-        rom[i + 0] = i >> 1; // lower nibble (addr >> 1)
-        rom[i + 1] = i >> 9; // upper nibble (addr >> (8 + 1))
-    }
-}
-
 void reset_gb(Gba& gba)
 {
     gb::reset(gba);
@@ -79,6 +71,8 @@ void reset_gba(Gba& gba)
     // this is too expensive to check for this in waitloop detection
     // so its safer to just disable it.
     gba.waitloop.reset(gba, gba.fat_device.type == fat::Type::NONE);
+    // same as above, code can be written to the rom region.
+    gba.set_cpu_backend(gba.cpu_backend);
     fat::reset(gba);
     gpio::reset(gba, skip_bios); // this is needed before mem::reset because rw needs resetting
     mem::reset(gba, skip_bios); // this needed to be before arm::reset because memtables
@@ -119,6 +113,7 @@ auto loadsave_gb(Gba& gba, std::span<const u8> new_save) -> bool
 
 auto loadsave_gba(Gba& gba, std::span<const u8> new_save) -> bool
 {
+    gba.dirty_pages.set_backup();
     return gba.backup.load_data(gba, new_save);
 }
 
@@ -221,21 +216,170 @@ auto run_gba(Gba& gba, u32 cycles)
     {
         for (;;)
         {
+            // runs until the next event is due
             arm7tdmi::run(gba);
+            gba.scheduler.fire();
 
-            if (gba.scheduler.should_fire())
+            if (gba.frame_end) [[unlikely]]
             {
-                gba.scheduler.fire();
-
-                if (gba.frame_end) [[unlikely]]
-                {
-                    break;
-                }
+                break;
             }
         }
     }
 }
 
+// size of a page of mem in a delta, the last page is smaller
+constexpr auto get_delta_page_size(u32 page) -> u32
+{
+    return std::min<u32>(mem::DirtyPages::SIZE, sizeof(mem::Mem) - (page << mem::DirtyPages::SHIFT));
+}
+
+constexpr auto is_delta_page_set(const StateDelta& delta, u32 page) -> bool
+{
+    return delta.pages[page >> 6] & (u64{1} << (page & 63));
+}
+
+auto get_delta_size(const StateDelta& delta) -> u32
+{
+    u32 size = sizeof(StateDelta);
+
+    for (u32 i = 0; i < mem::DirtyPages::COUNT; i++)
+    {
+        if (is_delta_page_set(delta, i))
+        {
+            size += get_delta_page_size(i);
+        }
+    }
+
+    if (delta.has_backup)
+    {
+        size += sizeof(backup::Backup);
+    }
+
+    return size;
+}
+
+// copies the header out of data, as data may not be aligned.
+// returns false if the header isn't valid or data is too small.
+auto read_delta(std::span<const u8> data, StateDelta& delta) -> bool
+{
+    if (data.size() < sizeof(StateDelta))
+    {
+        return false;
+    }
+
+    std::memcpy(&delta, data.data(), sizeof(delta));
+
+    if (delta.magic != StateMeta::MAGIC)
+    {
+        return false;
+    }
+    if (delta.version != StateMeta::VERSION)
+    {
+        return false;
+    }
+    if (delta.crc != 0)
+    {
+        return false;
+    }
+    if (delta.size != get_delta_size(delta) || delta.size > data.size())
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// copies the pages and backup that follow the header
+void apply_delta_memory(const StateDelta& delta, std::span<const u8> data, mem::Mem& mem, backup::Backup& backup)
+{
+    const auto* src = data.data() + sizeof(StateDelta);
+    auto* dst = reinterpret_cast<u8*>(&mem);
+
+    for (u32 i = 0; i < mem::DirtyPages::COUNT; i++)
+    {
+        if (is_delta_page_set(delta, i))
+        {
+            const auto size = get_delta_page_size(i);
+            std::memcpy(dst + (i << mem::DirtyPages::SHIFT), src, size);
+            src += size;
+        }
+    }
+
+    if (delta.has_backup)
+    {
+        std::memcpy(&backup, src, sizeof(backup));
+    }
+}
+
+// invalidates what's cached from a page of mem that was copied over
+void on_restore_page(Gba& gba, u32 page)
+{
+    const auto start = page << mem::DirtyPages::SHIFT;
+    const auto end = start + get_delta_page_size(page);
+
+    // calls func with the part of the page within the array at offset
+    const auto overlap = [start, end](u32 offset, u32 size, auto func)
+    {
+        const auto lo = std::max(start, offset);
+        const auto hi = std::min(end, offset + size);
+
+        if (lo < hi)
+        {
+            func(lo - offset, hi - lo);
+        }
+    };
+
+    if (gba.block_cache)
+    {
+        overlap(offsetof(mem::Mem, ewram), sizeof(gba.mem.ewram), [&gba](u32 offset, u32 size){ gba.block_cache->on_write_range(0x02000000 + offset, size); });
+        overlap(offsetof(mem::Mem, iwram), sizeof(gba.mem.iwram), [&gba](u32 offset, u32 size){ gba.block_cache->on_write_range(0x03000000 + offset, size); });
+    }
+    overlap(offsetof(mem::Mem, pram), sizeof(gba.mem.pram), [&gba](u32 offset, u32 size){ gba.render_thread.on_write(0x5, offset, size); });
+    overlap(offsetof(mem::Mem, vram), sizeof(gba.mem.vram), [&gba](u32 offset, u32 size)
+    {
+        gba.tile_cache.on_write_range(offset, size);
+        gba.render_thread.on_write(0x6, offset, size);
+    });
+    overlap(offsetof(mem::Mem, oam), sizeof(gba.mem.oam), [&gba](u32 offset, u32 size)
+    {
+        gba.obj_cache.dirty = true;
+        gba.render_thread.on_write(0x7, offset, size);
+    });
+}
+
+// used to give each snapshot a unique id
+std::atomic<u64> snapshot_ids{};
+
+// returns true if gba's mem matched the last generation of the snapshot,
+// or the current one when loading, so only the pages changed since are copied.
+auto is_snapshot_synced(const Gba& gba, const Snapshot& snapshot, bool loading) -> bool
+{
+    if (gba.snapshot_id != snapshot.id)
+    {
+        return false;
+    }
+
+    return gba.snapshot_generation == snapshot.generation || (loading && gba.snapshot_generation + 1 == snapshot.generation);
+}
+
+// everything that has to be rebuilt after the state is loaded
+void on_loadstate(Gba& gba, const scheduler::State& scheduler, const gb::State& gb_state)
+{
+    gba.obj_cache.dirty = true;
+    gba.tile_cache.invalidate();
+    gba.render_thread.on_write_all();
+
+    if (gba.is_gb())
+    {
+        gb::loadstate(gba, &gb_state);
+    }
+
+    mem::setup_tables(gba);
+    gba.set_cpu_backend(gba.get_cpu_backend());
+    scheduler.on_loadstate(gba);
+}
+
 } // namespace
 
 Header::Header(std::span<const u8> rom)
@@ -285,7 +429,7 @@ auto Header::validate_all() const -> bool
     return true;
 }
 
-Gba::Gba()
+Gba::Gba() : rom{rom::Image::get_empty()->get_data()}, rom_image{rom::Image::get_empty()}
 {
     // log_type = 0;
     // log_type |= log::FLAG_TYPE_ALL_APU;
@@ -321,16 +465,31 @@ auto Gba::reset() -> void
 
 auto Gba::loadrom(std::span<const u8> new_rom) -> bool
 {
-    if (new_rom.size() > sizeof(this->rom))
+    if (new_rom.size() > mem::ROM_SIZE)
     {
         assert(!"rom is way too beeg");
         return false;
     }
 
+    return loadrom(rom::Image::create(new_rom));
+}
+
+auto Gba::loadrom(std::shared_ptr<const rom::Image> image) -> bool
+{
+    if (!image)
+    {
+        return false;
+    }
+
+    const auto new_rom = image->get_rom();
     const Header header{new_rom};
 
     if (!header.validate_all())
     {
+        // gb::loadrom() resets, so the rom has to be set first
+        auto old_image = std::exchange(this->rom_image, std::move(image));
+        this->rom = this->rom_image->get_data();
+
         gb::init(*this);
         // reset the sram
         std::memset(mem.ewram, 0xFF, sizeof(mem.ewram));
@@ -338,13 +497,17 @@ auto Gba::loadrom(std::span<const u8> new_rom) -> bool
         if (gb::loadrom(*this, new_rom))
         {
             system = System::GB;
+            colour_lut_dirty = true;
             return true;
         }
 
+        this->rom_image = std::move(old_image);
+        this->rom = this->rom_image->get_data();
         return false;
     }
 
     system = System::GBA;
+    colour_lut_dirty = true;
 
     // todo: handle if the user has already set / loaded sram for the game
     // or maybe it should always be like this, load game, then load backup
@@ -355,10 +518,9 @@ auto Gba::loadrom(std::span<const u8> new_rom) -> bool
         // return false;
     }
 
-    // pre-calc the OOB rom read values, which is addr >> 1
-    fill_rom_oob_values(this->rom, new_rom.size());
-
-    std::memcpy(this->rom, new_rom.data(), new_rom.size());
+    // the OOB rom read values are already in the image
+    this->rom_image = std::move(image);
+    this->rom = this->rom_image->get_data();
 
     this->reset();
 
@@ -412,21 +574,48 @@ auto Gba::set_audio_callback(AudioCallback cb, std::span<s16> data, u32 _sample_
         }
     }
 
-    if (this->audio_callback && !this->sample_data.empty() && this->sample_rate_calculated)
-    {
-        scheduler.add(scheduler::ID::APU_SAMPLE, this->sample_rate_calculated, apu::on_sample_event, this);
-    }
-    else
-    {
-        scheduler.remove(scheduler::ID::APU_SAMPLE);
-    }
+    apu::start_sampling(*this);
+}
+
+void Gba::set_band_limited_audio(bool enable)
+{
+    apu::sync(*this);
+    this->band_limited_audio = enable;
+    apu::start_sampling(*this);
 }
 
 auto Gba::set_pixels(void* _pixels, u32 _stride, u8 _bpp) -> void
 {
+    render_thread.flush();
     this->pixels = _pixels;
     this->stride = _stride;
     this->bpp = _bpp;
+    this->colour_lut_dirty = true;
+}
+
+auto Gba::get_colour_lut() -> const u32*
+{
+    if (!colour_callback)
+    {
+        return nullptr;
+    }
+
+    if (colour_lut_dirty)
+    {
+        if (!colour_lut)
+        {
+            colour_lut = std::make_unique_for_overwrite<u32[]>(0x8000);
+        }
+
+        for (u32 i = 0; i < 0x8000; i++)
+        {
+            colour_lut[i] = colour_callback(userdata, Colour(i));
+        }
+
+        colour_lut_dirty = false;
+    }
+
+    return colour_lut.get();
 }
 
 auto Gba::get_render_mode() -> u8
@@ -469,6 +658,7 @@ auto Gba::loadstate(const State& state) -> bool
     this->apu = state.apu;
     this->ppu = state.ppu;
     this->mem = state.mem;
+    this->dirty_pages.set_all();
     this->dma[0] = state.dma[0];
     this->dma[1] = state.dma[1];
     this->dma[2] = state.dma[2];
@@ -479,20 +669,160 @@ auto Gba::loadstate(const State& state) -> bool
     this->timer[3] = state.timer[3];
     this->backup = state.backup;
     this->gpio = state.gpio;
+    on_loadstate(*this, state.scheduler, state.gb_state);
+
+    return true;
+}
+
+auto Gba::savestate(State& state) const -> bool
+{
+    state.magic = StateMeta::MAGIC;
+    state.version = StateMeta::VERSION;
+    state.size = StateMeta::SIZE;
+    state.crc = 0;
+
+    state.scheduler.on_savestate(*this);
+    state.cpu = this->cpu;
+    state.apu = this->apu;
+    state.ppu = this->ppu;
+    state.mem = this->mem;
+    state.dma[0] = this->dma[0];
+    state.dma[1] = this->dma[1];
+    state.dma[2] = this->dma[2];
+    state.dma[3] = this->dma[3];
+    state.timer[0] = this->timer[0];
+    state.timer[1] = this->timer[1];
+    state.timer[2] = this->timer[2];
+    state.timer[3] = this->timer[3];
+    state.backup = this->backup;
+    state.gpio = this->gpio;
 
     if (is_gb())
     {
-        gb::loadstate(*this, &state.gb_state);
+        gb::savestate(*this, &state.gb_state);
     }
 
-    mem::setup_tables(*this);
-    state.scheduler.on_loadstate(*this);
+    return true;
+}
+
+auto Gba::savestate_delta(std::span<u8> data) -> std::size_t
+{
+    // the gb core writes to mem directly, so nothing is tracked
+    if (is_gb())
+    {
+        dirty_pages.set_all();
+    }
+
+    // the last page (pram, oam and io) is always saved
+    dirty_pages.set(sizeof(mem::Mem) - 1);
+
+    StateDelta header{};
+    header.magic = StateMeta::MAGIC;
+    header.version = StateMeta::VERSION;
+    header.crc = 0;
+
+    header.scheduler.on_savestate(*this);
+    header.cpu = this->cpu;
+    header.apu = this->apu;
+    header.ppu = this->ppu;
+    header.dma[0] = this->dma[0];
+    header.dma[1] = this->dma[1];
+    header.dma[2] = this->dma[2];
+    header.dma[3] = this->dma[3];
+    header.timer[0] = this->timer[0];
+    header.timer[1] = this->timer[1];
+    header.timer[2] = this->timer[2];
+    header.timer[3] = this->timer[3];
+    header.gpio = this->gpio;
+
+    if (is_gb())
+    {
+        gb::savestate(*this, &header.gb_state);
+    }
+
+    std::memcpy(header.pages, dirty_pages.bits[mem::DirtyPages::USER_DELTA], sizeof(header.pages));
+    header.has_backup = dirty_pages.backup[mem::DirtyPages::USER_DELTA];
+    header.size = get_delta_size(header);
+
+    if (data.size() < header.size)
+    {
+        return 0;
+    }
+
+    auto* dst = data.data();
+    const auto* src = reinterpret_cast<const u8*>(&this->mem);
+    std::memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+
+    for (u32 i = 0; i < mem::DirtyPages::COUNT; i++)
+    {
+        if (dirty_pages.is_set(mem::DirtyPages::USER_DELTA, i))
+        {
+            const auto size = get_delta_page_size(i);
+            std::memcpy(dst, src + (i << mem::DirtyPages::SHIFT), size);
+            dst += size;
+        }
+    }
+
+    if (header.has_backup)
+    {
+        std::memcpy(dst, &this->backup, sizeof(this->backup));
+    }
+
+    dirty_pages.clear(mem::DirtyPages::USER_DELTA);
+    return header.size;
+}
+
+auto Gba::loadstate_delta(std::span<const u8> data) -> bool
+{
+    StateDelta header;
+    if (!read_delta(data, header))
+    {
+        return false;
+    }
+
+    this->cpu = header.cpu;
+    this->apu = header.apu;
+    this->ppu = header.ppu;
+    apply_delta_memory(header, data, this->mem, this->backup);
+    this->dma[0] = header.dma[0];
+    this->dma[1] = header.dma[1];
+    this->dma[2] = header.dma[2];
+    this->dma[3] = header.dma[3];
+    this->timer[0] = header.timer[0];
+    this->timer[1] = header.timer[1];
+    this->timer[2] = header.timer[2];
+    this->timer[3] = header.timer[3];
+    this->gpio = header.gpio;
+
+    // the pages that were loaded now differ from the last delta
+    dirty_pages.set_pages(header.pages, header.has_backup);
+
+    on_loadstate(*this, header.scheduler, header.gb_state);
 
     return true;
 }
 
-auto Gba::savestate(State& state) const -> bool
+void Gba::save_snapshot(Snapshot& snapshot)
 {
+    constexpr auto USER = mem::DirtyPages::USER_SNAPSHOT;
+    auto& state = snapshot.state;
+
+    if (!snapshot.id)
+    {
+        snapshot.id = ++snapshot_ids;
+    }
+
+    // the gb core writes to mem directly, so nothing is tracked.
+    // if mem didn't match the last generation, then it's saved in full.
+    if (is_gb() || !is_snapshot_synced(*this, snapshot, false))
+    {
+        dirty_pages.set_all();
+    }
+
+    // the last page (pram, oam and io) is always saved
+    dirty_pages.set(sizeof(mem::Mem) - 1);
+
     state.magic = StateMeta::MAGIC;
     state.version = StateMeta::VERSION;
     state.size = StateMeta::SIZE;
@@ -502,7 +832,6 @@ auto Gba::savestate(State& state) const -> bool
     state.cpu = this->cpu;
     state.apu = this->apu;
     state.ppu = this->ppu;
-    state.mem = this->mem;
     state.dma[0] = this->dma[0];
     state.dma[1] = this->dma[1];
     state.dma[2] = this->dma[2];
@@ -511,7 +840,6 @@ auto Gba::savestate(State& state) const -> bool
     state.timer[1] = this->timer[1];
     state.timer[2] = this->timer[2];
     state.timer[3] = this->timer[3];
-    state.backup = this->backup;
     state.gpio = this->gpio;
 
     if (is_gb())
@@ -519,6 +847,234 @@ auto Gba::savestate(State& state) const -> bool
         gb::savestate(*this, &state.gb_state);
     }
 
+    auto* dst = reinterpret_cast<u8*>(&state.mem);
+    const auto* src = reinterpret_cast<const u8*>(&this->mem);
+
+    for (u32 i = 0; i < mem::DirtyPages::COUNT; i++)
+    {
+        if (dirty_pages.is_set(USER, i))
+        {
+            const auto offset = i << mem::DirtyPages::SHIFT;
+            std::memcpy(dst + offset, src + offset, get_delta_page_size(i));
+        }
+    }
+
+    if (dirty_pages.backup[USER])
+    {
+        state.backup = this->backup;
+    }
+
+    std::memcpy(snapshot.pages, dirty_pages.bits[USER], sizeof(snapshot.pages));
+    snapshot.has_backup = dirty_pages.backup[USER];
+    snapshot.blip = blip;
+    snapshot.sample_rate_calculated = sample_rate_calculated;
+    snapshot.generation++;
+    dirty_pages.clear(USER);
+
+    snapshot_id = snapshot.id;
+    snapshot_generation = snapshot.generation;
+}
+
+auto Gba::load_snapshot(const Snapshot& snapshot) -> bool
+{
+    constexpr auto USER = mem::DirtyPages::USER_SNAPSHOT;
+    const auto& state = snapshot.state;
+
+    if (!snapshot.id || state.magic != StateMeta::MAGIC)
+    {
+        return false;
+    }
+
+    // if mem didn't match the last generation, then it's loaded in full
+    if (is_gb() || !is_snapshot_synced(*this, snapshot, true))
+    {
+        dirty_pages.set_all();
+    }
+
+    // the pages written to since the last save / load, along with the
+    // pages the snapshot was saved with, in case another instance saved it.
+    u64 load_pages[mem::DirtyPages::WORDS];
+    for (u32 i = 0; i < mem::DirtyPages::WORDS; i++)
+    {
+        load_pages[i] = dirty_pages.bits[USER][i] | snapshot.pages[i];
+    }
+    // the last page (pram, oam and io) is always loaded
+    load_pages[(mem::DirtyPages::COUNT - 1) >> 6] |= u64{1} << ((mem::DirtyPages::COUNT - 1) & 63);
+    const auto has_backup = dirty_pages.backup[USER] || snapshot.has_backup;
+
+    this->cpu = state.cpu;
+    this->apu = state.apu;
+    this->ppu = state.ppu;
+    this->dma[0] = state.dma[0];
+    this->dma[1] = state.dma[1];
+    this->dma[2] = state.dma[2];
+    this->dma[3] = state.dma[3];
+    this->timer[0] = state.timer[0];
+    this->timer[1] = state.timer[1];
+    this->timer[2] = state.timer[2];
+    this->timer[3] = state.timer[3];
+    this->gpio = state.gpio;
+
+    auto* dst = reinterpret_cast<u8*>(&this->mem);
+    const auto* src = reinterpret_cast<const u8*>(&state.mem);
+
+    for (u32 i = 0; i < mem::DirtyPages::COUNT; i++)
+    {
+        if (load_pages[i >> 6] & (u64{1} << (i & 63)))
+        {
+            const auto offset = i << mem::DirtyPages::SHIFT;
+            std::memcpy(dst + offset, src + offset, get_delta_page_size(i));
+            on_restore_page(*this, i);
+        }
+    }
+
+    if (has_backup)
+    {
+        this->backup = state.backup;
+    }
+
+    // the pages that were loaded now differ from the last delta
+    dirty_pages.set_pages(load_pages, has_backup);
+    dirty_pages.clear(USER);
+
+    snapshot_id = snapshot.id;
+    snapshot_generation = snapshot.generation;
+
+    // see on_loadstate(), the cpu backend isn't reset as the blocks
+    // in the pages that were copied are invalidated above.
+    if (is_gb())
+    {
+        gb::loadstate(*this, &state.gb_state);
+    }
+
+    mem::setup_tables(*this);
+    state.scheduler.on_loadstate(*this);
+
+    // on_loadstate() restarts sampling from now, which would put the
+    // audio out of phase each time a snapshot is loaded, ie, run-ahead.
+    if (snapshot.sample_rate_calculated == sample_rate_calculated)
+    {
+        apu::resume_sampling(*this, state.apu.sample_timestamp, snapshot.blip);
+    }
+
+    return true;
+}
+
+auto Gba::clone_into(Gba& dst) const -> bool
+{
+    if (&dst == this)
+    {
+        return true;
+    }
+
+    if (fat_device.type != fat::Type::NONE || dst.fat_device.type != fat::Type::NONE)
+    {
+        return false;
+    }
+
+    // this resets dst, so it's only done the first time
+    if (dst.rom_image != rom_image || dst.system != system)
+    {
+        if (!dst.loadrom(rom_image))
+        {
+            return false;
+        }
+    }
+
+    if (dst.has_bios != has_bios || std::memcmp(dst.bios, bios, sizeof(bios)))
+    {
+        std::memcpy(dst.bios, bios, sizeof(bios));
+        dst.has_bios = has_bios;
+        // removes the blocks of the old bios
+        dst.set_cpu_backend(dst.get_cpu_backend());
+    }
+
+    dst.bios_hle = bios_hle;
+    dst.cpu = this->cpu;
+    dst.apu = this->apu;
+    dst.ppu = this->ppu;
+    dst.dma[0] = this->dma[0];
+    dst.dma[1] = this->dma[1];
+    dst.dma[2] = this->dma[2];
+    dst.dma[3] = this->dma[3];
+    dst.timer[0] = this->timer[0];
+    dst.timer[1] = this->timer[1];
+    dst.timer[2] = this->timer[2];
+    dst.timer[3] = this->timer[3];
+    dst.gpio = this->gpio;
+    dst.waitloop = this->waitloop;
+
+    const auto has_backup = std::memcmp(&dst.backup, &this->backup, sizeof(backup)) != 0;
+    if (has_backup)
+    {
+        dst.backup = this->backup;
+    }
+
+    // only the pages that differ are copied, so that only the blocks
+    // within them are invalidated.
+    u64 pages_copied[mem::DirtyPages::WORDS]{};
+    auto* dst_mem = reinterpret_cast<u8*>(&dst.mem);
+    const auto* src_mem = reinterpret_cast<const u8*>(&this->mem);
+
+    for (u32 i = 0; i < mem::DirtyPages::COUNT; i++)
+    {
+        const auto offset = i << mem::DirtyPages::SHIFT;
+        const auto size = get_delta_page_size(i);
+
+        if (std::memcmp(dst_mem + offset, src_mem + offset, size))
+        {
+            std::memcpy(dst_mem + offset, src_mem + offset, size);
+            on_restore_page(dst, i);
+            pages_copied[i >> 6] |= u64{1} << (i & 63);
+        }
+    }
+
+    dst.dirty_pages.set_pages(pages_copied, has_backup);
+
+    if (is_gb())
+    {
+        auto gb_state = std::make_unique<gb::State>();
+        gb::savestate(*this, gb_state.get());
+        gb::loadstate(dst, gb_state.get());
+    }
+
+    scheduler::State scheduler_state;
+    scheduler_state.on_savestate(*this);
+    mem::setup_tables(dst);
+    scheduler_state.on_loadstate(dst);
+
+    return true;
+}
+
+auto apply_state_delta(State& state, std::span<const u8> data) -> bool
+{
+    StateDelta delta;
+    if (!read_delta(data, delta))
+    {
+        return false;
+    }
+
+    state.magic = StateMeta::MAGIC;
+    state.version = StateMeta::VERSION;
+    state.size = StateMeta::SIZE;
+    state.crc = 0;
+
+    state.scheduler = delta.scheduler;
+    state.cpu = delta.cpu;
+    state.apu = delta.apu;
+    state.ppu = delta.ppu;
+    apply_delta_memory(delta, data, state.mem, state.backup);
+    state.dma[0] = delta.dma[0];
+    state.dma[1] = delta.dma[1];
+    state.dma[2] = delta.dma[2];
+    state.dma[3] = delta.dma[3];
+    state.timer[0] = delta.timer[0];
+    state.timer[1] = delta.timer[1];
+    state.timer[2] = delta.timer[2];
+    state.timer[3] = delta.timer[3];
+    state.gpio = delta.gpio;
+    state.gb_state = delta.gb_state;
+
     return true;
 }
 
@@ -570,13 +1126,57 @@ auto Gba::get_rom_name() const -> RomName
     }
     else
     {
-        const Header header{this->rom};
+        const Header header{this->rom_image->get_rom()};
         std::strcpy(name.str, header.game_title);
     }
 
     return name;
 }
 
+void Gba::set_cpu_backend(arm7tdmi::Backend backend)
+{
+    cpu_backend = backend;
+
+    // see reset_gba()
+    const auto can_cache = is_gba() && fat_device.type == fat::Type::NONE;
+    if (can_cache && backend != arm7tdmi::Backend::interpreter)
+    {
+        if (!block_cache)
+        {
+            block_cache = std::make_unique<arm7tdmi::BlockCache>();
+        }
+
+        block_cache->reset();
+    }
+    else
+    {
+        block_cache.reset();
+    }
+
+    jit.reset(can_cache && backend == arm7tdmi::Backend::jit);
+}
+
+void Gba::set_skip_audio(bool enable)
+{
+    if (skip_audio != enable)
+    {
+        skip_audio = enable;
+
+        if (!enable)
+        {
+            apu::on_skip_audio_end(*this);
+        }
+    }
+}
+
+auto Gba::set_render_thread(bool enable) -> bool
+{
+    const auto result = render_thread.reset(*this, enable);
+    // writes to vram / pram are handled so that the thread sees them
+    mem::setup_tables(*this);
+    return result;
+}
+
 void Gba::set_fat_device_type(fat::Type type)
 {
     fat::init(*this, type);
@@ -607,7 +1207,12 @@ auto Gba::run(u32 _cycles) -> void
     else
     {
         run_gba(*this, _cycles);
+        // the frame may be read once this returns
+        render_thread.flush();
     }
+
+    // output the samples up to now
+    apu::sync(*this);
 }
 
 } // namespace gba
@@ -673,14 +1278,7 @@ void State::on_loadstate(gba::Gba& gba) const
 
     // special case for sample event
     // SEE: https://github.com/ITotalJustice/notorious_beeg/issues/85
-    if (gba.sample_data.empty() || !gba.sample_rate_calculated)
-    {
-        gba.scheduler.remove(ID::APU_SAMPLE);
-    }
-    else
-    {
-        gba.scheduler.add(ID::APU_SAMPLE, gba.sample_rate_calculated, gba::apu::on_sample_event, &gba);
-    }
+    gba::apu::start_sampling(gba);
 }
 
 } // namespace scheduler
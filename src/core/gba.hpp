@@ -4,18 +4,25 @@
 #pragma once
 
 #include "arm7tdmi/arm7tdmi.hpp"
+#include "arm7tdmi/block_cache.hpp"
+#include "arm7tdmi/jit.hpp"
 #include "fat/fat.hpp"
 #include "waitloop.hpp"
 #include "gameboy/types.hpp"
 #include "ppu/ppu.hpp"
+#include "ppu/render_thread.hpp"
 #include "apu/apu.hpp"
+#include "apu/blip.hpp"
 #include "mem.hpp"
 #include "dma.hpp"
 #include "timer.hpp"
 #include "scheduler.hpp"
 #include "backup/backup.hpp"
 #include "gpio.hpp"
+#include "rom.hpp"
 #include <cassert>
+#include <cstddef>
+#include <memory>
 #include <span>
 
 namespace scheduler {
@@ -43,6 +50,8 @@ enum ID : s32
     END,
 };
 
+static_assert(static_cast<s32>(ID::END) <= static_cast<s32>(RESERVED_ID), "scheduler does not have enough event slots!");
+
 struct DeltaManager
 {
     s32 deltas[ID::END]{};
@@ -177,6 +186,7 @@ struct SaveData
 };
 
 struct State;
+struct Snapshot;
 struct Header;
 
 using AudioCallback = void(*)(void* user);
@@ -192,7 +202,10 @@ struct Gba
     Gba();
     ~Gba();
 
-    // at the top so no offset needed into struct on r/w access
+    // at the top so no offset needed into struct on r/w access.
+    // see mem::Page, rmap / wmap and the function tables are used
+    // if an access isn't set for the page.
+    mem::Page pages[mem::PAGE_COUNT];
     mem::ReadArray rmap[16];
     mem::WriteArray wmap[16];
 
@@ -211,7 +224,14 @@ struct Gba
     scheduler::Scheduler scheduler;
     scheduler::DeltaManager delta;
     arm7tdmi::Arm7tdmi cpu;
-    mem::Mem mem;
+    // aligned so that the dirty pages line up with host pages, see DirtyPages
+    alignas(4096) mem::Mem mem;
+    // see savestate_delta()
+    mem::DirtyPages dirty_pages;
+    // the snapshot (and generation of it) that mem last matched,
+    // see save_snapshot()
+    u64 snapshot_id{};
+    u64 snapshot_generation{};
     ppu::Ppu ppu;
     apu::Apu apu;
     dma::Channel dma[4];
@@ -220,6 +240,12 @@ struct Gba
     gpio::Gpio gpio;
     fat::Device fat_device;
     waitloop::Waitloop waitloop;
+    // only allocated for the cached and jit backends, see set_cpu_backend()
+    std::unique_ptr<arm7tdmi::BlockCache> block_cache;
+    arm7tdmi::Jit jit;
+    ppu::ObjCache obj_cache;
+    ppu::TileCache tile_cache;
+    ppu::RenderThread render_thread;
     gb::Core gameboy;
 
     // 16kb, 32-bus
@@ -227,17 +253,52 @@ struct Gba
     bool has_bios;
 
     // 32mb(max), 16-bus
-    u8 rom[0x2000000];
+    // points to the data of rom_image, which may be shared with other
+    // instances, see rom.hpp
+    const u8* rom;
+    std::shared_ptr<const rom::Image> rom_image;
 
     bool stretch;
 
     auto reset() -> void;
+    // the rom is copied
     [[nodiscard]] auto loadrom(std::span<const u8> new_rom) -> bool;
+    // the image is referenced, this is how to share a rom between instances
+    [[nodiscard]] auto loadrom(std::shared_ptr<const rom::Image> image) -> bool;
     [[nodiscard]] auto loadbios(std::span<const u8> new_bios) -> bool;
     auto run(u32 cycles = CYCLES_PER_FRAME) -> void;
 
     [[nodiscard]] auto loadstate(const State& state) -> bool;
     [[nodiscard]] auto savestate(State& state) const -> bool;
+    // writes the pages of memory that changed since the last call to
+    // savestate_delta() along with the cpu, scheduler, io etc to data.
+    // data has to be at least StateMeta::DELTA_MAX_SIZE, see StateDelta.
+    // returns the size written or 0 if data is too small.
+    [[nodiscard]] auto savestate_delta(std::span<u8> data) -> std::size_t;
+    // applies a delta, the memory not in the delta is left as is.
+    // so the deltas have to be loaded in order on top of the state that
+    // the first delta was taken from.
+    [[nodiscard]] auto loadstate_delta(std::span<const u8> data) -> bool;
+    // fast in-memory savestate, ie, for run-ahead. only the pages written
+    // to since this last saved / loaded the same snapshot are copied,
+    // otherwise it's copied in full.
+    void save_snapshot(Snapshot& snapshot);
+    // restores a snapshot, only the pages written to since this last saved
+    // / loaded the same snapshot are copied, along with the pages the
+    // snapshot was last saved with. otherwise it's copied in full.
+    // so any number of instances (of the same rom) can fork from a snapshot,
+    // or follow the one saving it by loading every snapshot it saves.
+    // unlike loadstate(), the cpu backend isn't reset, only the blocks in
+    // the pages that were copied are invalidated.
+    [[nodiscard]] auto load_snapshot(const Snapshot& snapshot) -> bool;
+    // makes dst a copy of this, as if it had loaded a savestate of it,
+    // ie, to fork the game (see fork_pool.hpp).
+    // the rom image is shared and only the pages that differ are copied,
+    // so cloning into the same dst again is cheap.
+    // dst keeps its own userdata, pixels, sample_data, callbacks and cpu
+    // backend, so each clone can be bound to something else.
+    // returns false if a fat device is used, as it isn't part of the state.
+    [[nodiscard]] auto clone_into(Gba& dst) const -> bool;
 
     // load a save from data, must be used after a game has loaded
     [[nodiscard]] auto loadsave(std::span<const u8> new_save) -> bool;
@@ -251,18 +312,38 @@ struct Gba
     // OR keys together
     auto setkeys(u16 buttons, bool down) -> void;
 
-    void set_userdata(void* user) { this->userdata = user; }
+    void set_userdata(void* user) { this->userdata = user; this->colour_lut_dirty = true; }
     void set_audio_callback(AudioCallback cb, std::span<s16> data, u32 sample_rate = 65536);
+    // if set (the default), the psg channels are synthesised with
+    // band-limited steps rather than point-sampled at the sample rate.
+    // this is cheaper and doesn't alias, most noticeable at 32/48khz.
+    void set_band_limited_audio(bool enable);
     void set_vblank_callback(VblankCallback cb) { this->vblank_callback = cb; }
     void set_hblank_callback(HblankCallback cb) { this->hblank_callback = cb; }
     void set_frame_callback(FrameCallback cb) { this->frame_callback = cb; }
-    void set_colour_callback(ColourCallback cb) { this->colour_callback = cb; }
+    void set_colour_callback(ColourCallback cb) { this->colour_callback = cb; this->colour_lut_dirty = true; }
     void set_fat_flush_callback(FatFlushCallback cb) { this->fat_flush_callback = cb; }
     void set_log_callback(LogCallback cb) { this->log_callback = cb; }
 
     // set the pixels that the game will render to
     // IMPORTANT: if pixels == NULL, then no rendering will happen!
     auto set_pixels(void* pixels, u32 stride, u8 bpp) -> void;
+    // while set, frames are still fully emulated (irqs, dma, timing)
+    // but nothing is drawn to pixels. set this per frame, ie, for fast forward.
+    void set_skip_render(bool enable) { this->skip_render = enable; }
+    // same as above but no samples are made, so the audio callback isn't
+    // called. this is also a bit faster, ie, for run-ahead.
+    // the sample clock keeps running, so loading a snapshot saved before
+    // skipping carries on the audio from where it was saved.
+    void set_skip_audio(bool enable);
+
+    // returns colour_callback applied to every bgr555 colour (bit 15 is
+    // ignored), or nullptr if there's no callback.
+    // the table is rebuilt on first use after it's invalidated.
+    [[nodiscard]] auto get_colour_lut() -> const u32*;
+    // call this if the output of colour_callback changes, the table is
+    // already invalidated when the callback, userdata, pixels or rom change.
+    void invalidate_colour_lut() { this->colour_lut_dirty = true; }
 
     [[nodiscard]] auto get_render_mode() -> u8;
     // returns the priority of the layer
@@ -273,6 +354,25 @@ struct Gba
 
     [[nodiscard]] auto get_rom_name() const -> RomName;
 
+    // the new backend is used straight away, no reset is needed.
+    // defaults to the interpreter, the block cache is only allocated
+    // for the other backends.
+    // the jit falls back to the cached interpreter if the host isn't supported.
+    void set_cpu_backend(arm7tdmi::Backend backend);
+    [[nodiscard]] auto get_cpu_backend() const { return cpu_backend; }
+
+    // lines are drawn on another thread whilst the cpu runs, see render_thread.hpp.
+    // off by default, this is an unmeasured proof of concept.
+    // returns false if it could not be enabled.
+    auto set_render_thread(bool enable) -> bool;
+    [[nodiscard]] auto is_render_thread_enabled() const { return render_thread.is_enabled(); }
+
+    // if set (the default), common bios functions (IntrWait, decompression,
+    // CpuSet, affine and maths) are run natively rather than in the bios.
+    // clear this to always run the bios, ie, for exact bios timing.
+    void set_bios_hle(bool enable) { this->bios_hle = enable; }
+    [[nodiscard]] auto is_bios_hle_enabled() const { return bios_hle; }
+
      [[nodiscard]] auto get_fat_device_type() const { return fat_device.type; }
     void set_fat_device_type(fat::Type type);
     //
@@ -304,7 +404,13 @@ struct Gba
     u32 cycles_spent_in_halt;
 
     bool bit_crushing{false};
+    // see set_band_limited_audio()
+    bool band_limited_audio{true};
+    // see set_bios_hle()
+    bool bios_hle{true};
     bool frame_end;
+    // see set_cpu_backend()
+    arm7tdmi::Backend cpu_backend{arm7tdmi::Backend::interpreter};
     // controlled by the rom writing to [IO_LOG_CONTROL]
     bool rom_logging{false};
 
@@ -315,10 +421,16 @@ struct Gba
     std::size_t sample_count;
     u32 sample_rate;
     u32 sample_rate_calculated;
+    // psg output when band_limited_audio is set
+    apu::Blip blip;
 
-    void* pixels;
-    u32 stride;
-    u8 bpp;
+    void* pixels{};
+    u32 stride{};
+    u8 bpp{};
+    // see set_skip_render()
+    bool skip_render{false};
+    // see set_skip_audio()
+    bool skip_audio{false};
 
     char log_buffer[0x101]{};
     u32 log_buffer_index{};
@@ -330,6 +442,9 @@ struct Gba
     HblankCallback hblank_callback{};
     FrameCallback frame_callback{};
     ColourCallback colour_callback{};
+    // see get_colour_lut()
+    std::unique_ptr<u32[]> colour_lut{};
+    bool colour_lut_dirty{true};
     FatFlushCallback fat_flush_callback{};
     LogCallback log_callback{};
 };
@@ -353,11 +468,64 @@ struct State
     gb::State gb_state;
 };
 
+// the start of a delta savestate, see Gba::savestate_delta().
+// this is followed by every page of mem set in pages (in order), and
+// then backup if has_backup is set.
+struct StateDelta
+{
+    u32 magic; // see StateMeta::MAGIC
+    u32 version; // see StateMeta::VERSION
+    u32 size; // size of the header, pages and backup
+    u32 crc; // crc of game
+
+    scheduler::State scheduler;
+    arm7tdmi::Arm7tdmi cpu;
+    apu::Apu apu;
+    ppu::Ppu ppu;
+    dma::Channel dma[4];
+    timer::Timer timer[4];
+    gpio::Gpio gpio;
+    gb::State gb_state;
+
+    // see mem::DirtyPages
+    u64 pages[mem::DirtyPages::WORDS];
+    bool has_backup;
+};
+
 enum StateMeta : u32
 {
     MAGIC = 0xFACADE,
-    VERSION = 6,
+    VERSION = 10,
     SIZE = sizeof(State),
+    DELTA_MAX_SIZE = sizeof(StateDelta) + sizeof(mem::Mem) + sizeof(backup::Backup),
+};
+
+// applies a delta to a full state, so that state can be kept up to
+// date without a full savestate(), ie, for autosaves.
+[[nodiscard]] auto apply_state_delta(State& state, std::span<const u8> data) -> bool;
+
+// see Gba::save_snapshot()
+struct Snapshot
+{
+    Snapshot() = default;
+    // a copy would have the same id, see generation
+    Snapshot(const Snapshot&) = delete;
+    auto operator=(const Snapshot&) -> Snapshot& = delete;
+
+    State state;
+    // the pages copied by the last save_snapshot()
+    u64 pages[mem::DirtyPages::WORDS];
+    bool has_backup;
+    // the audio isn't part of State, as loadstate() restarts it.
+    // it's only restored if the sample rate is the same.
+    apu::Blip blip;
+    u32 sample_rate_calculated;
+    // unique to each snapshot, set on the first save
+    u64 id{};
+    // incremented on each save. as only the pages that changed are saved,
+    // an instance has to have matched the last generation (or this one)
+    // in order to only load those pages.
+    u64 generation{};
 };
 
 struct Header
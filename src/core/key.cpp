@@ -87,6 +87,7 @@ void set_key(Gba& gba, u16 buttons, bool down)
         }
     }
 
+    gba.waitloop.on_event_change(gba, waitloop::WAITLOOP_EVENT_IO, mem::IO_KEY);
     check_key_interrupt(gba);
 }
 
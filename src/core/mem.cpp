@@ -16,6 +16,7 @@
 #include "log.hpp"
 
 #include <cassert>
+#include <cstddef>
 #include <cstring>
 #include <type_traits>
 #include <bit>
@@ -30,44 +31,19 @@ constexpr auto mirror_address(const u32 addr) -> u32
     return addr & 0x0FFFFFFF;
 }
 
-inline auto is_new_region(u8 old_region, u8 new_region) -> bool
-{
-    switch (new_region)
-    {
-        case 0x8:
-        case 0x9:
-            return old_region != 0x8 && old_region != 0x9;
-
-        case 0xA:
-        case 0xB:
-            return old_region != 0xA && old_region != 0xB;
-
-        case 0xC:
-        case 0xD:
-            return old_region != 0xC && old_region != 0xD;
-
-        case 0xE:
-        case 0xF:
-            return old_region != 0xE && old_region != 0xF;
-
-        default:
-            return old_region != new_region;
-    }
-}
-
 template<typename T>
-[[nodiscard]] inline auto get_memory_timing(Gba& gba, const u8 region) -> u8
+[[nodiscard]] inline auto get_memory_timing(Gba& gba, const Page& page, const u8 region) -> u8
 {
     const auto new_region = is_new_region(gba.last_region, region);
     gba.last_region = region;
 
     if constexpr(std::is_same<T, u8>() || std::is_same<T, u16>())
     {
-        return gba.timing_table_16[new_region][region];
+        return page.timing_16[new_region];
     }
     else if constexpr(std::is_same<T, u32>())
     {
-        return gba.timing_table_32[new_region][region];
+        return page.timing_32[new_region];
     }
 }
 
@@ -157,6 +133,94 @@ inline auto empty_write([[maybe_unused]] Gba& gba, [[maybe_unused]] u32 addr, [[
     log::print_warn(gba, log::Type::MEMORY, "empty write to: 0x%08X value: 0x%08X\n", addr, value);
 }
 
+// returns the memory backing a region or nullptr, used for building pages.
+auto get_region_array(Gba& gba, u8 region, u32& mask) -> u8*
+{
+    switch (region)
+    {
+        case 0x2: mask = EWRAM_MASK; return gba.mem.ewram;
+        case 0x3: mask = IWRAM_MASK; return gba.mem.iwram;
+        case 0x5: mask = PRAM_MASK; return gba.mem.pram;
+        case 0x7: mask = OAM_MASK; return gba.mem.oam;
+        case 0x8: case 0x9: case 0xA: case 0xB: case 0xC: case 0xD:
+            // rom is never written to as wmap is never set
+            mask = ROM_MASK; return const_cast<u8*>(gba.rom);
+        default: mask = 0; return nullptr;
+    }
+}
+
+// rebuilds every page from rmap / wmap and the timing tables.
+// call this whenever any of those change.
+void update_pages(Gba& gba)
+{
+    for (u32 i = 0; i < PAGE_COUNT; i++)
+    {
+        const u32 addr = i << PAGE_SHIFT;
+        const u8 region = addr >> 24;
+        auto& page = gba.pages[i];
+
+        page = {};
+        page.timing_16[SEQ] = gba.timing_table_16[SEQ][region];
+        page.timing_16[NSEQ] = gba.timing_table_16[NSEQ][region];
+        page.timing_32[SEQ] = gba.timing_table_32[SEQ][region];
+        page.timing_32[NSEQ] = gba.timing_table_32[NSEQ][region];
+
+        // vram is 96kb mirrored every 128kb, where the last 32kb is a
+        // mirror of the 32kb before it. see read_vram_region().
+        if (region == 0x6)
+        {
+            auto offset = addr & VRAM_MASK;
+
+            if (offset >= 0x18000)
+            {
+                // access depends on the bg mode, so leave it to the handler
+                if (offset <= 0x1BFFF)
+                {
+                    continue;
+                }
+
+                offset -= 0x8000;
+            }
+
+            page.array = gba.mem.vram + offset;
+            page.mask = PAGE_MASK;
+            page.read_access = Access_ALL;
+            // 8bit writes are handled by write_vram_region(), as are all
+            // writes to bg vram so that the tile cache sees them.
+            // the render thread has to see every write.
+            if (offset >= ppu::TileCache::VRAM_SIZE && !gba.render_thread.is_enabled())
+            {
+                page.write_access = Access_16bit | Access_32bit;
+            }
+            continue;
+        }
+
+        u32 mask;
+        auto array = get_region_array(gba, region, mask);
+
+        if (!array)
+        {
+            continue;
+        }
+
+        // rmap / wmap are only ever set to the above arrays or cleared
+        assert(!gba.rmap[region].array || gba.rmap[region].array == array);
+        assert(!gba.wmap[region].array || gba.wmap[region].array == array);
+
+        page.array = array + (addr & mask & ~PAGE_MASK);
+        page.mask = mask & PAGE_MASK;
+        page.read_access = gba.rmap[region].array ? gba.rmap[region].access : static_cast<u8>(Access_NONE);
+        page.write_access = gba.wmap[region].array ? gba.wmap[region].access : static_cast<u8>(Access_NONE);
+
+        // pram writes are handled by write_pram_region() so that the
+        // render thread sees them.
+        if (region == 0x5 && gba.render_thread.is_enabled())
+        {
+            page.write_access = Access_NONE;
+        }
+    }
+}
+
 void update_wscnt_table(Gba& gba)
 {
     const auto sram = bit::get_range<0, 1>(REG_WSCNT);
@@ -282,6 +346,7 @@ void on_wscnt_write(Gba& gba, u16 value)
     if (old_value != new_value)
     {
         update_wscnt_table(gba);
+        update_pages(gba);
     }
 }
 
@@ -316,6 +381,7 @@ void on_imch_write(Gba& gba, u16 value)
     if (old_value != new_value)
     {
         update_wram_table(gba);
+        update_pages(gba);
     }
 }
 
@@ -630,6 +696,12 @@ inline auto write_io16(Gba& gba, const u32 addr, const u16 value) -> void
 {
     assert(!(addr & 0x1) && "unaligned addr in write_io16!");
 
+    // samples are made lazily, so output the ones before the write
+    if (addr >= IO_SOUND1CNT_L && addr <= IO_WAVE_RAM3_H) [[unlikely]]
+    {
+        apu::sync(gba);
+    }
+
     switch (addr)
     {
         case IO_TM0D:
@@ -960,6 +1032,12 @@ inline auto write_io32(Gba& gba, const u32 addr, const u32 value) -> void
 
 inline auto write_io8(Gba& gba, const u32 addr, const u8 value) -> void
 {
+    // samples are made lazily, so output the ones before the write
+    if (addr >= IO_SOUND1CNT_L && addr <= IO_WAVE_RAM3_H + 1) [[unlikely]]
+    {
+        apu::sync(gba);
+    }
+
     switch (addr)
     {
         case IO_SOUND1CNT_L + 0: apu::write_NR10(gba, value); break;
@@ -1144,6 +1222,8 @@ auto write_oam_region(Gba& gba, const u32 addr, const T value) -> void
     if constexpr(!std::is_same<T, u8>())
     {
         write_array<T>(gba.mem.oam, OAM_MASK, addr, value);
+        gba.obj_cache.dirty = true;
+        gba.render_thread.on_write(0x7, addr & OAM_MASK, sizeof(T));
     }
 }
 
@@ -1199,6 +1279,7 @@ auto write_gpio(Gba& gba, const u32 addr, const T value)
                 // this will cause the function ptr handler to be called instead
                 // which will handle the reads to gpio and rom
                 gba.rmap[0x8] = {};
+                update_pages(gba);
             }
             else
             {
@@ -1252,6 +1333,10 @@ auto write_vram_region(Gba& gba, u32 addr, const T value) -> void
         addr -= 0x8000;
     }
 
+    gba.tile_cache.on_write(addr);
+    gba.render_thread.on_write(0x6, addr, sizeof(T));
+    gba.dirty_pages.set(offsetof(Mem, vram) + addr);
+
     if constexpr(std::is_same<T, u8>())
     {
         const bool bitmap = ppu::is_bitmap_mode(gba);
@@ -1274,16 +1359,26 @@ auto write_vram_region(Gba& gba, u32 addr, const T value) -> void
 template<typename T>
 auto write_pram_region(Gba& gba, u32 addr, const T value) -> void
 {
+    gba.render_thread.on_write(0x5, addr & PRAM_MASK, sizeof(T));
+
     if constexpr(std::is_same<T, u8>())
     {
         const u16 new_value = (value << 8) | value;
         write_array<u16>(gba.mem.pram, PRAM_MASK, addr, new_value);
     }
+    else
+    {
+        // only reached if the page isn't writable, see update_pages()
+        write_array<T>(gba.mem.pram, PRAM_MASK, addr, value);
+    }
 }
 
 template<typename T> [[nodiscard]]
 auto read_eeprom_region(Gba& gba, const u32 addr) -> T
 {
+    // reads advance the state of the eeprom
+    gba.dirty_pages.set_backup();
+
     // todo: check rom size for region access
     if constexpr(std::is_same<T, u8>())
     {
@@ -1307,6 +1402,8 @@ auto read_eeprom_region(Gba& gba, const u32 addr) -> T
 template<typename T>
 auto write_eeprom_region(Gba& gba, const u32 addr, const T value) -> void
 {
+    gba.dirty_pages.set_backup();
+
     // todo: check rom size for region access
     if constexpr(std::is_same<T, u8>())
     {
@@ -1377,6 +1474,8 @@ auto write_sram_region(Gba& gba, const u32 addr, T value) -> void
         value >>= (addr & 3) * 8;
     }
 
+    gba.dirty_pages.set_backup();
+
     if (gba.backup.is_sram())
     {
         gba.backup.sram.write(gba, addr, value);
@@ -1532,13 +1631,12 @@ inline auto read_internal(Gba& gba, u32 addr) -> T
 {
     addr = mirror_address(addr);
     const auto region = addr >> 24;
-    gba.scheduler.tick(get_memory_timing<T>(gba, region));
-
-    const auto& entry = gba.rmap[region];
+    const auto& page = gba.pages[addr >> PAGE_SHIFT];
+    gba.scheduler.tick(get_memory_timing<T>(gba, page, region));
 
-    if (entry.access & sizeof(T)) [[likely]]
+    if (page.read_access & sizeof(T)) [[likely]]
     {
-        return read_array<T>(entry.array, entry.mask, addr);
+        return read_array<T>(page.array, page.mask, addr);
     }
     else
     {
@@ -1557,18 +1655,50 @@ inline auto read_internal(Gba& gba, u32 addr) -> T
     }
 }
 
+// vram is 96kb mirrored every 128kb, where the last 32kb is a mirror of
+// the 32kb before it.
+constexpr auto get_vram_offset(u32 addr) -> u32
+{
+    addr &= VRAM_MASK;
+    return addr > 0x17FFF ? addr - 0x8000 : addr;
+}
+
 template<typename T>
 inline auto write_internal(Gba& gba, u32 addr, T value)
 {
     addr = mirror_address(addr);
     const auto region = addr >> 24;
-    gba.scheduler.tick(get_memory_timing<T>(gba, region));
-
-    const auto& entry = gba.wmap[region];
+    const auto& page = gba.pages[addr >> PAGE_SHIFT];
+    gba.scheduler.tick(get_memory_timing<T>(gba, page, region));
 
-    if (entry.access & sizeof(T)) // don't mark likely as vram,pram,io writes are common
+    if (page.write_access & sizeof(T)) // don't mark likely as io writes are common
     {
-        write_array<T>(entry.array, entry.mask, addr, value);
+        write_array<T>(page.array, page.mask, addr, value);
+
+        // invalidate any cached code in ewram / iwram.
+        // pram is in the last page of Mem, which is always dirty.
+        switch (region)
+        {
+            case 0x2:
+                if (gba.block_cache)
+                {
+                    gba.block_cache->on_write(addr);
+                }
+                gba.dirty_pages.set(offsetof(Mem, ewram) + (addr & EWRAM_MASK));
+                break;
+
+            case 0x3:
+                if (gba.block_cache)
+                {
+                    gba.block_cache->on_write(addr);
+                }
+                gba.dirty_pages.set(offsetof(Mem, iwram) + (addr & IWRAM_MASK));
+                break;
+
+            case 0x6:
+                gba.dirty_pages.set(offsetof(Mem, vram) + get_vram_offset(addr));
+                break;
+        }
     }
     else
     {
@@ -1666,7 +1796,7 @@ auto setup_tables(Gba& gba) -> void
     gba.wmap[0x2] = {gba.mem.ewram, EWRAM_MASK, Access_ALL};
     gba.wmap[0x3] = {gba.mem.iwram, IWRAM_MASK, Access_ALL};
     gba.wmap[0x5] = {gba.mem.pram, PRAM_MASK, Access_16bit | Access_32bit};
-    gba.wmap[0x7] = {gba.mem.oam, OAM_MASK, Access_16bit | Access_32bit};
+    // oam writes go through write_oam_region() to update the obj cache
 
     // unmap rom array from 0x8 and let the func fallback handle it
     if (gba.gpio.rw)
@@ -1737,11 +1867,13 @@ auto setup_tables(Gba& gba) -> void
     #undef SET_WRITE_FUNCTION
 
     setup_timing_table(gba);
+    update_pages(gba);
 }
 
 auto reset(Gba& gba, bool skip_bios) -> void
 {
     gba.mem = {};
+    gba.dirty_pages.set_all();
 
     REG_KEY = 0xFFFF; // all keys are up
     REG_IMC_L = bit::set<5>(REG_IMC_L); // always set
@@ -1755,6 +1887,51 @@ auto reset(Gba& gba, bool skip_bios) -> void
     setup_tables(gba);
 }
 
+void DirtyPages::set_range(const u32 offset, const u32 size)
+{
+    if (!size)
+    {
+        return;
+    }
+
+    const auto last = (offset + size - 1) >> SHIFT;
+    for (auto page = offset >> SHIFT; page <= last; page++)
+    {
+        for (auto& user_bits : bits)
+        {
+            user_bits[page >> 6] |= u64{1} << (page & 63);
+        }
+    }
+}
+
+void DirtyPages::set_pages(const u64 (&pages)[WORDS], const bool has_backup)
+{
+    for (auto& user_bits : bits)
+    {
+        for (u32 i = 0; i < WORDS; i++)
+        {
+            user_bits[i] |= pages[i];
+        }
+    }
+
+    if (has_backup)
+    {
+        set_backup();
+    }
+}
+
+void DirtyPages::set_all()
+{
+    set_range(0, sizeof(Mem));
+    set_backup();
+}
+
+void DirtyPages::clear(const User user)
+{
+    std::memset(bits[user], 0, sizeof(bits[user]));
+    backup[user] = false;
+}
+
 auto get_cycles_for_region_16(Gba& gba, u8 region, u8 seq_type) -> u8
 {
     return gba.timing_table_16[seq_type][region];
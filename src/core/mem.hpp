@@ -4,6 +4,7 @@
 #pragma once
 
 #include "fwd.hpp"
+#include <cstddef>
 
 namespace gba::mem {
 
@@ -28,20 +29,45 @@ enum
     NSEQ = 1, // non-sequential access
 };
 
-// packed to 32bit on x86 (struct == 8 bytes)
-// 4 bytes padding on x64 (struct == 16 bytes)
+// access is a plain member so that the jit can test it by its offset.
+// 3 bytes padding on x86 (struct == 12 bytes)
+// 3 bytes padding on x64 (struct == 16 bytes)
 struct ReadArray
 {
     const u8* array;
-    u32 mask : 25; // only need max of 25 bits
-    u8 access : 3; // only need 0-7 values
+    u32 mask;
+    u8 access;
 };
 
 struct WriteArray
 {
     u8* array;
-    u32 mask : 25; // only need max of 25 bits
-    u8 access : 3; // only need 0-7 values
+    u32 mask;
+    u8 access;
+};
+
+// the 28-bit bus is split into pages so that mirrors and regions that are
+// only partly backed by memory (ie, vram) can still be accessed directly.
+enum : u32
+{
+    PAGE_SHIFT = 14, // 16kb
+    PAGE_SIZE = 1 << PAGE_SHIFT,
+    PAGE_MASK = PAGE_SIZE - 1,
+    PAGE_COUNT = 0x10000000 >> PAGE_SHIFT,
+};
+
+// 16 bytes on x64, built from rmap / wmap and the timing tables.
+struct Page
+{
+    // the address is masked with mask and then added to array.
+    // only valid if the access flag for the size is set.
+    u8* array;
+    u16 mask;
+    u8 read_access;
+    u8 write_access;
+    // same as timing_table_16/32[SEQ/NSEQ][region]
+    u8 timing_16[2];
+    u8 timing_32[2];
 };
 
 template<typename T>
@@ -58,12 +84,14 @@ struct Mem
     // 32kb, 32-bit bus
     u8 iwram[1024 * 32];
 
-    // 1kb, 16-bit
-    u8 pram[1024 * 1];
-
     // 96kb, 16-bit bus
+    // placed after iwram so that it starts on a DirtyPages page, which
+    // leaves pram, oam and io sharing the last page.
     u8 vram[1024 * 96];
 
+    // 1kb, 16-bit
+    u8 pram[1024 * 1];
+
     // 1kb, 32-bit
     u8 oam[1024 * 1];
 
@@ -78,6 +106,67 @@ struct Mem
     u32 bios_openbus_value;
 };
 
+// 4kb pages of Mem that have been written to since the last clear().
+// only ewram, iwram and vram are tracked, the last page (pram, oam and io)
+// is always treated as dirty as io changes all the time.
+struct DirtyPages
+{
+    enum : u32
+    {
+        SHIFT = 12,
+        SIZE = 1 << SHIFT,
+        COUNT = (sizeof(Mem) + SIZE - 1) >> SHIFT,
+        WORDS = (COUNT + 63) / 64,
+    };
+
+    // each user has its own bits, so that one clearing them doesn't
+    // lose the writes for the other.
+    enum User : u8
+    {
+        // see Gba::savestate_delta()
+        USER_DELTA,
+        // see Gba::save_snapshot()
+        USER_SNAPSHOT,
+        USER_COUNT,
+    };
+
+    // a bit per page
+    u64 bits[USER_COUNT][WORDS];
+    // set if the backup was written to (or read from, as eeprom reads
+    // change its state).
+    bool backup[USER_COUNT];
+
+    // offset is the offset into Mem
+    void set(u32 offset)
+    {
+        const auto word = offset >> (SHIFT + 6);
+        const auto bit = u64{1} << ((offset >> SHIFT) & 63);
+        bits[USER_DELTA][word] |= bit;
+        bits[USER_SNAPSHOT][word] |= bit;
+    }
+
+    void set_backup()
+    {
+        backup[USER_DELTA] = true;
+        backup[USER_SNAPSHOT] = true;
+    }
+
+    void set_range(u32 offset, u32 size);
+    // ORs in pages for every user, ie, the pages that were loaded
+    void set_pages(const u64 (&pages)[WORDS], bool has_backup);
+    void set_all();
+    void clear(User user);
+
+    [[nodiscard]] auto is_set(User user, u32 page) const -> bool
+    {
+        return bits[user][page >> 6] & (u64{1} << (page & 63));
+    }
+};
+
+// pram isn't tracked on write, so it has to live in the last page.
+static_assert(offsetof(Mem, vram) % DirtyPages::SIZE == 0);
+static_assert(offsetof(Mem, pram) >> DirtyPages::SHIFT == DirtyPages::COUNT - 1);
+
 enum GeneralInternalMemory
 {
     BIOS_MASK  = 0x00003FFF,
@@ -502,6 +591,16 @@ auto write8(Gba& gba, u32 addr, u8 value) -> void;
 auto write16(Gba& gba, u32 addr, u16 value) -> void;
 auto write32(Gba& gba, u32 addr, u32 value) -> void;
 
+// returns true (NSEQ) if the access is to a different region than the last access.
+[[nodiscard]]
+constexpr auto is_new_region(u8 old_region, u8 new_region) -> bool
+{
+    // the waitstate regions (0x8-0xF) are mirrored over 2 regions,
+    // so bit-0 is ignored for those.
+    const u8 mask = new_region >= 0x8 ? 0xE : 0xF;
+    return (old_region & mask) != (new_region & mask);
+}
+
 template <typename T> [[nodiscard]]
 constexpr auto align(u32 addr) -> u32
 {
@@ -55,7 +55,11 @@ auto on_hblank(Gba& gba)
 
     if (REG_VCOUNT < 160)
     {
-        render(gba);
+        // rendering has no side effects, so it can be skipped entirely
+        if (!gba.skip_render)
+        {
+            render(gba);
+        }
         dma::on_hblank(gba);
     }
 
@@ -79,6 +83,9 @@ auto on_vblank(Gba& gba)
 
     dma::on_vblank(gba);
 
+    // the frame is complete once the queued lines are drawn
+    gba.render_thread.flush();
+
     if (gba.vblank_callback != nullptr)
     {
         gba.vblank_callback(gba.userdata);
@@ -209,6 +216,9 @@ auto is_screen_visible(Gba& gba) -> bool
 auto reset(Gba& gba, bool skip_bios) -> void
 {
     gba.ppu = {};
+    gba.obj_cache.dirty = true;
+    gba.tile_cache.invalidate();
+    gba.render_thread.on_write_all();
 
     gba.ppu.period = Period::draw;
     const auto cycles = update_period_cycles(gba);
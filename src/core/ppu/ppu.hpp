@@ -4,6 +4,7 @@
 #pragma once
 
 #include "fwd.hpp"
+#include <cstring>
 #include <span>
 
 namespace gba::ppu {
@@ -26,6 +27,78 @@ struct Ppu
     s32 bg3y;
 };
 
+// objects that are visible on each line, in oam order.
+// this is built on the first line rendered after oam is written to,
+// so that each line only visits the objects that intersect it.
+struct ObjCache
+{
+    u8 count[160];
+    u8 index[160][128];
+    // set on every write to oam
+    bool dirty;
+};
+
+// decoded tiles and screen entries of the tile bgs, see render.cpp.
+// each 32 bytes of vram is a block, which is decoded on first use and
+// invalidated by any write to it (cpu or dma).
+// this only covers bg vram, as that's where tile bgs fetch from.
+struct TileCache
+{
+    enum : u32
+    {
+        VRAM_SIZE = 0x10000,
+        // the size of a 4bpp tile, and of 16 screen entries.
+        BLOCK_SHIFT = 5,
+        BLOCK_COUNT = VRAM_SIZE >> BLOCK_SHIFT,
+    };
+
+    struct Entry
+    {
+        u16 tile_index;
+        // index of the first colour of the palette bank
+        u8 palette;
+        bool hflip : 1;
+        bool vflip : 1;
+    };
+
+    // call this on every write to bg vram
+    void on_write(u32 addr)
+    {
+        if (addr < VRAM_SIZE)
+        {
+            const auto block = addr >> BLOCK_SHIFT;
+            tile_valid[block / 64] &= ~(1ULL << (block % 64));
+            entry_valid[block / 64] &= ~(1ULL << (block % 64));
+        }
+    }
+
+    // same as above but for a range, ie, dma.
+    void on_write_range(u32 addr, u32 size)
+    {
+        for (auto block = addr >> BLOCK_SHIFT; size && block <= (addr + size - 1) >> BLOCK_SHIFT && block < BLOCK_COUNT; block++)
+        {
+            tile_valid[block / 64] &= ~(1ULL << (block % 64));
+            entry_valid[block / 64] &= ~(1ULL << (block % 64));
+        }
+    }
+
+    // call this when vram is replaced, ie, loadstate
+    void invalidate()
+    {
+        std::memset(tile_valid, 0, sizeof(tile_valid));
+        std::memset(entry_valid, 0, sizeof(entry_valid));
+    }
+
+    // 4bpp tiles, keyed by the vram address of the tile, each pixel
+    // expanded to a palette index. 8bpp tiles are already in this
+    // format so they're read from vram instead.
+    u8 tiles[BLOCK_COUNT][64];
+    // keyed by the vram address of the entry / 2
+    Entry entries[VRAM_SIZE / 2];
+    u64 tile_valid[BLOCK_COUNT / 64];
+    u64 entry_valid[BLOCK_COUNT / 64];
+};
+
 // used for debugging
 auto render_bg_mode(Gba& gba, u8 mode, u8 layer, std::span<u16> pixels) -> u8;
 
@@ -4,15 +4,14 @@
 // things left
 // - obj mosaic
 
-// todo:
-// - cache oam entries
-// - cache screen entries
 #include "render.hpp"
 #include "gba.hpp"
 #include "bit.hpp"
 #include "log.hpp"
 #include "mem.hpp"
+#include "ppu/simd.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstring>
@@ -43,6 +42,22 @@ auto read_array_no_mask(std::span<const u8> array, u32 addr) -> T
     return data;
 }
 
+auto get_mode(const RenderContext& gba) -> u8
+{
+    return bit::get_range<0, 2>(REG_DISPCNT);
+}
+
+auto is_bitmap_mode(const RenderContext& gba) -> bool
+{
+    const auto mode = get_mode(gba);
+    return mode == 3 || mode == 4 || mode == 5;
+}
+
+auto is_screen_blanked(const RenderContext& gba) -> bool
+{
+    return bit::is_set<7>(REG_DISPCNT);
+}
+
 constexpr u8 OBJ_SIZE_X[4][4] =
 {
     { 8,  16, 32, 64 },
@@ -259,16 +274,18 @@ struct WindowBounds
     }
 
     // builds the obj window, call this rendering obj (and bg)
-    auto build(Gba& gba) -> void;
+    auto build(RenderContext& gba) -> void;
 
     // call this after rendering the obj
     // this will apply any obj windowing (if any)
-    auto apply_obj_window(Gba& gba, const ObjLine& obj_line) -> void;
+    auto apply_obj_window(RenderContext& gba, const ObjLine& obj_line) -> void;
 
     // returns true if the pixel can be drawn
     [[nodiscard]] auto in_bounds(const auto bg_num, const auto x) const { return bit::is_set(inside[x], bg_num); }
     // returns true if this pixel can blend
     [[nodiscard]] auto can_blend(const auto x) const { return in_bounds(5, x); }
+    // WinLayer flags of each pixel
+    [[nodiscard]] auto get_inside() const -> const u8* { return inside; }
 
 private:
     u8 inside[240];
@@ -471,7 +488,7 @@ constexpr auto get_bg_affine_xy(const BGxCNT& cnt, const BgAffineMeta& meta, u32
 }
 
 // psudo-ish code for affine
-auto render_obj_affine(Gba& gba, const OBJ_Attr& obj, const WindowBounds& bounds, ObjLine& line) -> void
+auto render_obj_affine(RenderContext& gba, const OBJ_Attr& obj, const WindowBounds& bounds, ObjLine& line) -> void
 {
     // if affine2X, then scale size by 2
     const auto scale_size = obj.attr0.OM == Affine2X ? 2 : 1;
@@ -733,12 +750,47 @@ constexpr auto blend_black(const u16 col, const u8 coeff) -> u16
     return fin_col.pack();
 }
 
-auto get_backdrop_colour(const Gba& gba) -> u16
+auto get_backdrop_colour(const RenderContext& gba) -> u16
 {
     return read_array_no_mask<u16>(gba.mem.pram, 0);
 }
 
-auto parse_obj(Gba& gba, const WindowBounds& bounds, ObjLine& line) -> void
+// rebuilds the objects visible on each line, see ObjCache
+auto build_obj_cache(RenderContext& gba) -> void
+{
+    auto& cache = gba.obj_cache;
+    const auto oam = std::span{gba.mem.oam};
+
+    std::memset(cache.count, 0, sizeof(cache.count));
+
+    // 1024 entries in oam, each entry is 64bytes, 1024/64=128
+    for (auto i = 0; i < 128; i++)
+    {
+        const Attr0 attr0 = read_array_no_mask<u16>(oam, (i * 8) + 0);
+        const Attr1 attr1 = read_array_no_mask<u16>(oam, (i * 8) + 2);
+
+        if (attr0.OM == ObjMode::Hide)
+        {
+            continue;
+        }
+
+        // same as the checks in parse_obj() and render_obj_affine()
+        const auto scale_size = attr0.OM == Affine2X ? 2 : 1;
+        const auto height = OBJ_SIZE_Y[attr0.Sh][attr1.Sz];
+        const auto sprite_y = attr0.Y + height > 256 ? attr0.Y - 256 : attr0.Y;
+        const auto start = std::max(sprite_y, 0);
+        const auto end = std::min(sprite_y + height * scale_size, 160);
+
+        for (auto y = start; y < end; y++)
+        {
+            cache.index[y][cache.count[y]++] = i;
+        }
+    }
+
+    cache.dirty = false;
+}
+
+auto parse_obj(RenderContext& gba, const WindowBounds& bounds, ObjLine& line) -> void
 {
     // ovram is the last 2 entries of the charblock in vram.
     // in tile modes, this allows for 1024 tiles in total.
@@ -748,9 +800,23 @@ auto parse_obj(Gba& gba, const WindowBounds& bounds, ObjLine& line) -> void
     const auto vcount = REG_VCOUNT;
     const auto is_1D_layout = bit::is_set<6>(REG_DISPCNT);
 
-    // 1024 entries in oam, each entry is 64bytes, 1024/64=128
-    for (auto i = 0; i < 128; i++)
+    // objects are only cached for the visible lines
+    if (vcount >= 160) [[unlikely]]
+    {
+        return;
+    }
+
+    if (gba.obj_cache.dirty)
     {
+        build_obj_cache(gba);
+    }
+
+    const auto count = gba.obj_cache.count[vcount];
+    const auto indexes = gba.obj_cache.index[vcount];
+
+    for (auto j = 0; j < count; j++)
+    {
+        const auto i = indexes[j];
         const OBJ_Attr obj{
             .attr0 = read_array_no_mask<u16>(oam, (i * 8) + 0),
             .attr1 = read_array_no_mask<u16>(oam, (i * 8) + 2),
@@ -907,7 +973,7 @@ auto parse_obj(Gba& gba, const WindowBounds& bounds, ObjLine& line) -> void
     }
 }
 
-auto render_obj(Gba& gba, const WindowBounds& bounds, ObjLine& line) -> void
+auto render_obj(RenderContext& gba, const WindowBounds& bounds, ObjLine& line) -> void
 {
     const auto pram = std::span{gba.mem.pram}.subspan(512);
 
@@ -931,7 +997,67 @@ auto render_obj(Gba& gba, const WindowBounds& bounds, ObjLine& line) -> void
     }
 }
 
-auto render_tile_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgMeta meta)
+// returns the 4bpp tile at addr, decoding it if needed
+auto get_cached_tile(RenderContext& gba, u32 addr) -> const u8*
+{
+    auto& cache = gba.tile_cache;
+    const auto block = addr >> TileCache::BLOCK_SHIFT;
+    auto& tile = cache.tiles[block];
+
+    if (!(cache.tile_valid[block / 64] & (1ULL << (block % 64))))
+    {
+        for (auto i = 0; i < 32; i++)
+        {
+            const auto pixels = gba.mem.vram[addr + i];
+            tile[i * 2 + 0] = pixels & 0xF;
+            tile[i * 2 + 1] = pixels >> 4;
+        }
+
+        cache.tile_valid[block / 64] |= 1ULL << (block % 64);
+    }
+
+    return tile;
+}
+
+auto decode_screen_entry(const ScreenEntry se) -> TileCache::Entry
+{
+    return {
+        .tile_index = se.tile_index,
+        .palette = static_cast<u8>(se.palette_bank * 16),
+        .hflip = static_cast<bool>(se.hflip),
+        .vflip = static_cast<bool>(se.vflip),
+    };
+}
+
+// returns the screen entry at addr, decoding the block if needed
+auto get_cached_screen_entry(RenderContext& gba, u32 addr) -> TileCache::Entry
+{
+    auto& cache = gba.tile_cache;
+
+    // the map of the last rows can be in obj vram, which isn't cached
+    if (addr >= TileCache::VRAM_SIZE) [[unlikely]]
+    {
+        return decode_screen_entry(read_array_no_mask<u16>(gba.mem.vram, addr));
+    }
+
+    const auto block = addr >> TileCache::BLOCK_SHIFT;
+
+    if (!(cache.entry_valid[block / 64] & (1ULL << (block % 64))))
+    {
+        const auto base = block << TileCache::BLOCK_SHIFT;
+
+        for (u32 i = 0; i < 32; i += 2)
+        {
+            cache.entries[(base + i) / 2] = decode_screen_entry(read_array_no_mask<u16>(gba.mem.vram, base + i));
+        }
+
+        cache.entry_valid[block / 64] |= 1ULL << (block % 64);
+    }
+
+    return cache.entries[addr / 2];
+}
+
+auto render_tile_line_bg(RenderContext& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgMeta meta)
 {
     const auto charblock_offset = cnt.CBB * CHARBLOCK_SIZE;
     const auto charblock_size = 4 * CHARBLOCK_SIZE - charblock_offset;
@@ -941,10 +1067,15 @@ auto render_tile_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds, con
     const auto y = (meta.yscroll + vcount) % 256;
     // pal_mem
     const auto pram = std::span{gba.mem.pram};
-    // tile_mem (where the tiles/tilesets are)
-    const auto charblock = std::span{gba.mem.vram}.subspan(charblock_offset);
     // se_mem (where the tilemaps are)
-    const auto screenblock = std::span{gba.mem.vram}.subspan((cnt.SBB * SCREENBLOCK_SIZE) + get_bg_offset<Index::Y>(cnt, meta.yscroll + vcount) + ((y / 8) * 64));
+    const auto screenblock_addr = (cnt.SBB * SCREENBLOCK_SIZE) + get_bg_offset<Index::Y>(cnt, meta.yscroll + vcount) + ((y / 8) * 64);
+
+    // the tile only changes every 8 pixels, so it's fetched once per tile.
+    // row is the 8 palette indices of the line, nullptr if out of bounds.
+    auto last_column = -1;
+    const u8* row = nullptr;
+    u16 palette = 0;
+    u8 flip = 0;
 
     for (auto x = 0; x < 240; x++)
     {
@@ -954,61 +1085,59 @@ auto render_tile_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds, con
             continue;
         }
 
-        const auto tx = (x + meta.xscroll) % 256;
-        const auto se_number = (tx / 8) + (get_bg_offset<Index::X>(cnt, x + meta.xscroll) / 2); // SE-number n = tx+ty·tw,
-        const ScreenEntry se = read_array_no_mask<u16>(screenblock, se_number * 2);
+        const auto column = (x + meta.xscroll) / 8;
 
-        const auto tile_x = se.hflip ? 7 - (tx & 7) : tx & 7;
-        const auto tile_y = se.vflip ? 7 - (y & 7) : y & 7;
+        if (column != last_column)
+        {
+            last_column = column;
 
-        const auto tile_offset = tile_x + (tile_y * 8);
+            const auto tx = (x + meta.xscroll) % 256;
+            const auto se_number = (tx / 8) + (get_bg_offset<Index::X>(cnt, x + meta.xscroll) / 2); // SE-number n = tx+ty·tw,
+            const auto se = get_cached_screen_entry(gba, screenblock_addr + se_number * 2);
+            const auto tile_y = se.vflip ? 7 - (y & 7) : y & 7;
 
-        auto pram_addr = 0;
-        auto pixel = 0;
+            flip = se.hflip ? 7 : 0;
+            row = nullptr;
 
-        if (cnt.CM == BG_4BPP)
-        {
-            const auto charblock_addr = (se.tile_index * 32) + tile_offset / 2;
-            // don't allow access to blocks 4,5
-            if (charblock_addr >= charblock_size) [[unlikely]]
+            if (cnt.CM == BG_4BPP)
             {
-                continue;
+                const auto charblock_addr = se.tile_index * 32;
+                // don't allow access to blocks 4,5
+                if (charblock_addr < charblock_size) [[likely]]
+                {
+                    row = get_cached_tile(gba, charblock_offset + charblock_addr) + tile_y * 8;
+                    palette = se.palette;
+                }
             }
-
-            pixel = charblock[charblock_addr];
-
-            if (tile_x & 1) // hi or lo nibble
+            else // BG_8BPP
             {
-                pixel >>= 4;
+                const auto charblock_addr = se.tile_index * 64;
+                // don't allow access to blocks 4,5
+                if (charblock_addr < charblock_size) [[likely]]
+                {
+                    row = gba.mem.vram + charblock_offset + charblock_addr + tile_y * 8;
+                    palette = 0;
+                }
             }
-
-            pixel &= 0xF; // 4bpp remember
-            pram_addr = 2 * pixel;
-            pram_addr += se.palette_bank * 32;
         }
-        else // BG_8BPP
-        {
-            const auto charblock_addr = (se.tile_index * 64) + tile_offset;
-            // don't allow access to blocks 4,5
-            if (charblock_addr >= charblock_size) [[unlikely]]
-            {
-                continue;
-            }
 
-            pixel = charblock[charblock_addr];
-            pram_addr = 2 * pixel;
+        if (!row) [[unlikely]]
+        {
+            continue;
         }
 
+        const auto pixel = row[((x + meta.xscroll) & 7) ^ flip];
+
         if (pixel != 0) // don't render transparent pixel
         {
             line.is_opaque[x] = true;
-            line.pixels[x] = read_array_no_mask<u16>(pram, pram_addr);
+            line.pixels[x] = read_array_no_mask<u16>(pram, (palette + pixel) * 2);
         }
     }
 }
 
 // affine bg is 1D layout, aka, 8bpp
-auto render_affine_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgAffineMeta meta)
+auto render_affine_line_bg(RenderContext& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgAffineMeta meta)
 {
     // width/height sizes are the same
     constexpr u16 sizes[4] = { 128, 256, 512, 1024 };
@@ -1069,7 +1198,7 @@ auto render_affine_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds, c
     }
 }
 
-auto render_bitmap3_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgAffineMeta meta)
+auto render_bitmap3_line_bg(RenderContext& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgAffineMeta meta)
 {
     constexpr auto width = 240;
     constexpr auto height = 160;
@@ -1096,7 +1225,7 @@ auto render_bitmap3_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds,
     }
 }
 
-auto render_bitmap4_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgAffineMeta meta)
+auto render_bitmap4_line_bg(RenderContext& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgAffineMeta meta)
 {
     constexpr auto width = 240;
     constexpr auto height = 160;
@@ -1129,7 +1258,7 @@ auto render_bitmap4_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds,
     }
 }
 
-auto render_bitmap5_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgAffineMeta meta)
+auto render_bitmap5_line_bg(RenderContext& gba, BgLine& line, const WindowBounds& bounds, const BGxCNT cnt, const BgAffineMeta meta)
 {
     constexpr auto width = 160;
     constexpr auto height = 128;
@@ -1157,12 +1286,12 @@ auto render_bitmap5_line_bg(Gba& gba, BgLine& line, const WindowBounds& bounds,
     }
 }
 
-auto is_obj_enabled(Gba& gba)
+auto is_obj_enabled(RenderContext& gba)
 {
     return bit::is_set<12>(REG_DISPCNT);
 }
 
-auto WindowBounds::build(Gba& gba) -> void
+auto WindowBounds::build(RenderContext& gba) -> void
 {
     // exit early if no windows are enabled
     if (!win0_enabled && !win1_enabled)
@@ -1233,7 +1362,7 @@ auto WindowBounds::build(Gba& gba) -> void
     }
 }
 
-auto WindowBounds::apply_obj_window(Gba& gba, const ObjLine& obj_line) -> void
+auto WindowBounds::apply_obj_window(RenderContext& gba, const ObjLine& obj_line) -> void
 {
     // exit early if obj window is not enabled
     if (!this->win_obj_enabled || !obj_line.number_of_windows)
@@ -1261,7 +1390,160 @@ auto WindowBounds::apply_obj_window(Gba& gba, const ObjLine& obj_line) -> void
     }
 }
 
-auto merge(Gba& gba, const WindowBounds& bounds, std::span<u16> pixels, std::span<const BgLine> bg_lines, const ObjLine& obj_line) -> void
+#if PPU_SIMD
+// same as merge_scalar() below, but LANES pixels at a time.
+// rather than the layer number, the layer bit is tracked so that it
+// can be tested against the bldmod src / dst bits.
+auto merge_simd(RenderContext& gba, const WindowBounds& bounds, std::span<u16> pixels, std::span<const BgLine> bg_lines, const ObjLine& obj_line) -> void
+{
+    using namespace simd;
+
+    const auto backdrop_colour = get_backdrop_colour(gba);
+    const auto obj_enabled = is_obj_enabled(gba);
+
+    const auto bldmod = BLDMOD{REG_BLDMOD};
+    const auto blend_mode = bldmod.get_mode();
+
+    const auto coeff_src = splat(std::min<u8>(16, bit::get_range<0, 4>(REG_COLEV)));
+    const auto coeff_dst = splat(std::min<u8>(16, bit::get_range<8, 12>(REG_COLEV)));
+    const auto coeff_wb = splat(std::min<u8>(16, bit::get_range<0, 4>(REG_COLEY)));
+
+    u16 src_bits = 0;
+    u16 dst_bits = 0;
+    for (auto i = 0; i < 6; i++)
+    {
+        src_bits |= bldmod.src[i] << i;
+        dst_bits |= bldmod.dst[i] << i;
+    }
+
+    const auto max_channel = splat(31);
+
+    for (auto x = 0; x < 240; x += LANES)
+    {
+        // top (0) and bottom (1) layer
+        auto pixel0 = splat(backdrop_colour);
+        auto pixel1 = pixel0;
+        auto prio0 = splat(PRIORITY_BACKDROP);
+        auto prio1 = prio0;
+        auto layer0 = splat(1 << BACKDROP_NUM);
+        auto layer1 = layer0;
+        auto obj_alpha = splat(0);
+
+        // returns the mask of lanes where the new pixel is the top layer
+        const auto add_layer = [&](Vec opaque, Vec new_pixel, Vec new_prio, Vec new_layer)
+        {
+            const auto top = and_(opaque, lt(new_prio, prio0));
+            const auto bottom = andnot(and_(opaque, lt(new_prio, prio1)), top);
+
+            pixel1 = select(top, pixel0, select(bottom, new_pixel, pixel1));
+            prio1 = select(top, prio0, select(bottom, new_prio, prio1));
+            layer1 = select(top, layer0, select(bottom, new_layer, layer1));
+
+            pixel0 = select(top, new_pixel, pixel0);
+            prio0 = select(top, new_prio, prio0);
+            layer0 = select(top, new_layer, layer0);
+
+            return top;
+        };
+
+        if (obj_enabled)
+        {
+            const auto top = add_layer(
+                not_zero(load_u8(obj_line.is_opaque + x)),
+                load(obj_line.pixels + x),
+                load_u8(obj_line.priority + x),
+                splat(1 << OBJ_NUM)
+            );
+
+            obj_alpha = and_(top, not_zero(load_u8(obj_line.is_alpha + x)));
+        }
+
+        for (auto& bg_line : bg_lines)
+        {
+            const auto top = add_layer(
+                not_zero(load_u8(bg_line.is_opaque + x)),
+                load(bg_line.pixels + x),
+                splat(bg_line.priority),
+                splat(1 << bg_line.num)
+            );
+
+            // bg is never alpha
+            obj_alpha = andnot(obj_alpha, top);
+        }
+
+        const auto top_src = not_zero(and_(layer0, splat(src_bits)));
+        const auto bottom_dst = not_zero(and_(layer1, splat(dst_bits)));
+        const auto can_blend = not_zero(and_(load_u8(bounds.get_inside() + x), splat(WinLayer_BLEND)));
+
+        // if obj has alpha bit set, it always does alpha blend as long
+        // as the bottom layer (dst) is enabled in bldmod
+        auto do_alpha = and_(obj_alpha, bottom_dst);
+        auto do_fade = splat(0);
+        const auto can_bldmod = andnot(and_(can_blend, top_src), obj_alpha);
+
+        switch (blend_mode)
+        {
+            case Blend::None:
+                break;
+
+            case Blend::Alpha:
+                do_alpha = or_(do_alpha, and_(can_bldmod, bottom_dst));
+                break;
+
+            case Blend::White:
+            case Blend::Black:
+                do_fade = can_bldmod;
+                break;
+        }
+
+        if (any(or_(do_alpha, do_fade)))
+        {
+            const auto r0 = and_(pixel0, max_channel);
+            const auto g0 = and_(shr<5>(pixel0), max_channel);
+            const auto b0 = and_(shr<10>(pixel0), max_channel);
+
+            const auto pack = [](Vec r, Vec g, Vec b)
+            {
+                return or_(or_(r, shl<5>(g)), shl<10>(b));
+            };
+
+            if (any(do_alpha))
+            {
+                const auto r1 = and_(pixel1, max_channel);
+                const auto g1 = and_(shr<5>(pixel1), max_channel);
+                const auto b1 = and_(shr<10>(pixel1), max_channel);
+
+                const auto alpha = [&](Vec src, Vec dst)
+                {
+                    return min(max_channel, shr<4>(add(mul(src, coeff_src), mul(dst, coeff_dst))));
+                };
+
+                pixel0 = select(do_alpha, pack(alpha(r0, r1), alpha(g0, g1), alpha(b0, b1)), pixel0);
+            }
+
+            if (any(do_fade))
+            {
+                const auto fade = [&](Vec col)
+                {
+                    if (blend_mode == Blend::White)
+                    {
+                        return add(col, shr<4>(mul(sub(max_channel, col), coeff_wb)));
+                    }
+                    return sub(col, shr<4>(mul(col, coeff_wb)));
+                };
+
+                pixel0 = select(do_fade, pack(fade(r0), fade(g0), fade(b0)), pixel0);
+            }
+        }
+
+        store(pixels.data() + x, pixel0);
+    }
+}
+#endif // PPU_SIMD
+
+// this is always built so that it can be tested against merge_simd(),
+// see RenderContext::scalar_merge.
+auto merge_scalar(RenderContext& gba, const WindowBounds& bounds, std::span<u16> pixels, std::span<const BgLine> bg_lines, const ObjLine& obj_line) -> void
 {
     struct Layers
     {
@@ -1391,14 +1673,27 @@ auto merge(Gba& gba, const WindowBounds& bounds, std::span<u16> pixels, std::spa
     }
 }
 
-auto is_bg_enabled(Gba& gba, u8 bg_num)
+auto merge(RenderContext& gba, const WindowBounds& bounds, std::span<u16> pixels, std::span<const BgLine> bg_lines, const ObjLine& obj_line) -> void
+{
+    #if PPU_SIMD
+    if (!gba.scalar_merge) [[likely]]
+    {
+        merge_simd(gba, bounds, pixels, bg_lines, obj_line);
+        return;
+    }
+    #endif
+
+    merge_scalar(gba, bounds, pixels, bg_lines, obj_line);
+}
+
+auto is_bg_enabled(RenderContext& gba, u8 bg_num)
 {
     assert(bg_num <= 3);
 
     return bit::is_set(REG_DISPCNT, 8 + bg_num);
 }
 
-auto get_bg_cnt(Gba& gba, u8 bg_num) -> BGxCNT
+auto get_bg_cnt(RenderContext& gba, u8 bg_num) -> BGxCNT
 {
     assert(bg_num <= 3);
 
@@ -1413,7 +1708,7 @@ auto get_bg_cnt(Gba& gba, u8 bg_num) -> BGxCNT
     std::unreachable();
 }
 
-auto get_bg_meta(Gba& gba, u8 bg_num) -> BgMeta
+auto get_bg_meta(RenderContext& gba, u8 bg_num) -> BgMeta
 {
     assert(bg_num <= 3);
 
@@ -1428,7 +1723,7 @@ auto get_bg_meta(Gba& gba, u8 bg_num) -> BgMeta
     std::unreachable();
 }
 
-auto get_bg_affine_meta(Gba& gba, u8 bg_num) -> BgAffineMeta
+auto get_bg_affine_meta(RenderContext& gba, u8 bg_num) -> BgAffineMeta
 {
     assert(bg_num >= 2 && bg_num <= 3);
 
@@ -1456,7 +1751,17 @@ auto get_bg_affine_meta(Gba& gba, u8 bg_num) -> BgAffineMeta
     std::unreachable();
 }
 
-auto write_scanline_to_frame(Gba& gba, const u16 scanline[160])
+// converts the line using the colour lut, T is the output pixel type
+template<typename T>
+auto write_scanline(T* pixels, const u16 scanline[240], const u32* lut) -> void
+{
+    for (auto i = 0; i < 240; i++)
+    {
+        pixels[i] = static_cast<T>(lut[scanline[i] & 0x7FFF]);
+    }
+}
+
+auto write_scanline_to_frame(RenderContext& gba, const u16 scanline[160])
 {
     if (!gba.pixels)
     {
@@ -1464,7 +1769,9 @@ auto write_scanline_to_frame(Gba& gba, const u16 scanline[160])
         return;
     }
 
-    if (!gba.colour_callback)
+    const auto lut = gba.colour_lut;
+
+    if (!lut)
     {
         if (gba.bpp == 2 || gba.bpp == 15 || gba.bpp == 16)
         {
@@ -1473,34 +1780,26 @@ auto write_scanline_to_frame(Gba& gba, const u16 scanline[160])
         return;
     }
 
-    const auto func = [&gba, &scanline](auto pixels) {
-        assert(240 <= gba.stride);
-
-        pixels = &pixels[gba.stride * REG_VCOUNT];
-
-        for (auto i = 0; i < 240; i++)
-        {
-            pixels[i] = gba.colour_callback(gba.userdata, Colour{scanline[i]});
-        }
-    };
+    assert(240 <= gba.stride);
+    const auto offset = gba.stride * REG_VCOUNT;
 
     switch (gba.bpp)
     {
         case 1:
         case 8:
-            func(static_cast<u8*>(gba.pixels));
+            write_scanline(static_cast<u8*>(gba.pixels) + offset, scanline, lut);
             break;
 
         case 2:
         case 15:
         case 16:
-            func(static_cast<u16*>(gba.pixels));
+            write_scanline(static_cast<u16*>(gba.pixels) + offset, scanline, lut);
             break;
 
         case 4:
         case 24:
         case 32:
-            func(static_cast<u32*>(gba.pixels));
+            write_scanline(static_cast<u32*>(gba.pixels) + offset, scanline, lut);
             break;
 
         default:
@@ -1509,7 +1808,7 @@ auto write_scanline_to_frame(Gba& gba, const u16 scanline[160])
     }
 }
 
-auto tile_render(Gba& gba, std::span<BgLine> bg_lines, const Layer layers = Layer::ALL, const bool apply_window = true, const bool apply_merge = true) -> void
+auto tile_render(RenderContext& gba, std::span<BgLine> bg_lines, const Layer layers = Layer::ALL, const bool apply_window = true, const bool apply_merge = true) -> void
 {
     // setup inital windowing (using win0 and win1)
     WindowBounds bounds{REG_DISPCNT, REG_WINOUT, apply_window};
@@ -1583,39 +1882,39 @@ auto tile_render(Gba& gba, std::span<BgLine> bg_lines, const Layer layers = Laye
 }
 
 // 4 regular
-auto render_mode0(Gba& gba) -> void
+auto render_mode0(RenderContext& gba) -> void
 {
     BgLine bg_lines[4]{ {0, RenderType::Reg}, {1, RenderType::Reg}, {2, RenderType::Reg}, {3, RenderType::Reg} };
     tile_render(gba, bg_lines);
 }
 
 // 2 regular, 1 affine
-auto render_mode1(Gba& gba) -> void
+auto render_mode1(RenderContext& gba) -> void
 {
     BgLine bg_lines[3]{ {0, RenderType::Reg}, {1, RenderType::Reg}, {2, RenderType::Affine} };
     tile_render(gba, bg_lines);
 }
 
 // 2 affine
-auto render_mode2(Gba& gba) -> void
+auto render_mode2(RenderContext& gba) -> void
 {
     BgLine bg_lines[2]{ {2, RenderType::Affine}, {3, RenderType::Affine} };
     tile_render(gba, bg_lines);
 }
 
-auto render_mode3(Gba& gba) -> void
+auto render_mode3(RenderContext& gba) -> void
 {
     BgLine bg_lines[1]{ {2, RenderType::Bitmap3} };
     tile_render(gba, bg_lines);
 }
 
-auto render_mode4(Gba& gba) -> void
+auto render_mode4(RenderContext& gba) -> void
 {
     BgLine bg_lines[1]{ {2, RenderType::Bitmap4} };
     tile_render(gba, bg_lines);
 }
 
-auto render_mode5(Gba& gba) -> void
+auto render_mode5(RenderContext& gba) -> void
 {
     BgLine bg_lines[1]{ {2, RenderType::Bitmap5} };
     tile_render(gba, bg_lines);
@@ -1645,16 +1944,37 @@ constexpr auto bits_per_pixel_to_bytes_per_pixel(u8 bpp)
     }
 }
 
+void clear_pixels(void* pixels, u32 stride, u8 bpp, u16 line)
+{
+    if (line < 160 && pixels && stride && bpp)
+    {
+        const auto bytes = bits_per_pixel_to_bytes_per_pixel(bpp);
+        auto dst = static_cast<u8*>(pixels) + (stride * line * bytes);
+        std::memset(dst, 0, 240 * bytes);
+    }
+}
+
+auto make_render_context(Gba& gba) -> RenderContext
+{
+    return {
+        .mem = { gba.mem.io, gba.mem.vram, gba.mem.pram, gba.mem.oam },
+        .ppu = gba.ppu,
+        .obj_cache = gba.obj_cache,
+        .tile_cache = gba.tile_cache,
+        .pixels = gba.pixels,
+        .stride = gba.stride,
+        .bpp = gba.bpp,
+        .colour_lut = gba.get_colour_lut(),
+    };
+}
+
 } // namespace
 
 void clear_line(Gba& gba, u16 line)
 {
-    if (line < 160 && gba.pixels && gba.stride && gba.bpp)
-    {
-        const auto bpp = bits_per_pixel_to_bytes_per_pixel(gba.bpp);
-        auto pixels = static_cast<u8*>(gba.pixels) + (gba.stride * line * bpp);
-        std::memset(pixels, 0, 240 * bpp);
-    }
+    // the render thread may still be drawing to pixels
+    gba.render_thread.flush();
+    clear_pixels(gba.pixels, gba.stride, gba.bpp, line);
 }
 
 void clear_screen(Gba& gba)
@@ -1667,11 +1987,27 @@ void clear_screen(Gba& gba)
 
 auto render(Gba& gba) -> void
 {
-    // return;
+    if (!is_screen_blanked(gba) && get_mode(gba) > 5) [[unlikely]]
+    {
+        log::print_error(gba, log::Type::PPU, "unhandled ppu mode: %u\n", get_mode(gba));
+    }
+
+    if (gba.render_thread.is_enabled())
+    {
+        gba.render_thread.queue_line(gba);
+        return;
+    }
+
+    auto ctx = make_render_context(gba);
+    render(ctx);
+}
+
+auto render(RenderContext& gba) -> void
+{
     // if forced blanking is enabled, the screen is black
     if (is_screen_blanked(gba)) [[unlikely]]
     {
-        clear_line(gba, REG_VCOUNT);
+        clear_pixels(gba.pixels, gba.stride, gba.bpp, REG_VCOUNT);
         return;
     }
 
@@ -1687,7 +2023,6 @@ auto render(Gba& gba) -> void
         case 5: render_mode5(gba); break;
 
         default:
-            log::print_error(gba, log::Type::PPU, "unhandled ppu mode: %u\n", mode);
             assert(!"unhandled ppu mode!");
             break;
     }
@@ -1695,8 +2030,9 @@ auto render(Gba& gba) -> void
 
 // todo: re-write this so that more internal info can be
 // shown in the front end.
-auto render_bg_mode(Gba& gba, u8 mode, u8 layer, std::span<u16> pixels) -> u8
+auto render_bg_mode(Gba& _gba, u8 mode, u8 layer, std::span<u16> pixels) -> u8
 {
+    auto gba = make_render_context(_gba);
     const auto cnt = get_bg_cnt(gba, layer);
     // for now, ignore the mode the frontend wants
     mode = get_mode(gba);
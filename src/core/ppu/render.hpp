@@ -4,10 +4,40 @@
 #pragma once
 
 #include "fwd.hpp"
+#include "mem.hpp"
+#include "ppu/ppu.hpp"
 
 namespace gba::ppu {
 
+// everything that the renderer reads, so that a line can be drawn from
+// a snapshot rather than the live state, see render_thread.hpp.
+// the members are named the same as Gba so that the REG_ macros work.
+struct RenderContext
+{
+    struct Mem
+    {
+        const decltype(mem::Mem::io)& io;
+        const decltype(mem::Mem::vram)& vram;
+        const decltype(mem::Mem::pram)& pram;
+        const decltype(mem::Mem::oam)& oam;
+    } mem;
+
+    const Ppu& ppu;
+    ObjCache& obj_cache;
+    TileCache& tile_cache;
+
+    void* pixels;
+    u32 stride;
+    u8 bpp;
+    const u32* colour_lut;
+    // uses the scalar merge() even if simd is available, see simd.hpp.
+    // this is only used to test one against the other.
+    bool scalar_merge{};
+};
+
 auto render(Gba& gba) -> void;
+// draws the line REG_VCOUNT of the context
+auto render(RenderContext& ctx) -> void;
 
 // memset line. max value is 159
 void clear_line(Gba& gba, u16 line);
@@ -0,0 +1,268 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "ppu/render_thread.hpp"
+#include "ppu/render.hpp"
+#include "gba.hpp"
+#include "mem.hpp"
+#include <cstring>
+#include <iterator>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    #define RENDER_THREAD 0
+#else
+    #define RENDER_THREAD 1
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+#endif
+
+namespace gba::ppu {
+
+#if RENDER_THREAD
+namespace {
+
+enum : u32
+{
+    // a full frame can be queued
+    LINE_COUNT = 160,
+    // only the regs up to (and including) COLEY are read by the renderer
+    IO_SNAPSHOT_SIZE = (mem::IO_COLEY & 0x3FF) + 2,
+};
+
+} // namespace
+
+struct RenderThread::State
+{
+    struct Line
+    {
+        decltype(mem::Mem::io) io;
+        Ppu ppu;
+        void* pixels;
+        u32 stride;
+        u8 bpp;
+        const u32* colour_lut;
+    };
+
+    decltype(mem::Mem::vram) vram;
+    decltype(mem::Mem::pram) pram;
+    decltype(mem::Mem::oam) oam;
+    ObjCache obj_cache;
+    TileCache tile_cache;
+
+    Line lines[LINE_COUNT];
+    // total number of lines queued / drawn, the slot is the count % LINE_COUNT
+    u32 head;
+    u32 tail;
+    bool quit;
+    // set whilst the worker is waiting for lines
+    bool idle;
+
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::thread thread;
+
+    void run()
+    {
+        std::unique_lock lock{mutex};
+
+        for (;;)
+        {
+            idle = true;
+            work_cv.wait(lock, [this]{ return quit || head != tail; });
+            idle = false;
+
+            if (quit)
+            {
+                return;
+            }
+
+            // the lines are drawn as a batch without holding the lock,
+            // the slots up to head are not written to until tail passes them.
+            const auto end = head;
+            lock.unlock();
+
+            for (auto i = tail; i != end; i++)
+            {
+                auto& line = lines[i % LINE_COUNT];
+
+                RenderContext ctx{
+                    .mem = { line.io, vram, pram, oam },
+                    .ppu = line.ppu,
+                    .obj_cache = obj_cache,
+                    .tile_cache = tile_cache,
+                    .pixels = line.pixels,
+                    .stride = line.stride,
+                    .bpp = line.bpp,
+                    .colour_lut = line.colour_lut,
+                };
+
+                render(ctx);
+            }
+
+            lock.lock();
+            tail = end;
+            done_cv.notify_all();
+        }
+    }
+};
+
+RenderThread::RenderThread() = default;
+
+RenderThread::~RenderThread()
+{
+    close();
+}
+
+auto RenderThread::reset(Gba& gba, bool enable) -> bool
+{
+    close();
+
+    if (!enable)
+    {
+        return true;
+    }
+
+    state = std::make_unique<State>();
+    state->thread = std::thread{[s = state.get()]{ s->run(); }};
+
+    // the shadow copy starts out empty
+    on_write_all();
+    update_shadow(gba);
+
+    return true;
+}
+
+void RenderThread::queue_line(Gba& gba)
+{
+    if (vram_dirty[0] || vram_dirty[1] || pram_dirty || oam_dirty)
+    {
+        flush();
+        update_shadow(gba);
+    }
+
+    // the table may be rebuilt, which the worker could be reading
+    if (gba.colour_lut_dirty && gba.colour_callback)
+    {
+        flush();
+    }
+
+    std::unique_lock lock{state->mutex};
+    state->done_cv.wait(lock, [s = state.get()]{ return s->head - s->tail < LINE_COUNT; });
+    lock.unlock();
+
+    auto& line = state->lines[state->head % LINE_COUNT];
+    std::memcpy(line.io, gba.mem.io, IO_SNAPSHOT_SIZE);
+    line.ppu = gba.ppu;
+    line.pixels = gba.pixels;
+    line.stride = gba.stride;
+    line.bpp = gba.bpp;
+    line.colour_lut = gba.get_colour_lut();
+
+    lock.lock();
+    state->head++;
+
+    if (state->idle)
+    {
+        state->work_cv.notify_one();
+    }
+}
+
+void RenderThread::flush()
+{
+    if (state)
+    {
+        std::unique_lock lock{state->mutex};
+        state->done_cv.wait(lock, [s = state.get()]{ return s->head == s->tail; });
+    }
+}
+
+void RenderThread::on_write_all()
+{
+    for (auto& dirty : vram_dirty)
+    {
+        dirty = ~0ULL;
+    }
+
+    pram_dirty = true;
+    oam_dirty = true;
+}
+
+void RenderThread::update_shadow(Gba& gba)
+{
+    for (u32 block = 0; block < VRAM_BLOCK_COUNT; block++)
+    {
+        if (vram_dirty[block / 64] & (1ULL << (block % 64)))
+        {
+            const auto offset = block << VRAM_BLOCK_SHIFT;
+            const auto size = 1U << VRAM_BLOCK_SHIFT;
+            std::memcpy(state->vram + offset, gba.mem.vram + offset, size);
+            state->tile_cache.on_write_range(offset, size);
+        }
+    }
+
+    if (pram_dirty)
+    {
+        std::memcpy(state->pram, gba.mem.pram, sizeof(state->pram));
+    }
+
+    if (oam_dirty)
+    {
+        std::memcpy(state->oam, gba.mem.oam, sizeof(state->oam));
+        state->obj_cache.dirty = true;
+    }
+
+    std::memset(vram_dirty, 0, sizeof(vram_dirty));
+    pram_dirty = false;
+    oam_dirty = false;
+}
+
+void RenderThread::close()
+{
+    if (state)
+    {
+        {
+            std::scoped_lock lock{state->mutex};
+            state->quit = true;
+        }
+
+        state->work_cv.notify_one();
+        state->thread.join();
+        state.reset();
+    }
+}
+
+#else
+
+RenderThread::RenderThread() = default;
+RenderThread::~RenderThread() = default;
+
+auto RenderThread::reset([[maybe_unused]] Gba& gba, bool enable) -> bool
+{
+    return !enable;
+}
+
+void RenderThread::queue_line([[maybe_unused]] Gba& gba)
+{
+}
+
+void RenderThread::flush()
+{
+}
+
+void RenderThread::on_write_all()
+{
+}
+
+void RenderThread::update_shadow([[maybe_unused]] Gba& gba)
+{
+}
+
+void RenderThread::close()
+{
+}
+
+#endif // RENDER_THREAD
+
+} // namespace gba::ppu
@@ -0,0 +1,91 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// draws lines on a worker thread whilst the cpu keeps running.
+// on each hblank, the io regs and ppu state that the renderer reads are
+// copied into a queue of lines, which the worker then draws from.
+// vram, pram and oam are drawn from a shadow copy, which is updated with
+// the ranges written to since the last line. as the copy can't be updated
+// whilst the worker is using it, the worker is waited on first, so a game
+// that writes vram every line will render (roughly) in serial.
+// the output is the same as the serial renderer.
+// pixels are only complete after a flush(), which is done on vblank
+// and at the end of Gba::run().
+//
+// this is a proof of concept. it has only been checked for correctness,
+// the speedup has never been measured (it was written on a single core
+// machine), so it is off by default and no frontend enables it.
+#pragma once
+
+#include "fwd.hpp"
+#include <memory>
+
+namespace gba::ppu {
+
+struct RenderThread
+{
+public:
+    RenderThread();
+    ~RenderThread();
+
+    RenderThread(const RenderThread&) = delete;
+    auto operator=(const RenderThread&) -> RenderThread& = delete;
+
+    // starts / stops the worker.
+    // returns false if threads aren't available.
+    auto reset(Gba& gba, bool enable) -> bool;
+    // returns master enable flag
+    [[nodiscard]] auto is_enabled() const -> bool { return state != nullptr; }
+
+    // queues REG_VCOUNT to be drawn
+    void queue_line(Gba& gba);
+    // waits until every queued line has been drawn
+    void flush();
+
+    // call this on every write to vram, pram or oam.
+    // offset is into the array of the region (5, 6 or 7).
+    void on_write(u8 region, u32 offset, u32 size)
+    {
+        if (!state)
+        {
+            return;
+        }
+
+        switch (region)
+        {
+            case 0x5: pram_dirty = true; break;
+            case 0x7: oam_dirty = true; break;
+            case 0x6:
+                for (auto block = offset >> VRAM_BLOCK_SHIFT; size && block <= (offset + size - 1) >> VRAM_BLOCK_SHIFT && block < VRAM_BLOCK_COUNT; block++)
+                {
+                    vram_dirty[block / 64] |= 1ULL << (block % 64);
+                }
+                break;
+        }
+    }
+
+    // call this when the memory is replaced, ie, loadstate
+    void on_write_all();
+
+private:
+    enum : u32
+    {
+        // vram is tracked in 1kb blocks
+        VRAM_BLOCK_SHIFT = 10,
+        VRAM_BLOCK_COUNT = (1024 * 96) >> VRAM_BLOCK_SHIFT,
+    };
+
+    struct State;
+    std::unique_ptr<State> state;
+
+    u64 vram_dirty[2]{};
+    static_assert(VRAM_BLOCK_COUNT <= 64 * 2);
+    bool pram_dirty{};
+    bool oam_dirty{};
+
+    // copies the dirty memory to the shadow copy
+    void update_shadow(Gba& gba);
+    void close();
+};
+
+} // namespace gba::ppu
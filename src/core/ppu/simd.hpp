@@ -0,0 +1,134 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// minimal wrapper over the host simd, used by merge() in render.cpp.
+// each vector is LANES u16, the backend is picked at compile time:
+// avx2, sse2, neon or wasm simd128. PPU_SIMD is 0 if none are available,
+// in which case the scalar path is used instead.
+// masks are all bits set (true) or all clear (false) per lane.
+#pragma once
+
+#include "fwd.hpp"
+
+#if defined(__AVX2__)
+    #define PPU_SIMD 1
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PPU_SIMD 1
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON)
+    #define PPU_SIMD 1
+    #include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+    #define PPU_SIMD 1
+    #include <wasm_simd128.h>
+#else
+    #define PPU_SIMD 0
+#endif
+
+#if PPU_SIMD
+namespace gba::ppu::simd {
+
+#if defined(__AVX2__)
+using Vec = __m256i;
+constexpr auto LANES = 16;
+
+inline auto load(const u16* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline auto load_u8(const void* p) { return _mm256_cvtepu8_epi16(_mm_loadu_si128(static_cast<const __m128i*>(p))); }
+inline void store(u16* p, Vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+inline auto splat(u16 v) { return _mm256_set1_epi16(static_cast<short>(v)); }
+inline auto and_(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+inline auto or_(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+// a & ~b
+inline auto andnot(Vec a, Vec b) { return _mm256_andnot_si256(b, a); }
+inline auto add(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+inline auto sub(Vec a, Vec b) { return _mm256_sub_epi16(a, b); }
+inline auto mul(Vec a, Vec b) { return _mm256_mullo_epi16(a, b); }
+template<int N> inline auto shr(Vec v) { return _mm256_srli_epi16(v, N); }
+template<int N> inline auto shl(Vec v) { return _mm256_slli_epi16(v, N); }
+inline auto eq(Vec a, Vec b) { return _mm256_cmpeq_epi16(a, b); }
+// values must be < 0x8000
+inline auto lt(Vec a, Vec b) { return _mm256_cmpgt_epi16(b, a); }
+// values must be < 0x8000
+inline auto min(Vec a, Vec b) { return _mm256_min_epi16(a, b); }
+inline auto select(Vec mask, Vec a, Vec b) { return _mm256_blendv_epi8(b, a, mask); }
+inline auto any(Vec mask) { return !_mm256_testz_si256(mask, mask); }
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+using Vec = __m128i;
+constexpr auto LANES = 8;
+
+inline auto load(const u16* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline auto load_u8(const void* p) { return _mm_unpacklo_epi8(_mm_loadl_epi64(static_cast<const __m128i*>(p)), _mm_setzero_si128()); }
+inline void store(u16* p, Vec v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+inline auto splat(u16 v) { return _mm_set1_epi16(static_cast<short>(v)); }
+inline auto and_(Vec a, Vec b) { return _mm_and_si128(a, b); }
+inline auto or_(Vec a, Vec b) { return _mm_or_si128(a, b); }
+// a & ~b
+inline auto andnot(Vec a, Vec b) { return _mm_andnot_si128(b, a); }
+inline auto add(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+inline auto sub(Vec a, Vec b) { return _mm_sub_epi16(a, b); }
+inline auto mul(Vec a, Vec b) { return _mm_mullo_epi16(a, b); }
+template<int N> inline auto shr(Vec v) { return _mm_srli_epi16(v, N); }
+template<int N> inline auto shl(Vec v) { return _mm_slli_epi16(v, N); }
+inline auto eq(Vec a, Vec b) { return _mm_cmpeq_epi16(a, b); }
+// values must be < 0x8000
+inline auto lt(Vec a, Vec b) { return _mm_cmplt_epi16(a, b); }
+// values must be < 0x8000
+inline auto min(Vec a, Vec b) { return _mm_min_epi16(a, b); }
+inline auto select(Vec mask, Vec a, Vec b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+inline auto any(Vec mask) { return _mm_movemask_epi8(mask) != 0; }
+#elif defined(__ARM_NEON)
+using Vec = uint16x8_t;
+constexpr auto LANES = 8;
+
+inline auto load(const u16* p) { return vld1q_u16(p); }
+inline auto load_u8(const void* p) { return vmovl_u8(vld1_u8(static_cast<const u8*>(p))); }
+inline void store(u16* p, Vec v) { vst1q_u16(p, v); }
+inline auto splat(u16 v) { return vdupq_n_u16(v); }
+inline auto and_(Vec a, Vec b) { return vandq_u16(a, b); }
+inline auto or_(Vec a, Vec b) { return vorrq_u16(a, b); }
+// a & ~b
+inline auto andnot(Vec a, Vec b) { return vbicq_u16(a, b); }
+inline auto add(Vec a, Vec b) { return vaddq_u16(a, b); }
+inline auto sub(Vec a, Vec b) { return vsubq_u16(a, b); }
+inline auto mul(Vec a, Vec b) { return vmulq_u16(a, b); }
+template<int N> inline auto shr(Vec v) { return vshrq_n_u16(v, N); }
+template<int N> inline auto shl(Vec v) { return vshlq_n_u16(v, N); }
+inline auto eq(Vec a, Vec b) { return vceqq_u16(a, b); }
+inline auto lt(Vec a, Vec b) { return vcltq_u16(a, b); }
+inline auto min(Vec a, Vec b) { return vminq_u16(a, b); }
+inline auto select(Vec mask, Vec a, Vec b) { return vbslq_u16(mask, a, b); }
+inline auto any(Vec mask)
+{
+    const auto half = vorr_u16(vget_low_u16(mask), vget_high_u16(mask));
+    return vget_lane_u64(vreinterpret_u64_u16(half), 0) != 0;
+}
+#elif defined(__wasm_simd128__)
+using Vec = v128_t;
+constexpr auto LANES = 8;
+
+inline auto load(const u16* p) { return wasm_v128_load(p); }
+inline auto load_u8(const void* p) { return wasm_u16x8_load8x8(p); }
+inline void store(u16* p, Vec v) { wasm_v128_store(p, v); }
+inline auto splat(u16 v) { return wasm_u16x8_splat(v); }
+inline auto and_(Vec a, Vec b) { return wasm_v128_and(a, b); }
+inline auto or_(Vec a, Vec b) { return wasm_v128_or(a, b); }
+// a & ~b
+inline auto andnot(Vec a, Vec b) { return wasm_v128_andnot(a, b); }
+inline auto add(Vec a, Vec b) { return wasm_i16x8_add(a, b); }
+inline auto sub(Vec a, Vec b) { return wasm_i16x8_sub(a, b); }
+inline auto mul(Vec a, Vec b) { return wasm_i16x8_mul(a, b); }
+template<int N> inline auto shr(Vec v) { return wasm_u16x8_shr(v, N); }
+template<int N> inline auto shl(Vec v) { return wasm_i16x8_shl(v, N); }
+inline auto eq(Vec a, Vec b) { return wasm_i16x8_eq(a, b); }
+inline auto lt(Vec a, Vec b) { return wasm_u16x8_lt(a, b); }
+inline auto min(Vec a, Vec b) { return wasm_u16x8_min(a, b); }
+inline auto select(Vec mask, Vec a, Vec b) { return wasm_v128_bitselect(a, b, mask); }
+inline auto any(Vec mask) { return wasm_v128_any_true(mask); }
+#endif
+
+// true for each lane that isn't zero
+inline auto not_zero(Vec v) { return andnot(splat(0xFFFF), eq(v, splat(0))); }
+
+} // namespace gba::ppu::simd
+#endif // PPU_SIMD
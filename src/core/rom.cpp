@@ -0,0 +1,252 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "rom.hpp"
+#include "mem.hpp"
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__)
+    #define ROM_MMAP 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #define ROM_MMAP 0
+#endif
+
+namespace gba::rom {
+namespace {
+
+enum : std::size_t
+{
+    // the OOB values repeat every 128kb, as they're (addr >> 1) & 0xFFFF
+    OOB_PERIOD = 0x20000,
+};
+
+// fills [offset, end) with the OOB values
+// NOTE: this does NOT work for OOB dma, as they return open bus!!!
+void fill_oob_values(u8* data, std::size_t offset, std::size_t end)
+{
+    for (auto i = offset; i < end; i++)
+    {
+        // lower nibble (addr >> 1), upper nibble (addr >> (8 + 1))
+        data[i] = (i & 1) ? i >> 9 : i >> 1;
+    }
+}
+
+#if ROM_MMAP
+auto align_up(std::size_t value, std::size_t alignment) -> std::size_t
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// maps [offset, ROM_SIZE) to a single block of OOB values.
+// offset must be a multiple of OOB_PERIOD.
+auto map_oob_values(u8* data, std::size_t offset) -> bool
+{
+    if (offset == mem::ROM_SIZE)
+    {
+        return true;
+    }
+
+    const auto fd = memfd_create("gba_rom_oob", MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    static u8 block[OOB_PERIOD];
+    fill_oob_values(block, 0, sizeof(block));
+
+    bool result = pwrite(fd, block, sizeof(block), 0) == sizeof(block);
+
+    for (auto i = offset; result && i < mem::ROM_SIZE; i += OOB_PERIOD)
+    {
+        result = mmap(data + i, OOB_PERIOD, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+    }
+
+    // the mappings keep the memory alive
+    close(fd);
+    return result;
+}
+
+// reserves mem::ROM_SIZE, the rom is then mapped over the start of it
+// by the caller and the rest is filled by map_oob_values().
+auto reserve() -> u8*
+{
+    const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    if (OOB_PERIOD % page_size)
+    {
+        return nullptr;
+    }
+
+    const auto ptr = mmap(nullptr, mem::ROM_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : static_cast<u8*>(ptr);
+}
+#endif // ROM_MMAP
+
+} // namespace
+
+auto Image::create(std::span<const u8> data) -> std::shared_ptr<const Image>
+{
+    if (data.size() > mem::ROM_SIZE)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<Image> image{new Image};
+    image->size = data.size();
+
+    #if ROM_MMAP
+    if (auto ptr = reserve())
+    {
+        image->data = ptr;
+        image->mapped = true;
+
+        const auto head = align_up(data.size(), OOB_PERIOD);
+        if (head)
+        {
+            if (mmap(ptr, head, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+            {
+                return nullptr;
+            }
+
+            std::memcpy(ptr, data.data(), data.size());
+            fill_oob_values(ptr, data.size(), head);
+            mprotect(ptr, head, PROT_READ);
+        }
+
+        if (!map_oob_values(ptr, head))
+        {
+            return nullptr;
+        }
+
+        return image;
+    }
+    #endif
+
+    image->data = new u8[mem::ROM_SIZE];
+    std::memcpy(image->data, data.data(), data.size());
+    fill_oob_values(image->data, data.size(), mem::ROM_SIZE);
+
+    return image;
+}
+
+auto Image::open(const std::string& path) -> std::shared_ptr<const Image>
+{
+    #if ROM_MMAP
+    const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < 0 || static_cast<std::size_t>(st.st_size) > mem::ROM_SIZE)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<Image> image{new Image};
+    image->size = static_cast<std::size_t>(st.st_size);
+    image->data = reserve();
+
+    if (!image->data)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    image->mapped = true;
+
+    const auto ptr = image->data;
+    const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const auto file_pages = align_up(image->size, page_size);
+    const auto head = align_up(image->size, OOB_PERIOD);
+    bool result = true;
+
+    // private so that the OOB values can be written after the end of the
+    // file, which only copies the last page.
+    if (file_pages)
+    {
+        result &= mmap(ptr, file_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED;
+    }
+
+    if (result && head > file_pages)
+    {
+        result &= mmap(ptr + file_pages, head - file_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED;
+    }
+
+    close(fd);
+
+    if (!result)
+    {
+        return nullptr;
+    }
+
+    fill_oob_values(ptr, image->size, head);
+    mprotect(ptr, head, PROT_READ);
+
+    if (!map_oob_values(ptr, head))
+    {
+        return nullptr;
+    }
+
+    return image;
+    #else
+    auto file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return nullptr;
+    }
+
+    std::fseek(file, 0, SEEK_END);
+    const auto size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+
+    if (size < 0 || static_cast<std::size_t>(size) > mem::ROM_SIZE)
+    {
+        std::fclose(file);
+        return nullptr;
+    }
+
+    std::shared_ptr<Image> image{new Image};
+    image->size = static_cast<std::size_t>(size);
+    image->data = new u8[mem::ROM_SIZE];
+
+    const auto read = std::fread(image->data, 1, image->size, file);
+    std::fclose(file);
+
+    if (read != image->size)
+    {
+        return nullptr;
+    }
+
+    fill_oob_values(image->data, image->size, mem::ROM_SIZE);
+    return image;
+    #endif
+}
+
+auto Image::get_empty() -> const std::shared_ptr<const Image>&
+{
+    static const auto empty = create({});
+    return empty;
+}
+
+Image::~Image()
+{
+    #if ROM_MMAP
+    if (mapped)
+    {
+        munmap(data, mem::ROM_SIZE);
+        return;
+    }
+    #endif
+
+    delete[] data;
+}
+
+} // namespace gba::rom
@@ -0,0 +1,50 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// an immutable rom image, which can be shared between many instances of
+// Gba as they only hold a reference to it.
+// the data is always mem::ROM_SIZE bytes, past the end of the rom are
+// the OOB values (addr >> 1). on linux the OOB values are mapped from a
+// single 128kb block, so only the rom itself takes up memory.
+#pragma once
+
+#include "fwd.hpp"
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+
+namespace gba::rom {
+
+struct Image
+{
+public:
+    // copies the rom into a new image, nullptr if it's too beeg.
+    [[nodiscard]] static auto create(std::span<const u8> data) -> std::shared_ptr<const Image>;
+    // maps the file into a new image, nullptr on failure.
+    // on hosts without mmap, the file is read instead.
+    [[nodiscard]] static auto open(const std::string& path) -> std::shared_ptr<const Image>;
+    // image without a rom, every read is OOB.
+    [[nodiscard]] static auto get_empty() -> const std::shared_ptr<const Image>&;
+
+    ~Image();
+
+    Image(const Image&) = delete;
+    auto operator=(const Image&) -> Image& = delete;
+
+    // mem::ROM_SIZE bytes
+    [[nodiscard]] auto get_data() const -> const u8* { return data; }
+    // size of the rom, without the OOB values
+    [[nodiscard]] auto get_size() const -> std::size_t { return size; }
+    [[nodiscard]] auto get_rom() const -> std::span<const u8> { return { data, size }; }
+
+private:
+    Image() = default;
+
+    u8* data{};
+    std::size_t size{};
+    // data is a mapping of mem::ROM_SIZE, otherwise it's new[]
+    bool mapped{};
+};
+
+} // namespace gba::rom
@@ -3,7 +3,6 @@
 #pragma once
 
 #include <cstdint>
-#include <vector>
 #include <algorithm>
 
 // set this to 0 if the scheduler can be empty, 1 by default
@@ -19,17 +18,34 @@ using s32 = std::int32_t;
 // cycles_late will always be 0 if on time or negative if late
 using Callback = void(*)(void* user, s32 id, s32 cycles_late);
 
-enum : s32 { RESERVED_ID = 0x7FFFFFFF };
+// max number of unique event ids, each id gets its own slot.
+// ids must be in the range [0, MAX_EVENTS).
+enum : s32 { MAX_EVENTS = 32 };
+// the last slot is reserved for the reset event
+enum : s32 { RESERVED_ID = MAX_EVENTS - 1 };
 enum : s32 { TIMEOUT_VALUE = 0x70000000 };
 
+// the type of operation passed to the trace callback
+enum class Trace : std::uint8_t
+{
+    ADD,
+    REMOVE,
+    FIRE,
+};
+
+// optional, called on every add, remove and fired event.
+// time is the absolute time of the event, cycles is get_ticks().
+// this is only used for recording traces, see frontend/benchmark.
+using TraceCallback = void(*)(void* user, Trace type, s32 id, s32 time, s32 cycles);
+
 struct Event {
     s32 time; // time until event expires (scheduler.cycles + event.cycle)
     s32 id; // event id
+};
+
+struct Slot {
     Callback callback; // function to call on event expire
     void* user; // user data passed to the callback
-
-    // used for std::_heap functions
-    auto operator>(const Event& rhs) const -> bool { return time > rhs.time; }
 };
 
 struct Scheduler {
@@ -43,7 +59,8 @@ public:
     // resets queue and cycles, adds reset event, optional custom callback
     void reset(s32 starting_cycles = 0, Callback reset_cb = nullptr, void* user = nullptr)
     {
-        queue.clear();
+        count = 0;
+        std::fill(std::begin(position), std::end(position), NOT_QUEUED);
         cycles = std::min<s32>(starting_cycles, TIMEOUT_VALUE);
         add_absolute(RESERVED_ID, TIMEOUT_VALUE, reset_cb ? reset_cb : reset_event, user ? user : this);
     }
@@ -53,17 +70,21 @@ public:
     {
         while (!empty())
         {
-            const auto event = queue.front();
+            const auto event = queue[0];
             // if event hasnt expired, we break early as we know no other
             // events have expired because the queue is sorted.
             if (event.time > cycles)
             {
                 break;
             }
-            std::pop_heap(queue.begin(), queue.end(), std::greater<>());
-            queue.pop_back();
-            event.callback(event.user, event.id, event.time - cycles);
+
+            trace(Trace::FIRE, event.id, event.time);
+            remove_at(0);
+            slots[event.id].callback(slots[event.id].user, event.id, event.time - cycles);
         }
+
+        // restores the deadline if end_budget() was called
+        update_deadline();
     }
 
     // adds relative new / existing event. updates time,cb,user if existing
@@ -75,46 +96,45 @@ public:
     // adds new / existing event. updates time,cb,user if existing
     void add_absolute(s32 id, s32 event_time, Callback cb, void* user)
     {
-        const auto itr = std::find_if(queue.begin(), queue.end(), [id](auto& e){ return id == e.id; });
+        trace(Trace::ADD, id, event_time);
+
+        slots[id].callback = cb;
+        slots[id].user = user;
 
-        // if event if already in queue then update time, cb and user.
-        if (itr != queue.end())
+        // if event if already in queue then update time and re-sort
+        // only the entry that changed.
+        if (const auto pos = position[id]; pos != NOT_QUEUED)
         {
-            // fast path if front of queue
-            if (itr == queue.begin())
+            const auto old_time = queue[pos].time;
+            queue[pos].time = event_time;
+
+            if (event_time < old_time)
             {
-                std::pop_heap(queue.begin(), queue.end(), std::greater<>());
-                queue.back().time = event_time;
-                queue.back().callback = cb;
-                queue.back().user = user;
-                std::push_heap(queue.begin(), queue.end(), std::greater<>());
+                sift_up(pos);
             }
-            // otherwise, sadly we have to sort the queue :/
             else
             {
-                itr->time = event_time;
-                itr->callback = cb;
-                itr->user = user;
-                std::make_heap(queue.begin(), queue.end(), std::greater<>());
+                sift_down(pos);
             }
         }
         // otherwise create new event
         else
         {
-            queue.emplace_back(Event{event_time, id, cb, user});
-            std::push_heap(queue.begin(), queue.end(), std::greater<>());
+            queue[count] = Event{event_time, id};
+            position[id] = count;
+            sift_up(count++);
         }
+
+        update_deadline();
     }
 
     // removes an event, does nothing if event not enabled.
     void remove(s32 id)
     {
-        const auto itr = std::remove_if(queue.begin(), queue.end(), [id](auto& e) { return id == e.id; });
-
-        if (itr != queue.end())
+        if (const auto pos = position[id]; pos != NOT_QUEUED)
         {
-            queue.erase(itr, queue.end());
-            std::make_heap(queue.begin(), queue.end(), std::greater<>()); // optimise this
+            trace(Trace::REMOVE, id, queue[pos].time);
+            remove_at(pos);
         }
     }
 
@@ -136,47 +156,57 @@ public:
         #if SCHEDULER_NEVER_EMPTY
         return false;
         #else
-        return queue.empty();
+        return count == 0;
         #endif
     }
 
-    // return true if fire() should be called
+    // return true if fire() should be called.
+    // the deadline is only updated when the queue changes, so this
+    // doesn't touch the queue.
     [[nodiscard]] auto should_fire() const -> bool
     {
-        if (empty())
-        {
-            return false;
-        }
-        return queue.front().time <= cycles;
+        return deadline <= cycles;
+    }
+
+    // returns the number of cycles that can be ticked before
+    // should_fire() returns true.
+    [[nodiscard]] auto get_budget() const -> s32
+    {
+        return deadline - cycles;
+    }
+
+    // makes should_fire() return true until fire() is called, which is used
+    // to break out of a loop that's running until the next event, ie, when
+    // the cpu changes state.
+    void end_budget()
+    {
+        deadline = cycles;
     }
 
     // returns if an event is found with matching id
     [[nodiscard]] auto has_event(s32 id) const -> bool
     {
-        const auto itr = std::find_if(queue.begin(), queue.end(), [id](auto& e){ return id == e.id; });
-        return itr != queue.end();
+        return position[id] != NOT_QUEUED;
     }
 
     // returns event cycles - get_ticks() or 0 if not found
     [[nodiscard]] auto get_event_cycles(s32 id) const -> s32
     {
-        const auto itr = std::find_if(queue.begin(), queue.end(), [id](auto& e){ return id == e.id; });
-        if (itr == queue.end())
+        if (!has_event(id))
         {
             return 0;
         }
-        return itr->time - get_ticks();
+        return queue[position[id]].time - get_ticks();
     }
 
     // returns event cycles or 0 if not found
     [[nodiscard]] auto get_event_cycles_absolute(s32 id) const -> s32
     {
-        const auto itr = std::find_if(queue.begin(), queue.end(), [id](auto& e){ return id == e.id; });
-        if (itr == queue.end())
+        if (!has_event(id))
         {
             return 0;
         }
-        return itr->time;
+        return queue[position[id]].time;
     }
 
     // return cycles - get_ticks() of next event or 0 if no events
@@ -186,7 +216,7 @@ public:
         {
             return 0;
         }
-        return queue.front().time - get_ticks();
+        return queue[0].time - get_ticks();
     }
 
     // return cycles of next event or 0 if no events
@@ -196,7 +226,7 @@ public:
         {
             return 0;
         }
-        return queue.front().time;
+        return queue[0].time;
     }
 
     // advances scheduler so that get_ticks() == get_next_event_cycles() if event has greater cycles
@@ -205,28 +235,136 @@ public:
         if (!empty())
         {
             // only advance if the next event time is greater than current time
-            if (queue.front().time > cycles)
+            if (queue[0].time > cycles)
             {
-                cycles = queue.front().time;
+                cycles = queue[0].time;
             }
         }
     }
 
+    // addresses of the current time and the deadline.
+    // used by generated code to check should_fire() without calling back
+    // into c++.
+    [[nodiscard]] auto get_ticks_address() const -> const s32* { return &cycles; }
+    [[nodiscard]] auto get_deadline_address() const -> const s32* { return &deadline; }
+
+    // set to nullptr to disable tracing
+    void set_trace_callback(TraceCallback cb, void* user)
+    {
+        trace_callback = cb;
+        trace_user = user;
+    }
+
     // default reset event
     static void reset_event(void* user, s32 id, [[maybe_unused]] s32 _ = 0)
     {
         auto s = static_cast<Scheduler*>(user);
 
         // no sort because order remains the same.
-        std::for_each(s->queue.begin(), s->queue.end(), [](auto& e){ e.time -= TIMEOUT_VALUE; });
+        std::for_each(s->queue, s->queue + s->count, [](auto& e){ e.time -= TIMEOUT_VALUE; });
 
         s->cycles -= TIMEOUT_VALUE;
         s->add_absolute(id, TIMEOUT_VALUE, reset_event, user);
     }
 
 private:
-    std::vector<Event> queue; // don't manually edit this!
+    enum : s32 { NOT_QUEUED = -1 };
+
+    void trace(Trace type, s32 id, s32 time) const
+    {
+        if (trace_callback) [[unlikely]]
+        {
+            trace_callback(trace_user, type, id, time, cycles);
+        }
+    }
+
+    // swaps 2 entries in the queue and updates their position
+    void swap(s32 a, s32 b)
+    {
+        std::swap(queue[a], queue[b]);
+        position[queue[a].id] = a;
+        position[queue[b].id] = b;
+    }
+
+    void sift_up(s32 pos)
+    {
+        while (pos > 0)
+        {
+            const auto parent = (pos - 1) / 2;
+            if (queue[parent].time <= queue[pos].time)
+            {
+                break;
+            }
+            swap(pos, parent);
+            pos = parent;
+        }
+    }
+
+    void sift_down(s32 pos)
+    {
+        for (;;)
+        {
+            const auto left = pos * 2 + 1;
+            const auto right = left + 1;
+            auto smallest = pos;
+
+            if (left < count && queue[left].time < queue[smallest].time)
+            {
+                smallest = left;
+            }
+            if (right < count && queue[right].time < queue[smallest].time)
+            {
+                smallest = right;
+            }
+            if (smallest == pos)
+            {
+                break;
+            }
+            swap(pos, smallest);
+            pos = smallest;
+        }
+    }
+
+    // moves the last entry into pos, then restores the heap
+    void remove_at(s32 pos)
+    {
+        position[queue[pos].id] = NOT_QUEUED;
+        count--;
+
+        if (pos != count)
+        {
+            const auto old_time = queue[pos].time;
+            queue[pos] = queue[count];
+            position[queue[pos].id] = pos;
+
+            if (queue[pos].time < old_time)
+            {
+                sift_up(pos);
+            }
+            else
+            {
+                sift_down(pos);
+            }
+        }
+
+        update_deadline();
+    }
+
+    // caches the time of the next event, see should_fire()
+    void update_deadline()
+    {
+        deadline = count ? queue[0].time : TIMEOUT_VALUE;
+    }
+
+    Event queue[MAX_EVENTS]; // min-heap sorted by time, don't manually edit this!
+    Slot slots[MAX_EVENTS]; // callback + user, indexed by id
+    s32 position[MAX_EVENTS]; // index into queue, indexed by id
+    s32 count; // number of events in the queue
     s32 cycles; // remember to tick this!
+    s32 deadline; // time of the next event, or cycles after end_budget()
+
+    TraceCallback trace_callback{};
+    void* trace_user{};
 };
 
 } // namespace scheduler
@@ -10,10 +10,12 @@
     #include "gba.cpp"
     #include "ppu/ppu.cpp"
     #include "ppu/render.cpp"
+    #include "ppu/render_thread.cpp"
     #include "mem.cpp"
     #include "dma.cpp"
     #include "timer.cpp"
     #include "apu/apu.cpp"
+    #include "apu/blip.cpp"
     #include "bios.cpp"
     #include "bios_hle.cpp"
     #include "gpio.cpp"
@@ -22,6 +24,8 @@
     #include "sio.cpp"
     #include "log.cpp"
     #include "waitloop.cpp"
+    #include "rom.cpp"
+    #include "fork_pool.cpp"
 
     #include "backup/backup.cpp"
     #include "backup/eeprom.cpp"
@@ -29,6 +33,8 @@
     #include "backup/sram.cpp"
 
     #include "arm7tdmi/arm7tdmi.cpp"
+    #include "arm7tdmi/block_cache.cpp"
+    #include "arm7tdmi/jit.cpp"
     #include "arm7tdmi/arm/arm_table.cpp"
     #include "arm7tdmi/thumb/thumb_table.cpp"
 
@@ -78,7 +78,7 @@ auto add_timer_event(Gba& gba, Timer& timer, u8 num, u8 offset) -> void
     log::print_info(gba, LOG_TYPE[num], "timestamp: %d adding timer[%u] counter: 0x%04X value: 0x%04X delta %d\n", gba.scheduler.get_ticks(), num, timer.counter, value, gba.delta.get(EVENTS[num], 0));
 }
 
-auto on_overflow(Gba& gba, u8 num) -> void
+auto on_overflow(Gba& gba, u8 num, s32 late) -> void
 {
     auto& timer = gba.timer[num];
     timer.counter = timer.reload;
@@ -88,7 +88,7 @@ auto on_overflow(Gba& gba, u8 num) -> void
     // these are audio fifo timers
     if (num == 0 || num == 1)
     {
-        apu::on_timer_overflow(gba, num);
+        apu::on_timer_overflow(gba, num, late);
     }
 
     // tick cascade timer when the timer above overflows
@@ -106,7 +106,7 @@ auto on_overflow(Gba& gba, u8 num) -> void
 
             if (cascade_timer.counter == 0)
             {
-                on_overflow(gba, num+1);
+                on_overflow(gba, num+1, late);
             }
         }
     }
@@ -188,7 +188,7 @@ void on_timer_event(void* user, s32 id, s32 late)
 {
     auto& gba = *static_cast<Gba*>(user);
     gba.delta.add(id, late);
-    on_overflow(gba, get_timer_num_from_event(id));
+    on_overflow(gba, get_timer_num_from_event(id), late);
 }
 
 auto read_timer(Gba& gba, u8 num) -> u16
@@ -5,6 +5,7 @@
 #include "arm7tdmi/arm7tdmi.hpp"
 #include "bit.hpp"
 #include "mem.hpp"
+#include <algorithm>
 #include <bit>
 #include <cstring>
 #include <utility>
@@ -15,6 +16,8 @@ namespace {
 auto on_idle_event(void* user, s32 id = 0, s32 late = 0) -> void
 {
     auto& gba = *static_cast<Gba*>(user);
+    // cycles_spent_in_halt is reset on vblank, so this is counted separately
+    u32 cycles_skipped = 0;
 
     while (gba.waitloop.is_in_waitloop() && !gba.frame_end)
     {
@@ -23,6 +26,7 @@ auto on_idle_event(void* user, s32 id = 0, s32 late = 0) -> void
         if (event_cycles > 0)
         {
             gba.cycles_spent_in_halt += event_cycles;
+            cycles_skipped += event_cycles;
         }
 
         gba.scheduler.advance_to_next_event();
@@ -33,141 +37,444 @@ auto on_idle_event(void* user, s32 id = 0, s32 late = 0) -> void
         if (gba.scheduler.get_ticks() - event_cycles_abs > 0)
         {
             gba.cycles_spent_in_halt += gba.scheduler.get_ticks() - event_cycles_abs;
+            cycles_skipped += gba.scheduler.get_ticks() - event_cycles_abs;
         }
     }
+
+    gba.waitloop.on_waitloop_exit(cycles_skipped);
 }
 
-// list of valid instructions
-constexpr auto is_valid(const u16 opcode) -> bool
+// what an instruction within the loop does, see decode_thumb() / decode_arm()
+struct Instruction
 {
-    constexpr auto move_shifted_register_mask_a = 0b111'00'00000'000'000;
-    constexpr auto move_shifted_register_mask_b = 0b000'00'00000'000'000;
+    // registers that are written to, a bit per register
+    u16 writes;
+    // registers used to form the address of a load
+    u16 address_regs;
+    // address of the load
+    u32 addr;
+    // size of the load, 0 if not a load
+    u8 size;
+    // the load is sign extended (ldrsb, ldrsh)
+    bool sign;
+    // set if the register written to is always set to value (mov imm)
+    bool constant;
+    // arm instruction that isn't always executed
+    bool conditional;
+    // branch within the loop, the instructions after may be skipped
+    bool branch;
+    // false if the instruction has side effects
+    bool valid;
+    u32 value;
+};
+
+constexpr auto reg_bit(const u32 reg) -> u16
+{
+    return static_cast<u16>(1 << reg);
+}
 
-    constexpr auto hi_register_operations_mask_a = 0b111111'00'0'0'000'000;
-    constexpr auto hi_register_operations_mask_b = 0b010001'00'0'0'000'000;
+constexpr auto load(const u32 Rd, const u16 address_regs, const u32 addr, const u8 size, const bool sign = false) -> Instruction
+{
+    return { .writes = reg_bit(Rd), .address_regs = address_regs, .addr = addr, .size = size, .sign = sign, .valid = true };
+}
 
-    constexpr auto move_compare_add_subtract_immediate_mask_a = 0b111'00'000'00000000;
-    constexpr auto move_compare_add_subtract_immediate_mask_b = 0b001'00'000'00000000;
+constexpr auto write(const u16 writes) -> Instruction
+{
+    return { .writes = writes, .valid = true };
+}
 
+constexpr auto mov(const u32 Rd, const u32 value) -> Instruction
+{
+    return { .writes = reg_bit(Rd), .constant = true, .valid = true, .value = value };
+}
+
+constexpr auto branch() -> Instruction
+{
+    return { .branch = true, .valid = true };
+}
+
+// regs[PC_INDEX] is the pc as seen by the instruction.
+// the loop is rejected if an opcode isn't decoded here.
+constexpr auto decode_thumb(const u32 (&regs)[16], const u16 opcode) -> Instruction
+{
     constexpr auto add_subtract_mask_a = 0b11111'0'0'000'000'000;
     constexpr auto add_subtract_mask_b = 0b00011'0'0'000'000'000;
 
+    constexpr auto move_shifted_register_mask_a = 0b111'00'00000'000'000;
+    constexpr auto move_shifted_register_mask_b = 0b000'00'00000'000'000;
+
+    constexpr auto move_compare_add_subtract_immediate_mask_a = 0b111'00'000'00000000;
+    constexpr auto move_compare_add_subtract_immediate_mask_b = 0b001'00'000'00000000;
+
     constexpr auto alu_operations_mask_a = 0b111111'0000'000'000;
     constexpr auto alu_operations_mask_b = 0b010000'0000'000'000;
 
-    if ((opcode & hi_register_operations_mask_a) == hi_register_operations_mask_b)
+    constexpr auto hi_register_operations_mask_a = 0b111111'00'0'0'000'000;
+    constexpr auto hi_register_operations_mask_b = 0b010001'00'0'0'000'000;
+
+    constexpr auto pc_relative_load_mask_a = 0b11111'000'00000000;
+    constexpr auto pc_relative_load_mask_b = 0b01001'000'00000000;
+
+    constexpr auto load_store_with_register_offset_mask_a = 0b1111'0'0'0'000'000'000;
+    constexpr auto load_store_with_register_offset_mask_b = 0b0101'0'0'0'000'000'000;
+
+    constexpr auto load_store_with_immediate_offset_mask_a = 0b111'0'0'00000'000'000;
+    constexpr auto load_store_with_immediate_offset_mask_b = 0b011'0'0'00000'000'000;
+
+    constexpr auto load_store_halfword_mask_a = 0b1111'0'00000'000'000;
+    constexpr auto load_store_halfword_mask_b = 0b1000'0'00000'000'000;
+
+    constexpr auto sp_relative_load_store_mask_a = 0b1111'0'000'00000000;
+    constexpr auto sp_relative_load_store_mask_b = 0b1001'0'000'00000000;
+
+    constexpr auto load_address_mask_a = 0b1111'0'000'00000000;
+    constexpr auto load_address_mask_b = 0b1010'0'000'00000000;
+
+    constexpr auto add_offset_to_stack_pointer_mask_a = 0b11111111'0'0000000;
+    constexpr auto add_offset_to_stack_pointer_mask_b = 0b10110000'0'0000000;
+
+    constexpr auto conditional_branch_mask_a = 0b1111'0000'00000000;
+    constexpr auto conditional_branch_mask_b = 0b1101'0000'00000000;
+
+    constexpr auto unconditional_branch_mask_a = 0b11111'00000000000;
+    constexpr auto unconditional_branch_mask_b = 0b11100'00000000000;
+
+    if ((opcode & add_subtract_mask_a) == add_subtract_mask_b)
+    {
+        return write(reg_bit(bit::get_range<0, 2>(opcode)));
+    }
+    else if ((opcode & move_shifted_register_mask_a) == move_shifted_register_mask_b)
     {
-        return bit::get_range<8, 9>(opcode) != 0x3; // BX
+        return write(reg_bit(bit::get_range<0, 2>(opcode)));
     }
     else if ((opcode & move_compare_add_subtract_immediate_mask_a) == move_compare_add_subtract_immediate_mask_b)
     {
-        return true;
+        const auto Op = bit::get_range<11, 12>(opcode);
+        const auto Rd = bit::get_range<8, 10>(opcode);
+
+        switch (Op)
+        {
+            case 0x0: return mov(Rd, bit::get_range<0, 7>(opcode));
+            case 0x1: return write(0); // cmp
+            default: return write(reg_bit(Rd));
+        }
     }
-    else if ((opcode & add_subtract_mask_a) == add_subtract_mask_b)
+    else if ((opcode & alu_operations_mask_a) == alu_operations_mask_b)
     {
-        return true;
+        const auto Op = bit::get_range<6, 9>(opcode);
+        const auto Rd = bit::get_range<0, 2>(opcode);
+
+        switch (Op)
+        {
+            case 0x8: // tst
+            case 0xA: // cmp
+            case 0xB: // cmn
+                return write(0);
+
+            default:
+                return write(reg_bit(Rd));
+        }
     }
-    else if ((opcode & move_shifted_register_mask_a) == move_shifted_register_mask_b)
+    else if ((opcode & hi_register_operations_mask_a) == hi_register_operations_mask_b)
     {
-        return true;
+        const auto Op = bit::get_range<8, 9>(opcode);
+        const auto Rd = bit::get_range<0, 2>(opcode) | (bit::is_set<7>(opcode) << 3);
+
+        switch (Op)
+        {
+            case 0x1: return write(0); // cmp
+            case 0x3: return {}; // bx
+            default: return Rd == arm7tdmi::PC_INDEX ? Instruction{} : write(reg_bit(Rd));
+        }
     }
-    else if ((opcode & alu_operations_mask_a) == alu_operations_mask_b)
+    else if ((opcode & pc_relative_load_mask_a) == pc_relative_load_mask_b)
     {
-        return true;
+        const auto Rd = bit::get_range<8, 10>(opcode);
+        const auto addr = (regs[arm7tdmi::PC_INDEX] & ~0x2) + (bit::get_range<0, 7>(opcode) << 2);
+        return load(Rd, 0, addr, 4);
     }
+    else if ((opcode & load_store_with_register_offset_mask_a) == load_store_with_register_offset_mask_b)
+    {
+        // L/H, B/S, sign extended. stores are 0
+        constexpr u8 size[8] = { 0, 0, 0, 1, 4, 2, 1, 2 };
+        const auto Op = bit::get_range<9, 11>(opcode);
+        const auto Ro = bit::get_range<6, 8>(opcode);
+        const auto Rb = bit::get_range<3, 5>(opcode);
+        const auto Rd = bit::get_range<0, 2>(opcode);
 
-    return false;
-}
+        if (!size[Op])
+        {
+            return {};
+        }
 
-constexpr auto is_cmp(const u16 opcode) -> bool
-{
-    constexpr auto move_compare_add_subtract_immediate_mask_a = 0b111'00'000'00000000 | (0x3 << 11);
-    constexpr auto move_compare_add_subtract_immediate_mask_b = 0b001'00'000'00000000 | (0x1 << 11);
+        return load(Rd, reg_bit(Rb) | reg_bit(Ro), regs[Rb] + regs[Ro], size[Op], Op == 0x3 || Op == 0x7);
+    }
+    else if ((opcode & load_store_with_immediate_offset_mask_a) == load_store_with_immediate_offset_mask_b)
+    {
+        const auto B = bit::is_set<12>(opcode);
+        const auto offset = bit::get_range<6, 10>(opcode);
+        const auto Rb = bit::get_range<3, 5>(opcode);
+        const auto Rd = bit::get_range<0, 2>(opcode);
 
-    constexpr auto hi_register_operations_mask_a = 0b111111'00'0'0'000'000 | (0x3 << 8);
-    constexpr auto hi_register_operations_mask_b = 0b010001'00'0'0'000'000 | (0x1 << 8); // only allow cmp for now
+        if (!bit::is_set<11>(opcode)) // store
+        {
+            return {};
+        }
 
-    constexpr auto alu_operations_mask_a = 0b111111'0000'000'000 | (0xF << 6);
-    constexpr auto alu_operations_mask_b = 0b010000'0000'000'000 | (0xA << 6);
+        return load(Rd, reg_bit(Rb), regs[Rb] + (B ? offset : offset << 2), B ? 1 : 4);
+    }
+    else if ((opcode & load_store_halfword_mask_a) == load_store_halfword_mask_b)
+    {
+        const auto offset = bit::get_range<6, 10>(opcode) << 1;
+        const auto Rb = bit::get_range<3, 5>(opcode);
+        const auto Rd = bit::get_range<0, 2>(opcode);
 
-    if ((opcode & hi_register_operations_mask_a) == hi_register_operations_mask_b)
+        if (!bit::is_set<11>(opcode)) // store
+        {
+            return {};
+        }
+
+        return load(Rd, reg_bit(Rb), regs[Rb] + offset, 2);
+    }
+    else if ((opcode & sp_relative_load_store_mask_a) == sp_relative_load_store_mask_b)
     {
-        return true;
+        const auto Rd = bit::get_range<8, 10>(opcode);
+        const auto offset = bit::get_range<0, 7>(opcode) << 2;
+
+        if (!bit::is_set<11>(opcode)) // store
+        {
+            return {};
+        }
+
+        return load(Rd, reg_bit(arm7tdmi::SP_INDEX), regs[arm7tdmi::SP_INDEX] + offset, 4);
     }
-    else if ((opcode & move_compare_add_subtract_immediate_mask_a) == move_compare_add_subtract_immediate_mask_b)
+    else if ((opcode & load_address_mask_a) == load_address_mask_b)
     {
-        return true;
+        return write(reg_bit(bit::get_range<8, 10>(opcode)));
     }
-    else if ((opcode & alu_operations_mask_a) == alu_operations_mask_b)
+    else if ((opcode & add_offset_to_stack_pointer_mask_a) == add_offset_to_stack_pointer_mask_b)
+    {
+        return write(reg_bit(arm7tdmi::SP_INDEX));
+    }
+    else if ((opcode & conditional_branch_mask_a) == conditional_branch_mask_b)
+    {
+        // 0xE is undefined and 0xF is swi
+        return bit::get_range<8, 11>(opcode) < 0xE ? branch() : Instruction{};
+    }
+    else if ((opcode & unconditional_branch_mask_a) == unconditional_branch_mask_b)
     {
-        return true;
+        return branch();
     }
 
-    return false;
+    // push, pop, ldm, stm, bl and swi
+    return {};
 }
 
-constexpr auto get_poll_addr(const Gba& gba, const u16 opcode) -> u32
+// see decode_thumb()
+constexpr auto decode_arm_opcode(const u32 (&regs)[16], const u32 opcode) -> Instruction
 {
-    constexpr auto load_store_halfword_mask_a = 0b1111'0'00000'000'000 | (1 << 11);
-    constexpr auto load_store_halfword_mask_b = 0b1000'0'00000'000'000 | (1 << 11);
+    constexpr auto branch_mask_a = 0b0000'1111'0000'0000'0000'0000'0000'0000;
+    constexpr auto branch_mask_b = 0b0000'1010'0000'0000'0000'0000'0000'0000;
+
+    constexpr auto multiply_mask_a = 0b0000'1111'1100'0000'0000'0000'1111'0000;
+    constexpr auto multiply_mask_b = 0b0000'0000'0000'0000'0000'0000'1001'0000;
+
+    constexpr auto multiply_long_mask_a = 0b0000'1111'1000'0000'0000'0000'1111'0000;
+    constexpr auto multiply_long_mask_b = 0b0000'0000'1000'0000'0000'0000'1001'0000;
 
-    constexpr auto load_store_with_immediate_offset_mask_a = 0b111'0'0'00000'000'000 | (1 << 11);
-    constexpr auto load_store_with_immediate_offset_mask_b = 0b011'0'0'00000'000'000 | (1 << 11);
+    constexpr auto halfword_data_transfer_mask_a = 0b0000'1110'0000'0000'0000'0000'1001'0000;
+    constexpr auto halfword_data_transfer_mask_b = 0b0000'0000'0000'0000'0000'0000'1001'0000;
 
-    constexpr auto load_store_with_register_offset_mask_a = 0b1111'0'0'1'000'000'000 | (1 << 11);
-    constexpr auto load_store_with_register_offset_mask_b = 0b0101'0'0'0'000'000'000 | (1 << 11);
+    constexpr auto data_processing_mask_a = 0b0000'1100'0000'0000'0000'0000'0000'0000;
+    constexpr auto data_processing_mask_b = 0b0000'0000'0000'0000'0000'0000'0000'0000;
 
-    constexpr auto load_store_sign_extended_byte_halfword_mask_a = 0b1111'0'0'1'000'000'000 | (1 << 11);
-    constexpr auto load_store_sign_extended_byte_halfword_mask_b = 0b0101'0'0'1'000'000'000 | (1 << 11);
+    constexpr auto single_data_transfer_mask_a = 0b0000'1100'0000'0000'0000'0000'0000'0000;
+    constexpr auto single_data_transfer_mask_b = 0b0000'0100'0000'0000'0000'0000'0000'0000;
 
-    // only scan select few instructions because these are by far the most
-    // commonly used, and speeds up decoding.
-    if ((opcode & load_store_halfword_mask_a) == load_store_halfword_mask_b)
+    const auto Rn = bit::get_range<16, 19>(opcode);
+    const auto Rd = bit::get_range<12, 15>(opcode);
+    const auto Rm = bit::get_range<0, 3>(opcode);
+
+    if (bit::get_range<28, 31>(opcode) == 0xF) // never
     {
-        const auto Rb = bit::get_range<3, 5>(opcode);
-        const auto offset = bit::get_range<6, 10>(opcode) << 1; // 6bit
-        const auto base = arm7tdmi::get_reg(gba, Rb);
-        return base + offset;
+        return {};
     }
-    else if ((opcode & load_store_with_immediate_offset_mask_a) == load_store_with_immediate_offset_mask_b)
+    else if ((opcode & branch_mask_a) == branch_mask_b)
     {
-        const auto Rb = bit::get_range<3, 5>(opcode);
-        const auto offset = bit::get_range<6, 10>(opcode);
-        const auto base = arm7tdmi::get_reg(gba, Rb);
+        return branch();
+    }
+    else if ((opcode & multiply_mask_a) == multiply_mask_b)
+    {
+        // Rd is in 16-19 for multiply
+        return Rn == arm7tdmi::PC_INDEX ? Instruction{} : write(reg_bit(Rn));
+    }
+    else if ((opcode & multiply_long_mask_a) == multiply_long_mask_b)
+    {
+        // RdHi is in 16-19, RdLo is in 12-15
+        return Rn == arm7tdmi::PC_INDEX || Rd == arm7tdmi::PC_INDEX ? Instruction{} : write(reg_bit(Rn) | reg_bit(Rd));
+    }
+    else if ((opcode & halfword_data_transfer_mask_a) == halfword_data_transfer_mask_b)
+    {
+        const auto P = bit::is_set<24>(opcode);
+        const auto U = bit::is_set<23>(opcode);
+        const auto I = bit::is_set<22>(opcode);
+        const auto W = bit::is_set<21>(opcode);
+        const auto L = bit::is_set<20>(opcode);
+        const auto SH = bit::get_range<5, 6>(opcode);
+
+        // only pre-indexed loads without writeback, SH=0 is swap
+        if (!P || W || !L || !SH || Rd == arm7tdmi::PC_INDEX || (!I && Rm == arm7tdmi::PC_INDEX))
+        {
+            return {};
+        }
+
+        const auto offset = I ? (bit::get_range<8, 11>(opcode) << 4) | Rm : regs[Rm];
+        const auto addr = U ? regs[Rn] + offset : regs[Rn] - offset;
+        const u16 address_regs = (Rn == arm7tdmi::PC_INDEX ? 0 : reg_bit(Rn)) | (I ? 0 : reg_bit(Rm));
+
+        return load(Rd, address_regs, addr, SH == 0x2 ? 1 : 2, SH != 0x1);
+    }
+    else if ((opcode & data_processing_mask_a) == data_processing_mask_b)
+    {
+        const auto I = bit::is_set<25>(opcode);
+        const auto Op = bit::get_range<21, 24>(opcode);
+        const auto S = bit::is_set<20>(opcode);
+        const auto test = Op >= 0x8 && Op <= 0xB; // tst, teq, cmp, cmn
 
-        if (bit::is_set<12>(opcode)) // byte
+        if (test)
+        {
+            // without S, these are mrs, msr and bx
+            return S ? write(0) : Instruction{};
+        }
+        else if (Rd == arm7tdmi::PC_INDEX)
         {
-            return base + offset;
+            return {};
         }
-        else // word
+        else if (I && Op == 0xD) // mov imm
         {
-            return base + (offset << 2);
+            return mov(Rd, std::rotr(bit::get_range<0, 7>(opcode), bit::get_range<8, 11>(opcode) * 2));
         }
+
+        return write(reg_bit(Rd));
     }
-    else if ((opcode & load_store_with_register_offset_mask_a) == load_store_with_register_offset_mask_b)
+    else if ((opcode & single_data_transfer_mask_a) == single_data_transfer_mask_b)
     {
-        const auto Ro = bit::get_range<6, 8>(opcode);
-        const auto Rb = bit::get_range<3, 5>(opcode);
-        const auto base = arm7tdmi::get_reg(gba, Rb);
-        const auto offset = arm7tdmi::get_reg(gba, Ro);
-        return (base + offset) & ~0x1;
+        const auto I = bit::is_set<25>(opcode);
+        const auto P = bit::is_set<24>(opcode);
+        const auto U = bit::is_set<23>(opcode);
+        const auto B = bit::is_set<22>(opcode);
+        const auto W = bit::is_set<21>(opcode);
+        const auto L = bit::is_set<20>(opcode);
+
+        // only pre-indexed loads without writeback.
+        // register offsets are only allowed with lsl #imm.
+        if (!P || W || !L || Rd == arm7tdmi::PC_INDEX)
+        {
+            return {};
+        }
+        else if (I && (bit::get_range<4, 6>(opcode) || Rm == arm7tdmi::PC_INDEX))
+        {
+            return {};
+        }
+
+        const auto offset = I ? regs[Rm] << bit::get_range<7, 11>(opcode) : bit::get_range<0, 11>(opcode);
+        const auto addr = U ? regs[Rn] + offset : regs[Rn] - offset;
+        const u16 address_regs = (Rn == arm7tdmi::PC_INDEX ? 0 : reg_bit(Rn)) | (I ? reg_bit(Rm) : 0);
+
+        return load(Rd, address_regs, addr, B ? 1 : 4);
     }
-    else if ((opcode & load_store_sign_extended_byte_halfword_mask_a) == load_store_sign_extended_byte_halfword_mask_b)
+
+    // swap, bl, block transfers, coprocessor, swi and undefined
+    return {};
+}
+
+constexpr auto decode_arm(const u32 (&regs)[16], const u32 opcode) -> Instruction
+{
+    auto i = decode_arm_opcode(regs, opcode);
+    i.conditional = bit::get_range<28, 31>(opcode) != arm7tdmi::COND_AL;
+    return i;
+}
+
+enum PollType
+{
+    // the value is always the same, ie, rom
+    POLL_CONSTANT,
+    // the value can change, writes are tracked in on_event_change().
+    POLL_MEMORY,
+    // writes aren't tracked, so this address cannot be polled
+    POLL_INVALID,
+};
+
+// io registers that either only change on a cpu write, or that
+// call on_event_change() when the hardware changes them.
+constexpr auto is_pollable_io(const u32 addr) -> bool
+{
+    switch (addr)
     {
-        const auto Ro = bit::get_range<6, 8>(opcode);
-        const auto Rb = bit::get_range<3, 5>(opcode);
-        const auto base = arm7tdmi::get_reg(gba, Rb);
-        const auto offset = arm7tdmi::get_reg(gba, Ro);
-        return (base + offset) & ~0x1;
+        case mem::IO_DISPCNT:
+        case mem::IO_DISPSTAT:
+        case mem::IO_VCOUNT:
+        case mem::IO_DMA0CNT_L:
+        case mem::IO_DMA0CNT_H:
+        case mem::IO_DMA1CNT_L:
+        case mem::IO_DMA1CNT_H:
+        case mem::IO_DMA2CNT_L:
+        case mem::IO_DMA2CNT_H:
+        case mem::IO_DMA3CNT_L:
+        case mem::IO_DMA3CNT_H:
+        case mem::IO_KEY:
+        case mem::IO_KEYCNT:
+        case mem::IO_IE:
+        case mem::IO_IF:
+        case mem::IO_IME:
+            return true;
     }
 
-    return 0xFFFFFFFF;
+    return false;
+}
+
+constexpr auto get_poll_type(const Gba& gba, const u32 addr, const u32 size) -> PollType
+{
+    switch (addr >> 24)
+    {
+        case 0x2: // EWRAM
+        case 0x3: // IWRAM
+        case 0x5: // pram
+        case 0x6: // vram
+        case 0x7: // oam
+            return POLL_MEMORY;
+
+        case 0x4:
+            for (u32 i = 0; i < size; i += 2)
+            {
+                if (!is_pollable_io((addr + i) & ~0x1))
+                {
+                    // std::printf("IO[0x%08X] waitloop\n", addr);
+                    return POLL_INVALID;
+                }
+            }
+            return POLL_MEMORY;
+
+        case 0x8: case 0x9: // rom
+        case 0xA: case 0xB:
+        case 0xC:
+            // gpio is mapped over the rom
+            if (addr + size > mem::GPIO_DATA && addr <= mem::GPIO_CONTROL + 1)
+            {
+                return POLL_INVALID;
+            }
+            return gba.rmap[addr >> 24].array ? POLL_CONSTANT : POLL_INVALID;
+
+        default: // bios, eeprom, sram
+            return POLL_INVALID;
+    }
 }
 
-inline auto read16(const u8* array, u32 addr) -> u16
+template<typename T>
+auto read(const mem::ReadArray& entry, const u32 addr) -> T
 {
-    u16 data;
-    std::memcpy(&data, array + addr, sizeof(data));
+    T data;
+    std::memcpy(&data, entry.array + (addr & entry.mask), sizeof(data));
 
     if constexpr(std::endian::native == std::endian::big)
     {
@@ -177,131 +484,148 @@ inline auto read16(const u8* array, u32 addr) -> u16
     return data;
 }
 
+auto read_load(const Gba& gba, const Instruction& i) -> u32
+{
+    const auto& entry = gba.rmap[i.addr >> 24];
+
+    switch (i.size)
+    {
+        case 1: return i.sign ? static_cast<s8>(read<u8>(entry, i.addr)) : read<u8>(entry, i.addr);
+        case 2: return i.sign ? static_cast<s16>(read<u16>(entry, i.addr)) : read<u16>(entry, i.addr);
+        default: return read<u32>(entry, i.addr);
+    }
+}
+
 } // namespace
 
 // CASTLEVANIA: https://discord.com/channels/465585922579103744/472481254911115266/1037621944591323146
 // TESTROM: https://discord.com/channels/465585922579103744/472481254911115266/1037612636898066522
 // POKEMON: https://discord.com/channels/465585922579103744/472481254911115266/1037753629534343199
-auto Waitloop::evaluate_loop_step1(Gba& gba, const u32 current_pc, u32 new_jump_pc) -> bool
+// checks that the loop [pc, branch_pc] is read only and polls at most
+// one address that can change. the registers are those at the start of the
+// loop, step2 checks that they're the same after another loop.
+auto Waitloop::evaluate_loop_step1(Gba& gba, const u32 branch_pc, const bool thumb) -> WaitloopResult
 {
-    // checks that the pc jumps back and that the pc is within rom range
-    if (current_pc <= new_jump_pc || new_jump_pc < 0x8000000 || new_jump_pc > 0x8FFFFFF)
-    {
-        return false;
-    }
+    const u32 size = thumb ? 2 : 4;
+    const auto region = pc >> 24;
 
-    const auto length = current_pc - new_jump_pc;
+    poll_address = 0xFFFFFFFF;
+    poll_size = 0;
 
-    if (length > 0xE)
+    switch (region)
     {
-        return false;
-    }
-
-    new_jump_pc &= mem::ROM_MASK;
-    const auto first_opcode = read16(gba.rom, new_jump_pc);
-    const auto last_opcode = read16(gba.rom, (new_jump_pc + length) - 6);
+        case 0x2: // EWRAM
+        case 0x3: // IWRAM
+        case 0x8: case 0x9: // rom
+        case 0xA: case 0xB:
+        case 0xC: case 0xD:
+            break;
 
-    poll_address = get_poll_addr(gba, first_opcode);
-    poll_address &= mem::align<u16>(poll_address);
+        default:
+            return WAITLOOP_RESULT_REJECT_REGION;
+    }
 
-    if (poll_address == 0xFFFFFFFF)
+    const auto& entry = gba.rmap[region];
+    if (region != branch_pc >> 24 || !entry.array || !(entry.access & size))
     {
-        return false;
+        return WAITLOOP_RESULT_REJECT_REGION;
     }
-    #if 1
-    if (!is_cmp(last_opcode))
-    #else
-    if (!is_valid(last_opcode)) // this works but often has false positives
-    #endif
+
+    u32 regs[16];
+    for (u8 i = 0; i < 16; i++)
     {
-        return false;
+        regs[i] = arm7tdmi::get_reg(gba, i);
     }
 
-    switch ((poll_address >> 24) & 0xF)
+    // registers that have the same value here on every loop, this is every
+    // register at the start, as step2 checks that these don't change.
+    u16 known = 0xFFFF;
+    // once a branch within the loop is seen, writes may be skipped
+    bool branched = false;
+
+    for (auto addr = pc; addr < branch_pc; addr += size)
     {
-        case 0x2: // EWRAM
-        case 0x3: // IWRAM
-        case 0x5: // pram
-        case 0x6: // vram
-        case 0x7: // oam
-            break;
+        regs[arm7tdmi::PC_INDEX] = addr + size * 2;
 
-        case 0x4:
-            // todo: support polling of more io registers
-            switch (poll_address)
+        auto i = thumb ? decode_thumb(regs, read<u16>(entry, addr)) : decode_arm(regs, read<u32>(entry, addr));
+        if (!i.valid)
+        {
+            return WAITLOOP_RESULT_REJECT_OPCODE;
+        }
+
+        if (i.size)
+        {
+            // the address would change each loop
+            if (i.address_regs & ~known)
+            {
+                return WAITLOOP_RESULT_REJECT_POLL;
+            }
+
+            i.addr &= ~(i.size - 1);
+
+            switch (get_poll_type(gba, i.addr, i.size))
             {
-                case mem::IO_VCOUNT:
-                case mem::IO_DISPSTAT:
-                case mem::IO_DMA0CNT_L:
-                case mem::IO_DMA0CNT_H:
-                case mem::IO_DMA1CNT_L:
-                case mem::IO_DMA1CNT_H:
-                case mem::IO_DMA2CNT_L:
-                case mem::IO_DMA2CNT_H:
-                case mem::IO_DMA3CNT_L:
-                case mem::IO_DMA3CNT_H:
+                case POLL_CONSTANT:
+                    i.value = read_load(gba, i);
+                    i.constant = true;
+                    break;
+
+                case POLL_MEMORY:
+                    if (poll_size && (poll_address != i.addr || poll_size != i.size))
+                    {
+                        return WAITLOOP_RESULT_REJECT_POLL;
+                    }
+                    poll_address = i.addr;
+                    poll_size = i.size;
                     break;
 
-                default:
-                    // std::printf("IO[0x%08X] waitloop\n", poll_address);
-                    return false;
+                case POLL_INVALID:
+                    return WAITLOOP_RESULT_REJECT_POLL;
             }
-            break;
+        }
 
-        default:
-            return false;
-    }
+        known &= ~i.writes;
 
-    if (length == 0x8) // 3 instructions, 0 to evaluate
-    {
-        return true;
-    }
-    else if (length == 0xA) // 4 instructions, 1 to evaluate
-    {
-        const auto second_opcode = read16(gba.rom, (new_jump_pc + 2));
-        return is_valid(second_opcode);
-    }
-    else if (length == 0xC) // 5 instructions, 2 to evaluate
-    {
-        const auto second_opcode = read16(gba.rom, (new_jump_pc + 2));
-        const auto third_opcode = read16(gba.rom, (new_jump_pc + 4));
-        return is_valid(second_opcode) && is_valid(third_opcode);
-    }
-    else if (length == 0xE) // 6 instructions, 3 to evaluate
-    {
-        const auto second_opcode = read16(gba.rom, (new_jump_pc + 2));
-        const auto third_opcode = read16(gba.rom, (new_jump_pc + 4));
-        const auto forth_opcode = read16(gba.rom, (new_jump_pc + 6));
-        return is_valid(second_opcode) && is_valid(third_opcode) && is_valid(forth_opcode);
+        // the write may not happen if skipped over
+        if (i.constant && !i.conditional && !branched)
+        {
+            regs[std::countr_zero(i.writes)] = i.value;
+            known |= i.writes;
+        }
+
+        branched |= i.branch;
     }
 
-    std::unreachable();
+    return WAITLOOP_RESULT_DETECTED;
 }
 
 // on the second step, check if the registers change, if true
-auto Waitloop::evaluate_loop_step2(Gba& gba, const u32 current_pc, const u32 new_jump_pc) -> bool
+auto Waitloop::evaluate_loop_step2(Gba& gba) -> bool
 {
-    return 0 == std::memcmp(wait_loop_registers, gba.cpu.registers, sizeof(wait_loop_registers));
+    return 0 == std::memcmp(wait_loop_registers, gba.cpu.registers, sizeof(wait_loop_registers)) && wait_loop_cpsr == arm7tdmi::get_u32_from_cpsr(gba);
 }
 
-void Waitloop::evaluate_loop(Gba& gba, const u32 current_pc, const u32 new_jump_pc)
+void Waitloop::evaluate_loop(Gba& gba, const u32 branch_pc, const bool thumb)
 {
     switch (step)
     {
-        case WAITLOOP_STEP_1:
-            if (evaluate_loop_step1(gba, current_pc, new_jump_pc))
+        case WAITLOOP_STEP_1: {
+            const auto result = evaluate_loop_step1(gba, branch_pc, thumb);
+            if (result == WAITLOOP_RESULT_DETECTED)
             {
                 std::memcpy(wait_loop_registers, gba.cpu.registers, sizeof(wait_loop_registers));
+                wait_loop_cpsr = arm7tdmi::get_u32_from_cpsr(gba);
                 step = WAITLOOP_STEP_2;
             }
             else
             {
+                add_report(branch_pc, thumb, result);
                 step = WAITLOOP_STEP_INVALID;
             }
-            break;
+        }   break;
 
         case WAITLOOP_STEP_2:
-            if (evaluate_loop_step2(gba, current_pc, new_jump_pc))
+            if (evaluate_loop_step2(gba))
             {
                 if (event_changed)
                 {
@@ -310,6 +634,7 @@ void Waitloop::evaluate_loop(Gba& gba, const u32 current_pc, const u32 new_jump_
                 }
                 else
                 {
+                    add_report(branch_pc, thumb, WAITLOOP_RESULT_DETECTED);
                     gba.waitloop.in_waitloop = true;
                     gba.scheduler.add(scheduler::ID::IDLE_LOOP, 0, on_idle_event, &gba);
                     step = WAITLOOP_STEP_1;
@@ -317,7 +642,8 @@ void Waitloop::evaluate_loop(Gba& gba, const u32 current_pc, const u32 new_jump_
             }
             else
             {
-                // std::printf("[WAITLOOP] failed step 2: 0x%08X\n", new_jump_pc);
+                // std::printf("[WAITLOOP] failed step 2: 0x%08X\n", pc);
+                add_report(branch_pc, thumb, WAITLOOP_RESULT_REJECT_REGISTERS);
                 step = WAITLOOP_STEP_INVALID;
             }
             break;
@@ -327,9 +653,10 @@ void Waitloop::evaluate_loop(Gba& gba, const u32 current_pc, const u32 new_jump_
     }
 }
 
-void Waitloop::on_thumb_loop(Gba& gba, const u32 current_pc, const u32 new_jump_pc)
+void Waitloop::on_loop(Gba& gba, const u32 branch_pc, const u32 new_jump_pc, const bool thumb)
 {
-    if (!is_enabled()) [[unlikely]]
+    // only short loops that jump back are checked
+    if (new_jump_pc > branch_pc || branch_pc - new_jump_pc >= (MAX_INSTRUCTIONS * (thumb ? 2 : 4)))
     {
         return;
     }
@@ -340,7 +667,27 @@ void Waitloop::on_thumb_loop(Gba& gba, const u32 current_pc, const u32 new_jump_
         step = WAITLOOP_STEP_1;
     }
 
-    evaluate_loop(gba, current_pc, new_jump_pc);
+    evaluate_loop(gba, branch_pc, thumb);
+}
+
+void Waitloop::on_thumb_loop(Gba& gba, const u32 current_pc, const u32 new_jump_pc)
+{
+    if (!is_enabled()) [[unlikely]]
+    {
+        return;
+    }
+
+    on_loop(gba, current_pc - 4, new_jump_pc, true);
+}
+
+void Waitloop::on_arm_loop(Gba& gba, const u32 current_pc, const u32 new_jump_pc)
+{
+    if (!is_enabled()) [[unlikely]]
+    {
+        return;
+    }
+
+    on_loop(gba, current_pc - 8, new_jump_pc, false);
 }
 
 void Waitloop::on_event_change(Gba& gba, const WaitloopEvent event, const u32 addr_start, const u32 addr_end)
@@ -355,27 +702,20 @@ void Waitloop::on_event_change(Gba& gba, const WaitloopEvent event, const u32 ad
                 break;
 
             // check if the dma was in range of the address that is polled.
-            case WAITLOOP_EVENT_DMA:
-                // dma addr was incremented
-                if (addr_start < addr_end)
-                {
-                    if (poll_address >= addr_start && poll_address <= addr_end)
-                    {
-                        in_waitloop = false;
-                    }
-                }
-                // otherwise the addr was decremented
-                else
+            case WAITLOOP_EVENT_DMA: {
+                // the addr may have been incremented or decremented
+                const auto lo = std::min(addr_start, addr_end);
+                const auto hi = std::max(addr_start, addr_end);
+
+                if (poll_address <= hi && poll_address + poll_size > lo)
                 {
-                    if (poll_address >= addr_end && poll_address <= addr_start)
-                    {
-                        in_waitloop = false;
-                    }
+                    in_waitloop = false;
                 }
-                break;
+            }   break;
 
+            // io registers are 16-bit
             case WAITLOOP_EVENT_IO:
-                if (addr_start == poll_address)
+                if (poll_address < addr_start + 2 && poll_address + poll_size > addr_start)
                 {
                     in_waitloop = false;
                 }
@@ -388,15 +728,73 @@ void Waitloop::on_event_change(Gba& gba, const WaitloopEvent event, const u32 ad
     }
 }
 
+void Waitloop::on_waitloop_exit(const u32 cycles)
+{
+    if (report_index >= 0)
+    {
+        report[report_index].cycles_skipped += cycles;
+    }
+}
+
+void Waitloop::add_report(const u32 branch_pc, const bool thumb, const WaitloopResult result)
+{
+    const auto match = [this, thumb](s32 index) { return report[index].pc == pc && report[index].thumb == thumb; };
+
+    // most of the time, it's the same loop as last time
+    if (report_index < 0 || !match(report_index))
+    {
+        report_index = -1;
+
+        for (u32 i = 0; i < report_count; i++)
+        {
+            if (match(i))
+            {
+                report_index = i;
+                break;
+            }
+        }
+
+        if (report_index < 0)
+        {
+            if (report_count == MAX_REPORT)
+            {
+                return;
+            }
+
+            report_index = report_count++;
+            report[report_index] = { .pc = pc, .thumb = thumb };
+        }
+    }
+
+    auto& r = report[report_index];
+    r.poll_address = poll_size ? poll_address : 0xFFFFFFFF;
+    r.length = (branch_pc - pc) / (thumb ? 2 : 4) + 1;
+    r.result = result;
+
+    if (result == WAITLOOP_RESULT_DETECTED)
+    {
+        r.detected++;
+    }
+    else
+    {
+        r.rejected++;
+    }
+}
+
 void Waitloop::reset(Gba& gba, const bool enable)
 {
     pc = 0;
     poll_address = 0;
+    poll_size = 0;
     std::memset(wait_loop_registers, 0, sizeof(wait_loop_registers));
+    wait_loop_cpsr = 0;
     step = WAITLOOP_STEP_1;
     in_waitloop = false;
     event_changed = false;
     enabled = enable;
+    std::memset(report, 0, sizeof(report));
+    report_count = 0;
+    report_index = -1;
 }
 
 } // namespace gba::waitloop
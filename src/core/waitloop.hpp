@@ -5,6 +5,7 @@
 #pragma once
 
 #include "fwd.hpp"
+#include <span>
 
 namespace gba::waitloop {
 
@@ -26,27 +27,76 @@ enum WaitloopStep
     WAITLOOP_STEP_INVALID,
 };
 
+enum WaitloopResult : u8
+{
+    // the loop was skipped
+    WAITLOOP_RESULT_DETECTED,
+    // the loop isn't in rom, ewram or iwram
+    WAITLOOP_RESULT_REJECT_REGION,
+    // the loop has an instruction that has side effects (store, swi...)
+    WAITLOOP_RESULT_REJECT_OPCODE,
+    // the loop reads from an address that can't be tracked, or more
+    // than one address that can change, or the address changes each loop.
+    WAITLOOP_RESULT_REJECT_POLL,
+    // the registers changed between step1 and step2
+    WAITLOOP_RESULT_REJECT_REGISTERS,
+};
+
+// an entry per loop that was checked, see get_report()
+struct LoopReport
+{
+    // the address that is jumped back to
+    u32 pc;
+    // the address that is polled, 0xFFFFFFFF if nothing is polled
+    u32 poll_address;
+    // total cycles that were skipped in this loop
+    u64 cycles_skipped;
+    // number of times the loop was skipped / rejected
+    u32 detected;
+    u32 rejected;
+    // number of instructions, including the branch
+    u8 length;
+    bool thumb;
+    // the result of the last check
+    WaitloopResult result;
+};
+
 struct Waitloop
 {
 public:
+    // max number of instructions in a loop, including the branch
+    static constexpr auto MAX_INSTRUCTIONS = 8;
+    // max number of loops that are reported
+    static constexpr auto MAX_REPORT = 64;
+
     // call this on startup or to disable waitloop
     void reset(Gba& gba, bool enable);
-    // call this on conditional branches
+    // call this on taken thumb branches, current_pc is the pc of the branch + 4
     void on_thumb_loop(Gba& gba, u32 current_pc, u32 new_jump_pc);
+    // call this on taken arm branches, current_pc is the pc of the branch + 8
+    void on_arm_loop(Gba& gba, u32 current_pc, u32 new_jump_pc);
     // call this whenever an event changes
     void on_event_change(Gba& gba, WaitloopEvent event, u32 addr_start = 0, u32 addr_end = 0);
+    // called when the loop is exited, with the cycles that were skipped
+    void on_waitloop_exit(u32 cycles);
     // returns master enable flag
     [[nodiscard]] auto is_enabled() const -> bool { return enabled; }
     // returns true if currently within a waitloop
     [[nodiscard]] auto is_in_waitloop() const -> bool { return in_waitloop; }
+    // returns every loop that was checked since reset()
+    [[nodiscard]] auto get_report() const -> std::span<const LoopReport> { return { report, report_count }; }
 
 private:
-    // the new pc of thumb conditional branch
+    // the new pc of the branch
     u32 pc;
     // the address that is polled
     u32 poll_address;
+    // the number of bytes that are polled, 0 if nothing is polled
+    u32 poll_size;
     // saved registers need for step2
     u32 wait_loop_registers[15];
+    // saved flags need for step2
+    u32 wait_loop_cpsr;
     // see WaitloopStep
     u8 step;
     // set to true whilst in a waitloop, cleared on_event_change().
@@ -56,9 +106,16 @@ private:
     // master enable flag, if false, no loop skipp will occur
     bool enabled;
 
-    auto evaluate_loop_step1(Gba& gba, u32 current_pc, u32 new_jump_pc) -> bool;
-    auto evaluate_loop_step2(Gba& gba, u32 current_pc, u32 new_jump_pc) -> bool;
-    void evaluate_loop(Gba& gba, u32 current_pc, u32 new_jump_pc);
+    LoopReport report[MAX_REPORT];
+    u32 report_count;
+    // entry of the current loop, -1 if none
+    s32 report_index;
+
+    auto evaluate_loop_step1(Gba& gba, u32 branch_pc, bool thumb) -> WaitloopResult;
+    auto evaluate_loop_step2(Gba& gba) -> bool;
+    void evaluate_loop(Gba& gba, u32 branch_pc, bool thumb);
+    void on_loop(Gba& gba, u32 branch_pc, u32 new_jump_pc, bool thumb);
+    void add_report(u32 branch_pc, bool thumb, WaitloopResult result);
 };
 
-} // namespace gba::arm7tdmi::waitloop
+} // namespace gba::waitloop
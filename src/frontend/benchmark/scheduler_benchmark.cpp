@@ -0,0 +1,308 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// records the scheduler events of a rom, then replays that trace through
+// the old heap based scheduler and the current slot based scheduler.
+// usage: scheduler_benchmark <rom|.trace> [frames=600] [iterations=50] [trace_out]
+#include <gba.hpp>
+#include <scheduler.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using s32 = scheduler::s32;
+
+struct Op
+{
+    scheduler::Trace type;
+    s32 id;
+    s32 time;
+    s32 cycles;
+};
+
+// the scheduler prior to slot ids, kept here for comparison.
+// add_absolute() and remove() do a linear search and full re-heapify.
+struct HeapScheduler
+{
+    struct Event
+    {
+        s32 time;
+        s32 id;
+        scheduler::Callback callback;
+        void* user;
+    };
+
+    void reset(s32 starting_cycles, scheduler::Callback cb, void* user)
+    {
+        queue.clear();
+        cycles = starting_cycles;
+        add_absolute(scheduler::RESERVED_ID, scheduler::TIMEOUT_VALUE, cb, user);
+    }
+
+    void fire()
+    {
+        while (!queue.empty())
+        {
+            const auto event = queue.front();
+            if (event.time > cycles)
+            {
+                break;
+            }
+            std::pop_heap(queue.begin(), queue.end(), compare);
+            queue.pop_back();
+            event.callback(event.user, event.id, event.time - cycles);
+        }
+    }
+
+    void add_absolute(s32 id, s32 event_time, scheduler::Callback cb, void* user)
+    {
+        const auto itr = std::find_if(queue.begin(), queue.end(), [id](auto& e){ return id == e.id; });
+
+        if (itr != queue.end())
+        {
+            if (itr == queue.begin())
+            {
+                std::pop_heap(queue.begin(), queue.end(), compare);
+                queue.back().time = event_time;
+                queue.back().callback = cb;
+                queue.back().user = user;
+                std::push_heap(queue.begin(), queue.end(), compare);
+            }
+            else
+            {
+                itr->time = event_time;
+                itr->callback = cb;
+                itr->user = user;
+                std::make_heap(queue.begin(), queue.end(), compare);
+            }
+        }
+        else
+        {
+            queue.emplace_back(Event{event_time, id, cb, user});
+            std::push_heap(queue.begin(), queue.end(), compare);
+        }
+    }
+
+    void remove(s32 id)
+    {
+        const auto itr = std::remove_if(queue.begin(), queue.end(), [id](auto& e) { return id == e.id; });
+
+        if (itr != queue.end())
+        {
+            queue.erase(itr, queue.end());
+            std::make_heap(queue.begin(), queue.end(), compare);
+        }
+    }
+
+    void tick(s32 ticks) { cycles += ticks; }
+    [[nodiscard]] auto get_ticks() const -> s32 { return cycles; }
+
+    static auto compare(const Event& a, const Event& b) -> bool { return a.time > b.time; }
+
+    std::vector<Event> queue;
+    s32 cycles;
+};
+
+struct FireCount
+{
+    std::uint64_t count;
+    std::uint64_t sum;
+};
+
+void on_fire(void* user, s32 id, s32 late)
+{
+    auto& result = *static_cast<FireCount*>(user);
+    result.count++;
+    result.sum += static_cast<std::uint64_t>(id) * 31 + static_cast<std::uint32_t>(late);
+}
+
+void on_trace(void* user, scheduler::Trace type, s32 id, s32 time, s32 cycles)
+{
+    static_cast<std::vector<Op>*>(user)->emplace_back(Op{type, id, time, cycles});
+}
+
+auto mem_size(std::FILE* file) -> std::size_t
+{
+    std::fseek(file, 0, SEEK_END);
+    const auto size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    return size > 0 ? static_cast<std::size_t>(size) : 0;
+}
+
+auto record(const char* path, int frames) -> std::vector<Op>
+{
+    std::vector<Op> trace;
+
+    auto file = std::fopen(path, "rb");
+    if (!file)
+    {
+        return trace;
+    }
+
+    std::vector<gba::u8> rom(mem_size(file));
+    const auto read = std::fread(rom.data(), 1, rom.size(), file);
+    std::fclose(file);
+    if (read != rom.size())
+    {
+        return trace;
+    }
+
+    auto gameboy_advance = std::make_unique<gba::Gba>();
+    gameboy_advance->scheduler.set_trace_callback(on_trace, &trace);
+
+    if (!gameboy_advance->loadrom(rom))
+    {
+        trace.clear();
+        return trace;
+    }
+
+    static gba::u16 dummy_pixels[160][240];
+    gameboy_advance->set_pixels(dummy_pixels, 240, 16);
+
+    // the sample event is one of the most frequently rescheduled events
+    static gba::s16 dummy_apu_data[2048];
+    gameboy_advance->set_audio_callback([](void*){}, dummy_apu_data, 65536);
+
+    for (int i = 0; i < frames; i++)
+    {
+        gameboy_advance->run();
+    }
+
+    gameboy_advance->scheduler.set_trace_callback(nullptr, nullptr);
+    return trace;
+}
+
+auto load_trace(const char* path) -> std::vector<Op>
+{
+    std::vector<Op> trace;
+
+    if (auto file = std::fopen(path, "rb"))
+    {
+        trace.resize(mem_size(file) / sizeof(Op));
+        if (std::fread(trace.data(), sizeof(Op), trace.size(), file) != trace.size())
+        {
+            trace.clear();
+        }
+        std::fclose(file);
+    }
+
+    return trace;
+}
+
+auto save_trace(const char* path, const std::vector<Op>& trace) -> bool
+{
+    auto file = std::fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    const auto written = std::fwrite(trace.data(), sizeof(Op), trace.size(), file);
+    std::fclose(file);
+    return written == trace.size();
+}
+
+template<typename T>
+auto replay(T& s, const std::vector<Op>& trace, FireCount& result) -> void
+{
+    s.reset(trace.empty() ? 0 : trace.front().cycles, on_fire, &result);
+
+    for (const auto& op : trace)
+    {
+        s.tick(op.cycles - s.get_ticks());
+
+        switch (op.type)
+        {
+            case scheduler::Trace::ADD:
+                s.add_absolute(op.id, op.time, on_fire, &result);
+                break;
+
+            case scheduler::Trace::REMOVE:
+                s.remove(op.id);
+                break;
+
+            case scheduler::Trace::FIRE:
+                s.fire();
+                break;
+        }
+    }
+}
+
+template<typename T>
+auto bench(const char* name, const std::vector<Op>& trace, int iterations) -> FireCount
+{
+    auto s = std::make_unique<T>();
+    FireCount result{};
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        result = {};
+        replay(*s, trace, result);
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    const auto total_ops = static_cast<double>(trace.size()) * iterations;
+
+    std::printf("%-6s %8.2f ms total %6.2f ns/op fired: %llu\n", name, static_cast<double>(ns) / 1e6, static_cast<double>(ns) / total_ops, static_cast<unsigned long long>(result.count));
+    return result;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    if (argc < 2)
+    {
+        std::printf("usage: %s <rom|.trace> [frames=600] [iterations=50] [trace_out]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string_view path{argv[1]};
+    const auto frames = argc > 2 ? std::atoi(argv[2]) : 600;
+    const auto iterations = argc > 3 ? std::atoi(argv[3]) : 50;
+
+    const auto trace = path.ends_with(".trace") ? load_trace(argv[1]) : record(argv[1], frames);
+    if (trace.empty())
+    {
+        std::printf("failed to load trace from: %s\n", argv[1]);
+        return 1;
+    }
+
+    if (argc > 4 && !save_trace(argv[4], trace))
+    {
+        std::printf("failed to save trace to: %s\n", argv[4]);
+    }
+
+    std::size_t adds{}, removes{}, fires{};
+    for (const auto& op : trace)
+    {
+        adds += op.type == scheduler::Trace::ADD;
+        removes += op.type == scheduler::Trace::REMOVE;
+        fires += op.type == scheduler::Trace::FIRE;
+    }
+
+    std::printf("trace: %zu ops (add: %zu remove: %zu fire: %zu) iterations: %d\n", trace.size(), adds, removes, fires, iterations);
+
+    const auto heap = bench<HeapScheduler>("heap", trace, iterations);
+    const auto slot = bench<scheduler::Scheduler>("slot", trace, iterations);
+
+    // ordering of events with the same time may differ, but the same
+    // events must have fired.
+    if (heap.count != slot.count || heap.sum != slot.sum)
+    {
+        std::printf("mismatch between heap and slot scheduler!\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -820,6 +820,8 @@ auto App::savestate(const std::string& path) -> bool
     std::string new_path = "/state/" + create_state_path(rom_path);
     if (frontend::Base::savestate(new_path))
     {
+        // the state has to be written before it can be synced
+        state_worker.flush();
         em_idbfs_syncfs();
         return true;
     }
@@ -1470,12 +1472,11 @@ auto App::on_audio_change() -> void
         return;
     }
 
-    std::scoped_lock lock0{core_mutex};
-    std::scoped_lock lock1{audio_mutex};
+    // the ring is cleared when the audio device is un-paused
+    std::scoped_lock lock{core_mutex};
 
     if (emu_audio_disabled)
     {
-        SDL_AudioStreamClear(audio_stream);
         gameboy_advance.set_audio_callback(nullptr, {});
     }
     else
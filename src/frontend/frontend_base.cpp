@@ -12,6 +12,7 @@
 #include <fstream>
 #include <filesystem>
 #include <string_view>
+#include <utility>
 #include <vector>
 #include <zlib.h>
 #include <minizip/unzip.h>
@@ -572,6 +573,8 @@ auto Base::closerom() -> void
         has_rom = false;
     }
 
+    rewind.clear();
+    run_ahead.close();
     emu_run = false;
 }
 
@@ -581,20 +584,33 @@ auto Base::loadrom(const std::string& path) -> bool
     closerom();
 
     rom_path = path;
-    const auto rom_data = loadfile(rom_path);
-    if (rom_data.empty())
+
+    // roms that aren't zipped are mapped rather than copied
+    if (auto image = path.ends_with(".zip") ? nullptr : gba::rom::Image::open(rom_path))
     {
-        return false;
+        if (!gameboy_advance.loadrom(std::move(image)))
+        {
+            return false;
+        }
     }
-
-    if (!gameboy_advance.loadrom(rom_data))
+    else
     {
-        return false;
+        const auto rom_data = loadfile(rom_path);
+        if (rom_data.empty())
+        {
+            return false;
+        }
+
+        if (!gameboy_advance.loadrom(rom_data))
+        {
+            return false;
+        }
     }
 
     emu_run = true;
     has_rom = true;
     loadsave(rom_path);
+    set_state_slot(state_slot);
 
     return true;
 }
@@ -618,6 +634,7 @@ auto Base::loadrom_mem(const std::string& path, std::span<const std::uint8_t> da
     emu_run = true;
     has_rom = true;
     loadsave(rom_path);
+    set_state_slot(state_slot);
 
     return true;
 }
@@ -657,41 +674,30 @@ auto Base::savegame(const std::string& path) -> bool
 auto Base::loadstate(const std::string& path) -> bool
 {
     const auto state_path = create_state_path(path, state_slot);
-    const auto state_data = loadfile(state_path);
 
-    if (!state_data.empty())
+    if (state_worker.load(gameboy_advance, state_path))
     {
-        auto state = std::make_unique<gba::State>();
-        uLongf dst_size = gba::StateMeta::SIZE;
-
-        if (Z_OK == uncompress(reinterpret_cast<std::uint8_t*>(state.get()), &dst_size, state_data.data(), state_data.size()))
-        {
-            std::printf("loadstate from: %s\n", state_path.c_str());
-            return gameboy_advance.loadstate(*state);
-        }
+        std::printf("loadstate from: %s\n", state_path.c_str());
+        return true;
     }
+
     return false;
 }
 
 auto Base::savestate(const std::string& path) -> bool
 {
-    auto state = std::make_unique<gba::State>();
-    if (gameboy_advance.savestate(*state))
-    {
-        const auto state_path = create_state_path(path, state_slot);
+    // the state is written on the worker, which logs when it's done
+    return state_worker.save(gameboy_advance, create_state_path(path, state_slot), state_compression);
+}
 
-        std::vector<std::uint8_t> buf;
-        buf.resize(compressBound(gba::StateMeta::SIZE));
-        uLongf dst_size = gba::StateMeta::SIZE;
+auto Base::set_state_slot(int slot) -> void
+{
+    state_slot = slot;
 
-        if (Z_OK == compress(buf.data(), &dst_size, reinterpret_cast<std::uint8_t*>(state.get()), gba::StateMeta::SIZE))
-        {
-            buf.resize(dst_size);
-            std::printf("savestate to: %s\n", state_path.c_str());
-            return dumpfile(state_path, buf);
-        }
+    if (has_rom)
+    {
+        state_worker.preload(create_state_path(rom_path, state_slot));
     }
-    return false;
 }
 
 auto Base::set_button(gba::Button button, bool down) -> void
@@ -702,6 +708,42 @@ auto Base::set_button(gba::Button button, bool down) -> void
     }
 }
 
+auto Base::rewind_frame() -> bool
+{
+    if (enabled_rewind != rewind.is_enabled())
+    {
+        if (enabled_rewind)
+        {
+            rewind.init(rewind_config);
+        }
+        else
+        {
+            rewind.close();
+        }
+    }
+
+    if (!enabled_rewind)
+    {
+        emu_rewind = false;
+    }
+
+    if (emu_rewind)
+    {
+        // if the state isn't ready yet, the frame is held.
+        // otherwise a frame is run from it so that it's presented,
+        // the audio is skipped as it'd be played backwards in chunks.
+        if (rewind.step(gameboy_advance))
+        {
+            gameboy_advance.set_skip_audio(true);
+            gameboy_advance.run();
+            gameboy_advance.set_skip_audio(false);
+        }
+        return true;
+    }
+
+    return false;
+}
+
 auto Base::update_scale(int screen_width, int screen_height) -> void
 {
     const auto scale_w = screen_width / width;
@@ -3,6 +3,9 @@
 
 #pragma once
 
+#include "rewind.hpp"
+#include "run_ahead.hpp"
+#include "state_worker.hpp"
 #include <gba.hpp>
 #include <cstddef>
 #include <cstdint>
@@ -49,18 +52,34 @@ protected:
     virtual auto savestate(const std::string& path) -> bool;
 
     virtual auto set_button(gba::Button button, bool down) -> void;
+    // sets the slot and preloads its state, so loading it doesn't block
+    auto set_state_slot(int slot) -> void;
+
+    // call this before running a frame, this starts / stops recording to
+    // match enabled_rewind. returns true whilst rewinding, in which case
+    // a state was (or will be) stepped back to and a frame was run from it
+    // (so it's presented), so the frame shouldn't be run.
+    auto rewind_frame() -> bool;
 
     virtual auto update_scale(int screen_width, int screen_height) -> void;
     virtual auto scale_with_aspect_ratio(int screen_width, int screen_height) -> std::tuple<int, int, int, int>;
 
 public:
     gba::Gba gameboy_advance{};
+    // call rewind.push() after running a frame, see rewind_frame()
+    Rewind rewind{};
+    RewindConfig rewind_config{};
+    // use run_ahead.run() in place of gba.run(), see run_ahead.hpp
+    RunAhead run_ahead{};
 
     static constexpr auto width{240};
     static constexpr auto height{160};
     int scale{3};
 
     int state_slot{};
+    // savestates are written on a worker, see state_worker.hpp
+    StateWorker state_worker{};
+    StateCompression state_compression{StateCompression::FAST};
     std::string rom_path{};
 
     // set to true when a rom is loaded
@@ -73,6 +92,10 @@ public:
     bool enabled_rewind{false};
     // when true, the emulator is rewinding
     bool emu_rewind{false};
+    // frames to run ahead of the game to remove its input lag, 0 disables
+    int run_ahead_frames{0};
+    // when true, the frames ahead are run on another core
+    bool run_ahead_second_instance{false};
     // keeps ascpect ratio when resizing the screen
     bool maintain_aspect_ratio{true};
     //
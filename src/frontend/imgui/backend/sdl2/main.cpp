@@ -378,9 +378,10 @@ auto App::poll_events() -> void
 
 auto App::run() -> void
 {
-    if (emu_run && has_rom)
+    if (emu_run && has_rom && !rewind_frame())
     {
-        gameboy_advance.run();
+        run_ahead.run(gameboy_advance, gba::CYCLES_PER_FRAME, run_ahead_frames, run_ahead_second_instance);
+        rewind.push(gameboy_advance);
     }
 }
 
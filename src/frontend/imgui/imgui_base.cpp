@@ -370,11 +370,19 @@ auto ImguiBase::menubar_tab_file() -> void
         {
             char label[10];
             std::sprintf(label, "Slot %d", i);
-            if (ImGui::MenuItem(label, nullptr, state_slot == i)) { state_slot = i; }
+            if (ImGui::MenuItem(label, nullptr, state_slot == i)) { set_state_slot(i); }
         }
         ImGui::EndMenu();
     }
 
+    if (ImGui::BeginMenu("Save State Compression"))
+    {
+        if (ImGui::MenuItem("Default", nullptr, state_compression == frontend::StateCompression::DEFAULT)) { state_compression = frontend::StateCompression::DEFAULT; }
+        if (ImGui::MenuItem("Fast", nullptr, state_compression == frontend::StateCompression::FAST)) { state_compression = frontend::StateCompression::FAST; }
+        if (ImGui::MenuItem("None", nullptr, state_compression == frontend::StateCompression::NONE)) { state_compression = frontend::StateCompression::NONE; }
+        ImGui::EndMenu();
+    }
+
     ImGui::Separator();
 
     if (ImGui::MenuItem("Quit", "Alt+F4")) { running = false; }
@@ -395,20 +403,21 @@ auto ImguiBase::menubar_tab_emulation() -> void
     }
     ImGui::Separator();
 
-    if (ImGui::MenuItem("Rewind Enabled", nullptr, &enabled_rewind))
+    // recording is started / stopped on the next frame, see rewind_frame()
+    ImGui::MenuItem("Rewind Enabled", nullptr, &enabled_rewind);
+    if (ImGui::MenuItem("Rewind", "Ctrl+R", &emu_rewind, enabled_rewind)) {}
+    ImGui::Separator();
+
+    if (ImGui::BeginMenu("Run Ahead"))
     {
-        // if (enabled_rewind)
-        // {
-        //     constexpr auto rewind_time = 60*60*10; // 10mins
-        //     rewind_init(&rw, compressor_zlib, compressor_zlib_size, rewind_time);
-        // }
-        // else
-        // {
-        //     rewind_close(&rw);
-        //     emu_rewind = false;
-        // }
+        if (ImGui::MenuItem("Disabled", nullptr, run_ahead_frames == 0)) { run_ahead_frames = 0; }
+        if (ImGui::MenuItem("1 Frame", nullptr, run_ahead_frames == 1)) { run_ahead_frames = 1; }
+        if (ImGui::MenuItem("2 Frames", nullptr, run_ahead_frames == 2)) { run_ahead_frames = 2; }
+        if (ImGui::MenuItem("3 Frames", nullptr, run_ahead_frames == 3)) { run_ahead_frames = 3; }
+        ImGui::Separator();
+        ImGui::MenuItem("Second Instance", nullptr, &run_ahead_second_instance);
+        ImGui::EndMenu();
     }
-    if (ImGui::MenuItem("Rewind", "Ctrl+R", &emu_rewind, enabled_rewind)) {}
     ImGui::Separator();
 
     if (ImGui::BeginMenu("FatDevice"))
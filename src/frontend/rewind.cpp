@@ -0,0 +1,575 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "rewind.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <vector>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    #define REWIND_THREAD 0
+#else
+    #define REWIND_THREAD 1
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+#endif
+
+namespace frontend {
+namespace {
+
+constexpr auto STATE_SIZE = sizeof(gba::State);
+static_assert(STATE_SIZE % sizeof(std::uint64_t) == 0);
+
+// an encoded state can be at most 8 bytes larger than the state
+constexpr auto ENCODE_MAX_SIZE = STATE_SIZE + sizeof(std::uint32_t) * 2;
+
+auto load_word(const std::uint8_t* data, std::size_t index) -> std::uint64_t
+{
+    std::uint64_t word;
+    std::memcpy(&word, data + index * sizeof(word), sizeof(word));
+    return word;
+}
+
+auto load_word(const std::uint8_t* data, const std::uint8_t* key, std::size_t index) -> std::uint64_t
+{
+    return key ? load_word(data, index) ^ load_word(key, index) : load_word(data, index);
+}
+
+// xor's src against key (if set) and stores the runs of zero words as a
+// count, the output is a list of [u32 zeros][u32 literals][literals words].
+// this is much faster than a general compressor and does just as well on
+// an xor'd state, as the few pages that changed are the only non-zero words.
+auto encode(const std::uint8_t* src, const std::uint8_t* key, std::uint8_t* out) -> std::size_t
+{
+    constexpr auto words = STATE_SIZE / sizeof(std::uint64_t);
+    std::size_t size = 0;
+
+    for (std::size_t i = 0; i < words;)
+    {
+        const auto zero_start = i;
+        while (i < words && !load_word(src, key, i))
+        {
+            i++;
+        }
+
+        const auto literal_start = i;
+        while (i < words && load_word(src, key, i))
+        {
+            i++;
+        }
+
+        const std::uint32_t counts[2] = { static_cast<std::uint32_t>(literal_start - zero_start), static_cast<std::uint32_t>(i - literal_start) };
+        std::memcpy(out + size, counts, sizeof(counts));
+        size += sizeof(counts);
+
+        for (auto j = literal_start; j < i; j++)
+        {
+            const auto word = load_word(src, key, j);
+            std::memcpy(out + size, &word, sizeof(word));
+            size += sizeof(word);
+        }
+    }
+
+    return size;
+}
+
+// the reverse of encode(), returns false if the data is invalid
+auto decode(const std::uint8_t* in, std::size_t size, const std::uint8_t* key, std::uint8_t* out) -> bool
+{
+    constexpr auto words = STATE_SIZE / sizeof(std::uint64_t);
+    std::size_t word = 0;
+
+    for (std::size_t i = 0; i + sizeof(std::uint32_t) * 2 <= size;)
+    {
+        std::uint32_t counts[2];
+        std::memcpy(counts, in + i, sizeof(counts));
+        i += sizeof(counts);
+
+        if (word + counts[0] + counts[1] > words || i + counts[1] * sizeof(std::uint64_t) > size)
+        {
+            return false;
+        }
+
+        if (key)
+        {
+            std::memcpy(out + word * sizeof(std::uint64_t), key + word * sizeof(std::uint64_t), counts[0] * sizeof(std::uint64_t));
+        }
+        else
+        {
+            std::memset(out + word * sizeof(std::uint64_t), 0, counts[0] * sizeof(std::uint64_t));
+        }
+        word += counts[0];
+
+        for (std::uint32_t j = 0; j < counts[1]; j++, word++)
+        {
+            auto value = load_word(in + i, j);
+            if (key)
+            {
+                value ^= load_word(key, word);
+            }
+            std::memcpy(out + word * sizeof(value), &value, sizeof(value));
+        }
+        i += counts[1] * sizeof(std::uint64_t);
+    }
+
+    return word == words;
+}
+
+auto as_bytes(gba::State& state) -> std::uint8_t*
+{
+    return reinterpret_cast<std::uint8_t*>(&state);
+}
+
+} // namespace
+
+struct Rewind::State
+{
+    struct Entry
+    {
+        // offset into the ring
+        std::size_t offset;
+        std::size_t size;
+        // if false, the entry is xor'd against the last keyframe before it
+        bool keyframe;
+    };
+
+    struct Capture
+    {
+        std::vector<std::uint8_t> data;
+        std::size_t size;
+    };
+
+    enum : std::size_t
+    {
+        // the emu can be a capture ahead of the worker, if the worker is
+        // further behind, then captures are skipped until it catches up.
+        CAPTURE_COUNT = 2,
+    };
+
+    explicit State(const RewindConfig& _config) : config{_config}
+    {
+        config.interval = std::max<std::size_t>(config.interval, 1);
+        max_entries = std::max<std::size_t>(config.max_frames / config.interval, 1);
+        // at least 2 groups have to fit, else the history is dropped
+        // every time a group is evicted.
+        config.keyframe_interval = std::clamp<std::size_t>(config.keyframe_interval, 1, std::max<std::size_t>(max_entries / 2, 1));
+
+        ring_size = config.max_memory;
+        ring = std::make_unique_for_overwrite<std::uint8_t[]>(ring_size);
+        scratch = std::make_unique_for_overwrite<std::uint8_t[]>(ENCODE_MAX_SIZE);
+        base = std::make_unique<gba::State>();
+        key = std::make_unique<gba::State>();
+        ready_state = std::make_unique<gba::State>();
+
+        for (auto& capture : captures)
+        {
+            capture.data.resize(gba::StateMeta::DELTA_MAX_SIZE);
+        }
+    }
+
+    RewindConfig config;
+    std::size_t max_entries;
+
+    // emu thread only
+    std::size_t frame_counter{};
+    // set when the next capture has to have every page
+    bool capture_all{true};
+
+    // worker only
+    std::unique_ptr<std::uint8_t[]> ring;
+    std::size_t ring_size;
+    // where the next entry is written
+    std::size_t head{};
+    // oldest to newest, the oldest is always a keyframe
+    std::deque<Entry> entries;
+    // number of entries since (and including) the newest keyframe
+    std::size_t group_size{};
+    std::unique_ptr<std::uint8_t[]> scratch;
+    // the state that the captures are applied to
+    std::unique_ptr<gba::State> base;
+    // the state of the newest keyframe
+    std::unique_ptr<gba::State> key;
+
+    // shared
+    Capture captures[CAPTURE_COUNT];
+    // total number of captures queued / added, the slot is the count % CAPTURE_COUNT
+    std::size_t capture_head{};
+    std::size_t capture_tail{};
+    // the newest entry, decoded ahead of time for step()
+    std::unique_ptr<gba::State> ready_state;
+    bool ready{};
+    // set whilst stepping back
+    bool want_step{};
+    // set when ready_state was loaded, so the newest entry is removed
+    bool consumed{};
+    // incremented when stepping back stops, so that a state that was
+    // being decoded whilst it stopped isn't used.
+    std::size_t step_generation{};
+    std::atomic<std::size_t> frames{};
+    std::atomic<std::size_t> memory{};
+    std::size_t memory_used{};
+
+    #if REWIND_THREAD
+    bool quit{};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+
+    [[nodiscard]] auto has_work() const -> bool
+    {
+        return consumed || capture_head != capture_tail || (want_step && !ready && !entries.empty());
+    }
+
+    void run()
+    {
+        std::unique_lock lock{mutex};
+
+        for (;;)
+        {
+            cv.wait(lock, [this]{ return quit || has_work(); });
+
+            if (quit)
+            {
+                return;
+            }
+
+            // the newest entry has to be removed before anything is added
+            if (consumed)
+            {
+                consumed = false;
+                lock.unlock();
+                remove_newest();
+                lock.lock();
+            }
+            else if (capture_head != capture_tail)
+            {
+                const auto& capture = captures[capture_tail % CAPTURE_COUNT];
+                lock.unlock();
+                add(capture);
+                lock.lock();
+                capture_tail++;
+            }
+            else
+            {
+                const auto generation = step_generation;
+                lock.unlock();
+                const auto result = decode_newest(*ready_state);
+                lock.lock();
+                ready = result && want_step && generation == step_generation;
+            }
+
+            update_stats();
+        }
+    }
+    #endif
+
+    void update_stats()
+    {
+        frames.store(entries.size() * config.interval, std::memory_order_relaxed);
+        memory.store(memory_used, std::memory_order_relaxed);
+    }
+
+    // removes the oldest keyframe and its deltas.
+    // if keep_newest is set, the newest group isn't removed.
+    auto evict(bool keep_newest) -> bool
+    {
+        const auto end = std::find_if(entries.begin() + 1, entries.end(), [](auto& e){ return e.keyframe; });
+        if (keep_newest && end == entries.end())
+        {
+            return false;
+        }
+
+        for (auto it = entries.begin(); it != end; ++it)
+        {
+            memory_used -= it->size;
+        }
+
+        entries.erase(entries.begin(), end);
+        if (entries.empty())
+        {
+            group_size = 0;
+        }
+
+        return true;
+    }
+
+    // returns the offset in the ring to write size bytes to,
+    // the oldest entries are removed to make room.
+    auto alloc(std::size_t size, bool keep_newest) -> std::optional<std::size_t>
+    {
+        if (size > ring_size)
+        {
+            return std::nullopt;
+        }
+
+        auto offset = head;
+        if (offset + size > ring_size)
+        {
+            // the end of the ring is left unused, the entries there are
+            // the oldest, so they're removed before the ones at the start.
+            while (!entries.empty() && entries.front().offset >= head)
+            {
+                if (!evict(keep_newest))
+                {
+                    return std::nullopt;
+                }
+            }
+            offset = 0;
+        }
+
+        while (!entries.empty() && entries.front().offset < offset + size && entries.front().offset + entries.front().size > offset)
+        {
+            if (!evict(keep_newest))
+            {
+                return std::nullopt;
+            }
+        }
+
+        head = offset + size;
+        return offset;
+    }
+
+    void add(const Capture& capture)
+    {
+        if (!gba::apply_state_delta(*base, { capture.data.data(), capture.size }))
+        {
+            return;
+        }
+
+        auto keyframe = entries.empty() || group_size >= config.keyframe_interval;
+
+        for (;;)
+        {
+            const auto size = encode(as_bytes(*base), keyframe ? nullptr : as_bytes(*key), scratch.get());
+            const auto offset = alloc(size, !keyframe);
+
+            if (offset)
+            {
+                std::memcpy(ring.get() + *offset, scratch.get(), size);
+                entries.push_back({ *offset, size, keyframe });
+                memory_used += size;
+                break;
+            }
+
+            // the state doesn't fit at all
+            if (keyframe)
+            {
+                return;
+            }
+
+            // the newest group takes up the whole ring, so start a new one
+            keyframe = true;
+        }
+
+        if (keyframe)
+        {
+            *key = *base;
+            group_size = 0;
+        }
+        group_size++;
+
+        while (entries.size() > max_entries && evict(true))
+        {
+        }
+    }
+
+    auto decode_newest(gba::State& out) const -> bool
+    {
+        if (entries.empty())
+        {
+            return false;
+        }
+
+        const auto& entry = entries.back();
+        return decode(ring.get() + entry.offset, entry.size, entry.keyframe ? nullptr : as_bytes(*key), as_bytes(out));
+    }
+
+    void remove_newest()
+    {
+        if (entries.empty())
+        {
+            return;
+        }
+
+        const auto entry = entries.back();
+        entries.pop_back();
+        memory_used -= entry.size;
+        head = entry.offset;
+        group_size--;
+
+        // the previous group is now the newest, so its keyframe is needed
+        if (entry.keyframe && !entries.empty())
+        {
+            const auto it = std::find_if(entries.rbegin(), entries.rend(), [](auto& e){ return e.keyframe; });
+            decode(ring.get() + it->offset, it->size, nullptr, as_bytes(*key));
+            group_size = static_cast<std::size_t>(std::distance(entries.rbegin(), it)) + 1;
+        }
+    }
+};
+
+Rewind::Rewind() = default;
+
+Rewind::~Rewind()
+{
+    close();
+}
+
+auto Rewind::init(const RewindConfig& config) -> void
+{
+    close();
+
+    state = std::make_unique<State>(config);
+
+    #if REWIND_THREAD
+    state->thread = std::thread{[s = state.get()]{ s->run(); }};
+    #endif
+}
+
+auto Rewind::close() -> void
+{
+    if (!state)
+    {
+        return;
+    }
+
+    #if REWIND_THREAD
+    {
+        std::scoped_lock lock{state->mutex};
+        state->quit = true;
+    }
+
+    state->cv.notify_one();
+    state->thread.join();
+    #endif
+
+    state.reset();
+}
+
+auto Rewind::clear() -> void
+{
+    if (state)
+    {
+        init(state->config);
+    }
+}
+
+auto Rewind::push(gba::Gba& gba) -> void
+{
+    if (!state)
+    {
+        return;
+    }
+
+    auto& s = *state;
+
+    #if REWIND_THREAD
+    std::unique_lock lock{s.mutex};
+
+    if (s.want_step)
+    {
+        s.want_step = false;
+        s.ready = false;
+        s.step_generation++;
+    }
+
+    if (++s.frame_counter < s.config.interval)
+    {
+        return;
+    }
+
+    // the worker is behind, the pages stay dirty until the next capture
+    if (s.capture_head - s.capture_tail >= State::CAPTURE_COUNT)
+    {
+        return;
+    }
+
+    s.frame_counter = 0;
+    // the slot isn't read by the worker until capture_head is moved past it
+    auto& capture = s.captures[s.capture_head % State::CAPTURE_COUNT];
+    lock.unlock();
+    #else
+    if (++s.frame_counter < s.config.interval)
+    {
+        return;
+    }
+
+    s.frame_counter = 0;
+    auto& capture = s.captures[0];
+    #endif
+
+    if (s.capture_all)
+    {
+        gba.dirty_pages.set_all();
+        s.capture_all = false;
+    }
+
+    capture.size = gba.savestate_delta(capture.data);
+
+    #if REWIND_THREAD
+    lock.lock();
+    s.capture_head++;
+    lock.unlock();
+    s.cv.notify_one();
+    #else
+    s.add(capture);
+    s.update_stats();
+    #endif
+}
+
+auto Rewind::step(gba::Gba& gba) -> bool
+{
+    if (!state)
+    {
+        return false;
+    }
+
+    auto& s = *state;
+
+    #if REWIND_THREAD
+    std::unique_lock lock{s.mutex};
+    s.want_step = true;
+
+    if (!s.ready)
+    {
+        lock.unlock();
+        s.cv.notify_one();
+        return false;
+    }
+
+    const auto result = gba.loadstate(*s.ready_state);
+    s.ready = false;
+    s.consumed = true;
+    lock.unlock();
+    s.cv.notify_one();
+    #else
+    if (!s.decode_newest(*s.ready_state))
+    {
+        return false;
+    }
+
+    const auto result = gba.loadstate(*s.ready_state);
+    s.remove_newest();
+    s.update_stats();
+    #endif
+
+    // the next capture has to start from the state that was loaded
+    s.frame_counter = 0;
+    return result;
+}
+
+auto Rewind::get_frames() const -> std::size_t
+{
+    return state ? state->frames.load(std::memory_order_relaxed) : 0;
+}
+
+auto Rewind::get_memory() const -> std::size_t
+{
+    return state ? state->memory.load(std::memory_order_relaxed) : 0;
+}
+
+} // namespace frontend
@@ -0,0 +1,71 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// records states whilst the game runs so that it can be stepped back.
+// every interval frames, a delta savestate is taken on the emu thread,
+// which is cheap as only the pages written to are copied (see
+// Gba::savestate_delta()). the rest is done on a worker thread:
+// the delta is applied to a full state, which is xor'd against the last
+// keyframe and compressed into a fixed size ring. as the xor'd state is
+// mostly zeros, it compresses to a few kb.
+// a keyframe is stored every keyframe_interval captures, so any entry is
+// restored from its keyframe and itself. when the ring is full, or holds
+// more than max_frames, the oldest keyframe and its deltas are dropped.
+// stepping back doesn't wait on the worker, the worker decodes the
+// newest entry ahead of time and step() loads it once it's ready.
+#pragma once
+
+#include <gba.hpp>
+#include <cstddef>
+#include <memory>
+
+namespace frontend {
+
+struct RewindConfig
+{
+    // max memory used to store states, in bytes
+    std::size_t max_memory{64 * 1024 * 1024};
+    // max number of frames that can be rewound
+    std::size_t max_frames{60 * 60 * 5};
+    // a state is captured every interval frames
+    std::size_t interval{2};
+    // a keyframe is stored every keyframe_interval captures
+    std::size_t keyframe_interval{60};
+};
+
+struct Rewind
+{
+public:
+    Rewind();
+    ~Rewind();
+
+    Rewind(const Rewind&) = delete;
+    auto operator=(const Rewind&) -> Rewind& = delete;
+
+    // starts recording, any previous history is removed
+    auto init(const RewindConfig& config) -> void;
+    // stops recording and frees the history
+    auto close() -> void;
+    // removes the history, ie, on loadrom
+    auto clear() -> void;
+    [[nodiscard]] auto is_enabled() const -> bool { return state != nullptr; }
+
+    // call this after each frame is run.
+    // NOTE: this uses Gba::savestate_delta(), so nothing else should.
+    auto push(gba::Gba& gba) -> void;
+    // loads the newest state and removes it from the history.
+    // returns false if the history is empty or the state isn't ready yet,
+    // in which case the frame should be held rather than run.
+    auto step(gba::Gba& gba) -> bool;
+
+    // returns the number of frames that can be rewound
+    [[nodiscard]] auto get_frames() const -> std::size_t;
+    // returns the memory used to store states, in bytes
+    [[nodiscard]] auto get_memory() const -> std::size_t;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+} // namespace frontend
@@ -0,0 +1,343 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "run_ahead.hpp"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    #define RUN_AHEAD_THREAD 0
+#else
+    #define RUN_AHEAD_THREAD 1
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+#endif
+
+namespace frontend {
+namespace {
+
+constexpr auto bytes_per_pixel(std::uint8_t bpp) -> std::size_t
+{
+    switch (bpp)
+    {
+        case 1: case 8: return 1;
+        case 2: case 15: case 16: return 2;
+        case 4: case 24: case 32: return 4;
+        default: return 0;
+    }
+}
+
+// the frame that's presented starts part way through the run before
+// it, as runs don't line up with frames, so the last 2 runs are drawn.
+constexpr auto is_drawn(std::size_t run, std::size_t runs) -> bool
+{
+    return run + 2 >= runs;
+}
+
+// the copy of the game that runs ahead when second_instance is set
+struct Instance
+{
+    explicit Instance(const gba::Snapshot& _snapshot) : snapshot{_snapshot}, clone{std::make_unique<gba::Gba>()} {}
+
+    // the real game is only read on the frontend thread, whilst the
+    // worker is idle.
+    auto init(const gba::Gba& real) -> bool
+    {
+        if (!clone->loadrom(real.rom_image))
+        {
+            return false;
+        }
+
+        if (real.has_bios && !clone->loadbios(real.bios))
+        {
+            return false;
+        }
+
+        clone->set_userdata(this);
+        clone->set_vblank_callback(on_vblank);
+        clone->set_skip_audio(true);
+
+        #if RUN_AHEAD_THREAD
+        thread = std::thread{[this]{ run_worker(); }};
+        #endif
+
+        return true;
+    }
+
+    ~Instance()
+    {
+        #if RUN_AHEAD_THREAD
+        if (thread.joinable())
+        {
+            {
+                std::scoped_lock lock{mutex};
+                quit = true;
+            }
+
+            work_cv.notify_one();
+            thread.join();
+        }
+        #endif
+    }
+
+    // matches the pixel format, colours and cpu backend of the real game
+    auto sync(gba::Gba& real) -> void
+    {
+        if (real.pixels != real_pixels || real.stride != clone->stride || real.bpp != clone->bpp)
+        {
+            real_pixels = real.pixels;
+            pixels.resize(real.pixels ? real.stride * 160 * bytes_per_pixel(real.bpp) : 0);
+            clone->set_pixels(real.pixels ? pixels.data() : nullptr, real.stride, real.bpp);
+            has_frame = false;
+        }
+
+        // the table is built here rather than the worker calling the
+        // frontend's colour callback.
+        const auto was_dirty = real.colour_lut_dirty;
+        const auto lut = real.get_colour_lut();
+
+        if (lut != colour_lut || (lut && was_dirty))
+        {
+            colour_lut = lut;
+            clone->set_colour_callback(lut ? on_colour : nullptr);
+        }
+
+        if (clone->get_cpu_backend() != real.get_cpu_backend())
+        {
+            clone->set_cpu_backend(real.get_cpu_backend());
+        }
+    }
+
+    // copies the frame into the real game's pixels and calls its vblank
+    // callback, as if it had drawn it.
+    auto present(gba::Gba& real) -> void
+    {
+        if (!has_frame || !real.pixels || real.pixels != real_pixels)
+        {
+            return;
+        }
+
+        std::memcpy(real.pixels, pixels.data(), pixels.size());
+        has_frame = false;
+
+        if (real.vblank_callback)
+        {
+            real.vblank_callback(real.userdata);
+        }
+    }
+
+    auto run_frames() -> void
+    {
+        if (!clone->load_snapshot(snapshot))
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < runs; i++)
+        {
+            is_last_run = i + 1 == runs;
+            clone->set_skip_render(!is_drawn(i, runs));
+            clone->run();
+        }
+
+        is_last_run = false;
+    }
+
+    static auto on_vblank(void* user) -> void
+    {
+        auto instance = static_cast<Instance*>(user);
+
+        // the rest of the run isn't drawn so the frame is kept as is
+        if (instance->is_last_run && !instance->has_frame)
+        {
+            instance->clone->set_skip_render(true);
+            instance->has_frame = true;
+        }
+    }
+
+    static auto on_colour(void* user, gba::Colour c) -> std::uint32_t
+    {
+        return static_cast<Instance*>(user)->colour_lut[c.bgr555 & 0x7FFF];
+    }
+
+    const gba::Snapshot& snapshot;
+    std::unique_ptr<gba::Gba> clone;
+    std::vector<std::uint8_t> pixels;
+    // the real game's pixels that pixels matches the format of
+    void* real_pixels{};
+    const std::uint32_t* colour_lut{};
+    // number of frames run from each snapshot
+    std::size_t runs{};
+    bool is_last_run{};
+    // set once the last run reaches vblank, pixels then holds the frame
+    bool has_frame{};
+
+    #if RUN_AHEAD_THREAD
+    bool quit{};
+    bool busy{};
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::thread thread;
+
+    auto run_worker() -> void
+    {
+        std::unique_lock lock{mutex};
+
+        for (;;)
+        {
+            work_cv.wait(lock, [this]{ return quit || busy; });
+
+            if (quit)
+            {
+                return;
+            }
+
+            lock.unlock();
+            run_frames();
+            lock.lock();
+            busy = false;
+            done_cv.notify_all();
+        }
+    }
+    #endif
+
+    // waits for the frames ahead of the last snapshot
+    auto wait() -> void
+    {
+        #if RUN_AHEAD_THREAD
+        std::unique_lock lock{mutex};
+        done_cv.wait(lock, [this]{ return !busy; });
+        #endif
+    }
+
+    // runs the frames ahead of the snapshot, on the worker if there's one
+    auto start() -> void
+    {
+        #if RUN_AHEAD_THREAD
+        {
+            std::scoped_lock lock{mutex};
+            busy = true;
+        }
+
+        work_cv.notify_one();
+        #else
+        run_frames();
+        #endif
+    }
+};
+
+} // namespace
+
+struct RunAhead::State
+{
+    gba::Snapshot snapshot{};
+    std::unique_ptr<Instance> instance;
+};
+
+RunAhead::RunAhead() = default;
+RunAhead::~RunAhead() = default;
+
+auto RunAhead::run(gba::Gba& gba, std::uint32_t cycles, std::size_t frames, bool second_instance) -> void
+{
+    if (!frames)
+    {
+        close();
+        gba.run(cycles);
+        return;
+    }
+
+    if (!state)
+    {
+        state = std::make_unique<State>();
+    }
+
+    auto& s = *state;
+
+    // the instance is only kept in sync whilst it loads every snapshot,
+    // so a new one is made if it's turned off or the rom changes.
+    if (s.instance)
+    {
+        s.instance->wait();
+
+        if (!second_instance || s.instance->clone->rom_image != gba.rom_image)
+        {
+            s.instance.reset();
+        }
+    }
+
+    if (second_instance && !s.instance)
+    {
+        s.instance = std::make_unique<Instance>(s.snapshot);
+
+        if (!s.instance->init(gba))
+        {
+            s.instance.reset();
+        }
+    }
+
+    // the frame from the last snapshot
+    if (s.instance)
+    {
+        s.instance->present(gba);
+    }
+
+    const auto vblank_callback = gba.vblank_callback;
+    const auto hblank_callback = gba.hblank_callback;
+    const auto frame_callback = gba.frame_callback;
+
+    gba.set_vblank_callback(nullptr);
+    gba.set_hblank_callback(nullptr);
+
+    if (s.instance)
+    {
+        auto& instance = *s.instance;
+
+        gba.set_skip_render(true);
+        gba.run(cycles);
+        gba.save_snapshot(s.snapshot);
+
+        instance.sync(gba);
+        instance.runs = frames + 1;
+        instance.start();
+    }
+    else
+    {
+        // runs are numbered from the real frame (0) to the last one
+        gba.set_skip_render(!is_drawn(0, frames + 1));
+        gba.run(cycles);
+        gba.save_snapshot(s.snapshot);
+
+        gba.set_skip_audio(true);
+        gba.set_frame_callback(nullptr);
+
+        for (std::size_t i = 1; i <= frames; i++)
+        {
+            if (i == frames)
+            {
+                gba.set_vblank_callback(vblank_callback);
+                gba.set_hblank_callback(hblank_callback);
+            }
+
+            gba.set_skip_render(!is_drawn(i, frames + 1));
+            gba.run();
+        }
+
+        [[maybe_unused]] const auto result = gba.load_snapshot(s.snapshot);
+        gba.set_skip_audio(false);
+    }
+
+    gba.set_skip_render(false);
+    gba.set_vblank_callback(vblank_callback);
+    gba.set_hblank_callback(hblank_callback);
+    gba.set_frame_callback(frame_callback);
+}
+
+auto RunAhead::close() -> void
+{
+    state.reset();
+}
+
+} // namespace frontend
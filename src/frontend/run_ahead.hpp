@@ -0,0 +1,50 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// runs the game frames ahead of what it's shown at, which removes the
+// frames of input lag that most games have (between reading the input
+// and drawing the result).
+// after the real frame is run, a snapshot is saved (see
+// Gba::save_snapshot()), then frames more are run with the same input,
+// without audio, only the last being presented. then the snapshot is
+// loaded, so the game itself is never ahead.
+// with second_instance, a copy of the game follows the real one by loading
+// each snapshot, and runs the frames ahead on a worker thread whilst the
+// next real frame is run. so this costs little on a second core, however
+// the frame that's presented is from the input of the frame before,
+// so it runs one more frame ahead to make up for it.
+// only the presented frame calls the vblank / hblank callbacks (the
+// hblank callback isn't called for the second instance), the real frame
+// still calls the audio and frame callbacks.
+#pragma once
+
+#include <gba.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace frontend {
+
+struct RunAhead
+{
+public:
+    RunAhead();
+    ~RunAhead();
+
+    RunAhead(const RunAhead&) = delete;
+    auto operator=(const RunAhead&) -> RunAhead& = delete;
+
+    // use this in place of gba.run(cycles). if frames is 0, the game is
+    // run as normal.
+    // NOTE: this uses Gba::save_snapshot(), if anything else also saves a
+    // snapshot of the same game, then each save is copied in full.
+    auto run(gba::Gba& gba, std::uint32_t cycles, std::size_t frames, bool second_instance) -> void;
+    // frees the snapshot and second instance, ie, on closerom
+    auto close() -> void;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+} // namespace frontend
@@ -0,0 +1,159 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// lock-free audio path between the emu thread and the audio callback.
+// the emu thread push()es the samples from the core into the ring,
+// the audio callback resamples them to the device rate with a ratio
+// that's nudged up or down to keep the ring near a target fill.
+// this means the two never wait on each other, and drift between the
+// emu and the audio device is absorbed rather than building up.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace frontend::sdl2 {
+
+struct AudioFrame
+{
+    std::int16_t left;
+    std::int16_t right;
+};
+
+// single producer, single consumer ring of stereo frames.
+// only one thread may push() and only one (other) thread may pop().
+struct AudioRing
+{
+public:
+    // NOT thread safe, capacity is rounded up to a power of 2
+    auto reset(std::size_t capacity) -> void
+    {
+        buffer.assign(std::bit_ceil(std::max<std::size_t>(capacity, 2)), {});
+        mask = buffer.size() - 1;
+        clear();
+    }
+
+    // NOT thread safe, only call whilst the consumer isn't running,
+    // ie, the audio device is paused.
+    auto clear() -> void
+    {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    // producer, samples are interleaved left / right.
+    // returns the number of frames pushed, the rest are dropped if full.
+    auto push(std::span<const std::int16_t> samples) -> std::size_t
+    {
+        const auto h = head.load(std::memory_order_relaxed);
+        const auto t = tail.load(std::memory_order_acquire);
+        const auto count = std::min(samples.size() / 2, buffer.size() - (h - t));
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            buffer[(h + i) & mask] = { samples[i * 2 + 0], samples[i * 2 + 1] };
+        }
+
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer, returns false if empty
+    auto pop(AudioFrame& frame) -> bool
+    {
+        const auto t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        frame = buffer[t & mask];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // number of frames in the ring, exact if called from the consumer
+    // or producer thread, though may be stale by the time it's used.
+    [[nodiscard]] auto size() const -> std::size_t
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] auto capacity() const -> std::size_t
+    {
+        return buffer.size();
+    }
+
+private:
+    std::vector<AudioFrame> buffer{};
+    std::size_t mask{};
+    // total frames pushed / popped, the index is the count & mask
+    alignas(64) std::atomic<std::size_t> head{};
+    alignas(64) std::atomic<std::size_t> tail{};
+};
+
+// linear resampler with dynamic rate control, runs on the consumer.
+struct AudioResampler
+{
+public:
+    // how far the ratio can be nudged, 0.5% isn't audible
+    static constexpr auto MAX_RATE_DELTA = 0.005;
+
+    // target is the number of frames the ring should be kept at
+    auto reset(double in_rate, double out_rate, std::size_t _target) -> void
+    {
+        step = in_rate / out_rate;
+        target = static_cast<double>(std::max<std::size_t>(_target, 1));
+        position = 1.0;
+        prev = {};
+        next = {};
+    }
+
+    // returns the number of input frames needed to fill out_frames
+    [[nodiscard]] auto get_frames_needed(std::size_t out_frames) const -> std::size_t
+    {
+        return static_cast<std::size_t>(position + step * (1.0 + MAX_RATE_DELTA) * out_frames) + 1;
+    }
+
+    // fills out from the ring, if the ring runs dry, the last frame is held.
+    auto run(AudioRing& ring, std::span<AudioFrame> out) -> void
+    {
+        // consume faster if over the target fill, slower if under.
+        const auto fill = std::clamp((static_cast<double>(ring.size()) - target) / target, -1.0, 1.0);
+        const auto ratio = step * (1.0 + MAX_RATE_DELTA * fill);
+
+        for (auto& frame : out)
+        {
+            while (position >= 1.0)
+            {
+                prev = next;
+                ring.pop(next);
+                position -= 1.0;
+            }
+
+            frame.left = lerp(prev.left, next.left);
+            frame.right = lerp(prev.right, next.right);
+            position += ratio;
+        }
+    }
+
+private:
+    [[nodiscard]] auto lerp(std::int16_t a, std::int16_t b) const -> std::int16_t
+    {
+        return static_cast<std::int16_t>(a + (b - a) * position);
+    }
+
+    double step{1.0};
+    double target{1.0};
+    // position between prev and next, [0, 1)
+    double position{1.0};
+    AudioFrame prev{};
+    AudioFrame next{};
+};
+
+} // namespace frontend::sdl2
@@ -99,9 +99,9 @@ auto Sdl2Base::init_audio(void* user, SDL_AudioCallback sdl2_cb, gba::AudioCallb
     aspec_wnt.userdata = user;
     aspec_wnt.callback = sdl2_cb;
 
-    // allow all apsec to be changed if needed.
-    // will be coverted and resampled by audiostream.
-    audio_device = SDL_OpenAudioDevice(nullptr, 0, &aspec_wnt, &aspec_got, SDL_AUDIO_ALLOW_ANY_CHANGE);
+    // the format and channels have to be what the core outputs (sdl
+    // converts if needed), the rate is resampled by audio_resampler.
+    audio_device = SDL_OpenAudioDevice(nullptr, 0, &aspec_wnt, &aspec_got, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
     if (audio_device == 0)
     {
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", SDL_GetError(), nullptr);
@@ -113,19 +113,13 @@ auto Sdl2Base::init_audio(void* user, SDL_AudioCallback sdl2_cb, gba::AudioCallb
         return false;
     }
 
-    // has to be power of 2
-    sample_data.resize((aspec_got.samples * aspec_got.channels) & ~0x1);
+    sample_data.resize(AUDIO_CHUNK_FRAMES * 2);
 
-    audio_stream = SDL_NewAudioStream(
-        aspec_wnt.format, aspec_wnt.channels, aspec_wnt.freq,
-        aspec_got.format, aspec_got.channels, aspec_got.freq
-    );
-
-    if (!audio_stream)
-    {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", SDL_GetError(), nullptr);
-        return false;
-    }
+    // enough to cover a callback of the device and a frame of the emu
+    const auto in_per_out = static_cast<double>(aspec_wnt.freq) / static_cast<double>(aspec_got.freq);
+    audio_target_frames = static_cast<std::size_t>(aspec_got.samples * in_per_out) + aspec_wnt.freq / 60;
+    audio_ring.reset(audio_target_frames * 4);
+    audio_resampler.reset(aspec_wnt.freq, aspec_got.freq, audio_target_frames);
 
     std::printf("[SDL-AUDIO] format\twant: 0x%X \tgot: 0x%X\n", aspec_wnt.format, aspec_got.format);
     std::printf("[SDL-AUDIO] freq\twant: %d \tgot: %d\n", aspec_wnt.freq, aspec_got.freq);
@@ -161,7 +155,6 @@ Sdl2Base::~Sdl2Base()
     }
 
     if (audio_device != 0) { SDL_CloseAudioDevice(audio_device); }
-    if (audio_stream != nullptr) { SDL_FreeAudioStream(audio_stream); }
     if (texture != nullptr) { SDL_DestroyTexture(texture); }
     if (renderer != nullptr) { SDL_DestroyRenderer(renderer); }
     if (window != nullptr) { SDL_DestroyWindow(window); }
@@ -354,6 +347,20 @@ auto Sdl2Base::run(double delta) -> void
 
     std::scoped_lock lock{core_mutex};
 
+    // the current frame may have been skipped, in which case
+    // it's still not presented, see update_pixels_from_gba().
+    // rewinding always draws, so that each state is seen.
+    if (is_fast_forwarding && (!emu_fast_forward || emu_rewind))
+    {
+        is_fast_forwarding = false;
+        gameboy_advance.set_skip_render(false);
+    }
+
+    if (rewind_frame())
+    {
+        return;
+    }
+
     if (gameboy_advance.is_gb())
     {
         if (gba::gb::has_rtc(gameboy_advance))
@@ -379,11 +386,32 @@ auto Sdl2Base::run(double delta) -> void
     // maybe keep track of deltas here to get an average?
     delta = std::min(delta, 1.333333);
     auto cycles = static_cast<double>(gba::CYCLES_PER_FRAME) * delta;
-    if (emu_fast_forward)
+    if (!emu_fast_forward)
+    {
+        run_ahead.run(gameboy_advance, cycles, run_ahead_frames, run_ahead_second_instance);
+        rewind.push(gameboy_advance);
+        return;
+    }
+
+    // frames are skipped from the next vblank, as the current one
+    // may already be part way through.
+    if (!is_fast_forwarding)
     {
-        cycles *= 2;
+        is_fast_forwarding = true;
+        is_frame_drawn = false;
+        fast_forward_frame = -1;
+    }
+
+    cycles *= 2;
+
+    // run a frame at a time so that rewind sees each one
+    while (cycles >= 1.0)
+    {
+        const auto frame_cycles = std::min(cycles, static_cast<double>(gba::CYCLES_PER_FRAME));
+        gameboy_advance.run(frame_cycles);
+        rewind.push(gameboy_advance);
+        cycles -= frame_cycles;
     }
-    gameboy_advance.run(cycles);
 }
 
 auto Sdl2Base::on_key_event(const SDL_KeyboardEvent& e) -> void
@@ -407,6 +435,15 @@ auto Sdl2Base::on_key_event(const SDL_KeyboardEvent& e) -> void
                     rom_file_picker();
                     break;
 
+                case SDL_SCANCODE_R:
+                    enabled_rewind ^= 1;
+                    break;
+
+                case SDL_SCANCODE_A:
+                    run_ahead_frames = (run_ahead_frames + 1) % 4;
+                    std::printf("run ahead frames: %d\n", run_ahead_frames);
+                    break;
+
                 default: break; // silence enum warning
             }
         }
@@ -817,76 +854,77 @@ auto Sdl2Base::open_url(const char* url) -> void
 
 auto Sdl2Base::fill_audio_data_from_stream(Uint8* data, int len, bool tick_rom) -> void
 {
-    audio_mutex.lock();
-
-    const auto available = SDL_AudioStreamAvailable(audio_stream);
-
-    bool not_enough_samples = false;
-
-    // if theres too little samples and ticking gba isn't an option
-    #if 0
-    if (available < len / 2 || (available < len && !tick_rom))
-    {
-        not_enough_samples = true;
-    }
-    #else
-    if (available < len && !tick_rom)
-    {
-        not_enough_samples = true;
-    }
-    #endif
+    const auto out = std::span{reinterpret_cast<AudioFrame*>(data), len / sizeof(AudioFrame)};
 
-    // too many samples behind so no point catching up, or emu isn't running.
-    #if 0
-    if (not_enough_samples || !emu_run || !has_focus || !has_rom || !running || emu_audio_disabled)
-    #else
-    if (not_enough_samples)
-    #endif
+    // only set when the callback is on the same thread as the emu
+    if (tick_rom)
     {
-        audio_mutex.unlock();
-        std::memset(data, aspec_got.silence, len);
-        return;
-    }
+        const auto needed = audio_resampler.get_frames_needed(out.size());
 
-    // this shouldn't be needed, however it causes less pops on startup
-    if (available < len)
-    {
-        // need to unlock this because gba callback locks this mutex
-        audio_mutex.unlock();
-        // with this locked, nothing else writes to audiostream
-        std::scoped_lock lock{core_mutex};
-
-        while (SDL_AudioStreamAvailable(audio_stream) < len)
+        if (audio_ring.size() < needed)
         {
-            gameboy_advance.run(1000);
-        }
+            std::scoped_lock lock{core_mutex};
 
-        // need to block otherwise race condition with get()
-        audio_mutex.lock();
+            while (audio_ring.size() < needed)
+            {
+                gameboy_advance.run(1000);
+            }
+        }
     }
 
-    SDL_AudioStreamGet(audio_stream, data, len);
-    audio_mutex.unlock();
+    audio_resampler.run(audio_ring, out);
 }
 
 auto Sdl2Base::fill_stream_from_sample_data() -> void
 {
-    std::scoped_lock lock{audio_mutex};
+    // if the ring is full, the samples are dropped. this only happens
+    // if the audio device stops pulling samples, otherwise the resampler
+    // keeps the ring near its target.
+    if (!audio_paused)
+    {
+        audio_ring.push(sample_data);
+    }
+}
 
-    const int max_latency = (aspec_got.size / 2) * 3;
+auto Sdl2Base::reset_audio_ring() -> void
+{
+    std::memset(sample_data.data(), 0, sample_data.size() * sizeof(sample_data[0]));
+    audio_ring.clear();
 
-    // safety net for if something strange happens with the sdl audio stream
-    // or the callback code where we have way too many samples, specifically about
-    // 3 frames worth. at that point, start discarding samples for a bit.
-    // not the best solution at all, but it'll do for now
-    if (!audio_paused && max_latency > SDL_AudioStreamAvailable(audio_stream))
+    while (audio_ring.size() < audio_target_frames)
     {
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size() * 2);
+        audio_ring.push(sample_data);
     }
+
+    audio_resampler.reset(aspec_wnt.freq, aspec_got.freq, audio_target_frames);
 }
 
 auto Sdl2Base::update_pixels_from_gba() -> void
 {
+    // the cycles run don't line up with frames, so whether a frame is
+    // skipped is decided here, at the start of it. only frames that are
+    // drawn in full are presented, otherwise they'd be part old / new.
+    const auto was_drawn = is_frame_drawn;
+
+    if (is_fast_forwarding)
+    {
+        const auto render_frames = std::max(1, fast_forward_render);
+        const auto period = render_frames + std::max(0, fast_forward_skip);
+
+        fast_forward_frame = (fast_forward_frame + 1) % period;
+        is_frame_drawn = fast_forward_frame < render_frames;
+        gameboy_advance.set_skip_render(!is_frame_drawn);
+    }
+    else
+    {
+        is_frame_drawn = true;
+    }
+
+    if (!was_drawn)
+    {
+        return;
+    }
+
     if (has_new_frame)
     {
         // std::printf("[WARNING] dropping frame, vblank called before previous frame was displayed!\n");
@@ -939,14 +977,8 @@ auto Sdl2Base::update_audio_device_pause_status() -> void
     }
     else if (!pause_on && status != SDL_AUDIO_PLAYING)
     {
-        std::scoped_lock lock1{core_mutex};
-        std::scoped_lock lock2{audio_mutex};
-        SDL_AudioStreamClear(audio_stream);
-        std::memset(sample_data.data(), aspec_got.silence, sample_data.size());
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size());
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size());
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size());
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size());
+        std::scoped_lock lock{core_mutex};
+        reset_audio_ring();
         SDL_PauseAudioDevice(audio_device, pause_on);
     }
     #else
@@ -963,14 +995,8 @@ auto Sdl2Base::update_audio_device_pause_status() -> void
     }
     else if (!new_paused && audio_paused)
     {
-        std::scoped_lock lock1{core_mutex};
-        std::scoped_lock lock2{audio_mutex};
-        SDL_AudioStreamClear(audio_stream);
-        std::memset(sample_data.data(), aspec_got.silence, sample_data.size());
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size());
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size());
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size());
-        SDL_AudioStreamPut(audio_stream, sample_data.data(), sample_data.size());
+        std::scoped_lock lock{core_mutex};
+        reset_audio_ring();
         SDL_PauseAudioDevice(audio_device, 0);
     }
     audio_paused = new_paused;
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "../frontend_base.hpp"
+#include "audio_ring.hpp"
 
 #include <SDL.h>
 #include <cstddef>
@@ -58,10 +59,16 @@ public:
     virtual auto open_url(const char* url) -> void;
     virtual auto rom_file_picker() -> void {}
 
-    // if tick_rom is true, when the stream doesnt have enough samples
-    // itll run the rom until enough samples are generated.
+    // called from the audio callback, resamples from audio_ring.
+    // if tick_rom is true, when the ring doesnt have enough samples
+    // itll run the rom until enough samples are generated, this must
+    // only be set if the callback is on the same thread as the emu.
     virtual auto fill_audio_data_from_stream(Uint8* data, int len, bool tick_rom = true) -> void;
+    // called from the gba audio callback, pushes into audio_ring.
     virtual auto fill_stream_from_sample_data() -> void;
+    // NOT thread safe, the audio device must be paused.
+    // empties the ring and fills it with silence up to the target.
+    virtual auto reset_audio_ring() -> void;
 
     virtual auto update_pixels_from_gba() -> void;
     virtual auto update_texture_from_pixels() -> void;
@@ -96,16 +103,34 @@ public:
 
     SDL_Rect emu_rect{};
 
+    // number of frames the core outputs per callback, kept small
+    // so that the ring fills smoothly.
+    static constexpr auto AUDIO_CHUNK_FRAMES = 256;
+
     SDL_AudioDeviceID audio_device{};
-    SDL_AudioStream* audio_stream{};
     SDL_AudioSpec aspec_wnt{};
     SDL_AudioSpec aspec_got{};
-    std::mutex audio_mutex{};
+    AudioRing audio_ring{};
+    AudioResampler audio_resampler{};
+    // frames the ring is kept at, see AudioResampler
+    std::size_t audio_target_frames{};
     std::mutex core_mutex{};
     std::vector<std::int16_t> sample_data{};
     bool has_focus{true};
     bool audio_paused{true};
 
+    // while fast forwarding, fast_forward_render frames are drawn, then
+    // fast_forward_skip frames are emulated without being drawn.
+    // this is decided at vblank, see update_pixels_from_gba().
+    int fast_forward_render{1};
+    int fast_forward_skip{1};
+    // position of the current frame within the above pattern
+    int fast_forward_frame{};
+    bool is_fast_forwarding{};
+    // false if the current frame wasn't drawn from the start, in which
+    // case it isn't presented.
+    bool is_frame_drawn{true};
+
     std::vector<std::uint8_t> frontbuffer;
     std::vector<std::uint8_t> backbuffer;
     bool has_new_frame{false};
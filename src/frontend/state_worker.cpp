@@ -0,0 +1,310 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "state_worker.hpp"
+#include "frontend_base.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <zlib.h>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    #define STATE_THREAD 0
+#else
+    #define STATE_THREAD 1
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+#endif
+
+namespace frontend {
+namespace {
+
+auto write_state(const gba::State& state, const std::string& path, StateCompression compression, std::vector<std::uint8_t>& buffer) -> bool
+{
+    const auto data = reinterpret_cast<const std::uint8_t*>(&state);
+
+    if (compression == StateCompression::NONE)
+    {
+        return Base::dumpfile(path, { data, gba::StateMeta::SIZE });
+    }
+
+    const auto level = compression == StateCompression::FAST ? Z_BEST_SPEED : Z_DEFAULT_COMPRESSION;
+    uLongf size = buffer.size();
+
+    if (Z_OK != compress2(buffer.data(), &size, data, gba::StateMeta::SIZE, level))
+    {
+        return false;
+    }
+
+    return Base::dumpfile(path, { buffer.data(), size });
+}
+
+auto read_state(const std::string& path, gba::State& state) -> bool
+{
+    const auto data = Base::loadfile(path);
+    if (data.empty())
+    {
+        return false;
+    }
+
+    const auto out = reinterpret_cast<std::uint8_t*>(&state);
+    uLongf size = gba::StateMeta::SIZE;
+
+    if (Z_OK == uncompress(out, &size, data.data(), data.size()) && size == gba::StateMeta::SIZE)
+    {
+        return true;
+    }
+
+    // saved with StateCompression::NONE
+    if (data.size() == gba::StateMeta::SIZE)
+    {
+        std::memcpy(out, data.data(), data.size());
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace
+
+struct StateWorker::State
+{
+    struct Save
+    {
+        std::unique_ptr<gba::State> state;
+        std::string path;
+        StateCompression compression;
+    };
+
+    enum : std::size_t
+    {
+        // number of saves that can be queued before save() waits
+        SAVE_COUNT = 2,
+    };
+
+    State()
+    {
+        for (auto& save : saves)
+        {
+            save.state = std::make_unique<gba::State>();
+        }
+
+        preloaded = std::make_unique<gba::State>();
+        preload_scratch = std::make_unique<gba::State>();
+        buffer.resize(compressBound(gba::StateMeta::SIZE));
+    }
+
+    Save saves[SAVE_COUNT];
+    // total number of saves queued / written, the slot is the count % SAVE_COUNT
+    std::size_t save_head{};
+    std::size_t save_tail{};
+
+    // path of the state in preloaded, empty if none
+    std::string preloaded_path;
+    std::unique_ptr<gba::State> preloaded;
+    // path to preload next, empty if none
+    std::string preload_path;
+    // path that's being preloaded, empty if none
+    std::string preload_busy_path;
+
+    // worker only
+    std::unique_ptr<gba::State> preload_scratch;
+    std::vector<std::uint8_t> buffer;
+
+    void write(Save& save)
+    {
+        if (write_state(*save.state, save.path, save.compression, buffer))
+        {
+            std::printf("savestate to: %s\n", save.path.c_str());
+        }
+        else
+        {
+            std::printf("failed to savestate to: %s\n", save.path.c_str());
+        }
+    }
+
+    // the state that was just written is the newest for that path
+    void on_write(Save& save)
+    {
+        std::swap(save.state, preloaded);
+        preloaded_path = save.path;
+    }
+
+    void on_preload(bool result, const std::string& path)
+    {
+        if (result)
+        {
+            std::swap(preload_scratch, preloaded);
+            preloaded_path = path;
+        }
+        else if (preloaded_path == path)
+        {
+            preloaded_path.clear();
+        }
+    }
+
+    #if STATE_THREAD
+    bool quit{};
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::thread thread;
+
+    void run()
+    {
+        std::unique_lock lock{mutex};
+
+        for (;;)
+        {
+            work_cv.wait(lock, [this]{ return quit || save_head != save_tail || !preload_path.empty(); });
+
+            // the saves are always written before quitting
+            if (save_head != save_tail)
+            {
+                auto& save = saves[save_tail % SAVE_COUNT];
+                lock.unlock();
+                write(save);
+                lock.lock();
+                on_write(save);
+                save_tail++;
+            }
+            else if (quit)
+            {
+                return;
+            }
+            else
+            {
+                preload_busy_path = std::exchange(preload_path, {});
+                lock.unlock();
+                const auto result = read_state(preload_busy_path, *preload_scratch);
+                lock.lock();
+                // if a save to the same path was queued whilst reading,
+                // then it'll replace this once it's written.
+                on_preload(result, preload_busy_path);
+                preload_busy_path.clear();
+            }
+
+            done_cv.notify_all();
+        }
+    }
+    #endif
+};
+
+StateWorker::StateWorker() : state{std::make_unique<State>()}
+{
+    #if STATE_THREAD
+    state->thread = std::thread{[s = state.get()]{ s->run(); }};
+    #endif
+}
+
+StateWorker::~StateWorker()
+{
+    #if STATE_THREAD
+    {
+        std::scoped_lock lock{state->mutex};
+        state->quit = true;
+    }
+
+    state->work_cv.notify_one();
+    state->thread.join();
+    #endif
+}
+
+auto StateWorker::save(const gba::Gba& gba, const std::string& path, StateCompression compression) -> bool
+{
+    auto& s = *state;
+
+    #if STATE_THREAD
+    std::unique_lock lock{s.mutex};
+    s.done_cv.wait(lock, [&s]{ return s.save_head - s.save_tail < State::SAVE_COUNT; });
+    // the slot isn't read until save_head is moved past it
+    auto& save = s.saves[s.save_head % State::SAVE_COUNT];
+    lock.unlock();
+    #else
+    auto& save = s.saves[0];
+    #endif
+
+    if (!gba.savestate(*save.state))
+    {
+        return false;
+    }
+
+    save.path = path;
+    save.compression = compression;
+
+    #if STATE_THREAD
+    lock.lock();
+    s.save_head++;
+    lock.unlock();
+    s.work_cv.notify_one();
+    #else
+    s.write(save);
+    s.on_write(save);
+    #endif
+
+    return true;
+}
+
+auto StateWorker::load(gba::Gba& gba, const std::string& path) -> bool
+{
+    auto& s = *state;
+
+    #if STATE_THREAD
+    std::unique_lock lock{s.mutex};
+
+    // the newest save to path that's still queued
+    for (auto i = s.save_head; i != s.save_tail; i--)
+    {
+        const auto& save = s.saves[(i - 1) % State::SAVE_COUNT];
+        if (save.path == path)
+        {
+            return gba.loadstate(*save.state);
+        }
+    }
+
+    // it'll be ready sooner than reading it again
+    s.done_cv.wait(lock, [&s, &path]{ return s.preload_busy_path != path; });
+    #endif
+
+    if (s.preloaded_path == path)
+    {
+        return gba.loadstate(*s.preloaded);
+    }
+
+    #if STATE_THREAD
+    lock.unlock();
+    #endif
+
+    auto new_state = std::make_unique<gba::State>();
+    return read_state(path, *new_state) && gba.loadstate(*new_state);
+}
+
+auto StateWorker::preload(const std::string& path) -> void
+{
+    auto& s = *state;
+
+    #if STATE_THREAD
+    {
+        std::scoped_lock lock{s.mutex};
+        s.preload_path = path;
+    }
+
+    s.work_cv.notify_one();
+    #else
+    s.on_preload(read_state(path, *s.preload_scratch), path);
+    #endif
+}
+
+auto StateWorker::flush() -> void
+{
+    #if STATE_THREAD
+    auto& s = *state;
+    std::unique_lock lock{s.mutex};
+    s.done_cv.wait(lock, [&s]{ return s.save_head == s.save_tail; });
+    #endif
+}
+
+} // namespace frontend
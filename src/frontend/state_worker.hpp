@@ -0,0 +1,56 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// compresses and writes savestates on a worker thread.
+// save() only copies the state into a preallocated buffer, the rest is
+// done on the worker, so saving doesn't hitch the emu.
+// preload() reads and decompresses a state ahead of time (ie, the selected
+// slot), so that load() doesn't have to touch the disk.
+// load() also checks the saves that are still queued, so loading a state
+// that was just saved doesn't wait for it to be written.
+#pragma once
+
+#include <gba.hpp>
+#include <memory>
+#include <string>
+
+namespace frontend {
+
+enum class StateCompression
+{
+    // zlib default level, smallest file
+    DEFAULT,
+    // zlib fastest level, a few times faster and slightly larger
+    FAST,
+    // the state is written as is
+    NONE,
+};
+
+struct StateWorker
+{
+public:
+    StateWorker();
+    // waits for every save to be written
+    ~StateWorker();
+
+    StateWorker(const StateWorker&) = delete;
+    auto operator=(const StateWorker&) -> StateWorker& = delete;
+
+    // snapshots the state and queues it to be written to path.
+    // only waits if the previous saves haven't been written yet.
+    auto save(const gba::Gba& gba, const std::string& path, StateCompression compression) -> bool;
+    // loads the state at path, from the preloaded state or queued save
+    // if there is one, else from the file.
+    auto load(gba::Gba& gba, const std::string& path) -> bool;
+    // queues path to be read and decompressed, this replaces the
+    // previously preloaded state.
+    auto preload(const std::string& path) -> void;
+    // waits for every save to be written, ie, before syncing the fs
+    auto flush() -> void;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+} // namespace frontend
@@ -0,0 +1,390 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+#include <algorithm>
+#include <arm7tdmi/arm7tdmi.hpp>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <gba.hpp>
+#include <mem.hpp>
+#include <memory>
+#include <vector>
+#include "test_utils.hpp"
+
+namespace {
+
+using namespace gba;
+
+// the hle swis tick the cycles that the bios would've spent, these are
+// fitted against the bundled bios so are allowed to be off by a bit.
+constexpr auto CYCLE_TOLERANCE_PERCENT = 2;
+constexpr auto CYCLE_TOLERANCE_MIN = 8;
+
+// where the test data is written to
+constexpr u32 SRC = 0x02000000;
+constexpr u32 DST = 0x02010000;
+constexpr u32 VRAM = 0x06000000;
+constexpr u32 OAM = 0x07000000;
+
+// the return address of the swi, see write_program()
+constexpr u32 SWI_RETURN = 0x0300000C;
+
+struct TestData
+{
+    const char* name;
+    u8 swi;
+    u32 r0{}, r1{}, r2{}, r3{};
+    // bit n set if rn is returned. the rest of r0-r3 are scratch, the
+    // bios leaves whatever it was using in them.
+    u8 outputs{};
+    // written to SRC
+    std::vector<u8> data{};
+};
+
+struct Result
+{
+    u32 registers[13];
+    u32 cpsr;
+    u32 cycles;
+    // r14_svc, set if the bios was entered
+    u32 lr_svc;
+    std::unique_ptr<mem::Mem> mem;
+};
+
+void push32(std::vector<u8>& data, u32 value)
+{
+    for (auto i = 0; i < 4; i++)
+    {
+        data.push_back(value >> (i * 8));
+    }
+}
+
+void push16(std::vector<u8>& data, u16 value)
+{
+    data.push_back(value >> 0);
+    data.push_back(value >> 8);
+}
+
+// 8 literals, then 4 copies of them
+auto create_lz77() -> std::vector<u8>
+{
+    std::vector<u8> data;
+    push32(data, 0x10 | (40 << 8));
+    data.push_back(0x00);
+    for (u8 c = 'a'; c < 'a' + 8; c++)
+    {
+        data.push_back(c);
+    }
+    data.push_back(0xF0);
+    for (auto i = 0; i < 4; i++)
+    {
+        data.push_back(0x50); // length 8
+        data.push_back(0x07); // displacement 8
+    }
+    return data;
+}
+
+// 8bit huffman with 'A' = 0, 'B' = 10, 'C' = 11
+auto create_huffman() -> std::vector<u8>
+{
+    constexpr char SYMBOLS[] = "ABCABBCCAAABCBACCBAABCCBAACBABCA";
+    constexpr auto SIZE = sizeof(SYMBOLS) - 1;
+
+    std::vector<u8> data;
+    push32(data, 0x28 | (SIZE << 8));
+    // tree size, root (left is data), 'A', node (both data), 'B', 'C', padding
+    const u8 tree[] = { 3, 0x80, 'A', 0xC0, 'B', 'C', 0, 0 };
+    data.insert(data.end(), std::begin(tree), std::end(tree));
+
+    u32 word = 0;
+    u32 bits = 0;
+    const auto push_bit = [&](u32 bit)
+    {
+        word |= bit << (31 - bits);
+        if (++bits == 32)
+        {
+            push32(data, word);
+            word = 0;
+            bits = 0;
+        }
+    };
+
+    for (std::size_t i = 0; i < SIZE; i++)
+    {
+        switch (SYMBOLS[i])
+        {
+            case 'A': push_bit(0); break;
+            case 'B': push_bit(1); push_bit(0); break;
+            case 'C': push_bit(1); push_bit(1); break;
+        }
+    }
+
+    if (bits)
+    {
+        push32(data, word);
+    }
+    return data;
+}
+
+// 6 'x', "abcd", 10 'y'
+auto create_rl() -> std::vector<u8>
+{
+    return { 0x30, 20, 0, 0, 0x83, 'x', 0x03, 'a', 'b', 'c', 'd', 0x87, 'y' };
+}
+
+auto create_diff8() -> std::vector<u8>
+{
+    std::vector<u8> data;
+    push32(data, 0x81 | (16 << 8));
+    for (auto i = 0; i < 16; i++)
+    {
+        data.push_back(i * 37 + 3);
+    }
+    return data;
+}
+
+auto create_diff16() -> std::vector<u8>
+{
+    std::vector<u8> data;
+    push32(data, 0x82 | (16 << 8));
+    for (auto i = 0; i < 8; i++)
+    {
+        push16(data, i * 0x1357 + 0x0101);
+    }
+    return data;
+}
+
+// 8 bytes of 2bit units, then the info (at SRC + 8), unpacked to 8bit + 1
+auto create_bit_unpack() -> std::vector<u8>
+{
+    std::vector<u8> data{ 0x1B, 0xE4, 0x00, 0xFF, 0x55, 0xAA, 0x39, 0xC6 };
+    push16(data, 8); // length
+    data.push_back(2); // src width
+    data.push_back(8); // dst width
+    push32(data, 1); // offset, zero flag clear
+    return data;
+}
+
+auto create_words(u32 count) -> std::vector<u8>
+{
+    std::vector<u8> data;
+    for (u32 i = 0; i < count; i++)
+    {
+        push32(data, i * 0x01234567 + 0x89ABCDEF);
+    }
+    return data;
+}
+
+// ox, oy, cx, cy, sx, sy, angle
+auto create_bg_affine() -> std::vector<u8>
+{
+    std::vector<u8> data;
+    push32(data, 0x00012000); push32(data, 0xFFFE8000);
+    push16(data, 120); push16(data, 80);
+    push16(data, 0x0100); push16(data, 0x0180);
+    push16(data, 0x2000); push16(data, 0);
+
+    push32(data, 0x00400000); push32(data, 0x00100000);
+    push16(data, 0xFFF0); push16(data, 40);
+    push16(data, 0xFF00); push16(data, 0x0080);
+    push16(data, 0xA400); push16(data, 0);
+    return data;
+}
+
+// sx, sy, angle
+auto create_obj_affine() -> std::vector<u8>
+{
+    std::vector<u8> data;
+    push16(data, 0x0100); push16(data, 0x0200); push16(data, 0x4000); push16(data, 0);
+    push16(data, 0xFF80); push16(data, 0x0100); push16(data, 0xC800); push16(data, 0);
+    return data;
+}
+
+auto create_tests() -> std::vector<TestData>
+{
+    return
+    {
+        { .name = "LZ77UnCompReadNormalWrite8bit", .swi = 0x11, .r0 = SRC, .r1 = DST, .data = create_lz77() },
+        { .name = "LZ77UnCompReadNormalWrite16bit", .swi = 0x12, .r0 = SRC, .r1 = VRAM, .data = create_lz77() },
+        { .name = "HuffUnCompReadNormal", .swi = 0x13, .r0 = SRC, .r1 = DST, .data = create_huffman() },
+        { .name = "RLUnCompReadNormalWrite8bit", .swi = 0x14, .r0 = SRC, .r1 = DST, .data = create_rl() },
+        { .name = "RLUnCompReadNormalWrite16bit", .swi = 0x15, .r0 = SRC, .r1 = VRAM, .data = create_rl() },
+        { .name = "BitUnPack", .swi = 0x10, .r0 = SRC, .r1 = DST, .r2 = SRC + 8, .data = create_bit_unpack() },
+        { .name = "Diff8bitUnFilterWrite8bit", .swi = 0x16, .r0 = SRC, .r1 = DST, .data = create_diff8() },
+        { .name = "Diff8bitUnFilterWrite16bit", .swi = 0x17, .r0 = SRC, .r1 = VRAM, .data = create_diff8() },
+        { .name = "Diff16bitUnFilter", .swi = 0x18, .r0 = SRC, .r1 = DST, .data = create_diff16() },
+        { .name = "BgAffineSet", .swi = 0x0E, .r0 = SRC, .r1 = DST, .r2 = 2, .data = create_bg_affine() },
+        { .name = "ObjAffineSet", .swi = 0x0F, .r0 = SRC, .r1 = DST, .r2 = 2, .r3 = 2, .data = create_obj_affine() },
+        { .name = "ObjAffineSet (oam)", .swi = 0x0F, .r0 = SRC, .r1 = OAM + 6, .r2 = 2, .r3 = 8, .data = create_obj_affine() },
+        { .name = "CpuFastSet (copy)", .swi = 0x0C, .r0 = SRC, .r1 = DST, .r2 = 40, .data = create_words(40) },
+        { .name = "CpuFastSet (fill)", .swi = 0x0C, .r0 = SRC, .r1 = VRAM, .r2 = 24 | (1 << 24), .data = create_words(1) },
+        { .name = "ArcTan", .swi = 0x09, .r0 = 0x2000, .outputs = 0b0001 },
+        { .name = "ArcTan (negative)", .swi = 0x09, .r0 = 0xFFFFF000, .outputs = 0b0001 },
+        { .name = "ArcTan2", .swi = 0x0A, .r0 = 0x1000, .r1 = 0x0800, .outputs = 0b0001 },
+        { .name = "ArcTan2 (-x)", .swi = 0x0A, .r0 = 0xFFFFF000, .r1 = 0x0400, .outputs = 0b0001 },
+        { .name = "ArcTan2 (-y)", .swi = 0x0A, .r0 = 0x0300, .r1 = 0xFFFFE000, .outputs = 0b0001 },
+        { .name = "ArcTan2 (-x, -y)", .swi = 0x0A, .r0 = 0xFFFFFF00, .r1 = 0xFFFFF800, .outputs = 0b0001 },
+        // r3 (|quot|) isn't compared, the bundled bios doesn't set it.
+        { .name = "DivArm", .swi = 0x07, .r0 = 7, .r1 = 100, .outputs = 0b0011 },
+        { .name = "DivArm (large)", .swi = 0x07, .r0 = 3, .r1 = 0x7FFFFFFF, .outputs = 0b0011 },
+    };
+}
+
+// starts the timers, calls the swi, then reads the timers into r10 / r11.
+// r8 = timer io, r9 = tm1 cascade, r10 = tm0 enable
+void write_program(Gba& gba, u8 swi)
+{
+    const u32 program[] =
+    {
+        0xE5889004, // str r9, [r8, #4]
+        0xE588A000, // str r10, [r8]
+        0xEF000000u | (swi << 16), // swi #swi
+        0xE1D8A0B0, // ldrh r10, [r8]
+        0xE1D8B0B4, // ldrh r11, [r8, #4]
+        0xEAFFFFFE, // b .
+    };
+
+    for (u32 i = 0; i < std::size(program); i++)
+    {
+        mem::write32(gba, 0x03000000 + i * 4, program[i]);
+    }
+}
+
+auto run(const std::vector<u8>& rom, const TestData& data, bool hle, Result& result) -> bool
+{
+    auto gba = std::make_unique<Gba>();
+    if (!gba->loadrom(rom))
+    {
+        return false;
+    }
+
+    gba->set_bios_hle(hle);
+    write_program(*gba, data.swi);
+
+    for (std::size_t i = 0; i < data.data.size(); i++)
+    {
+        mem::write8(*gba, SRC + i, data.data[i]);
+    }
+
+    arm7tdmi::set_reg(*gba, 0, data.r0);
+    arm7tdmi::set_reg(*gba, 1, data.r1);
+    arm7tdmi::set_reg(*gba, 2, data.r2);
+    arm7tdmi::set_reg(*gba, 3, data.r3);
+    arm7tdmi::set_reg(*gba, 8, mem::IO_TM0D);
+    arm7tdmi::set_reg(*gba, 9, 0x00840000);
+    arm7tdmi::set_reg(*gba, 10, 0x00800000);
+    arm7tdmi::set_reg(*gba, 11, 0xFFFFFFFF);
+
+    gba->run();
+
+    // the timers are only read once the swi returns
+    if (arm7tdmi::get_reg(*gba, 11) > 0xFFFF)
+    {
+        std::printf("[%s] %s didn't return\n", data.name, hle ? "hle" : "lle");
+        return false;
+    }
+
+    for (u8 i = 0; i < std::size(result.registers); i++)
+    {
+        result.registers[i] = arm7tdmi::get_reg(*gba, i);
+    }
+
+    result.cpsr = arm7tdmi::get_u32_from_cpsr(*gba);
+    result.cycles = (result.registers[11] << 16) | result.registers[10];
+    result.lr_svc = gba->cpu.banked_reg_svc[1];
+    result.mem = std::make_unique<mem::Mem>(gba->mem);
+    return true;
+}
+
+auto test(const std::vector<u8>& rom, const TestData& data) -> bool
+{
+    Result hle{};
+    Result lle{};
+
+    if (!run(rom, data, true, hle) || !run(rom, data, false, lle))
+    {
+        return false;
+    }
+
+    // otherwise, both ran the bios
+    if (hle.lr_svc == SWI_RETURN || lle.lr_svc != SWI_RETURN)
+    {
+        std::printf("[%s] swi wasn't handled by the hle\n", data.name);
+        return false;
+    }
+
+    // r10 and r11 are the cycles
+    for (u8 i = 0; i < 10; i++)
+    {
+        if (i < 4 && !(data.outputs & (1 << i)))
+        {
+            continue;
+        }
+
+        if (hle.registers[i] != lle.registers[i])
+        {
+            std::printf("[%s] r%u hle: 0x%08X lle: 0x%08X\n", data.name, i, hle.registers[i], lle.registers[i]);
+            return false;
+        }
+    }
+
+    if (hle.registers[12] != lle.registers[12] || hle.cpsr != lle.cpsr)
+    {
+        std::printf("[%s] r12 / cpsr hle: 0x%08X 0x%08X lle: 0x%08X 0x%08X\n", data.name, hle.registers[12], hle.cpsr, lle.registers[12], lle.cpsr);
+        return false;
+    }
+
+    // the bios uses the top of iwram for its stack
+    const auto compare = [&data](const char* name, const u8* a, const u8* b, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++)
+        {
+            if (a[i] != b[i])
+            {
+                std::printf("[%s] %s[0x%zX] hle: 0x%02X lle: 0x%02X\n", data.name, name, i, a[i], b[i]);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    if (!compare("ewram", hle.mem->ewram, lle.mem->ewram, sizeof(hle.mem->ewram)) ||
+        !compare("iwram", hle.mem->iwram, lle.mem->iwram, 0x7E00) ||
+        !compare("vram", hle.mem->vram, lle.mem->vram, sizeof(hle.mem->vram)) ||
+        !compare("oam", hle.mem->oam, lle.mem->oam, sizeof(hle.mem->oam)))
+    {
+        return false;
+    }
+
+    const auto diff = std::abs(static_cast<s32>(hle.cycles - lle.cycles));
+    const auto tolerance = std::max<s32>(CYCLE_TOLERANCE_MIN, lle.cycles * CYCLE_TOLERANCE_PERCENT / 100);
+    std::printf("[%s] cycles hle: %u lle: %u\n", data.name, hle.cycles, lle.cycles);
+
+    if (diff > tolerance)
+    {
+        std::printf("[%s] cycles are off by %d, max %d\n", data.name, diff, tolerance);
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+auto main() -> int
+{
+    const auto rom = test_utils::create_rom(0x1000, 0xE3A0F403); // mov pc, #0x03000000
+    const auto tests = create_tests();
+
+    for (const auto& data : tests)
+    {
+        if (!test(rom, data))
+        {
+            std::printf("failed bios hle test: %s\n", data.name);
+            return 1;
+        }
+    }
+
+    return 0; // passed!
+}
@@ -0,0 +1,390 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fork_pool.hpp>
+#include <gba.hpp>
+#include <mem.hpp>
+#include <memory>
+#include <vector>
+#include "test_utils.hpp"
+
+namespace {
+
+using namespace gba;
+
+constexpr auto FRAMES = 6;
+constexpr auto ROUNDS = 4;
+constexpr auto FORKS = 3;
+
+constexpr arm7tdmi::Backend BACKENDS[] =
+{
+    arm7tdmi::Backend::interpreter,
+    arm7tdmi::Backend::cached_interpreter,
+    arm7tdmi::Backend::jit,
+};
+
+// a rom that jumps to a loop in iwram, which fills the top of vram
+// (mode 3) with a counter. the loop is written by the test, and the
+// forks change it, so restoring iwram has to invalidate the cpu blocks.
+// blocks are only run if the first 2 opcodes match the pipeline, so the
+// opcode that changes is after that.
+auto create_rom() -> std::vector<u8>
+{
+    return test_utils::create_rom(0x1000, 0xE3A0F403); // mov pc, #0x03000000
+}
+
+// step is how much the counter is incremented by
+void write_program(Gba& gba, u8 step)
+{
+    constexpr u32 program[] =
+    {
+        0xE3A01406, // mov r1, #0x06000000
+        0xE4810004, // str r0, [r1], #4
+        0xE3110901, // tst r1, #0x4000
+        0xE2800000, // add r0, r0, #step
+        0x0AFFFFFB, // beq 0x03000004
+        0xEAFFFFF9, // b 0x03000000
+    };
+
+    for (u32 i = 0; i < std::size(program); i++)
+    {
+        const auto value = i == 3 ? program[i] | step : program[i];
+        mem::write32(gba, 0x03000000 + i * 4, value);
+    }
+}
+
+// what the "game" does each frame, seed is the same for the instances
+// that are compared, so that they do the same.
+void run_frame(Gba& gba, u32 seed)
+{
+    test_utils::Rng rng{seed * 2654435761u + 1};
+
+    gba.setkeys(0x3FF, false);
+    gba.setkeys(rng.next() & 0x3FF, true);
+
+    // the bottom of the bitmap, and something in ewram
+    for (auto i = 0; i < 16; i++)
+    {
+        mem::write16(gba, 0x06010000 + (rng.next() & 0xFFFE) % 0x2C00, rng.next());
+        mem::write32(gba, 0x02000000 + (rng.next() & 0x3FFFC), rng.next());
+    }
+
+    gba.run();
+}
+
+struct Instance
+{
+    std::unique_ptr<Gba> gba{std::make_unique<Gba>()};
+    u16 pixels[160][240]{};
+    // the pixels of the last frame
+    u16 frame[160][240]{};
+
+    static void vblank_callback(void* user)
+    {
+        auto& instance = *static_cast<Instance*>(user);
+        std::memcpy(instance.frame, instance.pixels, sizeof(instance.frame));
+    }
+
+    // this is kept by clone_into()
+    void bind(Gba& gba_, arm7tdmi::Backend backend)
+    {
+        gba_.set_userdata(this);
+        gba_.set_pixels(pixels, 240, 16);
+        gba_.set_vblank_callback(vblank_callback);
+        gba_.set_cpu_backend(backend);
+    }
+};
+
+// runs both with the same frames and compares every frame and the state
+auto check(Instance& a, Instance& b, u32 seed, const char* name) -> bool
+{
+    // run() stops a few lines into the frame, those lines were drawn
+    // before the state was loaded, so they aren't compared.
+    std::memset(a.pixels, 0, sizeof(a.pixels));
+    std::memset(b.pixels, 0, sizeof(b.pixels));
+
+    for (auto i = 0; i < FRAMES; i++)
+    {
+        run_frame(*a.gba, seed + i);
+        run_frame(*b.gba, seed + i);
+
+        if (std::memcmp(a.frame, b.frame, sizeof(a.frame)))
+        {
+            std::printf("[%s] frame %d pixels differ\n", name, i);
+            return false;
+        }
+    }
+
+    if (!test_utils::is_same_state(*a.gba, *b.gba))
+    {
+        std::printf("[%s] state differs\n", name);
+        return false;
+    }
+
+    return true;
+}
+
+struct Test
+{
+    arm7tdmi::Backend backend;
+    Instance origin;
+    // loads the state of origin with loadstate(), to compare against
+    Instance reference;
+    std::unique_ptr<State> state{std::make_unique<State>()};
+    u32 seed{};
+
+    auto init(const std::vector<u8>& rom) -> bool
+    {
+        if (!origin.gba->loadrom(rom) || !reference.gba->loadrom(rom))
+        {
+            return false;
+        }
+
+        origin.bind(*origin.gba, backend);
+        reference.bind(*reference.gba, backend);
+        mem::write16(*origin.gba, mem::IO_DISPCNT, 0x0403); // mode 3, bg2
+        write_program(*origin.gba, 1);
+        advance();
+        return true;
+    }
+
+    // the origin moves on, ie, the player keeps playing
+    void advance()
+    {
+        for (auto i = 0; i < FRAMES; i++)
+        {
+            run_frame(*origin.gba, seed++);
+        }
+    }
+
+    // the reference loads the origin's state
+    auto load_reference() -> bool
+    {
+        return origin.gba->savestate(*state) && reference.gba->loadstate(*state);
+    }
+};
+
+auto test_clone(Test& test) -> bool
+{
+    Instance clone;
+    clone.bind(*clone.gba, test.backend);
+
+    for (auto round = 0; round < ROUNDS; round++)
+    {
+        // the first clone is in full, the rest only copy what changed
+        if (!test.origin.gba->clone_into(*clone.gba) || !test.load_reference())
+        {
+            std::printf("failed to clone\n");
+            return false;
+        }
+
+        // every other round runs the program it was cloned with, so the
+        // blocks of the last one have to be invalidated by clone_into()
+        if (round % 2 == 0)
+        {
+            write_program(*clone.gba, round + 2);
+            write_program(*test.reference.gba, round + 2);
+        }
+
+        if (!check(test.reference, clone, round * 1000, "clone_into"))
+        {
+            return false;
+        }
+
+        test.advance();
+    }
+
+    return true;
+}
+
+auto test_snapshot(Test& test) -> bool
+{
+    auto snapshot = std::make_unique<Snapshot>();
+    Instance forks[FORKS];
+
+    for (auto& fork : forks)
+    {
+        fork.bind(*fork.gba, test.backend);
+        if (!test.origin.gba->clone_into(*fork.gba))
+        {
+            std::printf("failed to clone\n");
+            return false;
+        }
+    }
+
+    for (auto round = 0; round < ROUNDS; round++)
+    {
+        test.origin.gba->save_snapshot(*snapshot);
+
+        // the forks load the same snapshot again, so after the first
+        // round, only the pages that changed since are loaded.
+        for (auto rerun = 0; rerun < 2; rerun++)
+        {
+            for (auto i = 0; i < FORKS; i++)
+            {
+                // the last fork misses every other round, so it has to
+                // load the snapshot in full
+                if (i == FORKS - 1 && round % 2)
+                {
+                    continue;
+                }
+
+                auto& fork = forks[i];
+                if (!fork.gba->load_snapshot(*snapshot) || !test.load_reference())
+                {
+                    std::printf("failed to load snapshot\n");
+                    return false;
+                }
+
+                // the rerun runs the program of the snapshot, so the blocks
+                // of the first run have to be invalidated by load_snapshot()
+                if (rerun == 0)
+                {
+                    write_program(*fork.gba, i + 2);
+                    write_program(*test.reference.gba, i + 2);
+                }
+
+                const auto seed = (round * FORKS + i) * 1000 + rerun * 100;
+                if (!check(test.reference, fork, seed, "load_snapshot"))
+                {
+                    std::printf("round: %d rerun: %d fork: %d\n", round, rerun, i);
+                    return false;
+                }
+            }
+        }
+
+        test.advance();
+    }
+
+    return true;
+}
+
+struct PoolTest
+{
+    arm7tdmi::Backend backend;
+    Instance instances[FORKS];
+    u32 seed;
+    // if false, the forks run the program of the snapshot
+    bool change_program;
+
+    static void init_callback(void* user, Gba& fork, std::size_t index)
+    {
+        auto& test = *static_cast<PoolTest*>(user);
+        test.instances[index].bind(fork, test.backend);
+    }
+
+    static void fork_callback(void* user, Gba& fork, std::size_t index)
+    {
+        auto& test = *static_cast<PoolTest*>(user);
+        // see check()
+        std::memset(test.instances[index].pixels, 0, sizeof(test.instances[index].pixels));
+
+        if (test.change_program)
+        {
+            write_program(fork, index + 2);
+        }
+
+        for (auto i = 0; i < FRAMES; i++)
+        {
+            run_frame(fork, test.seed + index * 100 + i);
+        }
+    }
+};
+
+auto test_pool(Test& test) -> bool
+{
+    ForkPool pool{2};
+    auto pool_test = std::make_unique<PoolTest>();
+    pool_test->backend = test.backend;
+    pool.set_init_callback(PoolTest::init_callback, pool_test.get());
+
+    // the second run loads the snapshot into the same forks
+    for (auto round = 0; round < 2; round++)
+    {
+        pool_test->seed = round * 10000;
+        pool_test->change_program = round == 0;
+
+        if (!pool.run(*test.origin.gba, FORKS, PoolTest::fork_callback, pool_test.get()))
+        {
+            std::printf("failed to run pool\n");
+            return false;
+        }
+
+        for (std::size_t i = 0; i < FORKS; i++)
+        {
+            if (!test.load_reference())
+            {
+                return false;
+            }
+
+            auto& reference = *test.reference.gba;
+            std::memset(test.reference.pixels, 0, sizeof(test.reference.pixels));
+            if (pool_test->change_program)
+            {
+                write_program(reference, i + 2);
+            }
+
+            for (auto j = 0; j < FRAMES; j++)
+            {
+                run_frame(reference, pool_test->seed + i * 100 + j);
+            }
+
+            if (std::memcmp(test.reference.frame, pool_test->instances[i].frame, sizeof(test.reference.frame)))
+            {
+                std::printf("[pool] round: %d fork: %zu pixels differ\n", round, i);
+                return false;
+            }
+
+            if (!test_utils::is_same_state(reference, pool.get_fork(i)))
+            {
+                std::printf("[pool] round: %d fork: %zu state differs\n", round, i);
+                return false;
+            }
+        }
+
+        test.advance();
+    }
+
+    return true;
+}
+
+} // namespace
+
+auto main() -> int
+{
+    const auto rom = create_rom();
+
+    for (const auto backend : BACKENDS)
+    {
+        auto test = std::make_unique<Test>();
+        test->backend = backend;
+
+        if (!test->init(rom))
+        {
+            std::printf("failed to init\n");
+            return 1;
+        }
+
+        if (!test_clone(*test))
+        {
+            std::printf("failed clone test, backend: %u\n", static_cast<u32>(backend));
+            return 1;
+        }
+
+        if (!test_snapshot(*test))
+        {
+            std::printf("failed snapshot test, backend: %u\n", static_cast<u32>(backend));
+            return 1;
+        }
+
+        if (!test_pool(*test))
+        {
+            std::printf("failed pool test, backend: %u\n", static_cast<u32>(backend));
+            return 1;
+        }
+    }
+
+    return 0; // passed!
+}
@@ -0,0 +1,94 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <gba.hpp>
+#include <mem.hpp>
+#include <ppu/render.hpp>
+#include <memory>
+#include "test_utils.hpp"
+
+namespace {
+
+using namespace gba;
+
+constexpr auto TEST_COUNT = 20000;
+
+u16 scalar_pixels[160][240];
+u16 simd_pixels[160][240];
+
+// random vram, pram, oam and io, with a valid mode and the screen on
+void randomise(Gba& gba, test_utils::Rng& rng)
+{
+    rng.fill(gba.mem.vram, sizeof(gba.mem.vram));
+    rng.fill(gba.mem.pram, sizeof(gba.mem.pram));
+    rng.fill(gba.mem.oam, sizeof(gba.mem.oam));
+    rng.fill(gba.mem.io, 0x60);
+
+    REG_DISPCNT = (REG_DISPCNT & ~0x87) | (rng.next() % 6);
+    REG_VCOUNT = rng.next() % 160;
+
+    gba.ppu.bg2x = static_cast<s32>(rng.next()) >> 4;
+    gba.ppu.bg2y = static_cast<s32>(rng.next()) >> 4;
+    gba.ppu.bg3x = static_cast<s32>(rng.next()) >> 4;
+    gba.ppu.bg3y = static_cast<s32>(rng.next()) >> 4;
+
+    // the caches are updated on writes, which were skipped
+    gba.obj_cache.dirty = true;
+    gba.tile_cache.invalidate();
+}
+
+// draws the line with the scalar and (if available) simd merge()
+auto test(Gba& gba) -> bool
+{
+    const auto render = [&gba](u16 (&pixels)[160][240], bool scalar_merge)
+    {
+        ppu::RenderContext ctx{
+            .mem = { gba.mem.io, gba.mem.vram, gba.mem.pram, gba.mem.oam },
+            .ppu = gba.ppu,
+            .obj_cache = gba.obj_cache,
+            .tile_cache = gba.tile_cache,
+            .pixels = pixels,
+            .stride = 240,
+            .bpp = 16,
+            .colour_lut = nullptr,
+            .scalar_merge = scalar_merge,
+        };
+
+        ppu::render(ctx);
+    };
+
+    render(scalar_pixels, true);
+    render(simd_pixels, false);
+
+    const auto line = REG_VCOUNT;
+    if (std::memcmp(scalar_pixels[line], simd_pixels[line], sizeof(scalar_pixels[line])))
+    {
+        std::printf("mode: %u line: %u\n", REG_DISPCNT & 0x7, line);
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+auto main() -> int
+{
+    auto gba = std::make_unique<Gba>();
+    test_utils::Rng rng{0x12345678};
+
+    for (auto i = 0; i < TEST_COUNT; i++)
+    {
+        randomise(*gba, rng);
+
+        if (!test(*gba))
+        {
+            std::printf("failed ppu merge test: %d\n", i);
+            return 1;
+        }
+    }
+
+    return 0; // passed!
+}
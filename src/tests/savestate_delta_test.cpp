@@ -0,0 +1,349 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+#include <bios_hle.hpp>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <gba.hpp>
+#include <mem.hpp>
+#include <memory>
+#include <vector>
+#include "test_utils.hpp"
+
+namespace {
+
+using namespace gba;
+
+constexpr auto FRAMES = 8;
+
+// a rom that spins in a loop, so that everything written to memory is
+// written by the test. it has sram so that backup writes are tracked.
+auto create_rom() -> std::vector<u8>
+{
+    auto rom = test_utils::create_rom(0x10000, 0xEA00002E); // b 0x080000C0
+
+    // fill the rest with something to dma / copy from
+    for (std::size_t i = 0x200; i < rom.size(); i++)
+    {
+        rom[i] = static_cast<u8>(i * 7 + (i >> 8));
+    }
+
+    test_utils::write32(rom, 0xC0, 0xEAFFFFFE); // b 0x080000C0
+    std::memcpy(rom.data() + 0x100, "SRAM_V113", 9);
+
+    return rom;
+}
+
+// the last page of mem (pram, oam and io)
+constexpr auto LAST_PAGE = mem::DirtyPages::COUNT - 1;
+
+auto read_header(const std::vector<u8>& delta) -> StateDelta
+{
+    StateDelta header;
+    std::memcpy(&header, delta.data(), sizeof(header));
+    return header;
+}
+
+auto is_page_set(const StateDelta& header, u32 page) -> bool
+{
+    return header.pages[page >> 6] & (u64{1} << (page & 63));
+}
+
+auto count_pages(const StateDelta& header) -> u32
+{
+    u32 count = 0;
+    for (u32 i = 0; i < mem::DirtyPages::COUNT; i++)
+    {
+        count += is_page_set(header, i);
+    }
+    return count;
+}
+
+struct Test
+{
+    std::unique_ptr<Gba> gba{std::make_unique<Gba>()};
+    // loads every delta that gba saves
+    std::unique_ptr<Gba> follower{std::make_unique<Gba>()};
+    // kept up to date with apply_state_delta()
+    std::unique_ptr<State> state{test_utils::create_state()};
+    std::vector<u8> delta;
+
+    auto init(const std::vector<u8>& rom) -> bool
+    {
+        if (!gba->loadrom(rom) || !follower->loadrom(rom))
+        {
+            return false;
+        }
+
+        // the first delta is full, as everything is dirty after loading
+        gba->run();
+        if (!save_delta())
+        {
+            return false;
+        }
+
+        if (count_pages(read_header(delta)) != mem::DirtyPages::COUNT)
+        {
+            std::printf("first delta isn't full\n");
+            return false;
+        }
+
+        return gba->savestate(*state) && follower->loadstate(*state);
+    }
+
+    auto save_delta() -> bool
+    {
+        delta.resize(StateMeta::DELTA_MAX_SIZE);
+        const auto size = gba->savestate_delta(delta);
+        if (!size)
+        {
+            std::printf("failed to save delta\n");
+            return false;
+        }
+
+        delta.resize(size);
+        return true;
+    }
+
+    // keeps the state and the follower up to date without checking them
+    auto load_delta() -> bool
+    {
+        return apply_state_delta(*state, delta) && follower->loadstate_delta(delta);
+    }
+
+    // saves a delta and checks that it brings the state and the follower
+    // up to date with a full savestate of gba.
+    auto check(const char* name) -> bool
+    {
+        if (!save_delta())
+        {
+            return false;
+        }
+
+        auto expected = test_utils::create_state();
+        auto actual = test_utils::create_state();
+
+        if (!gba->savestate(*expected))
+        {
+            return false;
+        }
+
+        if (!apply_state_delta(*state, delta) || !test_utils::is_same_state(*state, *expected))
+        {
+            std::printf("[%s] apply_state_delta() doesn't match savestate()\n", name);
+            return false;
+        }
+
+        if (!follower->loadstate_delta(delta) || !follower->savestate(*actual) || !test_utils::is_same_state(*actual, *expected))
+        {
+            std::printf("[%s] loadstate_delta() doesn't match savestate()\n", name);
+            return false;
+        }
+
+        return true;
+    }
+};
+
+auto test_cpu_writes(Test& test) -> bool
+{
+    auto& gba = *test.gba;
+
+    for (auto i = 0; i < FRAMES; i++)
+    {
+        mem::write32(gba, 0x02000000 + i * 0x1000, 0xCAFE0000 + i); // ewram
+        mem::write16(gba, 0x03000000 + i * 0x800, 0xBEEF + i); // iwram
+        mem::write16(gba, 0x06000000 + i * 0x3000, 0x1234 + i); // vram
+        mem::write8(gba, 0x05000000 + i, 0x56); // pram
+        mem::write16(gba, mem::IO_BG0HOFS, i); // io
+        gba.run();
+
+        if (!test.check("cpu"))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+auto test_dma_writes(Test& test) -> bool
+{
+    auto& gba = *test.gba;
+
+    const auto dma = [&gba](u32 src, u32 dst, u16 count, bool word)
+    {
+        mem::write32(gba, mem::IO_DMA3SAD, src);
+        mem::write32(gba, mem::IO_DMA3DAD, dst);
+        mem::write16(gba, mem::IO_DMA3CNT_L, count);
+        mem::write16(gba, mem::IO_DMA3CNT_H, 0x8000 | (word << 10)); // enable, immediate
+    };
+
+    dma(0x08000200, 0x02011000, 0x1000, true); // rom to ewram, 4 pages
+    gba.run();
+    if (!test.check("dma rom to ewram"))
+    {
+        return false;
+    }
+
+    dma(0x02011000, 0x03004000, 0x400, true); // ewram to iwram
+    gba.run();
+    if (!test.check("dma ewram to iwram"))
+    {
+        return false;
+    }
+
+    dma(0x08001000, 0x06010000, 0x2000, false); // rom to vram (obj)
+    gba.run();
+    return test.check("dma rom to vram");
+}
+
+auto test_hle_writes(Test& test) -> bool
+{
+    auto& gba = *test.gba;
+
+    const auto swi = [&gba](u8 comment_field, u32 r0, u32 r1, u32 r2)
+    {
+        arm7tdmi::set_reg(gba, 0, r0);
+        arm7tdmi::set_reg(gba, 1, r1);
+        arm7tdmi::set_reg(gba, 2, r2);
+        return bios::hle(gba, comment_field);
+    };
+
+    if (!swi(0x0B, 0x08002000, 0x02030000, 0x2000)) // CpuSet, 16bit copy
+    {
+        std::printf("CpuSet not handled\n");
+        return false;
+    }
+    gba.run();
+    if (!test.check("hle CpuSet"))
+    {
+        return false;
+    }
+
+    if (!swi(0x0C, 0x08003000, 0x06008000, 0x800 | (1 << 24))) // CpuFastSet, fill
+    {
+        std::printf("CpuFastSet not handled\n");
+        return false;
+    }
+    gba.run();
+    return test.check("hle CpuFastSet");
+}
+
+auto test_invariants(Test& test) -> bool
+{
+    auto& gba = *test.gba;
+    constexpr auto EWRAM_PAGE = offsetof(mem::Mem, ewram) >> mem::DirtyPages::SHIFT;
+
+    // nothing written, only the last page is saved
+    if (!test.save_delta() || !test.load_delta())
+    {
+        return false;
+    }
+
+    auto header = read_header(test.delta);
+    if (count_pages(header) != 1 || !is_page_set(header, LAST_PAGE) || header.has_backup)
+    {
+        std::printf("empty delta has %u pages, backup: %u\n", count_pages(header), header.has_backup);
+        return false;
+    }
+
+    // each user has its own bits
+    mem::write8(gba, 0x02000000, 0xAA);
+    if (!gba.dirty_pages.is_set(mem::DirtyPages::USER_DELTA, EWRAM_PAGE) || !gba.dirty_pages.is_set(mem::DirtyPages::USER_SNAPSHOT, EWRAM_PAGE))
+    {
+        std::printf("write didn't set both users\n");
+        return false;
+    }
+
+    if (!test.save_delta())
+    {
+        return false;
+    }
+
+    header = read_header(test.delta);
+    if (count_pages(header) != 2 || !is_page_set(header, EWRAM_PAGE))
+    {
+        std::printf("delta has %u pages, expected ewram and the last page\n", count_pages(header));
+        return false;
+    }
+
+    if (gba.dirty_pages.is_set(mem::DirtyPages::USER_DELTA, EWRAM_PAGE) || !gba.dirty_pages.is_set(mem::DirtyPages::USER_SNAPSHOT, EWRAM_PAGE))
+    {
+        std::printf("savestate_delta() cleared the wrong user\n");
+        return false;
+    }
+
+    auto snapshot = std::make_unique<Snapshot>();
+    gba.save_snapshot(*snapshot);
+    if (gba.dirty_pages.is_set(mem::DirtyPages::USER_SNAPSHOT, EWRAM_PAGE))
+    {
+        std::printf("save_snapshot() didn't clear its user\n");
+        return false;
+    }
+
+    if (!test.load_delta())
+    {
+        return false;
+    }
+
+    // backup writes set the flag, which is cleared by the next delta
+    mem::write8(gba, 0x0E000010, 0x42);
+    if (!gba.dirty_pages.backup[mem::DirtyPages::USER_DELTA] || !gba.dirty_pages.backup[mem::DirtyPages::USER_SNAPSHOT])
+    {
+        std::printf("backup write didn't set both users\n");
+        return false;
+    }
+
+    if (!test.check("backup"))
+    {
+        return false;
+    }
+
+    if (!read_header(test.delta).has_backup || gba.dirty_pages.backup[mem::DirtyPages::USER_DELTA])
+    {
+        std::printf("backup flag wasn't saved and cleared\n");
+        return false;
+    }
+
+    return test.check("after backup");
+}
+
+} // namespace
+
+auto main() -> int
+{
+    const auto rom = create_rom();
+    Test test;
+
+    if (!test.init(rom))
+    {
+        std::printf("failed to init\n");
+        return 1;
+    }
+
+    if (!test_cpu_writes(test))
+    {
+        std::printf("failed cpu writes test\n");
+        return 1;
+    }
+
+    if (!test_dma_writes(test))
+    {
+        std::printf("failed dma writes test\n");
+        return 1;
+    }
+
+    if (!test_hle_writes(test))
+    {
+        std::printf("failed hle writes test\n");
+        return 1;
+    }
+
+    if (!test_invariants(test))
+    {
+        std::printf("failed invariants test\n");
+        return 1;
+    }
+
+    return 0; // passed!
+}
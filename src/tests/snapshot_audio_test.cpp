@@ -0,0 +1,164 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+#include <cstddef>
+#include <cstdio>
+#include <gba.hpp>
+#include <mem.hpp>
+#include <memory>
+#include <vector>
+#include "test_utils.hpp"
+
+namespace {
+
+using namespace gba;
+
+constexpr auto FRAMES = 120;
+constexpr auto RUN_AHEAD_FRAMES = 2;
+
+struct TestData
+{
+    u32 sample_rate;
+    bool band_limited;
+};
+
+constexpr TestData TEST_DATA[] =
+{
+    { .sample_rate = 65536, .band_limited = true },
+    { .sample_rate = 65536, .band_limited = false },
+    { .sample_rate = 48000, .band_limited = true },
+    { .sample_rate = 48000, .band_limited = false },
+    { .sample_rate = 32768, .band_limited = true },
+};
+
+// a rom that spins in a loop, the sound is made by the test
+auto create_rom() -> std::vector<u8>
+{
+    auto rom = test_utils::create_rom(0x1000, 0xEA00002E); // b 0x080000C0
+    test_utils::write32(rom, 0xC0, 0xEAFFFFFE); // b 0x080000C0
+    return rom;
+}
+
+struct Instance
+{
+    std::unique_ptr<Gba> gba{std::make_unique<Gba>()};
+    s16 buffer[2048]{};
+    std::vector<s16> output{};
+
+    static void audio_callback(void* user)
+    {
+        auto& instance = *static_cast<Instance*>(user);
+        const auto count = instance.gba->sample_count;
+        instance.output.insert(instance.output.end(), instance.buffer, instance.buffer + count);
+    }
+
+    auto init(const std::vector<u8>& rom, const TestData& data) -> bool
+    {
+        if (!gba->loadrom(rom))
+        {
+            return false;
+        }
+
+        gba->set_userdata(this);
+        gba->set_audio_callback(audio_callback, buffer, data.sample_rate);
+        gba->set_band_limited_audio(data.band_limited);
+
+        mem::write16(*gba, mem::IO_SOUNDCNT_X, 0x80); // master enable
+        mem::write16(*gba, mem::IO_SOUNDCNT_L, 0xFF77); // every psg channel, full volume
+        mem::write16(*gba, mem::IO_SOUNDCNT_H, 0x0002); // psg at 100%
+        return true;
+    }
+};
+
+// changes the pitch / volume of the psg channels, so that each frame
+// differs from the last.
+void write_sound(Gba& gba, test_utils::Rng& rng)
+{
+    mem::write16(gba, mem::IO_SOUND1CNT_H, 0xF000 | (rng.next() & 0xC0)); // volume, duty
+    mem::write16(gba, mem::IO_SOUND1CNT_X, 0x8000 | (rng.next() & 0x7FF)); // restart, freq
+    mem::write16(gba, mem::IO_SOUND2CNT_L, 0xA000 | (rng.next() & 0xC0));
+    mem::write16(gba, mem::IO_SOUND2CNT_H, 0x8000 | (rng.next() & 0x7FF));
+    mem::write16(gba, mem::IO_SOUND4CNT_L, 0x7000);
+    mem::write16(gba, mem::IO_SOUND4CNT_H, 0x8000 | (rng.next() & 0xFF));
+}
+
+// runs the real frame then the frames ahead, with audio skipped, which
+// write something else, then rolls back. see frontend::RunAhead.
+void run_ahead(Gba& gba, Snapshot& snapshot, test_utils::Rng& rng)
+{
+    gba.run();
+    gba.save_snapshot(snapshot);
+    gba.set_skip_audio(true);
+
+    for (auto i = 0; i < RUN_AHEAD_FRAMES; i++)
+    {
+        write_sound(gba, rng);
+        gba.run();
+    }
+
+    [[maybe_unused]] const auto result = gba.load_snapshot(snapshot);
+    gba.set_skip_audio(false);
+}
+
+auto test(const std::vector<u8>& rom, const TestData& data) -> bool
+{
+    Instance expected;
+    Instance actual;
+    auto snapshot = std::make_unique<Snapshot>();
+
+    if (!expected.init(rom, data) || !actual.init(rom, data))
+    {
+        return false;
+    }
+
+    // both get the same writes for the real frames
+    test_utils::Rng rng{0x12345678};
+    test_utils::Rng ahead_rng{0x87654321};
+
+    for (auto i = 0; i < FRAMES; i++)
+    {
+        auto frame_rng = rng;
+        write_sound(*expected.gba, rng);
+        write_sound(*actual.gba, frame_rng);
+
+        expected.gba->run();
+        run_ahead(*actual.gba, *snapshot, ahead_rng);
+    }
+
+    if (expected.output.empty() || expected.output.size() != actual.output.size())
+    {
+        std::printf("sample count: %zu vs %zu\n", expected.output.size(), actual.output.size());
+        return false;
+    }
+
+    std::size_t diff = 0;
+    for (std::size_t i = 0; i < expected.output.size(); i++)
+    {
+        diff += expected.output[i] != actual.output[i];
+    }
+
+    if (diff)
+    {
+        std::printf("%zu of %zu samples differ\n", diff, expected.output.size());
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+auto main() -> int
+{
+    const auto rom = create_rom();
+
+    for (const auto& data : TEST_DATA)
+    {
+        if (!test(rom, data))
+        {
+            std::printf("failed snapshot audio test: rate: %u band_limited: %u\n", data.sample_rate, data.band_limited);
+            return 1;
+        }
+    }
+
+    return 0; // passed!
+}
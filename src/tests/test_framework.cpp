@@ -6,6 +6,7 @@
 
 #include <cstddef>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <string_view>
@@ -57,6 +58,20 @@ auto colour_callback(void* user, gba::Colour c) -> std::uint32_t
     return (c.b8() << 16) | (c.g8() << 8) | (c.r8() << 0) | 0xFF000000;
 }
 
+// every loop that was checked for idle skipping, see waitloop.hpp
+auto print_waitloop_report(const gba::Gba& gameboy_advance) -> void
+{
+    constexpr const char* results[] = { "detected", "region", "opcode", "poll", "registers" };
+
+    std::printf("waitloop report:\n");
+    for (const auto& r : gameboy_advance.waitloop.get_report())
+    {
+        std::printf("\t0x%08X %s len: %u poll: 0x%08X %-9s detected: %u rejected: %u skipped: %llu cycles\n",
+            r.pc, r.thumb ? "thumb" : "arm  ", r.length, r.poll_address, results[r.result],
+            r.detected, r.rejected, static_cast<unsigned long long>(r.cycles_skipped));
+    }
+}
+
 } // namespace
 
 struct Button
@@ -84,6 +99,25 @@ auto main(int argc, char** argv) -> int
     gameboy_advance->set_colour_callback(colour_callback);
     gameboy_advance->set_pixels(pixels, width, bpp);
 
+    // allows for every test to be run against each cpu backend
+    if (const auto backend = std::getenv("NB_CPU_BACKEND"))
+    {
+        const std::string_view view{backend};
+        if (view == "interpreter") { gameboy_advance->set_cpu_backend(gba::arm7tdmi::Backend::interpreter); }
+        else if (view == "cached") { gameboy_advance->set_cpu_backend(gba::arm7tdmi::Backend::cached_interpreter); }
+        else if (view == "jit") { gameboy_advance->set_cpu_backend(gba::arm7tdmi::Backend::jit); }
+    }
+
+    if (std::getenv("NB_RENDER_THREAD"))
+    {
+        gameboy_advance->set_render_thread(true);
+    }
+
+    if (std::getenv("NB_LLE_BIOS"))
+    {
+        gameboy_advance->set_bios_hle(false);
+    }
+
     const auto rom_path = argv[1];
     std::string _image_path;
 
@@ -171,6 +205,11 @@ auto main(int argc, char** argv) -> int
 
     }
 
+    if (std::getenv("NB_WAITLOOP_REPORT"))
+    {
+        print_waitloop_report(*gameboy_advance);
+    }
+
     if (read_or_write == RW::WRITE)
     {
         if (!stbi_write_png(image_path, width, height, bpp, pixels, width * bpp))
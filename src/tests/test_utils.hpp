@@ -0,0 +1,81 @@
+// Copyright 2022 TotalJustice.
+// SPDX-License-Identifier: GPL-3.0-only
+
+// helpers shared by the standalone tests.
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <gba.hpp>
+#include <memory>
+#include <vector>
+
+namespace gba::test_utils {
+
+inline void write32(std::vector<u8>& rom, std::size_t offset, u32 value)
+{
+    std::memcpy(rom.data() + offset, &value, sizeof(value));
+}
+
+// a rom of size bytes that starts with the entry opcode, the caller
+// fills in the rest. the header is valid, see Header::validate_all().
+inline auto create_rom(std::size_t size, u32 entry) -> std::vector<u8>
+{
+    std::vector<u8> rom(size);
+
+    write32(rom, 0x00, entry);
+
+    rom[0xB2] = 0x96;
+    u8 checksum = -0x19;
+    for (std::size_t i = 0xA0; i < 0xBD; i++)
+    {
+        checksum -= rom[i];
+    }
+    rom[0xBD] = checksum;
+
+    return rom;
+}
+
+// xorshift32, so that every run does the same
+struct Rng
+{
+    u32 state;
+
+    auto next() -> u32
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    void fill(void* data, std::size_t size)
+    {
+        auto p = static_cast<u8*>(data);
+        for (std::size_t i = 0; i < size; i++)
+        {
+            p[i] = static_cast<u8>(next());
+        }
+    }
+};
+
+// state is zero initialised so that padding compares equal
+inline auto create_state() -> std::unique_ptr<State>
+{
+    return std::make_unique<State>();
+}
+
+inline auto is_same_state(const State& a, const State& b) -> bool
+{
+    return !std::memcmp(&a, &b, sizeof(State));
+}
+
+inline auto is_same_state(const Gba& a, const Gba& b) -> bool
+{
+    auto state_a = create_state();
+    auto state_b = create_state();
+
+    return a.savestate(*state_a) && b.savestate(*state_b) && is_same_state(*state_a, *state_b);
+}
+
+} // namespace gba::test_utils